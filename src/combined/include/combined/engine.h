@@ -9,6 +9,7 @@
 
 #include "glm/fwd.hpp"
 
+#include <experimental/optional>
 #include <memory>
 
 namespace wayverb {
@@ -44,6 +45,7 @@ enum class state {
     starting_waveguide,
     running_waveguide,
     finishing_waveguide,
+    running_raytracer_and_waveguide,
     postprocessing,
 };
 
@@ -57,10 +59,31 @@ constexpr auto to_string(state s) {
         case state::starting_waveguide: return "starting waveguide";
         case state::running_waveguide: return "running waveguide";
         case state::finishing_waveguide: return "finishing waveguide";
+        case state::running_raytracer_and_waveguide:
+            return "running raytracer and waveguide";
         case state::postprocessing: return "postprocessing";
     }
 }
 
+//  scheduling  ////////////////////////////////////////////////////////////////
+
+/// sequential: The raytracer runs first, and its output decides how long the
+///     waveguide must run for.
+/// concurrent: Both simulations run at the same time, and the waveguide
+///     length is estimated from the reverb time of the scene.
+///     This takes roughly as long as the slower simulation, rather than the
+///     sum of both, but may simulate slightly more waveguide output than is
+///     strictly necessary.
+///     Each simulation runs on its own thread, so the engine's events may
+///     fire from two threads at once.
+enum class scheduling { sequential, concurrent };
+
+/// Estimate how long the raytracer output will be, without running it.
+/// Returns nothing if the scene isn't closed or absorbent enough for a
+/// reverb time estimate.
+std::experimental::optional<double> estimate_simulation_time(
+        const core::gpu_scene_data& scene, double safety_margin = 1.5);
+
 //  postprocessing  ////////////////////////////////////////////////////////////
 
 /// This is badly designed. Really, the capsules should be polymorphic.
@@ -98,10 +121,32 @@ public:
            const raytracer::simulation_parameters& raytracer,
            std::unique_ptr<waveguide_base> waveguide);
 
+    /// Uses a mesh which has already been built, perhaps for a different
+    /// receiver on the same lattice.
+    /// Each receiver is simulated at its nearest mesh node, and a single
+    /// waveguide run is shared between all of them.
+    engine(const core::compute_context& compute_context,
+           std::shared_ptr<const waveguide::voxels_and_mesh> voxels_and_mesh,
+           const glm::vec3& source,
+           util::aligned::vector<glm::vec3> receivers,
+           const core::environment& environment,
+           const raytracer::simulation_parameters& raytracer,
+           std::unique_ptr<waveguide_base> waveguide);
+
     ~engine() noexcept;
 
+    /// Returns the result for the first receiver.
     std::unique_ptr<intermediate> run(const std::atomic_bool& keep_going) const;
 
+    /// Returns one result per receiver, or nothing if the run was cancelled.
+    util::aligned::vector<std::unique_ptr<intermediate>> run_all(
+            const std::atomic_bool& keep_going) const;
+
+    /// Concurrent scheduling falls back to sequential if the simulation
+    /// time can't be estimated.
+    void set_scheduling(scheduling s);
+    scheduling get_scheduling() const;
+
     //  notifications  /////////////////////////////////////////////////////////
 
     /// Args: Current engine state, progress within state.
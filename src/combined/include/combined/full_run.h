@@ -21,6 +21,15 @@ public:
                           const raytracer::simulation_parameters& raytracer,
                           std::unique_ptr<waveguide_base> waveguide);
 
+    postprocessing_engine(
+            const core::compute_context& compute_context,
+            std::shared_ptr<const waveguide::voxels_and_mesh> voxels_and_mesh,
+            const glm::vec3& source,
+            util::aligned::vector<glm::vec3> receivers,
+            const core::environment& environment,
+            const raytracer::simulation_parameters& raytracer,
+            std::unique_ptr<waveguide_base> waveguide);
+
     postprocessing_engine(const postprocessing_engine&) = delete;
     postprocessing_engine(postprocessing_engine&&) noexcept = delete;
 
@@ -34,30 +43,7 @@ public:
         It e_capsules,
         double sample_rate,
         const std::atomic_bool& keep_going) {
-        //  Only add engine listeners if things are listening to this object.
-
-        engine_state_changed::scoped_connection state;
-        if (!engine_state_changed_.empty()) {
-            state = engine_state_changed::scoped_connection{
-                    engine_.connect_engine_state_changed(
-                            make_forwarding_call(engine_state_changed_))};
-        }
-
-        waveguide_node_pressures_changed::scoped_connection pressures;
-        if (!waveguide_node_pressures_changed_.empty()) {
-            pressures = waveguide_node_pressures_changed::scoped_connection{
-                    engine_.connect_waveguide_node_pressures_changed(
-                            make_forwarding_call(
-                                    waveguide_node_pressures_changed_))};
-        }
-
-        raytracer_reflections_generated::scoped_connection reflections;
-        if (!raytracer_reflections_generated_.empty()) {
-            reflections = raytracer_reflections_generated::scoped_connection{
-                    engine_.connect_raytracer_reflections_generated(
-                            make_forwarding_call(
-                                    raytracer_reflections_generated_))};
-        }
+        const auto connections = connect_to_engine();
 
         //  Start running.
 
@@ -82,6 +68,21 @@ public:
         return channels;
     }
 
+    /// Runs every receiver at once.
+    /// capsules holds the capsules for each receiver, in the same order as
+    /// the receivers passed to the constructor.
+    /// Returns channels indexed by receiver, then capsule.
+    std::experimental::optional<util::aligned::vector<
+            util::aligned::vector<util::aligned::vector<float>>>>
+    run_all(const util::aligned::vector<
+                    util::aligned::vector<std::unique_ptr<capsule_base>>>&
+                    capsules,
+            double sample_rate,
+            const std::atomic_bool& keep_going);
+
+    void set_scheduling(scheduling s);
+    scheduling get_scheduling() const;
+
     //  notifications
 
     using engine_state_changed = engine::engine_state_changed;
@@ -106,6 +107,15 @@ public:
     const waveguide::voxels_and_mesh& get_voxels_and_mesh() const;
 
 private:
+    /// Only add engine listeners if things are listening to this object.
+    struct scoped_connections final {
+        engine_state_changed::scoped_connection state;
+        waveguide_node_pressures_changed::scoped_connection pressures;
+        raytracer_reflections_generated::scoped_connection reflections;
+    };
+
+    scoped_connections connect_to_engine();
+
     engine engine_;
 
     engine_state_changed engine_state_changed_;
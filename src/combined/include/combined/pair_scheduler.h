@@ -0,0 +1,67 @@
+#pragma once
+
+#include "utilities/aligned/vector.h"
+
+#include <atomic>
+#include <functional>
+
+namespace wayverb {
+
+namespace raytracer {
+struct simulation_parameters;
+}  // namespace raytracer
+
+namespace waveguide {
+struct voxels_and_mesh;
+}  // namespace waveguide
+
+namespace combined {
+
+/// A rough upper bound on the device memory needed to simulate one source
+/// with a group of receivers sharing a mesh.
+///
+/// Covers the waveguide mesh, pressure fields, boundary filters and
+/// coefficients, and the receiver probe ring.
+/// Also covers every raytracer segment in flight (see
+/// raytracer::segments_in_flight), each with its rays, per-receiver outputs
+/// and histograms.
+/// Both simulations are counted, because with concurrent scheduling they may
+/// be resident at the same time.
+/// Small per-run buffers, such as error flags and kernel arguments, are not
+/// counted, so budgets should leave some headroom.
+size_t estimate_device_memory(
+        const waveguide::voxels_and_mesh& voxels_and_mesh,
+        size_t num_receivers,
+        const raytracer::simulation_parameters& raytracer,
+        double speed_of_sound);
+
+/// Runs independent jobs on several host threads at once, but only starts a
+/// job when its estimated device memory fits alongside the jobs which are
+/// already running.
+/// A job which is larger than the whole budget is run on its own.
+///
+/// Jobs are started in index order, so callers can write results into a
+/// vector indexed by job, and the output order is always the same.
+class pair_scheduler final {
+public:
+    /// A memory_budget of 0 means that memory is not limited.
+    pair_scheduler(size_t max_concurrent_jobs, size_t memory_budget);
+
+    /// Calls callback(i) for every i in [0, job_memory.size()).
+    /// No new jobs are started once keep_going is false, or once a job has
+    /// thrown. Returns when all started jobs have finished, rethrowing the
+    /// first exception if there was one.
+    void run(const util::aligned::vector<size_t>& job_memory,
+             const std::function<void(size_t)>& callback,
+             const std::atomic_bool& keep_going) const;
+
+    size_t get_max_concurrent_jobs() const;
+    size_t get_memory_budget() const;
+
+private:
+    size_t max_concurrent_jobs_;
+    size_t memory_budget_;
+};
+
+}  // namespace combined
+}  // namespace wayverb
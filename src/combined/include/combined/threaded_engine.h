@@ -3,15 +3,20 @@
 #include "combined/full_run.h"
 #include "combined/model/persistent.h"
 
+#include "waveguide/mesh_cache.h"
 #include "waveguide/mesh_descriptor.h"
 
+#include <algorithm>
+#include <atomic>
 #include <future>
+#include <thread>
 
 namespace wayverb {
 namespace combined {
 
 /// Given a scene, and a collection of sources and receivers,
-/// For each source-receiver pair:
+/// Build (or reuse) a waveguide mesh shared by all receivers.
+/// For each source-receiver pair (several at once, if they fit in memory):
 ///     Simulate the scene.
 ///     Do microphone post-processing according to the receiver's capsules.
 ///     Cache the results.
@@ -34,8 +39,33 @@ public:
 
     bool is_running() const;
 
+    /// Settings for the next run.
+    /// Several source/receiver pairs may be rendered at once on separate
+    /// host threads, as long as their estimated device memory fits within
+    /// the budget. A budget of 0 uses half of the device's global memory.
+    void set_max_concurrent_pairs(size_t pairs);
+    size_t get_max_concurrent_pairs() const;
+
+    void set_device_memory_budget(size_t bytes);
+    size_t get_device_memory_budget() const;
+
+    /// Whether each pair runs its raytracer and waveguide one after the
+    /// other (the default), or at the same time.
+    /// With concurrent scheduling, the state, pressure and reflection events
+    /// of a pair may fire from two threads at once, so handlers must be
+    /// thread-safe.
+    void set_scheduling(scheduling s);
+    scheduling get_scheduling() const;
+
+    /// The structure used by the raytracer to find ray intersections.
+    void set_acceleration_structure(core::acceleration_structure acceleration);
+    core::acceleration_structure get_acceleration_structure() const;
+
     void cancel();
 
+    /// When several pairs are rendered at once, the node position, node
+    /// pressure and reflection events only come from one of them at a time,
+    /// so that the visualiser never sees two meshes interleaved.
     using engine_state_changed = util::event<size_t, size_t, state, double>;
     using waveguide_node_positions_changed =
             util::event<waveguide::mesh_descriptor>;
@@ -85,6 +115,17 @@ private:
     std::atomic_bool is_running_{false};
     std::atomic_bool keep_going_{true};
 
+    std::atomic<size_t> max_concurrent_pairs_{
+            std::max(std::thread::hardware_concurrency() / 2, 1u)};
+    std::atomic<size_t> memory_budget_{0};
+    std::atomic<scheduling> scheduling_{scheduling::sequential};
+    std::atomic<core::acceleration_structure> acceleration_{
+            core::acceleration_structure::voxels};
+
+    /// Kept between runs, so re-rendering an unchanged scene doesn't have to
+    /// rebuild the mesh.
+    waveguide::mesh_cache mesh_cache_;
+
     std::future<void> future_;
 };
 
@@ -44,12 +44,17 @@ public:
 
     virtual double compute_sampling_frequency() const = 0;
 
-    virtual std::experimental::optional<
-            util::aligned::vector<waveguide::bandpass_band>>
+    /// Runs a single simulation from source, and returns the bands recorded
+    /// at each receiver.
+    ///
+    /// pressure_callback is passed one pressure per node, in the layout given
+    /// by voxelised.mesh.get_bricks().
+    virtual std::experimental::optional<util::aligned::vector<
+            util::aligned::vector<waveguide::bandpass_band>>>
     run(const core::compute_context& cc,
         const waveguide::voxels_and_mesh& voxelised,
         const glm::vec3& source,
-        const glm::vec3& receiver,
+        const util::aligned::vector<glm::vec3>& receivers,
         const core::environment& environment,
         double simulation_time,
         const std::atomic_bool& keep_going,
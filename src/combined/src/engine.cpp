@@ -13,6 +13,11 @@
 
 #include "glm/glm.hpp"
 
+#include <cmath>
+#include <future>
+#include <mutex>
+#include <numeric>
+
 namespace wayverb {
 namespace combined {
 
@@ -85,6 +90,33 @@ auto make_intermediate_impl_ptr(combined_results<Histogram> to_process,
 
 }  // namespace
 
+std::experimental::optional<double> estimate_simulation_time(
+        const core::gpu_scene_data& scene, double safety_margin) {
+    //  The raytracer traces paths until their energy has decayed by 60dB,
+    //  which is roughly the reverb time.
+    //  Eyring is more accurate for absorbent rooms, but needs a closed scene.
+    //  Sabine is tried if Eyring produces nonsense.
+    const auto estimate = [&](auto&& reverb_time) {
+        try {
+            const double ret = max_element(reverb_time());
+            return std::isfinite(ret) && 0 < ret
+                           ? std::experimental::make_optional(ret *
+                                                              safety_margin)
+                           : std::experimental::nullopt;
+        } catch (const std::runtime_error&) {
+            return std::experimental::optional<double>{};
+        }
+    };
+
+    if (const auto ret = estimate(
+                [&] { return core::eyring_reverb_time(scene, 0.0f); })) {
+        return ret;
+    }
+    return estimate([&] { return core::sabine_reverb_time(scene, 0.0f); });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 class engine::impl final {
 public:
     impl(const core::compute_context& compute_context,
@@ -95,71 +127,119 @@ public:
          const raytracer::simulation_parameters& raytracer,
          std::unique_ptr<waveguide_base> waveguide)
             : compute_context_{compute_context}
-            , voxels_and_mesh_{waveguide::compute_voxels_and_mesh(
-                      compute_context,
-                      scene_data,
-                      receiver,
-                      waveguide->compute_sampling_frequency(),
-                      environment.speed_of_sound)}
-            , room_volume_{estimate_volume(voxels_and_mesh_.mesh)}
+            , voxels_and_mesh_{std::make_shared<waveguide::voxels_and_mesh>(
+                      waveguide::compute_voxels_and_mesh(
+                              compute_context,
+                              scene_data,
+                              receiver,
+                              waveguide->compute_sampling_frequency(),
+                              environment.speed_of_sound))}
+            , room_volume_{estimate_volume(voxels_and_mesh_->mesh)}
             , source_{source}
-            , receiver_{receiver}
+            , receivers_{receiver}
             , environment_{environment}
             , raytracer_{raytracer}
             , waveguide_{std::move(waveguide)} {}
 
-    std::unique_ptr<intermediate> run(
+    impl(const core::compute_context& compute_context,
+         std::shared_ptr<const waveguide::voxels_and_mesh> voxels_and_mesh,
+         const glm::vec3& source,
+         util::aligned::vector<glm::vec3> receivers,
+         const core::environment& environment,
+         const raytracer::simulation_parameters& raytracer,
+         std::unique_ptr<waveguide_base> waveguide)
+            : compute_context_{compute_context}
+            , voxels_and_mesh_{std::move(voxels_and_mesh)}
+            , room_volume_{estimate_volume(voxels_and_mesh_->mesh)}
+            , source_{source}
+            , receivers_{std::move(receivers)}
+            , environment_{environment}
+            , raytracer_{raytracer}
+            , waveguide_{std::move(waveguide)} {}
+
+    util::aligned::vector<std::unique_ptr<intermediate>> run(
             const std::atomic_bool& keep_going) const {
-        //  RAYTRACER  /////////////////////////////////////////////////////////
+        if (scheduling_ == scheduling::concurrent) {
+            if (const auto simulation_time = estimate_simulation_time(
+                        voxels_and_mesh_->voxels.get_scene_data())) {
+                return run_concurrent(*simulation_time, keep_going);
+            }
+            //  The scene isn't suitable for a reverb time estimate, so the
+            //  waveguide length has to come from the raytracer instead.
+        }
+        return run_sequential(keep_going);
+    }
 
-        const auto rays_to_visualise = std::min(32ul, raytracer_.rays);
+    void set_scheduling(scheduling s) { scheduling_ = s; }
+    scheduling get_scheduling() const { return scheduling_; }
 
-        engine_state_changed_(state::starting_raytracer, 1.0);
+    //  notifications  /////////////////////////////////////////////////////////
 
-        auto raytracer_output = raytracer::canonical(
-                compute_context_,
-                voxels_and_mesh_.voxels,
-                source_,
-                receiver_,
-                environment_,
-                raytracer_,
-                rays_to_visualise,
-                keep_going,
-                [&](auto step, auto total_steps) {
-                    engine_state_changed_(state::running_raytracer,
-                                          step / (total_steps - 1.0));
-                });
+    engine_state_changed::connection connect_engine_state_changed(
+            engine_state_changed::callback_type callback) {
+        return engine_state_changed_.connect(std::move(callback));
+    }
 
+    waveguide_node_pressures_changed::connection
+    connect_waveguide_node_pressures_changed(
+            waveguide_node_pressures_changed::callback_type callback) {
+        return waveguide_node_pressures_changed_.connect(std::move(callback));
+    }
 
-        if (!(keep_going && raytracer_output)) {
-            return nullptr;
-        }
+    raytracer_reflections_generated::connection
+    connect_raytracer_reflections_generated(
+            raytracer_reflections_generated::callback_type callback) {
+        return raytracer_reflections_generated_.connect(std::move(callback));
+    }
 
-        engine_state_changed_(state::finishing_raytracer, 1.0);
+    //  cached data  ///////////////////////////////////////////////////////////
 
-        raytracer_reflections_generated_(std::move(raytracer_output->visual),
-                                         source_);
+    const waveguide::voxels_and_mesh& get_voxels_and_mesh() const {
+        return *voxels_and_mesh_;
+    }
 
-        //  look for the max time of an impulse
-        const auto max_stochastic_time =
-                max_time(raytracer_output->aural.stochastic);
+private:
+    template <typename Callback>
+    auto run_raytracer(const std::atomic_bool& keep_going,
+                       Callback&& callback) const {
+        const auto rays_to_visualise = std::min(32ul, raytracer_.rays);
 
-        //  WAVEGUIDE  /////////////////////////////////////////////////////////
-        engine_state_changed_(state::starting_waveguide, 1.0);
+        //  Rays are traced once from the source, and every receiver is
+        //  tested against each reflection.
+        return raytracer::canonical(compute_context_,
+                                    voxels_and_mesh_->voxels,
+                                    source_,
+                                    receivers_,
+                                    environment_,
+                                    raytracer_,
+                                    rays_to_visualise,
+                                    keep_going,
+                                    std::forward<Callback>(callback));
+    }
 
-        auto waveguide_output = waveguide_->run(
+    template <typename Callback>
+    auto run_waveguide(double simulation_time,
+                       const std::atomic_bool& keep_going,
+                       Callback&& callback) const {
+        //  A single simulation from the source is recorded at every receiver.
+        return waveguide_->run(
                 compute_context_,
-                voxels_and_mesh_,
+                *voxels_and_mesh_,
                 source_,
-                receiver_,
+                receivers_,
                 environment_,
-                max_stochastic_time,
+                simulation_time,
                 keep_going,
                 [&](auto& queue, const auto& buffer, auto step, auto steps) {
                     //  If there are node pressure listeners.
                     if (!waveguide_node_pressures_changed_.empty()) {
+                        //  The mesh is stored in bricks on the device, but
+                        //  listeners expect one pressure per grid point.
                         auto pressures =
-                                core::read_from_buffer<float>(queue, buffer);
+                                voxels_and_mesh_->mesh.get_bricks().to_dense(
+                                        core::read_from_buffer<float>(queue,
+                                                                      buffer),
+                                        0.0f);
                         const auto time =
                                 step / waveguide_->compute_sampling_frequency();
                         const auto distance =
@@ -168,60 +248,173 @@ public:
                                                           distance);
                     }
 
+                    callback(step, steps);
+                });
+    }
+
+    template <typename Raytracer, typename Waveguide>
+    auto make_intermediates(Raytracer& raytracer_outputs,
+                            Waveguide& waveguide_outputs) const {
+        util::aligned::vector<std::unique_ptr<intermediate>> ret;
+        ret.reserve(receivers_.size());
+        for (auto i = 0u; i != receivers_.size(); ++i) {
+            ret.emplace_back(make_intermediate_impl_ptr(
+                    make_combined_results(std::move(raytracer_outputs[i]),
+                                          std::move(waveguide_outputs[i])),
+                    source_,
+                    receivers_[i],
+                    room_volume_,
+                    environment_));
+        }
+        return ret;
+    }
+
+    util::aligned::vector<std::unique_ptr<intermediate>> run_sequential(
+            const std::atomic_bool& keep_going) const {
+        //  RAYTRACER  /////////////////////////////////////////////////////////
+
+        engine_state_changed_(state::starting_raytracer, 1.0);
+
+        auto raytracer_output =
+                run_raytracer(keep_going, [&](auto step, auto total_steps) {
+                    engine_state_changed_(state::running_raytracer,
+                                          step / (total_steps - 1.0));
+                });
+
+        if (!(keep_going && raytracer_output)) {
+            return {};
+        }
+
+        raytracer_reflections_generated_(std::move(raytracer_output->visual),
+                                         source_);
+
+        auto& raytracer_outputs = raytracer_output->aural;
+
+        engine_state_changed_(state::finishing_raytracer, 1.0);
+
+        //  look for the max time of an impulse
+        const auto max_stochastic_time = std::accumulate(
+                begin(raytracer_outputs),
+                end(raytracer_outputs),
+                0.0,
+                [](auto a, const auto& b) {
+                    return std::max(
+                            a, static_cast<double>(max_time(b.stochastic)));
+                });
+
+        //  WAVEGUIDE  /////////////////////////////////////////////////////////
+        engine_state_changed_(state::starting_waveguide, 1.0);
+
+        auto waveguide_output = run_waveguide(
+                max_stochastic_time, keep_going, [&](auto step, auto steps) {
                     engine_state_changed_(state::running_waveguide,
                                           step / (steps - 1.0));
                 });
 
         if (!(keep_going && waveguide_output)) {
-            return nullptr;
+            return {};
         }
 
         engine_state_changed_(state::finishing_waveguide, 1.0);
 
-        return make_intermediate_impl_ptr(
-                make_combined_results(std::move(raytracer_output->aural),
-                                      std::move(*waveguide_output)),
-                source_,
-                receiver_,
-                room_volume_,
-                environment_);
+        return make_intermediates(raytracer_outputs, *waveguide_output);
     }
 
-    //  notifications  /////////////////////////////////////////////////////////
-
-    engine_state_changed::connection connect_engine_state_changed(
-            engine_state_changed::callback_type callback) {
-        return engine_state_changed_.connect(std::move(callback));
-    }
+    /// The waveguide runs on its own thread, on its own queue, while the
+    /// raytracer runs on this one.
+    /// The waveguide length can't depend on the raytracer output, so it has
+    /// to be estimated up-front.
+    util::aligned::vector<std::unique_ptr<intermediate>> run_concurrent(
+            double simulation_time, const std::atomic_bool& keep_going) const {
+        engine_state_changed_(state::starting_raytracer, 1.0);
+        engine_state_changed_(state::starting_waveguide, 1.0);
 
-    waveguide_node_pressures_changed::connection
-    connect_waveguide_node_pressures_changed(
-            waveguide_node_pressures_changed::callback_type callback) {
-        return waveguide_node_pressures_changed_.connect(std::move(callback));
-    }
+        //  Each stage is stopped if the user cancels, or if the other stage
+        //  fails, so that we never wait on work which will be thrown away.
+        std::atomic_bool raytracer_keep_going{true};
+        std::atomic_bool waveguide_keep_going{true};
+
+        //  Progress is reported as the mean of both stages.
+        std::mutex progress_mutex;
+        double raytracer_progress = 0;
+        double waveguide_progress = 0;
+        const auto report_progress = [&](double& stage, double progress) {
+            std::lock_guard<std::mutex> lck{progress_mutex};
+            stage = progress;
+            engine_state_changed_(
+                    state::running_raytracer_and_waveguide,
+                    (raytracer_progress + waveguide_progress) / 2);
+        };
+
+        auto waveguide_future = std::async(std::launch::async, [&] {
+            try {
+                auto ret = run_waveguide(
+                        simulation_time,
+                        waveguide_keep_going,
+                        [&](auto step, auto steps) {
+                            if (!keep_going) {
+                                waveguide_keep_going = false;
+                            }
+                            report_progress(waveguide_progress,
+                                            step / (steps - 1.0));
+                        });
+                if (!ret) {
+                    raytracer_keep_going = false;
+                }
+                return ret;
+            } catch (...) {
+                raytracer_keep_going = false;
+                throw;
+            }
+        });
+
+        auto raytracer_output = [&] {
+            try {
+                auto ret = run_raytracer(
+                        raytracer_keep_going,
+                        [&](auto step, auto total_steps) {
+                            if (!keep_going) {
+                                raytracer_keep_going = false;
+                            }
+                            report_progress(raytracer_progress,
+                                            step / (total_steps - 1.0));
+                        });
+                if (!ret) {
+                    waveguide_keep_going = false;
+                }
+                return ret;
+            } catch (...) {
+                waveguide_keep_going = false;
+                throw;
+            }
+        }();
+
+        auto waveguide_output = waveguide_future.get();
+
+        if (!(keep_going && raytracer_output && waveguide_output)) {
+            return {};
+        }
 
-    raytracer_reflections_generated::connection
-    connect_raytracer_reflections_generated(
-            raytracer_reflections_generated::callback_type callback) {
-        return raytracer_reflections_generated_.connect(std::move(callback));
-    }
+        engine_state_changed_(state::finishing_raytracer, 1.0);
+        engine_state_changed_(state::finishing_waveguide, 1.0);
 
-    //  cached data  ///////////////////////////////////////////////////////////
+        raytracer_reflections_generated_(std::move(raytracer_output->visual),
+                                         source_);
 
-    const waveguide::voxels_and_mesh& get_voxels_and_mesh() const {
-        return voxels_and_mesh_;
+        return make_intermediates(raytracer_output->aural, *waveguide_output);
     }
 
-private:
     core::compute_context compute_context_;
-    waveguide::voxels_and_mesh voxels_and_mesh_;
+    std::shared_ptr<const waveguide::voxels_and_mesh> voxels_and_mesh_;
     double room_volume_;
     glm::vec3 source_;
-    glm::vec3 receiver_;
+    util::aligned::vector<glm::vec3> receivers_;
     core::environment environment_;
     raytracer::simulation_parameters raytracer_;
     std::unique_ptr<waveguide_base> waveguide_;
 
+    scheduling scheduling_{scheduling::sequential};
+
     engine_state_changed engine_state_changed_;
     waveguide_node_pressures_changed waveguide_node_pressures_changed_;
     raytracer_reflections_generated raytracer_reflections_generated_;
@@ -244,13 +437,39 @@ engine::engine(const core::compute_context& compute_context,
                                         raytracer,
                                         std::move(waveguide))} {}
 
+engine::engine(
+        const core::compute_context& compute_context,
+        std::shared_ptr<const waveguide::voxels_and_mesh> voxels_and_mesh,
+        const glm::vec3& source,
+        util::aligned::vector<glm::vec3> receivers,
+        const core::environment& environment,
+        const raytracer::simulation_parameters& raytracer,
+        std::unique_ptr<waveguide_base> waveguide)
+        : pimpl_{std::make_unique<impl>(compute_context,
+                                        std::move(voxels_and_mesh),
+                                        source,
+                                        std::move(receivers),
+                                        environment,
+                                        raytracer,
+                                        std::move(waveguide))} {}
+
 engine::~engine() noexcept = default;
 
 std::unique_ptr<intermediate> engine::run(
         const std::atomic_bool& keep_going) const {
+    auto ret = pimpl_->run(keep_going);
+    return ret.empty() ? nullptr : std::move(ret.front());
+}
+
+util::aligned::vector<std::unique_ptr<intermediate>> engine::run_all(
+        const std::atomic_bool& keep_going) const {
     return pimpl_->run(keep_going);
 }
 
+void engine::set_scheduling(scheduling s) { pimpl_->set_scheduling(s); }
+
+scheduling engine::get_scheduling() const { return pimpl_->get_scheduling(); }
+
 engine::engine_state_changed::connection engine::connect_engine_state_changed(
         engine_state_changed::callback_type callback) {
     return pimpl_->connect_engine_state_changed(std::move(callback));
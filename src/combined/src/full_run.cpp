@@ -20,6 +20,93 @@ postprocessing_engine::postprocessing_engine(
                   raytracer,
                   std::move(waveguide)} {}
 
+postprocessing_engine::postprocessing_engine(
+        const core::compute_context& compute_context,
+        std::shared_ptr<const waveguide::voxels_and_mesh> voxels_and_mesh,
+        const glm::vec3& source,
+        util::aligned::vector<glm::vec3> receivers,
+        const core::environment& environment,
+        const raytracer::simulation_parameters& raytracer,
+        std::unique_ptr<waveguide_base> waveguide)
+        : engine_{compute_context,
+                  std::move(voxels_and_mesh),
+                  source,
+                  std::move(receivers),
+                  environment,
+                  raytracer,
+                  std::move(waveguide)} {}
+
+std::experimental::optional<util::aligned::vector<
+        util::aligned::vector<util::aligned::vector<float>>>>
+postprocessing_engine::run_all(
+        const util::aligned::vector<
+                util::aligned::vector<std::unique_ptr<capsule_base>>>&
+                capsules,
+        double sample_rate,
+        const std::atomic_bool& keep_going) {
+    const auto connections = connect_to_engine();
+
+    //  Start running.
+
+    const auto intermediates = engine_.run_all(keep_going);
+
+    if (intermediates.empty()) {
+        return std::experimental::nullopt;
+    }
+
+    if (intermediates.size() != capsules.size()) {
+        throw std::runtime_error{
+                "Number of capsule sets does not match number of receivers."};
+    }
+
+    engine_state_changed_(state::postprocessing, 1.0);
+
+    util::aligned::vector<util::aligned::vector<util::aligned::vector<float>>>
+            ret;
+    ret.reserve(intermediates.size());
+    for (auto i = 0u; i != intermediates.size() && keep_going; ++i) {
+        util::aligned::vector<util::aligned::vector<float>> channels;
+        for (const auto& capsule : capsules[i]) {
+            channels.emplace_back(
+                    capsule->postprocess(*intermediates[i], sample_rate));
+        }
+        ret.emplace_back(std::move(channels));
+    }
+
+    if (!keep_going) {
+        return std::experimental::nullopt;
+    }
+
+    return ret;
+}
+
+postprocessing_engine::scoped_connections
+postprocessing_engine::connect_to_engine() {
+    scoped_connections ret;
+
+    if (!engine_state_changed_.empty()) {
+        ret.state = engine_state_changed::scoped_connection{
+                engine_.connect_engine_state_changed(
+                        make_forwarding_call(engine_state_changed_))};
+    }
+
+    if (!waveguide_node_pressures_changed_.empty()) {
+        ret.pressures = waveguide_node_pressures_changed::scoped_connection{
+                engine_.connect_waveguide_node_pressures_changed(
+                        make_forwarding_call(
+                                waveguide_node_pressures_changed_))};
+    }
+
+    if (!raytracer_reflections_generated_.empty()) {
+        ret.reflections = raytracer_reflections_generated::scoped_connection{
+                engine_.connect_raytracer_reflections_generated(
+                        make_forwarding_call(
+                                raytracer_reflections_generated_))};
+    }
+
+    return ret;
+}
+
 postprocessing_engine::engine_state_changed::connection
 postprocessing_engine::connect_engine_state_changed(
         engine_state_changed::callback_type callback) {
@@ -40,6 +127,14 @@ postprocessing_engine::connect_raytracer_reflections_generated(
 
 //  get contents
 
+void postprocessing_engine::set_scheduling(scheduling s) {
+    engine_.set_scheduling(s);
+}
+
+scheduling postprocessing_engine::get_scheduling() const {
+    return engine_.get_scheduling();
+}
+
 const waveguide::voxels_and_mesh& postprocessing_engine::get_voxels_and_mesh()
         const {
     return engine_.get_voxels_and_mesh();
@@ -0,0 +1,173 @@
+#include "combined/pair_scheduler.h"
+
+#include "raytracer/cl/structs.h"
+#include "raytracer/raytracer.h"
+#include "raytracer/reflection_processor/stochastic_histogram.h"
+#include "raytracer/reflector.h"
+#include "raytracer/simulation_parameters.h"
+
+#include "waveguide/cl/structs.h"
+#include "waveguide/mesh.h"
+#include "waveguide/postprocessor/receiver_set.h"
+
+#include "utilities/scoped_thread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace wayverb {
+namespace combined {
+
+size_t estimate_device_memory(
+        const waveguide::voxels_and_mesh& voxels_and_mesh,
+        size_t num_receivers,
+        const raytracer::simulation_parameters& raytracer,
+        double speed_of_sound) {
+    //  Two pressure fields, which may be multiband, plus the node data and
+    //  the single-band copy shown to callbacks.
+    const auto& mesh = voxels_and_mesh.mesh;
+    const auto mesh_nodes = mesh.get_bricks().get_num_nodes();
+    const auto node_memory =
+            mesh_nodes * (2 * sizeof(core::bands_type) +
+                          sizeof(waveguide::condensed_node) + sizeof(cl_float));
+    const auto brick_memory =
+            mesh.get_bricks().get_brick_table().size() * sizeof(cl_uint) +
+            mesh.get_bricks().get_brick_origins().size() * sizeof(cl_int3);
+
+    //  Boundary nodes carry filter state, and each surface has its own
+    //  filter coefficients.
+    //  The single-band kernel needs more of both than the multiband one, so
+    //  its sizes are used.
+    const auto& structure = mesh.get_structure();
+    const auto boundary_memory =
+            structure.get_boundary_indices<1>().size() *
+                    sizeof(waveguide::boundary_data_array_1) +
+            structure.get_boundary_indices<2>().size() *
+                    sizeof(waveguide::boundary_data_array_2) +
+            structure.get_boundary_indices<3>().size() *
+                    sizeof(waveguide::boundary_data_array_3) +
+            structure.get_coefficients().size() *
+                    (sizeof(waveguide::coefficients_canonical) +
+                     sizeof(core::bands_type));
+
+    //  Every receiver and band is recorded through one probe ring.
+    const auto probe_memory =
+            waveguide::postprocessor::receiver_set::get_device_memory(
+                    num_receivers, core::simulation_bands);
+
+    const auto waveguide_memory =
+            node_memory + brick_memory + boundary_memory + probe_memory;
+
+    //  Each segment of rays has its own reflector, finder and histograms,
+    //  and segments_in_flight of them are on the device at once: one being
+    //  traced while the previous one is still being processed.
+    //  Segments are never larger than max_rays_per_segment, however much
+    //  memory the device has.
+    //  Histograms are directional in the canonical callbacks.
+    using histogram =
+            raytracer::stochastic::directional_energy_histogram<20, 9>;
+    const auto segment_memory =
+            raytracer::max_rays_per_segment *
+                    raytracer::get_per_ray_size(num_receivers) +
+            raytracer::reflection_processor::get_histogram_memory<histogram>(
+                    voxels_and_mesh.voxels,
+                    num_receivers,
+                    speed_of_sound,
+                    raytracer.histogram_sample_rate);
+    const auto raytracer_memory =
+            raytracer::segments_in_flight * segment_memory;
+
+    //  With concurrent scheduling, both stages may be resident at once.
+    return waveguide_memory + raytracer_memory;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+pair_scheduler::pair_scheduler(size_t max_concurrent_jobs,
+                               size_t memory_budget)
+        : max_concurrent_jobs_{std::max(max_concurrent_jobs, size_t{1})}
+        , memory_budget_{memory_budget} {}
+
+void pair_scheduler::run(const util::aligned::vector<size_t>& job_memory,
+                         const std::function<void(size_t)>& callback,
+                         const std::atomic_bool& keep_going) const {
+    const auto jobs = job_memory.size();
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t next_job = 0;
+    size_t running = 0;
+    size_t memory_in_use = 0;
+    std::exception_ptr error;
+
+    const auto should_stop = [&] {
+        return next_job == jobs || error || !keep_going;
+    };
+
+    const auto fits = [&] {
+        return !memory_budget_ || !running ||
+               memory_in_use + job_memory[next_job] <= memory_budget_;
+    };
+
+    const auto worker = [&] {
+        std::unique_lock<std::mutex> lck{mutex};
+        for (;;) {
+            //  keep_going isn't signalled, so it's polled while waiting.
+            while (!(should_stop() || fits())) {
+                cv.wait_for(lck, std::chrono::milliseconds{100});
+            }
+            if (should_stop()) {
+                return;
+            }
+
+            //  Jobs are always taken in order, so a big job at the front of
+            //  the queue holds up the smaller ones behind it.
+            const auto job = next_job++;
+            running += 1;
+            memory_in_use += job_memory[job];
+
+            lck.unlock();
+            try {
+                callback(job);
+            } catch (...) {
+                lck.lock();
+                if (!error) {
+                    error = std::current_exception();
+                }
+                lck.unlock();
+            }
+            lck.lock();
+
+            running -= 1;
+            memory_in_use -= job_memory[job];
+            cv.notify_all();
+        }
+    };
+
+    {
+        const auto num_threads = std::min(max_concurrent_jobs_, jobs);
+        std::vector<util::scoped_thread> threads;
+        threads.reserve(num_threads);
+        for (auto i = 0u; i != num_threads; ++i) {
+            threads.emplace_back(std::thread{worker});
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+size_t pair_scheduler::get_max_concurrent_jobs() const {
+    return max_concurrent_jobs_;
+}
+
+size_t pair_scheduler::get_memory_budget() const { return memory_budget_; }
+
+}  // namespace combined
+}  // namespace wayverb
@@ -1,5 +1,6 @@
 #include "combined/threaded_engine.h"
 #include "combined/forwarding_call.h"
+#include "combined/pair_scheduler.h"
 #include "combined/validate_placements.h"
 #include "combined/waveguide_base.h"
 
@@ -9,9 +10,12 @@
 #include "core/environment.h"
 
 #include "waveguide/mesh.h"
+#include "waveguide/mesh_cache.h"
 
 #include "audio_file/audio_file.h"
 
+#include <iterator>
+
 namespace wayverb {
 namespace combined {
 namespace {
@@ -28,6 +32,12 @@ struct channel_info final {
     std::string file_name;
 };
 
+/// Receivers which can all be recorded from the same waveguide run.
+struct receiver_group final {
+    std::shared_ptr<const waveguide::voxels_and_mesh> voxels_and_mesh;
+    util::aligned::vector<size_t> receivers;
+};
+
 }  // namespace
 
 std::unique_ptr<capsule_base> polymorphic_capsule_model(
@@ -54,6 +64,36 @@ std::unique_ptr<waveguide_base> polymorphic_waveguide_model(
 
 complete_engine::~complete_engine() noexcept { cancel(); }
 
+void complete_engine::set_max_concurrent_pairs(size_t pairs) {
+    max_concurrent_pairs_ = pairs;
+}
+
+size_t complete_engine::get_max_concurrent_pairs() const {
+    return max_concurrent_pairs_;
+}
+
+void complete_engine::set_device_memory_budget(size_t bytes) {
+    memory_budget_ = bytes;
+}
+
+size_t complete_engine::get_device_memory_budget() const {
+    return memory_budget_;
+}
+
+void complete_engine::set_scheduling(scheduling s) { scheduling_ = s; }
+
+scheduling complete_engine::get_scheduling() const { return scheduling_; }
+
+void complete_engine::set_acceleration_structure(
+        core::acceleration_structure acceleration) {
+    acceleration_ = acceleration;
+}
+
+core::acceleration_structure complete_engine::get_acceleration_structure()
+        const {
+    return acceleration_;
+}
+
 bool complete_engine::is_running() const { return is_running_; }
 void complete_engine::cancel() { keep_going_ = false; }
 
@@ -120,7 +160,7 @@ void complete_engine::do_run(core::compute_context compute_context,
         {
             //  Check that all sources and receivers are inside the mesh.
             const auto voxelised =
-                    core::make_voxelised_scene_data(scene_data, 5, 0.1f);
+                    core::make_voxelised_scene_data(scene_data, 0.1f);
 
             if (!are_all_inside(make_position_extractor_iterator(
                                         std::begin(*persistent.sources())),
@@ -144,98 +184,224 @@ void complete_engine::do_run(core::compute_context compute_context,
         const auto poly_waveguide =
                 polymorphic_waveguide_model(*persistent.waveguide().item());
 
-        std::vector<channel_info> all_channels;
+        const auto& receivers = *persistent.receivers().item();
+
+        //  Receivers are snapped onto the lattice through the first receiver,
+        //  so that every pair can share the same mesh.
+        const auto lattice_anchor =
+                receivers.empty() ? glm::vec3{}
+                                  : receivers[0].item()->get_position();
+
+        const core::acceleration_structure acceleration = acceleration_;
+        const scheduling pair_scheduling = scheduling_;
+
+        const auto get_voxels_and_mesh = [&](const glm::vec3& receiver) {
+            const auto get = [&](const glm::vec3& anchor) {
+                return mesh_cache_.get(
+                        compute_context,
+                        scene_data,
+                        anchor,
+                        poly_waveguide->compute_sampling_frequency(),
+                        environment.speed_of_sound,
+                        acceleration);
+            };
+
+            auto ret = get(lattice_anchor);
 
-        const auto runs = persistent.sources().item()->size() *
-                          persistent.receivers().item()->size();
+            //  Close to a wall, the nearest node on the shared lattice might be
+            //  outside, in which case the receiver gets a lattice of its own.
+            if (!waveguide::is_inside(
+                        ret->mesh,
+                        compute_index(ret->mesh.get_descriptor(), receiver))) {
+                ret = get(receiver);
+            }
 
-        auto run = 0;
+            return ret;
+        };
 
-        //  For each source-receiver pair.
-        for (auto source = std::begin(*persistent.sources().item()),
-                  e_source = std::end(*persistent.sources().item());
-             source != e_source && keep_going_;
+        //  A single waveguide run from each source can be recorded at every
+        //  receiver in the same mesh, so receivers are grouped by mesh.
+        util::aligned::vector<receiver_group> groups;
+        for (auto i = 0u; i != receivers.size(); ++i) {
+            auto voxels_and_mesh =
+                    get_voxels_and_mesh(receivers[i].item()->get_position());
+            const auto it = std::find_if(
+                    begin(groups), end(groups), [&](const auto& group) {
+                        return group.voxels_and_mesh == voxels_and_mesh;
+                    });
+            if (it != end(groups)) {
+                it->receivers.emplace_back(i);
+            } else {
+                groups.emplace_back(
+                        receiver_group{std::move(voxels_and_mesh), {i}});
+            }
+        }
+
+        //  Each job renders one source with one group of receivers.
+        struct job final {
+            size_t source;
+            size_t group;
+        };
+
+        util::aligned::vector<job> jobs;
+        util::aligned::vector<size_t> job_memory;
+        for (auto source = 0u; source != persistent.sources().item()->size();
              ++source) {
-            for (auto receiver = std::begin(*persistent.receivers().item()),
-                      e_receiver = std::end(*persistent.receivers().item());
-                 receiver != e_receiver && keep_going_;
-                 ++receiver, ++run) {
-                //  Set up an engine to use.
-                postprocessing_engine eng{compute_context,
-                                          scene_data,
-                                          source->item()->get_position(),
-                                          receiver->item()->get_position(),
-                                          environment,
-                                          persistent.raytracer().item()->get(),
-                                          poly_waveguide->clone()};
-
-                //  Send new node position notification.
+            for (auto group = 0u; group != groups.size(); ++group) {
+                jobs.emplace_back(job{source, group});
+                job_memory.emplace_back(estimate_device_memory(
+                        *groups[group].voxels_and_mesh,
+                        groups[group].receivers.size(),
+                        persistent.raytracer().item()->get(),
+                        environment.speed_of_sound));
+            }
+        }
+
+        const auto runs = jobs.size();
+
+        //  Channels are kept per-job, so that the output order doesn't depend
+        //  on which jobs finish first.
+        std::vector<std::vector<channel_info>> job_channels(runs);
+
+        //  Node positions and pressures from different jobs would be
+        //  interleaved in the visualiser, so only one job drives it at a
+        //  time. Whichever job starts while it is free takes it over.
+        std::atomic_bool visualiser_in_use{false};
+
+        const auto render = [&](size_t run) {
+            const auto& source =
+                    (*persistent.sources().item())[jobs[run].source];
+            const auto& group = groups[jobs[run].group];
+
+            const auto get_receiver = [&](auto index) -> const auto& {
+                return *receivers[group.receivers[index]].item();
+            };
+
+            //  Set up an engine to use.
+            postprocessing_engine eng{
+                    compute_context,
+                    group.voxels_and_mesh,
+                    source.item()->get_position(),
+                    util::map_to_vector(begin(group.receivers),
+                                        end(group.receivers),
+                                        [&](auto i) {
+                                            return receivers[i]
+                                                    .item()
+                                                    ->get_position();
+                                        }),
+                    environment,
+                    persistent.raytracer().item()->get(),
+                    poly_waveguide->clone()};
+
+            eng.set_scheduling(pair_scheduling);
+
+            struct visualiser_lock final {
+                std::atomic_bool& in_use;
+                const bool owned;
+
+                ~visualiser_lock() noexcept {
+                    if (owned) {
+                        in_use = false;
+                    }
+                }
+            };
+            const visualiser_lock visualiser{visualiser_in_use,
+                                             !visualiser_in_use.exchange(true)};
+
+            //  Send new node position notification.
+            if (visualiser.owned) {
                 waveguide_node_positions_changed_(
                         eng.get_voxels_and_mesh().mesh.get_descriptor());
+            }
 
-                //  Register callbacks.
-                if (!engine_state_changed_.empty()) {
-                    eng.connect_engine_state_changed([this, runs, run](
-                            auto state, auto progress) {
-                        engine_state_changed_(run, runs, state, progress);
-                    });
-                }
+            //  Register callbacks.
+            if (!engine_state_changed_.empty()) {
+                eng.connect_engine_state_changed(
+                        [this, runs, run](auto state, auto progress) {
+                            engine_state_changed_(run, runs, state, progress);
+                        });
+            }
 
-                if (!waveguide_node_pressures_changed_.empty()) {
-                    eng.connect_waveguide_node_pressures_changed(
-                            make_forwarding_call(
-                                    waveguide_node_pressures_changed_));
-                }
+            if (visualiser.owned &&
+                !waveguide_node_pressures_changed_.empty()) {
+                eng.connect_waveguide_node_pressures_changed(
+                        make_forwarding_call(
+                                waveguide_node_pressures_changed_));
+            }
 
-                if (!raytracer_reflections_generated_.empty()) {
-                    eng.connect_raytracer_reflections_generated(
-                            make_forwarding_call(
-                                    raytracer_reflections_generated_));
-                }
+            if (visualiser.owned &&
+                !raytracer_reflections_generated_.empty()) {
+                eng.connect_raytracer_reflections_generated(
+                        make_forwarding_call(raytracer_reflections_generated_));
+            }
 
-                const auto polymorphic_capsules = util::map_to_vector(
-                        std::begin(*receiver->item()->capsules().item()),
-                        std::end(*receiver->item()->capsules().item()),
-                        [&](const auto& i) {
+            util::aligned::vector<
+                    util::aligned::vector<std::unique_ptr<capsule_base>>>
+                    polymorphic_capsules;
+            for (auto i = 0u; i != group.receivers.size(); ++i) {
+                const auto& receiver = get_receiver(i);
+                polymorphic_capsules.emplace_back(util::map_to_vector(
+                        std::begin(*receiver.capsules().item()),
+                        std::end(*receiver.capsules().item()),
+                        [&](const auto& capsule) {
                             return polymorphic_capsule_model(
-                                    *i.item(),
-                                    receiver->item()->get_orientation());
-                        });
+                                    *capsule.item(),
+                                    receiver.get_orientation());
+                        }));
+            }
 
-                //  Run the simulation, cache the result.
-                auto channel =
-                        eng.run(begin(polymorphic_capsules),
-                                end(polymorphic_capsules),
+            //  Run the simulation, cache the result.
+            auto channels =
+                    eng.run_all(polymorphic_capsules,
                                 get_sample_rate(output.get_sample_rate()),
                                 keep_going_);
 
-                //  If user cancelled while processing the channel, channel
-                //  will be null, but we want to exit before throwing an
-                //  exception.
-                if (!keep_going_) {
-                    break;
-                }
+            //  If user cancelled while processing the channel, channel will
+            //  be null, but we want to exit before throwing an exception.
+            if (!keep_going_) {
+                return;
+            }
 
-                if (!channel) {
-                    throw std::runtime_error{
-                            "Encountered unknown error, causing channel not to "
-                            "be rendered."};
-                }
+            if (!channels) {
+                throw std::runtime_error{
+                        "Encountered unknown error, causing channel not to be "
+                        "rendered."};
+            }
 
-                for (size_t i = 0,
-                            e = receiver->item()->capsules().item()->size();
-                     i != e;
-                     ++i) {
-                    all_channels.emplace_back(channel_info{
-                            std::move((*channel)[i]),
+            for (auto i = 0u; i != group.receivers.size(); ++i) {
+                const auto& receiver = get_receiver(i);
+                for (size_t j = 0, e = receiver.capsules().item()->size();
+                     j != e;
+                     ++j) {
+                    job_channels[run].emplace_back(channel_info{
+                            std::move((*channels)[i][j]),
                             compute_output_path(
-                                    *source->item(),
-                                    *receiver->item(),
-                                    *(*receiver->item()->capsules().item())[i]
-                                             .item(),
+                                    *source.item(),
+                                    receiver,
+                                    *(*receiver.capsules().item())[j].item(),
                                     output)});
                 }
             }
+        };
+
+        //  By default, use up to half of the device memory, leaving room for
+        //  the scene and for other applications.
+        const auto memory_budget = [&]() -> size_t {
+            if (const size_t ret = memory_budget_) {
+                return ret;
+            }
+            const auto& device = compute_context.device;
+            return device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / 2;
+        }();
+
+        pair_scheduler{max_concurrent_pairs_, memory_budget}.run(
+                job_memory, render, keep_going_);
+
+        std::vector<channel_info> all_channels;
+        for (auto& channels : job_channels) {
+            std::move(begin(channels),
+                      end(channels),
+                      std::back_inserter(all_channels));
         }
 
         //  If keep going is false now, then the simulation was cancelled.
@@ -19,11 +19,12 @@ public:
         return waveguide::compute_sampling_frequency(sim_params_);
     }
 
-    std::experimental::optional<util::aligned::vector<waveguide::bandpass_band>>
+    std::experimental::optional<util::aligned::vector<
+            util::aligned::vector<waveguide::bandpass_band>>>
     run(const core::compute_context& cc,
         const waveguide::voxels_and_mesh& voxelised,
         const glm::vec3& source,
-        const glm::vec3& receiver,
+        const util::aligned::vector<glm::vec3>& receivers,
         const core::environment& environment,
         double simulation_time,
         const std::atomic_bool& keep_going,
@@ -32,9 +33,9 @@ public:
                            size_t step,
                            size_t steps)> pressure_callback) override {
         return waveguide::canonical(cc,
-                                    std::move(voxelised),
+                                    voxelised,
                                     source,
-                                    receiver,
+                                    receivers,
                                     environment,
                                     sim_params_,
                                     simulation_time,
@@ -0,0 +1,88 @@
+#include "combined/pair_scheduler.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using namespace wayverb::combined;
+
+TEST(pair_scheduler, runs_every_job) {
+    const util::aligned::vector<size_t> memory(100, 1);
+    util::aligned::vector<size_t> results(memory.size(), 0);
+
+    pair_scheduler{8, 0}.run(memory,
+                             [&](auto i) { results[i] = i * 2; },
+                             true);
+
+    for (auto i = 0u; i != results.size(); ++i) {
+        ASSERT_EQ(results[i], i * 2);
+    }
+}
+
+TEST(pair_scheduler, respects_memory_budget) {
+    const util::aligned::vector<size_t> memory{4, 3, 2, 5, 1, 6, 2, 3, 4, 1};
+    constexpr size_t budget = 7;
+
+    std::mutex mutex;
+    size_t in_use = 0;
+    size_t max_in_use = 0;
+
+    pair_scheduler{4, budget}.run(
+            memory,
+            [&](auto i) {
+                {
+                    std::lock_guard<std::mutex> lck{mutex};
+                    in_use += memory[i];
+                    max_in_use = std::max(max_in_use, in_use);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds{5});
+                std::lock_guard<std::mutex> lck{mutex};
+                in_use -= memory[i];
+            },
+            true);
+
+    ASSERT_LE(max_in_use, budget);
+}
+
+TEST(pair_scheduler, oversized_jobs_run_alone) {
+    const util::aligned::vector<size_t> memory{10, 10, 10};
+    std::atomic<size_t> finished{0};
+
+    pair_scheduler{4, 5}.run(memory, [&](auto) { finished += 1; }, true);
+
+    ASSERT_EQ(finished, memory.size());
+}
+
+TEST(pair_scheduler, cancel) {
+    const util::aligned::vector<size_t> memory(100, 1);
+    std::atomic_bool keep_going{true};
+    std::atomic<size_t> started{0};
+
+    pair_scheduler{1, 0}.run(memory,
+                             [&](auto i) {
+                                 started += 1;
+                                 if (i == 10) {
+                                     keep_going = false;
+                                 }
+                             },
+                             keep_going);
+
+    ASSERT_EQ(started, 11);
+}
+
+TEST(pair_scheduler, rethrows) {
+    const util::aligned::vector<size_t> memory(10, 1);
+    ASSERT_THROW(pair_scheduler(4, 0).run(memory,
+                                          [&](auto i) {
+                                              if (i == 3) {
+                                                  throw std::runtime_error{
+                                                          "oops"};
+                                              }
+                                          },
+                                          true),
+                 std::runtime_error);
+}
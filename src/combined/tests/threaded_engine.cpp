@@ -35,3 +35,11 @@ TEST(threaded_engine, threaded_engine) {
 
     complete.run(compute_context{}, scene_data, persistent, model::output{});
 }
+
+TEST(threaded_engine, scheduling_is_opt_in) {
+    complete_engine complete{};
+    ASSERT_EQ(complete.get_scheduling(), scheduling::sequential);
+
+    complete.set_scheduling(scheduling::concurrent);
+    ASSERT_EQ(complete.get_scheduling(), scheduling::concurrent);
+}
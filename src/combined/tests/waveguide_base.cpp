@@ -0,0 +1,87 @@
+#include "combined/waveguide_base.h"
+
+#include "waveguide/mesh.h"
+#include "waveguide/simulation_parameters.h"
+
+#include "core/cl/common.h"
+#include "core/environment.h"
+#include "core/geo/box.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::combined;
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+namespace {
+
+/// Recording every receiver from a single run should give exactly the same
+/// outputs as running each receiver on its own.
+void check_receivers_are_independent(waveguide_base& waveguide) {
+    const compute_context cc{};
+
+    const geo::box box{glm::vec3{0, 0, 0}, glm::vec3{4, 3, 2}};
+    constexpr glm::vec3 source{1, 1, 1};
+    const util::aligned::vector<glm::vec3> receivers{
+            {3, 2, 1}, {2, 1.5, 1.2}, {1.5, 2.5, 0.5}};
+
+    const auto scene_data =
+            geo::get_scene_data(box, make_surface<simulation_bands>(0.1, 0));
+
+    const environment environment{};
+    const auto voxels_and_mesh =
+            compute_voxels_and_mesh(cc,
+                                    scene_data,
+                                    source,
+                                    waveguide.compute_sampling_frequency(),
+                                    environment.speed_of_sound);
+
+    constexpr auto simulation_time = 0.05;
+    const auto run = [&](const auto& receivers) {
+        auto ret = waveguide.run(cc,
+                                 voxels_and_mesh,
+                                 source,
+                                 receivers,
+                                 environment,
+                                 simulation_time,
+                                 true,
+                                 [](auto&, const auto&, auto, auto) {});
+        if (!ret) {
+            throw std::runtime_error{"Waveguide run failed."};
+        }
+        return *ret;
+    };
+
+    const auto together = run(receivers);
+    ASSERT_EQ(together.size(), receivers.size());
+
+    for (auto i = 0u; i != receivers.size(); ++i) {
+        const auto alone =
+                run(util::aligned::vector<glm::vec3>{receivers[i]}).front();
+        ASSERT_EQ(together[i].size(), alone.size());
+
+        for (auto band = 0u; band != alone.size(); ++band) {
+            const auto& a = together[i][band].band.directional;
+            const auto& b = alone[band].band.directional;
+            ASSERT_EQ(a.size(), b.size());
+            ASSERT_FALSE(a.empty());
+
+            for (auto step = 0u; step != a.size(); ++step) {
+                ASSERT_EQ(a[step].pressure, b[step].pressure);
+                ASSERT_EQ(a[step].intensity, b[step].intensity);
+            }
+        }
+    }
+}
+
+}  // namespace
+
+TEST(waveguide_base, single_band_receivers_are_independent) {
+    check_receivers_are_independent(
+            *make_waveguide_ptr(single_band_parameters{500, 0.6}));
+}
+
+TEST(waveguide_base, multiband_receivers_are_independent) {
+    check_receivers_are_independent(*make_waveguide_ptr(
+            multiple_band_constant_spacing_parameters{3, 500, 0.6}));
+}
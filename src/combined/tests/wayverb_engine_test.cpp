@@ -9,6 +9,7 @@
 #include "core/cl/common.h"
 #include "core/environment.h"
 #include "core/geo/box.h"
+#include "core/reverb_time.h"
 #include "core/scene_data.h"
 
 #include "gtest/gtest.h"
@@ -52,3 +53,50 @@ TEST(engine, engine) {
     const auto result =
             intermediate->postprocess(attenuator::null{}, output_sample_rate);
 }
+
+TEST(engine, estimate_simulation_time) {
+    const auto box = geo::box{glm::vec3{0, 0, 0}, glm::vec3{5.56, 3.97, 2.81}};
+    const auto scene_data =
+            geo::get_scene_data(box, make_surface<simulation_bands>(0.1, 0.1));
+
+    const auto sabine = max_element(sabine_reverb_time(scene_data, 0.0f));
+    const auto eyring = max_element(eyring_reverb_time(scene_data, 0.0f));
+
+    const auto estimate = estimate_simulation_time(scene_data, 1.0);
+    ASSERT_TRUE(estimate);
+    ASSERT_NEAR(*estimate, eyring, 1.0e-4);
+    ASSERT_LT(*estimate, sabine);
+
+    //  A scene which absorbs nothing never decays.
+    const auto reflective =
+            geo::get_scene_data(box, make_surface<simulation_bands>(0, 0));
+    ASSERT_FALSE(estimate_simulation_time(reflective));
+}
+
+TEST(engine, concurrent) {
+    constexpr auto min = glm::vec3{0, 0, 0};
+    constexpr auto max = glm::vec3{5.56, 3.97, 2.81};
+    const auto box = geo::box{min, max};
+    constexpr auto source = glm::vec3{2.09, 2.12, 2.12},
+                   receiver = glm::vec3{2.09, 3.08, 0.96};
+    constexpr auto output_sample_rate = 96000.0;
+    constexpr auto surface = make_surface<simulation_bands>(0.1, 0.1);
+
+    const auto scene_data = geo::get_scene_data(box, surface);
+
+    engine e{compute_context{},
+             scene_data,
+             source,
+             receiver,
+             wayverb::core::environment{},
+             simulation_parameters{1 << 16, 5},
+             make_waveguide_ptr(single_band_parameters{1000, 0.5})};
+    e.set_scheduling(scheduling::concurrent);
+
+    const auto intermediate = e.run(true);
+    ASSERT_NE(intermediate, nullptr);
+
+    const auto result =
+            intermediate->postprocess(attenuator::null{}, output_sample_rate);
+    ASSERT_FALSE(result.empty());
+}
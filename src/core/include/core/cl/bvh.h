@@ -0,0 +1,9 @@
+#pragma once
+
+namespace wayverb {
+namespace core {
+namespace cl_sources {
+extern const char* bvh;
+}  // namespace cl_sources
+}  // namespace core
+}  // namespace wayverb
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "core/cl/representation.h"
+#include "core/cl/traits.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace wayverb {
+namespace core {
+
+/// A single node in a flattened bounding volume hierarchy.
+/// Nodes are stored depth-first, so the first child of an interior node is
+/// always the next node in the array.
+/// For interior nodes, count is zero and offset is the index of the second
+/// child.
+/// For leaves, offset and count describe a range in the triangle index array.
+struct alignas(1 << 4) bvh_node final {
+    cl_float bounds_min[3];
+    cl_uint offset;
+    cl_float bounds_max[3];
+    cl_uint count;
+};
+
+static_assert(sizeof(bvh_node) == 32, "bvh_node must be 32 bytes");
+
+template <>
+struct cl_representation<bvh_node> final {
+    static constexpr auto value = R"(
+typedef struct {
+    float bounds_min[3];
+    uint offset;
+    float bounds_max[3];
+    uint count;
+} bvh_node;
+)";
+};
+
+inline bool operator==(const bvh_node& a, const bvh_node& b) {
+    return std::equal(std::begin(a.bounds_min),
+                      std::end(a.bounds_min),
+                      std::begin(b.bounds_min)) &&
+           std::equal(std::begin(a.bounds_max),
+                      std::end(a.bounds_max),
+                      std::begin(b.bounds_max)) &&
+           a.offset == b.offset && a.count == b.count;
+}
+
+inline bool operator!=(const bvh_node& a, const bvh_node& b) {
+    return !(a == b);
+}
+
+}  // namespace core
+}  // namespace wayverb
@@ -9,6 +9,15 @@ namespace core {
 
 enum class device_type { cpu, gpu };
 
+/// Whether devices without double precision support should be rejected.
+/// Only the waveguide boundary filters need doubles, and they can be built in
+/// single precision instead by defining WAYVERB_SINGLE_PRECISION_FILTERS.
+#ifdef WAYVERB_SINGLE_PRECISION_FILTERS
+constexpr auto requires_double_precision = false;
+#else
+constexpr auto requires_double_precision = true;
+#endif
+
 /// invariant: device is a valid device for the context
 class compute_context final {
 public:
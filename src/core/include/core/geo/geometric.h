@@ -51,7 +51,7 @@ std::experimental::optional<intersection> intersection_accumulator(
 template <typename T>
 std::experimental::optional<intersection> ray_triangle_intersection(
         const ray& ray,
-        const size_t* triangle_indices,
+        const cl_uint* triangle_indices,
         size_t num_triangle_indices,
         const triangle* triangles,
         const T* vertices,
@@ -2,9 +2,36 @@
 
 #include "core/cl/common.h"
 
+#include <string>
+
 namespace wayverb {
 namespace core {
 
+/// Built programs are shared between all program_wrappers in the process,
+/// keyed by context, device, source and build options.
+/// Compiled binaries are also written to disk, so that later runs can skip
+/// the source compilation step entirely.
+struct program_cache_statistics final {
+    size_t memory_hits;  ///  Program found in the process-wide cache.
+    size_t disk_hits;    ///  Program loaded from a cached binary.
+    size_t misses;       ///  Program built from source.
+};
+
+program_cache_statistics get_program_cache_statistics();
+void reset_program_cache_statistics();
+
+/// Drops all in-memory programs (and the contexts they keep alive).
+void clear_program_cache();
+
+/// Set the directory used for cached program binaries.
+/// An empty string disables the on-disk cache.
+/// Defaults to $WAYVERB_PROGRAM_CACHE_DIR if set, otherwise a private per-user
+/// cache directory (see util::user_cache_directory).
+/// Cached binaries are loaded without further checks, so the directory should
+/// not be writable by anyone else.
+void set_program_binary_cache_directory(const std::string& directory);
+std::string get_program_binary_cache_directory();
+
 class program_wrapper final {
 public:
     program_wrapper(const compute_context& cc, const std::string& source);
@@ -35,8 +62,6 @@ public:
     }
 
 private:
-    void build(const cl::Device& device) const;
-
     cl::Device device;
     cl::Program program;
 };
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "core/cl/bvh_structs.h"
+#include "core/cl/geometry_structs.h"
+#include "core/conversions.h"
+#include "core/geo/geometric.h"
+#include "core/scene_data.h"
+
+#include "utilities/aligned/vector.h"
+#include "utilities/map_to_vector.h"
+
+#include "glm/glm.hpp"
+
+#include <experimental/optional>
+
+namespace wayverb {
+namespace core {
+
+/// A bounding volume hierarchy over the triangles of a scene, built using
+/// the surface area heuristic.
+/// This is an alternative to the uniform voxel grid for ray queries, which
+/// adapts to the distribution of triangles rather than splitting the scene
+/// into cells of a fixed size.
+///
+/// The flattened layout is shared with the device: see bvh_node.
+class bvh final {
+public:
+    /// The depth of the tree is limited, so that traversals (on the host and
+    /// on the device) can use a fixed-size stack.
+    static constexpr size_t max_depth = 64;
+
+    bvh(const util::aligned::vector<triangle>& triangles,
+        const util::aligned::vector<glm::vec3>& vertices,
+        size_t max_leaf_size = 4);
+
+    const util::aligned::vector<bvh_node>& get_nodes() const;
+    const util::aligned::vector<cl_uint>& get_triangle_indices() const;
+
+private:
+    util::aligned::vector<bvh_node> nodes_;
+    util::aligned::vector<cl_uint> triangle_indices_;
+};
+
+template <typename Vertex, typename Surface>
+bvh make_bvh(const generic_scene_data<Vertex, Surface>& scene) {
+    return bvh{scene.get_triangles(),
+               util::map_to_vector(begin(scene.get_vertices()),
+                                   end(scene.get_vertices()),
+                                   to_vec3{})};
+}
+
+/// Find the closest intersection between a ray and the triangles in the
+/// hierarchy, ignoring the triangle with index to_ignore.
+template <typename Vertex>
+std::experimental::optional<intersection> intersects(
+        const bvh& hierarchy,
+        const triangle* triangles,
+        const Vertex* vertices,
+        const geo::ray& ray,
+        size_t to_ignore = ~size_t{0});
+
+}  // namespace core
+}  // namespace wayverb
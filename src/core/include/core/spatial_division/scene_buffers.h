@@ -1,5 +1,6 @@
 #pragma once
 
+#include "core/cl/bvh_structs.h"
 #include "core/cl/voxel_structs.h"
 #include "core/spatial_division/voxelised_scene_data.h"
 
@@ -8,8 +9,23 @@ namespace core {
 
 /// Provides a simple utility for loading voxelised scene data to the gpu in
 /// one go.
+///
+/// The bvh buffers always exist, so that kernels can take them
+/// unconditionally, but they only hold a placeholder when the scene has no
+/// bvh.
 template <typename Vertex, typename Surface>
 class generic_scene_buffers final {
+    template <typename T, typename Function>
+    static cl::Buffer load_bvh(
+            const cl::Context& context,
+            const voxelised_scene_data<Vertex, Surface>& scene_data,
+            const Function& get) {
+        if (const auto& hierarchy = scene_data.get_bvh()) {
+            return load_to_buffer(context, get(*hierarchy), true);
+        }
+        return load_to_buffer(context, util::aligned::vector<T>(1), true);
+    }
+
 public:
     generic_scene_buffers(
             const cl::Context& context,
@@ -24,6 +40,15 @@ public:
                                                   .get_aabb()
                                                   .get_max())}
             , side_{static_cast<cl_uint>(scene_data.get_voxels().get_side())}
+            , bvh_nodes_{load_bvh<bvh_node>(
+                      context_,
+                      scene_data,
+                      [](const auto& i) { return i.get_nodes(); })}
+            , bvh_triangle_indices_{load_bvh<cl_uint>(
+                      context_,
+                      scene_data,
+                      [](const auto& i) { return i.get_triangle_indices(); })}
+            , use_bvh_{static_cast<bool>(scene_data.get_bvh())}
             , triangles_{load_to_buffer(
                       context_,
                       scene_data.get_scene_data().get_triangles(),
@@ -43,6 +68,14 @@ public:
     aabb get_global_aabb() const { return global_aabb_; }
     cl_uint get_side() const { return side_; }
 
+    const cl::Buffer& get_bvh_nodes_buffer() const { return bvh_nodes_; }
+    const cl::Buffer& get_bvh_triangle_indices_buffer() const {
+        return bvh_triangle_indices_;
+    }
+    /// Whether kernels should use the bvh rather than the voxels for
+    /// closest-hit queries.
+    cl_uint get_use_bvh() const { return use_bvh_; }
+
     const cl::Buffer& get_triangles_buffer() const { return triangles_; }
     const cl::Buffer& get_vertices_buffer() const { return vertices_; }
     const cl::Buffer& get_surfaces_buffer() const { return surfaces_; }
@@ -54,6 +87,10 @@ private:
     const aabb global_aabb_;
     const cl_uint side_;
 
+    const cl::Buffer bvh_nodes_;
+    const cl::Buffer bvh_triangle_indices_;
+    const cl_uint use_bvh_;
+
     const cl::Buffer triangles_;
     const cl::Buffer vertices_;
     const cl::Buffer surfaces_;
@@ -1,119 +1,91 @@
 #pragma once
 
+#include "core/cl/triangle.h"
+#include "core/geo/box.h"
 #include "core/geo/rect.h"
 #include "core/indexing.h"
-#include "core/spatial_division/ndim_tree.h"
+#include "core/spatial_division/range.h"
 
-namespace wayverb {
-namespace core {
+#include "utilities/aligned/vector.h"
 
-using voxel = util::aligned::vector<size_t>;
+#include <functional>
+#include <stdexcept>
 
-namespace detail {
+namespace wayverb {
+namespace core {
 
-////////////////////////////////////////////////////////////////////////////////
+/// A read-only view of the indices of the triangles which overlap a single
+/// voxel.
+class voxel final {
+public:
+    constexpr voxel(const cl_uint* begin, const cl_uint* end)
+            : begin_{begin}
+            , end_{end} {}
 
-template <size_t n>
-struct voxel_data_trait final {
-    using prev_type = voxel_data_trait<n - 1>;
-    using nested_type = typename prev_type::data_type;
-    using data_type = util::aligned::vector<nested_type>;
-    static data_type get_blank(size_t size) {
-        return data_type(size, prev_type::get_blank(size));
-    }
-};
+    constexpr const cl_uint* begin() const { return begin_; }
+    constexpr const cl_uint* end() const { return end_; }
+    constexpr const cl_uint* data() const { return begin_; }
+    constexpr size_t size() const { return end_ - begin_; }
+    constexpr bool empty() const { return begin_ == end_; }
 
-template <>
-struct voxel_data_trait<0> final {
-    using data_type = voxel;
-    static data_type get_blank(size_t) { return data_type{}; }
+private:
+    const cl_uint* begin_;
+    const cl_uint* end_;
 };
 
-template <size_t n>
-using voxel_data_t = typename voxel_data_trait<n>::data_type;
-
-////////////////////////////////////////////////////////////////////////////////
-
-template <size_t n>
-inline const voxel& index(const typename voxel_data_trait<n>::data_type& data,
-                          indexing::index_t<n> i) {
-    return index<n - 1>(data[indexing::back<n>(i)], indexing::reduce<n>(i));
-}
-
-template <>
-inline const voxel& index<1>(
-        const typename voxel_data_trait<1>::data_type& data,
-        indexing::index_t<1> i) {
-    return data[i];
-}
-
-template <size_t n>
-inline voxel& index(typename voxel_data_trait<n>::data_type& data,
-                    indexing::index_t<n> i) {
-    return index<n - 1>(data[indexing::back<n>(i)], indexing::reduce<n>(i));
-}
-
-template <>
-inline voxel& index<1>(typename voxel_data_trait<1>::data_type& data,
-                       indexing::index_t<1> i) {
-    return data[i];
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-template <size_t n>
-void voxelise(const ndim_tree<n>& tree,
-              const indexing::index_t<n>& position,
-              voxel_data_t<n>& ret) {
-    if (!tree.has_nodes()) {
-        index<n>(ret, position) = tree.get_items();
-    } else {
-        for (size_t i = 0; i != tree.get_nodes().size(); ++i) {
-            const auto relative = indexing::relative_position<n>(i) *
-                                  static_cast<unsigned>(tree.get_side() / 2);
-            voxelise(tree.get_nodes()[i], position + relative, ret);
-        }
-    }
-}
-
-template <size_t n>
-voxel_data_t<n> voxelise(const ndim_tree<n>& tree) {
-    auto ret = voxel_data_trait<n>::get_blank(tree.get_side());
-    voxelise(tree, indexing::index_t<n>{0}, ret);
-    return ret;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-}  // namespace detail
-
-/// A box full of voxels, where each voxel keeps track of its own boundary
-/// and indices of triangles that overlap that boundary.
-/// Can be 'flattened' - converts the collection into a memory-efficient
-/// array representation, which can be passed to the GPU.
+/// A box full of voxels, where each voxel holds the indices of triangles that
+/// overlap its boundary.
+///
+/// Voxels are stored in the same flat representation that is used on the
+/// GPU, so the collection can be uploaded without repacking:
+///     The first side^n entries hold the offset of each voxel's block.
+///     Each block holds the number of triangles in the voxel, followed by
+///     their indices in ascending order.
 template <size_t n>
 class voxel_collection final {
 public:
     using aabb_type = detail::range_t<n>;
-    using data_type = detail::voxel_data_t<n>;
 
-    /// Construct directly from an existing tree.
-    voxel_collection(const ndim_tree<n>& tree)
-            : aabb_{tree.get_aabb()}
-            , data_{detail::voxelise(tree)} {}
+    voxel_collection(const aabb_type& aabb,
+                     size_t side,
+                     util::aligned::vector<cl_uint> flattened)
+            : aabb_{aabb}
+            , side_{side}
+            , flattened_{std::move(flattened)} {
+        size_t voxels = 1;
+        for (auto i = 0u; i != n; ++i) {
+            voxels *= side_;
+        }
+        if (flattened_.size() < voxels) {
+            throw std::runtime_error{"Flattened voxel data is too small."};
+        }
+    }
 
     aabb_type get_aabb() const { return aabb_; }
-    size_t get_side() const { return data_.size(); }
-    const auto& get_voxel(indexing::index_t<n> i) const {
-        return detail::index<n>(data_, i);
+    size_t get_side() const { return side_; }
+
+    voxel get_voxel(indexing::index_t<n> i) const {
+        const auto offset = flattened_[to_flat(i)];
+        const auto begin = flattened_.data() + offset + 1;
+        return voxel{begin, begin + flattened_[offset]};
     }
-    auto& get_voxel(indexing::index_t<n> i) {
-        return detail::index<n>(data_, i);
+
+    const util::aligned::vector<cl_uint>& get_flattened() const {
+        return flattened_;
     }
 
 private:
+    size_t to_flat(indexing::index_t<n> i) const {
+        size_t ret = 0;
+        for (auto j = 0u; j != n; ++j) {
+            ret = ret * side_ + i[j];
+        }
+        return ret;
+    }
+
     aabb_type aabb_;
-    data_type data_;
+    size_t side_;
+    util::aligned::vector<cl_uint> flattened_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -132,8 +104,23 @@ auto voxel_aabb(const voxel_collection<n>& voxels, indexing::index_t<n> i) {
     return vt(root, root + dim);
 }
 
+/// A grid resolution which keeps the number of triangles per voxel roughly
+/// constant as scenes get bigger.
+size_t compute_voxel_side(size_t num_triangles);
+
+/// Bins each triangle into every voxel it overlaps.
+/// Triangles are tested against the voxels under their bounding box on
+/// several threads, and then scattered straight into the flat
+/// representation.
+voxel_collection<3> make_voxel_collection(
+        const util::aligned::vector<triangle>& triangles,
+        const util::aligned::vector<glm::vec3>& vertices,
+        const geo::box& aabb,
+        size_t side);
+
 /// Returns a flat array-representation of the collection.
-util::aligned::vector<cl_uint> get_flattened(const voxel_collection<3>& voxels);
+const util::aligned::vector<cl_uint>& get_flattened(
+        const voxel_collection<3>& voxels);
 
 /// arguments
 ///     a ray and
@@ -3,6 +3,7 @@
 #include "core/azimuth_elevation.h"
 #include "core/geo/geometric.h"
 #include "core/scene_data.h"
+#include "core/spatial_division/bvh.h"
 #include "core/spatial_division/voxel_collection.h"
 
 #include <random>
@@ -10,14 +11,40 @@
 namespace wayverb {
 namespace core {
 
+/// The structure used to accelerate closest-hit ray queries.
+/// The voxel grid is always built, because the waveguide and the inside
+/// tests walk it directly, but closest-hit queries (on the host and on the
+/// device) can use a bounding volume hierarchy instead.
+enum class acceleration_structure { voxels, bvh };
+
 template <typename Vertex, typename Surface>
 class voxelised_scene_data final {
-    static auto compute_triangle_indices(size_t num) {
-        util::aligned::vector<size_t> ret(num);
-        std::iota(ret.begin(), ret.end(), 0);
-        return ret;
+    template <typename Scene>
+    static std::experimental::optional<bvh> compute_bvh(
+            const Scene& scene, acceleration_structure acceleration) {
+        if (acceleration == acceleration_structure::bvh) {
+            return make_bvh(scene);
+        }
+        return std::experimental::nullopt;
     }
 
+    struct side_tag final {};
+
+    voxelised_scene_data(side_tag,
+                         size_t side,
+                         generic_scene_data<Vertex, Surface> scene,
+                         const geo::box& aabb,
+                         acceleration_structure acceleration)
+            : scene_{std::move(scene)}
+            , voxels_{make_voxel_collection(
+                      scene_.get_triangles(),
+                      util::map_to_vector(begin(scene_.get_vertices()),
+                                          end(scene_.get_vertices()),
+                                          to_vec3{}),
+                      aabb,
+                      side)}
+            , bvh_{compute_bvh(scene_, acceleration)} {}
+
 public:
     //  invariant:
     //  The 'voxels' structure holds references/indexes to valid triangles in
@@ -25,27 +52,42 @@ public:
 
     using scene_data = generic_scene_data<Vertex, Surface>;
 
+    /// The voxel grid has 2^octree_depth voxels along each side.
     voxelised_scene_data(scene_data scene,
                          size_t octree_depth,
-                         const geo::box& aabb)
-            : scene_{std::move(scene)}
-            , voxels_{ndim_tree<3>{
-                      octree_depth,
-                      [this](auto item, const auto& aabb) {
-                          // This is a bit greedy - we're sacrificing some speed
-                          // in the name of correctness.
-                          return geo::overlaps(
-                                  padded(aabb, glm::vec3{0.001}),
-                                  geo::get_triangle_vec3(
-                                          scene_.get_triangles()[item],
-                                          scene_.get_vertices().data()));
-                      },
-                      compute_triangle_indices(scene_.get_triangles().size()),
-                      aabb}} {}
+                         const geo::box& aabb,
+                         acceleration_structure acceleration =
+                                 acceleration_structure::voxels)
+            : voxelised_scene_data{side_tag{},
+                                   size_t{1} << octree_depth,
+                                   std::move(scene),
+                                   aabb,
+                                   acceleration} {}
+
+    /// Chooses the resolution of the voxel grid from the number of triangles
+    /// in the scene.
+    voxelised_scene_data(scene_data scene,
+                         const geo::box& aabb,
+                         acceleration_structure acceleration =
+                                 acceleration_structure::voxels)
+            : voxelised_scene_data{
+                      side_tag{},
+                      compute_voxel_side(scene.get_triangles().size()),
+                      std::move(scene),
+                      aabb,
+                      acceleration} {}
 
     const scene_data& get_scene_data() const { return scene_; }
     const voxel_collection<3>& get_voxels() const { return voxels_; }
 
+    acceleration_structure get_acceleration_structure() const {
+        return bvh_ ? acceleration_structure::bvh
+                    : acceleration_structure::voxels;
+    }
+
+    /// Only present if the scene was built with acceleration_structure::bvh.
+    const std::experimental::optional<bvh>& get_bvh() const { return bvh_; }
+
     //  We can allow modifying surfaces without violating the invariant.
     template <typename It>
     void set_surfaces(It begin, It end) {
@@ -56,23 +98,50 @@ public:
 private:
     scene_data scene_;
     voxel_collection<3> voxels_;
+    std::experimental::optional<bvh> bvh_;
 };
 
+template <typename Vertex, typename Surface, typename T>
+auto make_voxelised_scene_data(generic_scene_data<Vertex, Surface> scene,
+                               const util::range<T>& aabb,
+                               acceleration_structure acceleration =
+                                       acceleration_structure::voxels) {
+    return voxelised_scene_data<Vertex, Surface>{
+            std::move(scene), aabb, acceleration};
+}
+
+/// Pads the bounding box of the scene, and chooses the resolution of the voxel
+/// grid from the number of triangles.
+template <typename Vertex, typename Surface, typename Pad>
+auto make_voxelised_scene_data(generic_scene_data<Vertex, Surface> scene,
+                               Pad padding,
+                               acceleration_structure acceleration =
+                                       acceleration_structure::voxels) {
+    const auto aabb =
+            padded(geo::compute_aabb(scene.get_vertices()), glm::vec3{padding});
+    return make_voxelised_scene_data(std::move(scene), aabb, acceleration);
+}
+
 template <typename Vertex, typename Surface, typename T>
 auto make_voxelised_scene_data(generic_scene_data<Vertex, Surface> scene,
                                size_t octree_depth,
-                               const util::range<T>& aabb) {
+                               const util::range<T>& aabb,
+                               acceleration_structure acceleration =
+                                       acceleration_structure::voxels) {
     return voxelised_scene_data<Vertex, Surface>{
-            std::move(scene), octree_depth, aabb};
+            std::move(scene), octree_depth, aabb, acceleration};
 }
 
 template <typename Vertex, typename Surface, typename Pad>
 auto make_voxelised_scene_data(generic_scene_data<Vertex, Surface> scene,
                                size_t octree_depth,
-                               Pad padding) {
+                               Pad padding,
+                               acceleration_structure acceleration =
+                                       acceleration_structure::voxels) {
     const auto aabb =
             padded(geo::compute_aabb(scene.get_vertices()), glm::vec3{padding});
-    return make_voxelised_scene_data(std::move(scene), octree_depth, aabb);
+    return make_voxelised_scene_data(
+            std::move(scene), octree_depth, aabb, acceleration);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -82,6 +151,14 @@ std::experimental::optional<intersection> intersects(
         const voxelised_scene_data<Vertex, Surface>& voxelised,
         const geo::ray& ray,
         size_t to_ignore = ~size_t{0}) {
+    if (const auto& hierarchy = voxelised.get_bvh()) {
+        return intersects(*hierarchy,
+                          voxelised.get_scene_data().get_triangles().data(),
+                          voxelised.get_scene_data().get_vertices().data(),
+                          ray,
+                          to_ignore);
+    }
+
     std::experimental::optional<intersection> state;
     traverse(voxelised.get_voxels(),
              ray,
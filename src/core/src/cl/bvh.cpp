@@ -0,0 +1,158 @@
+#include "core/cl/bvh.h"
+
+namespace wayverb {
+namespace core {
+namespace cl_sources {
+const char* bvh = R"(
+//  The host-side builder limits the depth of the tree, so the traversal stack
+//  can never overflow.
+#define BVH_STACK_SIZE 64
+
+//  Returns the distance along the ray at which it enters the node, or INFINITY
+//  if the ray misses the node or only hits it beyond max_t.
+float bvh_node_entry(const global bvh_node* node,
+                     ray r,
+                     float3 inv_direction,
+                     float max_t);
+float bvh_node_entry(const global bvh_node* node,
+                     ray r,
+                     float3 inv_direction,
+                     float max_t) {
+    const float3 bounds_min = (float3)(
+            node->bounds_min[0], node->bounds_min[1], node->bounds_min[2]);
+    const float3 bounds_max = (float3)(
+            node->bounds_max[0], node->bounds_max[1], node->bounds_max[2]);
+
+    const float3 t0 = (bounds_min - r.position) * inv_direction;
+    const float3 t1 = (bounds_max - r.position) * inv_direction;
+
+    //  fmin and fmax ignore the NaNs produced by axis-aligned rays which
+    //  start on a slab boundary.
+    const float3 near = fmin(t0, t1);
+    const float3 far = fmax(t0, t1);
+
+    const float t_enter = fmax(fmax(near.x, near.y), fmax(near.z, 0.0f));
+    const float t_exit = fmin(fmin(far.x, far.y), fmin(far.z, max_t));
+
+    return t_enter <= t_exit ? t_enter : INFINITY;
+}
+
+intersection bvh_traversal(ray r,
+                           const global bvh_node* nodes,
+                           const global uint* triangle_indices,
+                           const global triangle* triangles,
+                           const global float3* vertices,
+                           uint avoid_intersecting_with);
+intersection bvh_traversal(ray r,
+                           const global bvh_node* nodes,
+                           const global uint* triangle_indices,
+                           const global triangle* triangles,
+                           const global float3* vertices,
+                           uint avoid_intersecting_with) {
+    intersection ret = {};
+    float max_t = INFINITY;
+
+    const float3 inv_direction = 1 / r.direction;
+
+    if (bvh_node_entry(nodes, r, inv_direction, max_t) == INFINITY) {
+        return ret;
+    }
+
+    uint stack[BVH_STACK_SIZE];
+    float stack_entry[BVH_STACK_SIZE];
+    uint stack_size = 0;
+
+    uint node_index = 0;
+    for (;;) {
+        const global bvh_node* node = nodes + node_index;
+
+        if (node->count) {
+            const intersection i =
+                    ray_triangle_group_intersection(r,
+                                                    triangles,
+                                                    triangle_indices +
+                                                            node->offset,
+                                                    node->count,
+                                                    vertices,
+                                                    avoid_intersecting_with);
+            if (i.inter.t && i.inter.t < max_t) {
+                ret = i;
+                max_t = i.inter.t;
+            }
+        } else {
+            //  Visit the nearer child first, so that max_t shrinks as
+            //  quickly as possible.
+            uint near = node_index + 1;
+            uint far = node->offset;
+            float t_near =
+                    bvh_node_entry(nodes + near, r, inv_direction, max_t);
+            float t_far =
+                    bvh_node_entry(nodes + far, r, inv_direction, max_t);
+            if (t_far < t_near) {
+                const uint tmp = near;
+                near = far;
+                far = tmp;
+                const float tmp_t = t_near;
+                t_near = t_far;
+                t_far = tmp_t;
+            }
+
+            if (t_near != INFINITY) {
+                if (t_far != INFINITY) {
+                    stack[stack_size] = far;
+                    stack_entry[stack_size] = t_far;
+                    stack_size += 1;
+                }
+                node_index = near;
+                continue;
+            }
+        }
+
+        //  Pop nodes until finding one which might still hold a closer hit.
+        for (;;) {
+            if (!stack_size) {
+                return ret;
+            }
+            stack_size -= 1;
+            if (stack_entry[stack_size] <= max_t) {
+                node_index = stack[stack_size];
+                break;
+            }
+        }
+    }
+}
+
+bool bvh_point_intersection(float3 begin,
+                            float3 point,
+                            const global bvh_node* nodes,
+                            const global uint* triangle_indices,
+                            const global triangle* triangles,
+                            const global float3* vertices,
+                            uint avoid_intersecting_with);
+bool bvh_point_intersection(float3 begin,
+                            float3 point,
+                            const global bvh_node* nodes,
+                            const global uint* triangle_indices,
+                            const global triangle* triangles,
+                            const global float3* vertices,
+                            uint avoid_intersecting_with) {
+    const float3 begin_to_point = point - begin;
+    const float mag = length(begin_to_point);
+    const float3 direction = normalize(begin_to_point);
+
+    const ray to_point = {begin, direction};
+
+    const intersection inter = bvh_traversal(to_point,
+                                             nodes,
+                                             triangle_indices,
+                                             triangles,
+                                             vertices,
+                                             avoid_intersecting_with);
+
+    return !inter.inter.t || mag < inter.inter.t;
+}
+)";
+
+}  // namespace cl_sources
+}  // namespace core
+}  // namespace wayverb
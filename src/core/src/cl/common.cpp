@@ -29,20 +29,22 @@ cl::Context get_context(device_type type) {
 cl::Device get_device(const cl::Context& context) {
     auto devices = context.getInfo<CL_CONTEXT_DEVICES>();
 
-    devices.erase(
-            std::remove_if(
-                    begin(devices),
-                    end(devices),
-                    [](const cl::Device& i) {
-                        return i.getInfo<
-                                       CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE>() ==
-                               0u;
-                    }),
-            devices.end());
-
-    if (devices.empty()) {
-        throw std::runtime_error(
-                "No available OpenCL devices support double precision.");
+    if (requires_double_precision) {
+        devices.erase(
+                std::remove_if(
+                        begin(devices),
+                        end(devices),
+                        [](const cl::Device& i) {
+                            return i.getInfo<
+                                           CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE>() ==
+                                   0u;
+                        }),
+                devices.end());
+
+        if (devices.empty()) {
+            throw std::runtime_error(
+                    "No available OpenCL devices support double precision.");
+        }
     }
 
     devices.erase(remove_if(begin(devices),
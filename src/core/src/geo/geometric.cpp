@@ -114,7 +114,7 @@ template std::experimental::optional<intersection> intersection_accumulator<
 template <typename T>
 std::experimental::optional<intersection> ray_triangle_intersection(
         const ray& ray,
-        const size_t* triangle_indices,
+        const cl_uint* triangle_indices,
         size_t num_triangle_indices,
         const triangle* triangles,
         const T* vertices,
@@ -131,7 +131,7 @@ std::experimental::optional<intersection> ray_triangle_intersection(
 
 template std::experimental::optional<intersection>
 ray_triangle_intersection<glm::vec3>(const ray& ray,
-                                     const size_t* triangle_indices,
+                                     const cl_uint* triangle_indices,
                                      size_t num_triangle_indices,
                                      const triangle* triangles,
                                      const glm::vec3* vertices,
@@ -139,7 +139,7 @@ ray_triangle_intersection<glm::vec3>(const ray& ray,
 
 template std::experimental::optional<intersection>
 ray_triangle_intersection<cl_float3>(const ray& ray,
-                                     const size_t* triangle_indices,
+                                     const cl_uint* triangle_indices,
                                      size_t num_triangle_indices,
                                      const triangle* triangles,
                                      const cl_float3* vertices,
@@ -1,9 +1,231 @@
 #include "core/program_wrapper.h"
 
+#include "utilities/cache_file.h"
+#include "utilities/fnv1a.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <experimental/optional>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <tuple>
 
 namespace wayverb {
 namespace core {
+namespace {
+
+constexpr auto build_options = "-Werror";
+
+uint64_t compute_source_hash(
+        const std::vector<std::pair<const char*, size_t>>& sources) {
+    util::fnv1a hash;
+    for (const auto& source : sources) {
+        hash.update(source.first, source.second);
+        hash.update("", 1);
+    }
+    return hash.get();
+}
+
+using cache_key = std::tuple<cl_context, cl_device_id, uint64_t, std::string>;
+
+struct program_cache final {
+    std::mutex mutex;
+    std::map<cache_key, cl::Program> programs;
+    //  Binaries are handed straight to the driver, so by default they're
+    //  kept where nobody else can plant them.
+    std::string directory = [] {
+        if (const auto dir = std::getenv("WAYVERB_PROGRAM_CACHE_DIR")) {
+            return std::string{dir};
+        }
+        return util::user_cache_directory("programs");
+    }();
+
+    std::atomic<size_t> memory_hits{0};
+    std::atomic<size_t> disk_hits{0};
+    std::atomic<size_t> misses{0};
+};
+
+program_cache& get_cache() {
+    static program_cache cache;
+    return cache;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// Binaries are only valid for one particular device and driver, so these
+/// must be part of the file name.
+std::string binary_path(const std::string& directory,
+                        const cl::Device& device,
+                        uint64_t source_hash) {
+    util::fnv1a hash;
+    hash.update(device.getInfo<CL_DEVICE_NAME>());
+    hash.update(device.getInfo<CL_DEVICE_VERSION>());
+    hash.update(device.getInfo<CL_DRIVER_VERSION>());
+    hash.update(build_options);
+    hash.update_value(source_hash);
+
+    std::ostringstream ss;
+    ss << directory << "/wayverb_" << std::hex << std::setfill('0')
+       << std::setw(16) << hash.get() << ".clbin";
+    return ss.str();
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream file{path, std::ios::binary};
+    if (!file) {
+        return {};
+    }
+    std::ostringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+void write_file(const std::string& path, const std::string& contents) {
+    util::write_file_atomically(path, [&](std::ostream& file) {
+        return static_cast<bool>(
+                file.write(contents.data(), contents.size()));
+    });
+}
+
+std::string get_program_binary(const cl::Program& program,
+                               const cl::Device& device) {
+    const auto devices = program.getInfo<CL_PROGRAM_DEVICES>();
+    const auto sizes = program.getInfo<CL_PROGRAM_BINARY_SIZES>();
+
+    std::vector<std::string> binaries;
+    std::vector<char*> pointers;
+    binaries.reserve(sizes.size());
+    pointers.reserve(sizes.size());
+    for (const auto size : sizes) {
+        binaries.emplace_back(size, '\0');
+        pointers.emplace_back(size ? &binaries.back()[0] : nullptr);
+    }
+
+    if (clGetProgramInfo(program(),
+                         CL_PROGRAM_BINARIES,
+                         pointers.size() * sizeof(char*),
+                         pointers.data(),
+                         nullptr) != CL_SUCCESS) {
+        return {};
+    }
+
+    for (auto i = 0u; i != devices.size(); ++i) {
+        if (devices[i]() == device()) {
+            return binaries[i];
+        }
+    }
+    return {};
+}
+
+std::experimental::optional<cl::Program> load_program_binary(
+        const cl::Context& context,
+        const cl::Device& device,
+        const std::string& binary) {
+    if (binary.empty()) {
+        return std::experimental::nullopt;
+    }
+    try {
+        cl::Program program{
+                context,
+                std::vector<cl::Device>{device},
+                cl::Program::Binaries{
+                        std::make_pair(binary.data(), binary.size())}};
+        program.build({device}, build_options);
+        return program;
+    } catch (const cl::Error&) {
+        //  The binary is stale or corrupt, so fall back to the source.
+        return std::experimental::nullopt;
+    }
+}
+
+cl::Program build_program(
+        const compute_context& cc,
+        const std::vector<std::pair<const char*, size_t>>& sources) {
+    auto& cache = get_cache();
+    const auto source_hash = compute_source_hash(sources);
+    const cache_key key{cc.context(), cc.device(), source_hash, build_options};
+
+    std::string directory;
+    {
+        std::lock_guard<std::mutex> lck{cache.mutex};
+        const auto it = cache.programs.find(key);
+        if (it != cache.programs.end()) {
+            cache.memory_hits += 1;
+            return it->second;
+        }
+        directory = cache.directory;
+    }
+
+    //  Building may take a long time, so the cache isn't locked here.
+    //  If two threads race to build the same program, the first one to
+    //  finish wins and the other result is discarded.
+    const auto path = directory.empty()
+                              ? std::string{}
+                              : binary_path(directory, cc.device, source_hash);
+
+    const auto program = [&] {
+        if (!path.empty()) {
+            if (auto ret = load_program_binary(
+                        cc.context, cc.device, read_file(path))) {
+                cache.disk_hits += 1;
+                return *ret;
+            }
+        }
+
+        cl::Program ret{cc.context, sources};
+        ret.build({cc.device}, build_options);
+        cache.misses += 1;
+
+        if (!path.empty()) {
+            write_file(path, get_program_binary(ret, cc.device));
+        }
+        return ret;
+    }();
+
+    std::lock_guard<std::mutex> lck{cache.mutex};
+    return cache.programs.emplace(key, program).first->second;
+}
+
+}  // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+
+program_cache_statistics get_program_cache_statistics() {
+    const auto& cache = get_cache();
+    return {cache.memory_hits, cache.disk_hits, cache.misses};
+}
+
+void reset_program_cache_statistics() {
+    auto& cache = get_cache();
+    cache.memory_hits = 0;
+    cache.disk_hits = 0;
+    cache.misses = 0;
+}
+
+void clear_program_cache() {
+    auto& cache = get_cache();
+    std::lock_guard<std::mutex> lck{cache.mutex};
+    cache.programs.clear();
+}
+
+void set_program_binary_cache_directory(const std::string& directory) {
+    auto& cache = get_cache();
+    std::lock_guard<std::mutex> lck{cache.mutex};
+    cache.directory = directory;
+}
+
+std::string get_program_binary_cache_directory() {
+    auto& cache = get_cache();
+    std::lock_guard<std::mutex> lck{cache.mutex};
+    return cache.directory;
+}
+
+////////////////////////////////////////////////////////////////////////////////
 
 program_wrapper::program_wrapper(const compute_context& cc,
                                  const std::string& source)
@@ -29,13 +251,7 @@ program_wrapper::program_wrapper(
         const compute_context& cc,
         const std::vector<std::pair<const char*, size_t>>& sources)
         : device(cc.device)
-        , program(cc.context, sources) {
-    build(device);
-}
-
-void program_wrapper::build(const cl::Device& device) const {
-    program.build({device}, "-Werror");
-}
+        , program(build_program(cc, sources)) {}
 
 cl::Device program_wrapper::get_device() const { return device; }
 
@@ -0,0 +1,375 @@
+#include "core/spatial_division/bvh.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace wayverb {
+namespace core {
+
+namespace {
+
+/// Below this depth nodes are split using the surface area heuristic.
+/// Deeper nodes are split at the median, which halves the number of
+/// triangles at each level, so the tree can never exceed bvh::max_depth.
+constexpr size_t max_sah_depth = 32;
+
+constexpr size_t num_bins = 16;
+
+/// The cost of visiting a node, relative to one ray-triangle test.
+constexpr float traversal_cost = 1;
+
+struct bounds final {
+    glm::vec3 min{std::numeric_limits<float>::infinity()};
+    glm::vec3 max{-std::numeric_limits<float>::infinity()};
+
+    void grow(const glm::vec3& v) {
+        min = glm::min(min, v);
+        max = glm::max(max, v);
+    }
+
+    void grow(const bounds& b) {
+        min = glm::min(min, b.min);
+        max = glm::max(max, b.max);
+    }
+
+    float area() const {
+        const auto d = glm::max(max - min, glm::vec3{0});
+        return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+};
+
+struct primitive final {
+    bounds aabb;
+    glm::vec3 centroid;
+    cl_uint index;
+};
+
+struct build_state final {
+    util::aligned::vector<primitive> primitives;
+    size_t max_leaf_size;
+    util::aligned::vector<bvh_node> nodes;
+    util::aligned::vector<cl_uint> triangle_indices;
+};
+
+bvh_node make_node(const bounds& b, cl_uint offset, cl_uint count) {
+    return bvh_node{{b.min.x, b.min.y, b.min.z},
+                    offset,
+                    {b.max.x, b.max.y, b.max.z},
+                    count};
+}
+
+struct split final {
+    float cost;
+    size_t axis;
+    size_t bin;
+};
+
+size_t get_bin(const glm::vec3& centroid,
+               const bounds& centroid_bounds,
+               size_t axis) {
+    const auto extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+    const auto bin = static_cast<size_t>(
+            (centroid[axis] - centroid_bounds.min[axis]) * num_bins / extent);
+    return std::min(bin, num_bins - 1);
+}
+
+/// Evaluates the surface area heuristic at the boundaries between evenly
+/// spaced bins along each axis, and returns the cheapest split.
+std::experimental::optional<split> find_sah_split(
+        const primitive* b,
+        const primitive* e,
+        const bounds& node_bounds,
+        const bounds& centroid_bounds) {
+    const auto parent_area = node_bounds.area();
+    if (parent_area <= 0) {
+        return std::experimental::nullopt;
+    }
+
+    std::experimental::optional<split> ret;
+    for (auto axis = 0u; axis != 3; ++axis) {
+        if (centroid_bounds.max[axis] <= centroid_bounds.min[axis]) {
+            continue;
+        }
+
+        std::array<bounds, num_bins> bin_bounds{};
+        std::array<size_t, num_bins> bin_counts{};
+        for (auto it = b; it != e; ++it) {
+            const auto bin = get_bin(it->centroid, centroid_bounds, axis);
+            bin_bounds[bin].grow(it->aabb);
+            bin_counts[bin] += 1;
+        }
+
+        //  Sweep from the right to find the cost of each right-hand side.
+        std::array<float, num_bins> right_cost{};
+        bounds right;
+        size_t right_count = 0;
+        for (auto i = num_bins - 1; i != 0; --i) {
+            right.grow(bin_bounds[i]);
+            right_count += bin_counts[i];
+            right_cost[i] = right.area() * right_count;
+        }
+
+        //  Then sweep from the left, combining with the right-hand costs.
+        bounds left;
+        size_t left_count = 0;
+        for (auto i = 0u; i != num_bins - 1; ++i) {
+            left.grow(bin_bounds[i]);
+            left_count += bin_counts[i];
+            if (!left_count || left_count == static_cast<size_t>(e - b)) {
+                continue;
+            }
+            const auto cost =
+                    traversal_cost +
+                    (left.area() * left_count + right_cost[i + 1]) /
+                            parent_area;
+            if (!ret || cost < ret->cost) {
+                ret = split{cost, axis, i};
+            }
+        }
+    }
+    return ret;
+}
+
+void build(build_state& state,
+           size_t node_index,
+           size_t b,
+           size_t e,
+           size_t depth) {
+    const auto first = state.primitives.begin() + b;
+    const auto last = state.primitives.begin() + e;
+    const auto count = e - b;
+
+    bounds node_bounds;
+    bounds centroid_bounds;
+    for (auto it = first; it != last; ++it) {
+        node_bounds.grow(it->aabb);
+        centroid_bounds.grow(it->centroid);
+    }
+
+    const auto make_leaf = [&] {
+        state.nodes[node_index] =
+                make_node(node_bounds,
+                          static_cast<cl_uint>(state.triangle_indices.size()),
+                          static_cast<cl_uint>(count));
+        for (auto it = first; it != last; ++it) {
+            state.triangle_indices.emplace_back(it->index);
+        }
+    };
+
+    if (count <= 1 || bvh::max_depth <= depth + 1) {
+        make_leaf();
+        return;
+    }
+
+    auto mid = first;
+    if (depth < max_sah_depth) {
+        const auto best = find_sah_split(
+                &*first, &*first + count, node_bounds, centroid_bounds);
+        if (count <= state.max_leaf_size && (!best || count <= best->cost)) {
+            make_leaf();
+            return;
+        }
+        if (best) {
+            mid = std::partition(first, last, [&](const auto& i) {
+                return get_bin(i.centroid, centroid_bounds, best->axis) <=
+                       best->bin;
+            });
+        }
+    }
+
+    if (mid == first || mid == last) {
+        //  Split at the median along the longest axis.
+        const auto extent = centroid_bounds.max - centroid_bounds.min;
+        const auto axis = extent.x < extent.y ? (extent.y < extent.z ? 2 : 1)
+                                              : (extent.x < extent.z ? 2 : 0);
+        if (extent[axis] <= 0) {
+            //  Every centroid is in the same place, so nothing can be gained
+            //  by splitting.
+            make_leaf();
+            return;
+        }
+        mid = first + count / 2;
+        std::nth_element(first, mid, last, [&](const auto& i, const auto& j) {
+            return i.centroid[axis] < j.centroid[axis];
+        });
+    }
+
+    const auto split_index =
+            static_cast<size_t>(mid - state.primitives.begin());
+
+    //  The first child directly follows its parent.
+    const auto left = state.nodes.size();
+    state.nodes.emplace_back();
+    build(state, left, b, split_index, depth + 1);
+
+    const auto right = state.nodes.size();
+    state.nodes.emplace_back();
+    build(state, right, split_index, e, depth + 1);
+
+    state.nodes[node_index] =
+            make_node(node_bounds, static_cast<cl_uint>(right), 0);
+}
+
+float node_entry(const bvh_node& node,
+                 const glm::vec3& position,
+                 const glm::vec3& inv_direction,
+                 float max_t) {
+    auto t_enter = 0.0f;
+    auto t_exit = max_t;
+    for (auto i = 0; i != 3; ++i) {
+        const auto t0 = (node.bounds_min[i] - position[i]) * inv_direction[i];
+        const auto t1 = (node.bounds_max[i] - position[i]) * inv_direction[i];
+        //  fmin and fmax ignore the NaNs produced by axis-aligned rays which
+        //  start on a slab boundary.
+        t_enter = std::fmax(t_enter, std::fmin(t0, t1));
+        t_exit = std::fmin(t_exit, std::fmax(t0, t1));
+    }
+    return t_enter <= t_exit ? t_enter
+                             : std::numeric_limits<float>::infinity();
+}
+
+}  // namespace
+
+constexpr size_t bvh::max_depth;
+
+bvh::bvh(const util::aligned::vector<triangle>& triangles,
+         const util::aligned::vector<glm::vec3>& vertices,
+         size_t max_leaf_size) {
+    if (triangles.empty()) {
+        return;
+    }
+
+    build_state state{
+            util::aligned::vector<primitive>{},
+            std::max(max_leaf_size, size_t{1}),
+            util::aligned::vector<bvh_node>{},
+            util::aligned::vector<cl_uint>{}};
+
+    state.primitives.reserve(triangles.size());
+    for (auto i = 0u; i != triangles.size(); ++i) {
+        const auto& tri = triangles[i];
+        bounds b;
+        b.grow(vertices[tri.v0]);
+        b.grow(vertices[tri.v1]);
+        b.grow(vertices[tri.v2]);
+        state.primitives.emplace_back(
+                primitive{b, (b.min + b.max) * 0.5f, static_cast<cl_uint>(i)});
+    }
+
+    state.nodes.reserve(2 * triangles.size());
+    state.triangle_indices.reserve(triangles.size());
+
+    state.nodes.emplace_back();
+    build(state, 0, 0, state.primitives.size(), 0);
+
+    nodes_ = std::move(state.nodes);
+    triangle_indices_ = std::move(state.triangle_indices);
+}
+
+const util::aligned::vector<bvh_node>& bvh::get_nodes() const {
+    return nodes_;
+}
+
+const util::aligned::vector<cl_uint>& bvh::get_triangle_indices() const {
+    return triangle_indices_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename Vertex>
+std::experimental::optional<intersection> intersects(
+        const bvh& hierarchy,
+        const triangle* triangles,
+        const Vertex* vertices,
+        const geo::ray& ray,
+        size_t to_ignore) {
+    constexpr auto inf = std::numeric_limits<float>::infinity();
+
+    std::experimental::optional<intersection> ret;
+
+    const auto& nodes = hierarchy.get_nodes();
+    const auto& indices = hierarchy.get_triangle_indices();
+    if (nodes.empty()) {
+        return ret;
+    }
+
+    const auto position = ray.get_position();
+    const auto inv_direction = 1.0f / ray.get_direction();
+    const auto max_t = [&] { return ret ? ret->inter.t : inf; };
+
+    if (node_entry(nodes.front(), position, inv_direction, max_t()) == inf) {
+        return ret;
+    }
+
+    std::array<std::pair<size_t, float>, bvh::max_depth> stack;
+    size_t stack_size = 0;
+
+    size_t node_index = 0;
+    for (;;) {
+        const auto& node = nodes[node_index];
+
+        if (node.count) {
+            for (auto i = node.offset; i != node.offset + node.count; ++i) {
+                ret = geo::intersection_accumulator(
+                        ray, indices[i], triangles, vertices, ret, to_ignore);
+            }
+        } else {
+            //  Visit the nearer child first, so that max_t shrinks as
+            //  quickly as possible.
+            auto near = std::make_pair(
+                    node_index + 1,
+                    node_entry(nodes[node_index + 1],
+                               position,
+                               inv_direction,
+                               max_t()));
+            auto far = std::make_pair(
+                    size_t{node.offset},
+                    node_entry(nodes[node.offset],
+                               position,
+                               inv_direction,
+                               max_t()));
+            if (far.second < near.second) {
+                std::swap(near, far);
+            }
+
+            if (near.second != inf) {
+                if (far.second != inf) {
+                    stack[stack_size++] = far;
+                }
+                node_index = near.first;
+                continue;
+            }
+        }
+
+        //  Pop nodes until finding one which might still hold a closer hit.
+        for (;;) {
+            if (!stack_size) {
+                return ret;
+            }
+            const auto next = stack[--stack_size];
+            if (next.second <= max_t()) {
+                node_index = next.first;
+                break;
+            }
+        }
+    }
+}
+
+template std::experimental::optional<intersection> intersects<glm::vec3>(
+        const bvh& hierarchy,
+        const triangle* triangles,
+        const glm::vec3* vertices,
+        const geo::ray& ray,
+        size_t to_ignore);
+
+template std::experimental::optional<intersection> intersects<cl_float3>(
+        const bvh& hierarchy,
+        const triangle* triangles,
+        const cl_float3* vertices,
+        const geo::ray& ray,
+        size_t to_ignore);
+
+}  // namespace core
+}  // namespace wayverb
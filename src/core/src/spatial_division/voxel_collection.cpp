@@ -1,39 +1,133 @@
 #include "core/spatial_division/voxel_collection.h"
 #include "core/cl/traits.h"
 #include "core/geo/geometric.h"
+#include "core/geo/triangle_vec.h"
 #include "core/scene_data.h"
 
+#include "utilities/work_stealing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <thread>
+#include <vector>
+
 namespace wayverb {
 namespace core {
 
-util::aligned::vector<cl_uint> get_flattened(
-        const voxel_collection<3>& voxels) {
-    using std::pow;
-
-    const auto side = voxels.get_side();
-    const auto dim = pow(side, 3);
+size_t compute_voxel_side(size_t num_triangles) {
+    //  Aim for a few voxels per triangle, which keeps the number of triangles
+    //  in each voxel small without wasting too many steps on empty space.
+    constexpr auto voxels_per_triangle = 4.0;
+    constexpr size_t min_side = 4;
+    constexpr size_t max_side = 128;
+    const auto side = static_cast<size_t>(
+            std::ceil(std::cbrt(voxels_per_triangle * num_triangles)));
+    return std::max(min_side, std::min(side, max_side));
+}
 
-    util::aligned::vector<cl_uint> ret(dim);
+voxel_collection<3> make_voxel_collection(
+        const util::aligned::vector<triangle>& triangles,
+        const util::aligned::vector<glm::vec3>& vertices,
+        const geo::box& aabb,
+        size_t side) {
+    side = std::max(side, size_t{1});
+    const auto num_voxels = side * side * side;
+    const auto dim = dimensions(aabb) / static_cast<float>(side);
+
+    //  This is a bit greedy - we're sacrificing some speed in the name of
+    //  correctness.
+    const glm::vec3 padding{0.001};
+
+    const auto to_index = [&](const glm::vec3& v) {
+        const glm::ivec3 ret{glm::floor((v - aabb.get_min()) / dim)};
+        return glm::clamp(
+                ret, glm::ivec3{0}, glm::ivec3{static_cast<int>(side - 1)});
+    };
 
-    const auto to_flat = [side](auto i) {
-        return i.x * side * side + i.y * side + i.z;
+    const auto to_flat = [side](const glm::ivec3& i) {
+        return static_cast<cl_uint>(i.x * side * side + i.y * side + i.z);
     };
 
-    for (auto x = 0u; x != side; ++x) {
-        for (auto y = 0u; y != side; ++y) {
-            for (auto z = 0u; z != side; ++z) {
-                const glm::ivec3 ind(x, y, z);
-                ret[to_flat(ind)] = ret.size();
-                const auto& v{voxels.get_voxel(ind)};
-                ret.emplace_back(v.size());
-                for (const auto& i : v) {
-                    ret.emplace_back(i);
+    //  Each chunk of triangles records (voxel, triangle) pairs of its own, so
+    //  that the tests can run in parallel without any locking.
+    constexpr size_t chunk_size = 1 << 10;
+    const auto num_chunks = (triangles.size() + chunk_size - 1) / chunk_size;
+    std::vector<util::aligned::vector<std::pair<cl_uint, cl_uint>>> hits(
+            num_chunks);
+
+    std::vector<size_t> chunks(num_chunks);
+    std::iota(chunks.begin(), chunks.end(), 0);
+
+    util::work_stealing_for_each(
+            std::move(chunks),
+            std::thread::hardware_concurrency(),
+            [&](auto /*worker*/, auto chunk, const auto& /*spawn*/) {
+                auto& output = hits[chunk];
+                const auto b = chunk * chunk_size;
+                const auto e = std::min(b + chunk_size, triangles.size());
+                for (auto t = b; t != e; ++t) {
+                    const auto tri = geo::get_triangle_vec3(triangles[t],
+                                                            vertices.data());
+                    const auto min = to_index(glm::min(
+                            glm::min(tri.s[0], tri.s[1]), tri.s[2]) - padding);
+                    const auto max = to_index(glm::max(
+                            glm::max(tri.s[0], tri.s[1]), tri.s[2]) + padding);
+
+                    for (auto x = min.x; x <= max.x; ++x) {
+                        for (auto y = min.y; y <= max.y; ++y) {
+                            for (auto z = min.z; z <= max.z; ++z) {
+                                const glm::ivec3 i{x, y, z};
+                                const auto root =
+                                        aabb.get_min() + dim * glm::vec3{i};
+                                if (geo::overlaps(
+                                            padded(geo::box{root, root + dim},
+                                                   padding),
+                                            tri)) {
+                                    output.emplace_back(
+                                            to_flat(i),
+                                            static_cast<cl_uint>(t));
+                                }
+                            }
+                        }
+                    }
                 }
-            }
+            });
+
+    //  Count the triangles in each voxel, and lay out the blocks.
+    util::aligned::vector<cl_uint> counts(num_voxels, 0);
+    for (const auto& chunk : hits) {
+        for (const auto& hit : chunk) {
+            counts[hit.first] += 1;
         }
     }
 
-    return ret;
+    util::aligned::vector<cl_uint> ret(num_voxels);
+    size_t total = num_voxels;
+    for (auto i = 0u; i != num_voxels; ++i) {
+        ret[i] = static_cast<cl_uint>(total);
+        total += counts[i] + 1;
+    }
+    ret.resize(total);
+
+    //  Chunks are visited in order, so each voxel's indices end up sorted.
+    util::aligned::vector<cl_uint> cursors(num_voxels);
+    for (auto i = 0u; i != num_voxels; ++i) {
+        ret[ret[i]] = counts[i];
+        cursors[i] = ret[i] + 1;
+    }
+    for (const auto& chunk : hits) {
+        for (const auto& hit : chunk) {
+            ret[cursors[hit.first]++] = hit.second;
+        }
+    }
+
+    return voxel_collection<3>{aabb, side, std::move(ret)};
+}
+
+const util::aligned::vector<cl_uint>& get_flattened(
+        const voxel_collection<3>& voxels) {
+    return voxels.get_flattened();
 }
 
 namespace {
@@ -108,7 +202,7 @@ void traverse(const voxel_collection<3>& voxels,
     for (;;) {
         const auto min_i = min_component(t_max);
 
-        const auto& tri{voxels.get_voxel(*ind)};
+        const auto tri = voxels.get_voxel(*ind);
         if (fun(ray, tri, prev_max, t_max[min_i])) {
             // callback has signalled that it should quit
             return;
@@ -0,0 +1,201 @@
+#include "core/azimuth_elevation.h"
+#include "core/cl/bvh.h"
+#include "core/cl/common.h"
+#include "core/cl/geometry.h"
+#include "core/conversions.h"
+#include "core/geo/box.h"
+#include "core/program_wrapper.h"
+#include "core/scene_data_loader.h"
+#include "core/spatial_division/bvh.h"
+#include "core/spatial_division/scene_buffers.h"
+#include "core/spatial_division/voxelised_scene_data.h"
+
+#include "utilities/map_to_vector.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+
+#ifndef OBJ_PATH
+#define OBJ_PATH ""
+#endif
+
+using namespace wayverb::core;
+
+namespace {
+
+auto get_test_scenes() {
+    return util::aligned::vector<scene_data_loader::scene_data>{
+            geo::get_scene_data(
+                    geo::box{glm::vec3(0, 0, 0), glm::vec3(4, 3, 6)},
+                    std::string{"default"}),
+            geo::get_scene_data(
+                    geo::box{glm::vec3(0, 0, 0), glm::vec3(3, 3, 3)},
+                    std::string{"default"}),
+            *scene_data_loader{OBJ_PATH}.get_scene_data()};
+}
+
+auto get_voxelised(const scene_data_loader::scene_data& scene) {
+    return make_voxelised_scene_data(
+            scene_with_extracted_surfaces(
+                    scene,
+                    util::aligned::unordered_map<std::string,
+                                                 surface<simulation_bands>>{}),
+            5,
+            0.1f,
+            acceleration_structure::bvh);
+}
+
+bool contains(const bvh_node& outer, const bvh_node& inner) {
+    for (auto i = 0; i != 3; ++i) {
+        if (inner.bounds_min[i] < outer.bounds_min[i] ||
+            outer.bounds_max[i] < inner.bounds_max[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void check_node(const bvh& b, size_t index, size_t depth) {
+    ASSERT_LT(depth, bvh::max_depth);
+    const auto& node = b.get_nodes()[index];
+    if (node.count) {
+        ASSERT_LE(node.offset + node.count, b.get_triangle_indices().size());
+        return;
+    }
+    const auto& nodes = b.get_nodes();
+    ASSERT_LT(node.offset, nodes.size());
+    ASSERT_TRUE(contains(node, nodes[index + 1]));
+    ASSERT_TRUE(contains(node, nodes[node.offset]));
+    check_node(b, index + 1, depth + 1);
+    check_node(b, node.offset, depth + 1);
+}
+
+}  // namespace
+
+TEST(bvh, structure) {
+    for (const auto& scene : get_test_scenes()) {
+        const auto voxelised = get_voxelised(scene);
+        const auto& b = *voxelised.get_bvh();
+
+        //  Every triangle must appear exactly once.
+        auto indices = b.get_triangle_indices();
+        std::sort(begin(indices), end(indices));
+        ASSERT_EQ(indices.size(),
+                  voxelised.get_scene_data().get_triangles().size());
+        for (auto i = 0u; i != indices.size(); ++i) {
+            ASSERT_EQ(indices[i], i);
+        }
+
+        check_node(b, 0, 0);
+    }
+}
+
+TEST(bvh, empty) {
+    const bvh b{util::aligned::vector<triangle>{},
+                util::aligned::vector<glm::vec3>{}};
+    ASSERT_TRUE(b.get_nodes().empty());
+    ASSERT_FALSE(intersects(b,
+                            static_cast<const triangle*>(nullptr),
+                            static_cast<const glm::vec3*>(nullptr),
+                            geo::ray{glm::vec3{0}, glm::vec3{0, 0, 1}}));
+}
+
+TEST(bvh, matches_brute_force) {
+    const glm::vec3 source{1, 2, 1};
+    for (const auto& scene : get_test_scenes()) {
+        const auto voxelised = get_voxelised(scene);
+        const auto& triangles = voxelised.get_scene_data().get_triangles();
+        const auto vertices = util::map_to_vector(
+                begin(voxelised.get_scene_data().get_vertices()),
+                end(voxelised.get_scene_data().get_vertices()),
+                to_vec3{});
+
+        for (const auto& direction : get_random_directions(1000)) {
+            const geo::ray ray{source, direction};
+            const auto fast = intersects(voxelised, ray);
+            const auto slow = geo::ray_triangle_intersection(
+                    ray, triangles.data(), triangles.size(), vertices.data());
+            ASSERT_EQ(static_cast<bool>(fast), static_cast<bool>(slow));
+            if (fast) {
+                ASSERT_EQ(fast->index, slow->index);
+            }
+        }
+    }
+}
+
+TEST(bvh, device_matches_host) {
+    const compute_context cc{};
+    const program_wrapper program{
+            cc,
+            std::vector<std::string>{
+                    cl_representation_v<bands_type>,
+                    cl_representation_v<surface<simulation_bands>>,
+                    cl_representation_v<triangle>,
+                    cl_representation_v<triangle_verts>,
+                    cl_representation_v<ray>,
+                    cl_representation_v<triangle_inter>,
+                    cl_representation_v<intersection>,
+                    cl_representation_v<bvh_node>,
+                    cl_sources::geometry,
+                    cl_sources::bvh,
+                    R"(
+kernel void bvh_test(const global ray* rays,
+                     const global bvh_node* nodes,
+                     const global uint* triangle_indices,
+                     const global triangle* triangles,
+                     const global float3* vertices,
+                     global intersection* ret) {
+    const size_t thread = get_global_id(0);
+    ret[thread] = bvh_traversal(rays[thread],
+                                nodes,
+                                triangle_indices,
+                                triangles,
+                                vertices,
+                                ~(uint)0);
+}
+)"}};
+    auto kernel = program.get_kernel<cl::Buffer,
+                                     cl::Buffer,
+                                     cl::Buffer,
+                                     cl::Buffer,
+                                     cl::Buffer,
+                                     cl::Buffer>("bvh_test");
+
+    cl::CommandQueue queue{cc.context, cc.device};
+
+    const glm::vec3 source{1, 2, 1};
+    for (const auto& scene : get_test_scenes()) {
+        const auto voxelised = get_voxelised(scene);
+        const auto buffers = make_scene_buffers(cc.context, voxelised);
+
+        const auto directions = get_random_directions(1000);
+        const auto rays = util::map_to_vector(
+                begin(directions), end(directions), [&](const auto& i) {
+                    return convert(geo::ray{source, i});
+                });
+        const auto ray_buffer = load_to_buffer(cc.context, rays, true);
+        cl::Buffer results{cc.context,
+                           CL_MEM_READ_WRITE,
+                           rays.size() * sizeof(intersection)};
+
+        kernel(cl::EnqueueArgs(queue, cl::NDRange(rays.size())),
+               ray_buffer,
+               buffers.get_bvh_nodes_buffer(),
+               buffers.get_bvh_triangle_indices_buffer(),
+               buffers.get_triangles_buffer(),
+               buffers.get_vertices_buffer(),
+               results);
+
+        const auto device = read_from_buffer<intersection>(queue, results);
+
+        for (auto i = 0u; i != rays.size(); ++i) {
+            const auto host = intersects(voxelised, convert(rays[i]));
+            ASSERT_EQ(static_cast<bool>(device[i].inter.t),
+                      static_cast<bool>(host));
+            if (host) {
+                ASSERT_EQ(device[i].index, host->index);
+            }
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#include "core/program_wrapper.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::core;
+
+namespace {
+constexpr auto source = R"(
+kernel void add_one(global float* data) {
+    const size_t thread = get_global_id(0);
+    data[thread] += 1;
+}
+)";
+}  // namespace
+
+TEST(program_wrapper, cache_hits) {
+    const compute_context cc{};
+
+    clear_program_cache();
+    reset_program_cache_statistics();
+
+    const program_wrapper first{cc, source};
+    const auto after_first = get_program_cache_statistics();
+    ASSERT_EQ(after_first.memory_hits, 0);
+    ASSERT_EQ(after_first.disk_hits + after_first.misses, 1);
+
+    const program_wrapper second{cc, source};
+    const auto after_second = get_program_cache_statistics();
+    ASSERT_EQ(after_second.memory_hits, 1);
+    ASSERT_EQ(after_second.disk_hits, after_first.disk_hits);
+    ASSERT_EQ(after_second.misses, after_first.misses);
+
+    //  With the in-memory cache gone, the binary should come from disk.
+    if (!get_program_binary_cache_directory().empty()) {
+        clear_program_cache();
+        const program_wrapper third{cc, source};
+        ASSERT_EQ(get_program_cache_statistics().disk_hits,
+                  after_second.disk_hits + 1);
+    }
+
+    cl::CommandQueue queue{cc.context, cc.device};
+    auto buffer = load_to_buffer(
+            cc.context, util::aligned::vector<cl_float>(16, 1), false);
+    second.get_kernel<cl::Buffer>("add_one")(
+            cl::EnqueueArgs{queue, cl::NDRange{16}}, buffer);
+    for (const auto& i : read_from_buffer<cl_float>(queue, buffer)) {
+        ASSERT_EQ(i, 2);
+    }
+}
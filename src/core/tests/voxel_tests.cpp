@@ -1,6 +1,7 @@
 #include "core/azimuth_elevation.h"
 #include "core/cl/common.h"
 #include "core/conversions.h"
+#include "core/geo/triangle_vec.h"
 #include "core/scene_data_loader.h"
 #include "core/spatial_division/scene_buffers.h"
 #include "core/spatial_division/voxel_collection.h"
@@ -60,6 +61,47 @@ TEST(voxel, flatten) {
     }
 }
 
+TEST(voxel, matches_brute_force) {
+    for (const auto& scene : get_test_scenes()) {
+        const auto& triangles = scene.get_triangles();
+        const auto vertices = util::map_to_vector(begin(scene.get_vertices()),
+                                                  end(scene.get_vertices()),
+                                                  to_vec3{});
+        const auto aabb = padded(geo::compute_aabb(vertices), glm::vec3{0.1});
+        const auto voxels = make_voxel_collection(triangles, vertices, aabb, 8);
+        ASSERT_EQ(voxels.get_side(), 8u);
+
+        for (auto x = 0u; x != 8; ++x) {
+            for (auto y = 0u; y != 8; ++y) {
+                for (auto z = 0u; z != 8; ++z) {
+                    const glm::uvec3 i{x, y, z};
+                    const auto box =
+                            padded(voxel_aabb(voxels, i), glm::vec3{0.001});
+                    util::aligned::vector<cl_uint> expected;
+                    for (auto t = 0u; t != triangles.size(); ++t) {
+                        if (geo::overlaps(box,
+                                          geo::get_triangle_vec3(
+                                                  triangles[t],
+                                                  vertices.data()))) {
+                            expected.emplace_back(t);
+                        }
+                    }
+                    const auto v = voxels.get_voxel(i);
+                    ASSERT_EQ(util::aligned::vector<cl_uint>(v.begin(),
+                                                             v.end()),
+                              expected);
+                }
+            }
+        }
+    }
+}
+
+TEST(voxel, side) {
+    ASSERT_EQ(compute_voxel_side(0), 4u);
+    ASSERT_EQ(compute_voxel_side(1 << 12), 26u);
+    ASSERT_EQ(compute_voxel_side(1 << 30), 128u);
+}
+
 TEST(voxel, surrounded) {
     const glm::vec3 source{1, 2, 1};
     for (const auto& scene : get_test_scenes()) {
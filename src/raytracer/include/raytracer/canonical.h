@@ -41,6 +41,15 @@ auto make_canonical_results(
     return canonical_results<Histogram>{std::move(aural), std::move(visual)};
 }
 
+/// Results for several receivers, which share a single set of rays.
+template <typename Histogram>
+struct multiple_canonical_results final {
+    util::aligned::vector<simulation_results<Histogram>> aural;
+    util::aligned::vector<util::aligned::vector<reflection>> visual;
+};
+
+/// Traces rays from the source once, and collects results at every receiver.
+/// aural holds one entry per receiver, in the same order as receivers.
 template <typename Callback>
 auto canonical(
         const core::compute_context& cc,
@@ -48,7 +57,7 @@ auto canonical(
                                          core::surface<core::simulation_bands>>&
                 scene,
         const glm::vec3& source,
-        const glm::vec3& receiver,
+        const util::aligned::vector<glm::vec3>& receivers,
         const core::environment& environment,
         const simulation_parameters& sim_params,
         size_t visual_items,
@@ -62,16 +71,60 @@ auto canonical(
             cc,
             scene,
             source,
-            receiver,
+            receivers,
             environment,
             keep_going,
             std::forward<Callback>(callback),
-            make_canonical_callbacks(sim_params, visual_items));
-    return tup ? std::experimental::make_optional(make_canonical_results(
-                         make_simulation_results(std::move(std::get<0>(*tup)),
-                                                 std::move(std::get<1>(*tup))),
-                         std::move(std::get<2>(*tup))))
-               : std::experimental::nullopt;
+            make_canonical_callbacks(sim_params, visual_items),
+            std::random_device{}(),
+            static_cast<float>(sim_params.roulette_threshold));
+
+    using histogram_type =
+            typename std::decay_t<decltype(std::get<1>(*tup))>::value_type;
+    using return_type = multiple_canonical_results<histogram_type>;
+
+    if (!tup) {
+        return std::experimental::optional<return_type>{};
+    }
+
+    auto& image_source = std::get<0>(*tup);
+    auto& stochastic = std::get<1>(*tup);
+
+    return_type ret{{}, std::move(std::get<2>(*tup))};
+    ret.aural.reserve(receivers.size());
+    for (auto i = 0u; i != receivers.size(); ++i) {
+        ret.aural.emplace_back(make_simulation_results(
+                std::move(image_source[i]), std::move(stochastic[i])));
+    }
+    return std::experimental::make_optional(std::move(ret));
+}
+
+template <typename Callback>
+auto canonical(
+        const core::compute_context& cc,
+        const core::voxelised_scene_data<cl_float3,
+                                         core::surface<core::simulation_bands>>&
+                scene,
+        const glm::vec3& source,
+        const glm::vec3& receiver,
+        const core::environment& environment,
+        const simulation_parameters& sim_params,
+        size_t visual_items,
+        const std::atomic_bool& keep_going,
+        Callback&& callback) {
+    auto results = canonical(cc,
+                             scene,
+                             source,
+                             util::aligned::vector<glm::vec3>{receiver},
+                             environment,
+                             sim_params,
+                             visual_items,
+                             keep_going,
+                             std::forward<Callback>(callback));
+    return results ? std::experimental::make_optional(make_canonical_results(
+                             std::move(results->aural.front()),
+                             std::move(results->visual)))
+                   : std::experimental::nullopt;
 }
 
 }  // namespace raytracer
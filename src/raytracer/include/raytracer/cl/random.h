@@ -0,0 +1,5 @@
+#pragma once
+
+namespace cl_sources {
+extern const char* random;
+}  // namespace cl_sources
@@ -12,15 +12,18 @@ struct alignas(1 << 4) reflection final {
     cl_uint triangle;     //  triangle which contains source
     cl_char keep_going;   //  whether or not this is the teriminator for this
                           //  path (like a \0 in a char*)
-    cl_char receiver_visible;  //  whether or not the receiver is visible from
-                               //  this point
+    cl_char receiver_visible;  //  whether or not any receiver is visible
+                               //  from this point
+    cl_float weight;  //  energy scale applied by russian roulette to the
+                      //  segment ending here, 1 if the ray wasn't tested
 };
 
 constexpr auto to_tuple(const reflection& x) {
     return std::tie(x.position,
                     x.triangle,
                     x.keep_going,
-                    x.receiver_visible);
+                    x.receiver_visible,
+                    x.weight);
 }
 
 constexpr bool operator==(const reflection& a, const reflection& b) {
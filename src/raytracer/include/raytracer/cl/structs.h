@@ -105,6 +105,7 @@ typedef struct {
     uint triangle;
     char keep_going;
     char receiver_visible;
+    float weight;
 } reflection;
 )";
 };
@@ -2,20 +2,26 @@
 
 #include "raytracer/cl/structs.h"
 #include "raytracer/image_source/tree.h"
+#include "raytracer/image_source/validation.h"
 
 #include "core/callback_accumulator.h"
 #include "core/spatial_division/voxelised_scene_data.h"
 
 #include "utilities/aligned/vector.h"
 
-#include <future>
-
 namespace wayverb {
 namespace raytracer {
 namespace image_source {
 
+/// Checks every path in the tree for validity, on all available cores.
+/// Branches are split into smaller units of work as they are traversed, so
+/// that a few very large branches don't hold everything up.
+///
+/// Each worker collects its own impulses, and these are concatenated at the
+/// end. Which worker finds which path depends on scheduling, so the order of
+/// the impulses is nondeterministic, although their contents are not.
 util::aligned::vector<impulse<core::simulation_bands>> postprocess_branches(
-        const multitree<path_element>& tree,
+        const tree& tree,
         const glm::vec3& source,
         const glm::vec3& receiver,
         const core::voxelised_scene_data<cl_float3,
@@ -23,36 +29,20 @@ util::aligned::vector<impulse<core::simulation_bands>> postprocess_branches(
                 voxelised,
         bool flip_phase);
 
-template <typename It>
-auto postprocess_branches(
-        It b_branches,
-        It e_branches,
+/// Checks the candidate paths on the device, leaving only the pressure
+/// calculation for the host.
+/// Gives the same results as postprocess_branches, for the candidates
+/// collected from the same tree.
+util::aligned::vector<impulse<core::simulation_bands>> postprocess_candidates(
+        path_validator& validator,
+        const core::scene_buffers& buffers,
+        const candidate_paths& candidates,
         const glm::vec3& source,
         const glm::vec3& receiver,
         const core::voxelised_scene_data<cl_float3,
                                          core::surface<core::simulation_bands>>&
                 voxelised,
-        bool flip_phase) {
-    auto futures = util::map_to_vector(
-            b_branches, e_branches, [&](const auto& branch) {
-                return std::async(std::launch::async, [&] {
-                    return postprocess_branches(
-                            branch, source, receiver, voxelised, flip_phase);
-                });
-            });
-
-    using value_type = decltype(
-            std::declval<typename decltype(futures)::value_type>().get());
-
-    //  Collect futures.
-    value_type ret;
-    for (auto& fut : futures) {
-        const auto thread_results = fut.get();
-        ret.insert(ret.end(), thread_results.begin(), thread_results.end());
-    }
-
-    return ret;
-}
+        bool flip_phase);
 
 }  // namespace image_source
 }  // namespace raytracer
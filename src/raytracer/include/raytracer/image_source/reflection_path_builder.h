@@ -1,33 +1,47 @@
 #pragma once
 
+#include "raytracer/cl/reflection.h"
 #include "raytracer/image_source/tree.h"
-#include "raytracer/iterative_builder.h"
+
+#include "utilities/aligned/vector.h"
 
 namespace wayverb {
 namespace raytracer {
 namespace image_source {
 
+/// Builds up the paths taken by a group of rays, one reflection at a time.
+///
+/// Each ray remembers the tree node it reached on the previous step, so a new
+/// reflection costs a single insertion, and paths never have to be stored
+/// separately.
+/// Rays are split into contiguous chunks, each with its own tree, so that
+/// chunks can be extended on separate threads without locking.
+/// The chunk trees are merged into the final tree at the end.
 class reflection_path_builder final {
 public:
-    reflection_path_builder(size_t rays)
-            : reflection_path_builder_{rays} {}
-
-    template <typename It>
-    void push(It b, It e) {
-        reflection_path_builder_.push(b, e, [](const reflection& i) {
-            return i.keep_going
-                           ? std::experimental::make_optional(path_element{
-                                     i.triangle,
-                                     static_cast<bool>(i.receiver_visible)})
-                           : std::experimental::nullopt;
-        });
-    }
-
-    const auto& get_data() const { return reflection_path_builder_.get_data(); }
-    auto& get_data() { return reflection_path_builder_.get_data(); }
+    /// Rays are only split up when there are at least this many per chunk.
+    static constexpr size_t min_rays_per_chunk = 1 << 12;
+
+    explicit reflection_path_builder(size_t rays);
+
+    /// Extends every path with the next reflection of its ray.
+    /// There must be exactly one reflection per ray.
+    void push(const util::aligned::vector<reflection>& reflections);
+
+    /// Adds every path found so far to ret.
+    void merge_into(tree& ret) const;
 
 private:
-    iterative_builder<path_element> reflection_path_builder_;
+    struct chunk final {
+        size_t begin;
+        size_t end;
+        tree paths;
+    };
+
+    util::aligned::vector<chunk> chunks_;
+
+    /// The node which each ray has reached.
+    util::aligned::vector<tree::node_index> cursors_;
 };
 
 }  // namespace image_source
@@ -31,7 +31,7 @@ auto run(
                                   cc,
                                   voxelised,
                                   source,
-                                  receiver,
+                                  util::aligned::vector<glm::vec3>{receiver},
                                   environment,
                                   true,
                                   [](auto /*i*/, auto /*steps*/) {},
@@ -41,7 +41,7 @@ auto run(
         throw std::runtime_error{"Raytracer failed to generate results."};
     }
 
-    return std::move(std::get<0>(*results));
+    return std::move(std::get<0>(*results).front());
 }
 
 }  // namespace image_source
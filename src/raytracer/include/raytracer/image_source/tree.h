@@ -1,7 +1,6 @@
 #pragma once
 
 #include "raytracer/image_source/fast_pressure_calculator.h"
-#include "raytracer/multitree.h"
 
 #include "core/cl/include.h"
 #include "core/geo/triangle_vec.h"
@@ -9,6 +8,8 @@
 
 #include "utilities/aligned/vector.h"
 
+#include <functional>
+
 namespace wayverb {
 namespace raytracer {
 namespace image_source {
@@ -32,20 +33,77 @@ constexpr bool operator!=(const path_element& a, const path_element& b) {
     return !(a == b);
 }
 
-/// Need this because we'll be storing path_elements in a set.
-constexpr bool operator<(const path_element& a, const path_element& b) {
-    return a.index < b.index;
-}
-
 ////////////////////////////////////////////////////////////////////////////////
 
+/// A trie of the paths found by the raytracer, where each node stands for a
+/// reflection from a single triangle.
+///
+/// Nodes live in a single flat array and refer to each other by index, so
+/// there's no allocation per node, and a tree can be copied or merged
+/// cheaply.
+/// Children are found through an open-addressed hash table keyed on
+/// (parent, triangle), so insertion takes constant time however many branches
+/// a node has.
+///
+/// A parent is always created before its children, so a node's index is
+/// always greater than its parent's.
 class tree final {
 public:
+    using node_index = cl_uint;
+
+    /// The root holds no item, and is the parent of the first reflection of
+    /// every path.
+    static constexpr node_index root = 0;
+    static constexpr node_index none = ~node_index{0};
+
+    tree();
+
+    /// Finds the child of parent which reflects from the same triangle as
+    /// item, creating it if necessary.
+    /// A node is visible if any of the paths through it were visible from
+    /// the receiver.
+    node_index insert(node_index parent, const path_element& item);
+
     void push(const util::aligned::vector<path_element>& path);
-    const multitree<path_element>::branches_type& get_branches() const;
+
+    /// Adds every path from other.
+    void merge(const tree& other);
+
+    /// The number of nodes, including the root.
+    size_t size() const;
+
+    const path_element& get_item(node_index node) const;
+    node_index get_parent(node_index node) const;
+
+    /// Finds an existing child of parent, or returns none.
+    node_index find(node_index parent, cl_uint triangle) const;
+
+    /// Calls callback with the index of each child of node.
+    template <typename Callback>
+    void for_each_child(node_index node, const Callback& callback) const {
+        for (auto i = nodes_[node].first_child; i != none;
+             i = nodes_[i].next_sibling) {
+            callback(i);
+        }
+    }
 
 private:
-    multitree<path_element> root_{path_element{}};
+    struct node final {
+        path_element item;
+        node_index parent;
+        node_index first_child;
+        node_index next_sibling;
+    };
+
+    size_t slot(node_index parent, cl_uint triangle) const;
+    void grow();
+
+    util::aligned::vector<node> nodes_;
+
+    /// Holds node indices, or none for empty slots.
+    /// The size is always a power of two, and at most half the slots are
+    /// used.
+    util::aligned::vector<node_index> slots_;
 };
 
 using postprocessor = std::function<void(
@@ -53,8 +111,27 @@ using postprocessor = std::function<void(
         util::aligned::vector<reflection_metadata>::const_iterator,
         util::aligned::vector<reflection_metadata>::const_iterator)>;
 
+/// Checks every path in the tree.
+void find_valid_paths(
+        const tree& tree,
+        const glm::vec3& source,
+        const glm::vec3& receiver,
+        const core::voxelised_scene_data<cl_float3,
+                                         core::surface<core::simulation_bands>>&
+                voxelised,
+        const postprocessor& callback);
+
+/// Like find_valid_paths, but for the subtree under a particular node.
+///
+/// prefix holds the items on the path from the top of the tree down to (but
+/// not including) node.
+/// If recurse is false, only node itself is checked, so that its children
+/// can be handed out separately.
 void find_valid_paths(
-        const multitree<path_element>& tree,
+        const tree& tree,
+        tree::node_index node,
+        const util::aligned::vector<path_element>& prefix,
+        bool recurse,
         const glm::vec3& source,
         const glm::vec3& receiver,
         const core::voxelised_scene_data<cl_float3,
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "raytracer/image_source/tree.h"
+
+#include "core/cl/common.h"
+#include "core/program_wrapper.h"
+#include "core/spatial_division/scene_buffers.h"
+
+#include "utilities/aligned/vector.h"
+
+namespace wayverb {
+namespace raytracer {
+namespace image_source {
+
+/// Candidate image-source paths, flattened so that they can be checked on
+/// the device.
+///
+/// Path i reflects from triangles[offsets[i]] up to (but not including)
+/// triangles[offsets[i + 1]], in order.
+/// image_sources holds the image source after each of those reflections, so
+/// the last one for each path is the image source of the path as a whole.
+struct candidate_paths final {
+    util::aligned::vector<cl_uint> offsets{0};
+    util::aligned::vector<cl_uint> triangles;
+    util::aligned::vector<cl_float3> image_sources;
+};
+
+inline size_t size(const candidate_paths& paths) {
+    return paths.offsets.size() - 1;
+}
+
+/// Finds the image source at every node in the tree which might be visible
+/// from a receiver.
+/// The image sources only depend on the source, so the same candidates can
+/// be checked against every receiver.
+candidate_paths collect_candidate_paths(
+        const tree& tree,
+        const glm::vec3& source,
+        const core::voxelised_scene_data<cl_float3,
+                                         core::surface<core::simulation_bands>>&
+                voxelised);
+
+/// Checks many candidate paths against the scene at once on the device.
+///
+/// This runs the same tests as find_valid_paths: for each image source,
+/// working back from the receiver, the path must pass through the correct
+/// triangle, and there must be line-of-sight from the source to the first
+/// reflection.
+class path_validator final {
+public:
+    /// Paths are uploaded and checked in batches of this size.
+    static constexpr size_t max_paths_per_batch = 1 << 16;
+
+    explicit path_validator(const core::compute_context& cc);
+
+    /// Calls callback for each valid path, in the order they appear in
+    /// paths.
+    /// As with find_valid_paths, the metadata for the reflection closest to
+    /// the receiver comes first.
+    void validate(const candidate_paths& paths,
+                  const core::scene_buffers& buffers,
+                  const glm::vec3& source,
+                  const glm::vec3& receiver,
+                  const postprocessor& callback);
+
+private:
+    auto get_kernel() const {
+        return program_wrapper_.get_kernel<cl::Buffer,  //  offsets
+                                           cl::Buffer,  //  path triangles
+                                           cl::Buffer,  //  image sources
+                                           cl_float3,   //  source
+                                           cl_float3,   //  receiver
+                                           cl::Buffer,  //  voxel_index
+                                           core::aabb,  //  global_aabb
+                                           cl_uint,     //  side
+                                           cl::Buffer,  //  bvh_nodes
+                                           cl::Buffer,  //  bvh_indices
+                                           cl_uint,     //  use_bvh
+                                           cl::Buffer,  //  triangles
+                                           cl::Buffer,  //  vertices
+                                           cl::Buffer,  //  valid
+                                           cl::Buffer   //  metadata
+                                           >("validate_image_source_paths");
+    }
+
+    core::compute_context cc_;
+    cl::CommandQueue queue_;
+    core::program_wrapper program_wrapper_;
+};
+
+}  // namespace image_source
+}  // namespace raytracer
+}  // namespace wayverb
@@ -14,15 +14,27 @@ public:
 
     auto get_kernel() const {
         return program_wrapper_.get_kernel<cl::Buffer,  //  ray
-                                           cl_float3,   //  receiver
+                                           cl::Buffer,  //  receivers
+                                           cl_uint,     //  num_receivers
                                            cl::Buffer,  //  voxel_index
                                            core::aabb,  //  global_aabb
                                            cl_uint,     //  side
+                                           cl::Buffer,  //  bvh_nodes
+                                           cl::Buffer,  //  bvh_indices
+                                           cl_uint,     //  use_bvh
                                            cl::Buffer,  //  triangles
                                            cl::Buffer,  //  vertices
                                            cl::Buffer,  //  surfaces
-                                           cl::Buffer,  //  rng
-                                           cl::Buffer   //  reflection
+                                           cl_uint,     //  seed
+                                           cl_uint,     //  first_ray
+                                           cl_uint,     //  bounce
+                                           cl::Buffer,  //  active
+                                           cl::Buffer,  //  next_active
+                                           cl::Buffer,  //  num_next_active
+                                           cl::Buffer,  //  throughput
+                                           cl_float,    //  roulette
+                                           cl::Buffer,  //  reflection
+                                           cl::Buffer   //  visibility
                                            >("reflections");
     }
 
@@ -17,9 +17,13 @@
 #include "raytracer/reflection_processor/visual.h"
 
 #include "utilities/apply.h"
+#include "utilities/for_each.h"
 #include "utilities/map.h"
 
+#include <algorithm>
+#include <deque>
 #include <experimental/optional>
+#include <future>
 #include <iostream>
 
 namespace wayverb {
@@ -71,6 +75,39 @@ void zip_apply(A&& a, B&& b) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/// Processors may provide a converged() method, to say that tracing more rays
+/// won't improve their results.
+/// Processors without one have no opinion.
+template <typename T>
+auto is_converged(const T& t, int)
+        -> decltype(std::experimental::make_optional(t.converged())) {
+    return std::experimental::make_optional(t.converged());
+}
+
+template <typename T>
+std::experimental::optional<bool> is_converged(const T&, long) {
+    return std::experimental::nullopt;
+}
+
+/// True if at least one processor has an opinion, and every processor with an
+/// opinion is happy to stop.
+template <typename Tuple>
+bool all_converged(const Tuple& processors) {
+    auto any_opinion = false;
+    auto all = true;
+    util::for_each(
+            [&](const auto& processor) {
+                if (const auto converged = is_converged(processor, 0)) {
+                    any_opinion = true;
+                    all = all && *converged;
+                }
+            },
+            processors);
+    return any_opinion && all;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 /// This could be WAY more generic but my deadline is rly soon so maybe another
 /// time.
 template <typename Engine>
@@ -185,6 +222,40 @@ constexpr auto make_random_direction_generator_iterator(
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/// Rays are traced in segments, and this many segments are traced at once.
+/// The device can then trace one segment while the host processes the
+/// reflections from another.
+constexpr size_t segments_in_flight = 2;
+
+/// Smaller segments make less efficient use of the device, but allow
+/// convergence to be checked more often.
+constexpr size_t min_rays_per_segment = 1 << 12;
+constexpr size_t max_rays_per_segment = 1 << 16;
+
+/// The device memory used by each ray in a segment, including the working
+/// buffers of the stochastic finder.
+constexpr size_t get_per_ray_size(size_t num_receivers) {
+    return reflector::get_per_ray_size(num_receivers) + sizeof(reflection) +
+           sizeof(stochastic_path_info) +
+           num_receivers * 2 * sizeof(impulse<core::simulation_bands>);
+}
+
+/// Chooses the number of rays in each segment, so that all of the segments
+/// in flight fit comfortably in the device's memory.
+size_t compute_rays_per_segment(const cl::Device& device,
+                                size_t num_receivers);
+
+/// Every ray is traced once, and all receivers are tested against each
+/// reflection, so the results of each callback are per-receiver where that
+/// makes sense.
+/// See reflector for the meaning of roulette_threshold.
+/// Tracing stops early, between segments, if the callbacks decide that their
+/// results are good enough (see all_converged).
+///
+/// Each segment has its own reflector and group processors, and so its own
+/// command queues.
+/// Segments are traced on worker threads, but their results are always
+/// accumulated in order, on the calling thread.
 template <typename It, typename PerStepCallback, typename Callbacks>
 auto run(
         It b_direction,
@@ -194,11 +265,13 @@ auto run(
                                          core::surface<core::simulation_bands>>&
                 voxelised,
         const glm::vec3& source,
-        const glm::vec3& receiver,
+        const util::aligned::vector<glm::vec3>& receivers,
         const core::environment& environment,
         const std::atomic_bool& keep_going,
         PerStepCallback&& per_step_callback,
-        Callbacks&& callbacks) {
+        Callbacks&& callbacks,
+        cl_uint seed = std::random_device{}(),
+        float roulette_threshold = 0) {
     const core::scene_buffers buffers{cc.context, voxelised};
 
     const auto make_ray_iterator = [&](auto it) {
@@ -211,58 +284,110 @@ auto run(
     auto processors = util::apply_each(
             util::map(make_get_processor_functor_adapter{},
                       std::forward<Callbacks>(callbacks)),
-            std::tie(cc, source, receiver, environment, voxelised));
+            std::tie(cc, source, receivers, environment, voxelised));
 
     using return_type = decltype(util::apply_each(
             util::map(make_get_results_functor_adapter{}, processors)));
 
-    constexpr auto segment_size = 1 << 14;
+    const auto rays_per_segment =
+            compute_rays_per_segment(cc.device, receivers.size());
     const auto reflection_depth =
             compute_optimum_reflection_number(voxelised.get_scene_data());
 
-    const auto run_segment = [&](auto b, auto e) {
+    //  The reflector and group processors are created here, so that
+    //  directions are drawn in order and the processors are only touched by
+    //  one thread at a time.
+    //  The worker only has to run the steps.
+    const auto start_segment = [&](auto b, auto e) {
         const auto num_directions = std::distance(b, e);
 
-        reflector ref{cc, receiver, make_ray_iterator(b), make_ray_iterator(e)};
+        reflector ref{cc,
+                      receivers,
+                      make_ray_iterator(b),
+                      make_ray_iterator(e),
+                      seed,
+                      static_cast<cl_uint>(std::distance(b_direction, b)),
+                      roulette_threshold};
 
         auto group_processors = util::apply_each(
                 util::map(make_get_group_processor_functor_adapter{},
                           processors),
                 std::make_tuple(num_directions));
 
-        for (auto i = 0ul; i != reflection_depth; ++i) {
-            const auto reflections = ref.run_step(buffers);
-            const auto b = begin(reflections);
-            const auto e = end(reflections);
-            util::call_each(
-                    util::map(make_process_functor_adapter{}, group_processors),
-                    std::tie(b, e, buffers, i, reflection_depth));
-        }
+        return std::async(
+                std::launch::async,
+                [&,
+                 ref = std::move(ref),
+                 group_processors = std::move(group_processors)]() mutable {
+                    //  Processors may still be reading the previous
+                    //  reflections on their own queues.
+                    std::vector<cl::Event> consumers;
+                    for (auto i = 0ul; i != reflection_depth && keep_going;
+                         ++i) {
+                        auto reflections =
+                                ref.run_step_on_device(buffers, consumers);
+                        util::call_each(
+                                util::map(make_process_functor_adapter{},
+                                          group_processors),
+                                std::tie(reflections,
+                                         buffers,
+                                         i,
+                                         reflection_depth));
+                        consumers = reflections.get_consumer_events();
+                    }
+                    return std::move(group_processors);
+                });
+    };
 
-        zip_apply(util::map(make_accumulate_functor_adapter{}, processors),
-                  group_processors);
+    const auto get_results = [&] {
+        return std::experimental::make_optional(util::apply_each(
+                util::map(make_get_results_functor_adapter{}, processors)));
     };
 
-    const auto groups = std::distance(b_direction, e_direction) / segment_size;
+    const auto total = std::distance(b_direction, e_direction);
+    const auto groups = (total + rays_per_segment - 1) / rays_per_segment;
+
+    //  If we return early, the destructors of any remaining futures will wait
+    //  for their segments to finish.
+    std::deque<decltype(start_segment(b_direction, e_direction))> in_flight;
 
     auto it = b_direction;
-    for (auto group = 0; it + segment_size <= e_direction;
-         it += segment_size, ++group) {
-        run_segment(it, it + segment_size);
+    for (auto group = 0;; ++group) {
+        //  Keep the pipeline full.
+        while (in_flight.size() != segments_in_flight && it != e_direction) {
+            const auto remaining = std::distance(it, e_direction);
+            const auto next =
+                    it + std::min<std::ptrdiff_t>(rays_per_segment, remaining);
+            in_flight.emplace_back(start_segment(it, next));
+            it = next;
+        }
+
+        if (in_flight.empty()) {
+            break;
+        }
+
+        auto group_processors = in_flight.front().get();
+        in_flight.pop_front();
+
+        if (!keep_going) {
+            return std::experimental::optional<return_type>{};
+        }
+
+        zip_apply(util::map(make_accumulate_functor_adapter{}, processors),
+                  group_processors);
 
         per_step_callback(group, groups);
 
         if (!keep_going) {
             return std::experimental::optional<return_type>{};
         }
-    }
 
-    if (it != e_direction) {
-        run_segment(it, e_direction);
+        if (all_converged(processors)) {
+            return get_results();
+        }
     }
 
-    return std::experimental::make_optional(util::apply_each(
-            util::map(make_get_results_functor_adapter{}, processors)));
+    return get_results();
 }
 
 }  // namespace raytracer
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "raytracer/cl/structs.h"
+
+#include "core/cl/include.h"
+
+#include "utilities/aligned/vector.h"
+
+#include <vector>
+
+namespace wayverb {
+namespace raytracer {
+
+/// The reflections produced by a single step of the reflector.
+/// These stay in device memory, so that device-side consumers (like the
+/// stochastic finder) can use them directly.
+/// Consumers which need the reflections on the host can ask for a copy, which
+/// is made at most once per step and then shared.
+class reflection_batch final {
+public:
+    reflection_batch(cl::CommandQueue& queue,
+                     const cl::Buffer& buffer,
+                     const cl::Buffer& visibility,
+                     size_t num_receivers,
+                     const cl::Event& ready,
+                     size_t size);
+
+    const cl::Buffer& get_buffer() const;
+
+    /// One cl_char per reflection and receiver, in [reflection][receiver]
+    /// order, which is set if that receiver is visible from the reflection.
+    const cl::Buffer& get_visibility_buffer() const;
+    size_t get_num_receivers() const;
+
+    /// Complete once the reflections have been written to the buffer.
+    /// Kernels on other queues should wait on this before reading.
+    const cl::Event& get_event() const;
+
+    /// Consumers which read the buffers from other queues should add an event
+    /// here, which completes once they have finished reading.
+    /// The reflector overwrites the buffers on its next step, so it must wait
+    /// on all of these first.
+    void add_consumer_event(const cl::Event& done);
+    const std::vector<cl::Event>& get_consumer_events() const;
+
+    size_t size() const;
+
+    /// Copies (at least) the first `items` reflections to the host.
+    const util::aligned::vector<reflection>& read(size_t items);
+
+    /// Copies all reflections to the host.
+    const util::aligned::vector<reflection>& read();
+
+private:
+    cl::CommandQueue* queue_;
+    cl::Buffer buffer_;
+    cl::Buffer visibility_;
+    size_t num_receivers_;
+    cl::Event ready_;
+    std::vector<cl::Event> consumers_;
+    size_t size_;
+
+    util::aligned::vector<reflection> host_;
+};
+
+}  // namespace raytracer
+}  // namespace wayverb
@@ -1,11 +1,14 @@
 #pragma once
 
 #include "raytracer/image_source/reflection_path_builder.h"
+#include "raytracer/reflection_batch.h"
 
 #include "core/cl/common.h"
 #include "core/environment.h"
 #include "core/spatial_division/scene_buffers.h"
 
+#include <experimental/optional>
+
 namespace wayverb {
 namespace raytracer {
 namespace reflection_processor {
@@ -14,23 +17,34 @@ class image_source_group_processor final {
 public:
     image_source_group_processor(size_t max_order, size_t items);
 
-    template <typename It>
-    void process(It b,
-                 It e,
-                 const core::scene_buffers& /*buffers*/,
+    void process(reflection_batch& reflections,
+                 const core::scene_buffers& buffers,
                  size_t step,
                  size_t /*total*/) {
+        //  Only the handles are copied, so this doesn't touch the device.
+        if (!buffers_) {
+            buffers_.emplace(buffers);
+        }
+
+        //  later reflections aren't needed, so don't copy them to the host
         if (step < max_image_source_order_) {
-            builder_.push(b, e);
+            builder_.push(reflections.read());
         }
     }
 
-    auto get_results() const { return builder_.get_data(); }
+    const auto& get_results() const { return builder_; }
+
+    /// The scene buffers used by the raytracer, if any steps have run.
+    const std::experimental::optional<core::scene_buffers>& get_buffers()
+            const {
+        return buffers_;
+    }
 
 private:
     size_t max_image_source_order_;
 
     raytracer::image_source::reflection_path_builder builder_;
+    std::experimental::optional<core::scene_buffers> buffers_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -38,8 +52,9 @@ private:
 class image_source_processor final {
 public:
     image_source_processor(
+            const core::compute_context& cc,
             const glm::vec3& source,
-            const glm::vec3& receiver,
+            const util::aligned::vector<glm::vec3>& receivers,
             const core::environment& environment,
             const core::voxelised_scene_data<
                     cl_float3,
@@ -50,11 +65,18 @@ public:
             size_t num_directions) const;
     void accumulate(const image_source_group_processor& processor);
 
-    util::aligned::vector<impulse<8>> get_results() const;
+    /// The reflection tree is shared between receivers, but each receiver's
+    /// paths are validated separately, in batches on the device.
+    /// Validation reuses the raytracer's scene buffers, rather than
+    /// uploading the scene again.
+    /// Returns one set of impulses per receiver.
+    util::aligned::vector<util::aligned::vector<impulse<8>>> get_results()
+            const;
 
 private:
+    core::compute_context cc_;
     glm::vec3 source_;
-    glm::vec3 receiver_;
+    util::aligned::vector<glm::vec3> receivers_;
     core::environment environment_;
     const core::voxelised_scene_data<cl_float3,
                                      core::surface<core::simulation_bands>>&
@@ -64,6 +86,7 @@ private:
     size_t max_order_;
 
     raytracer::image_source::tree tree_;
+    std::experimental::optional<core::scene_buffers> buffers_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -75,7 +98,7 @@ public:
     image_source_processor get_processor(
             const core::compute_context& cc,
             const glm::vec3& source,
-            const glm::vec3& receiver,
+            const util::aligned::vector<glm::vec3>& receivers,
             const core::environment& environment,
             const core::voxelised_scene_data<
                     cl_float3,
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "raytracer/histogram.h"
+#include "raytracer/reflection_batch.h"
 #include "raytracer/simulation_parameters.h"
+#include "raytracer/stochastic/convergence.h"
+#include "raytracer/stochastic/device_histogram.h"
 #include "raytracer/stochastic/finder.h"
 #include "raytracer/stochastic/postprocessing.h"
 
@@ -9,35 +12,15 @@
 #include "core/environment.h"
 #include "core/spatial_division/scene_buffers.h"
 
+#include "utilities/map_to_vector.h"
+
+#include <algorithm>
+
 namespace wayverb {
 
 namespace raytracer {
 namespace reflection_processor {
 
-template <typename T, typename U, typename Alloc>
-void energy_histogram_sum(const T& item,
-                          double sample_rate,
-                          std::vector<U, Alloc>& ret) {
-    ret[time(item) * sample_rate] += volume(item);
-}
-
-template <typename T, typename U, typename Alloc, size_t Az, size_t El>
-void energy_histogram_sum(
-        const T& item,
-        double sample_rate,
-        core::vector_look_up_table<std::vector<U, Alloc>, Az, El>& ret) {
-    using table = std::decay_t<decltype(ret)>;
-    ret.at(table::index(item.pointing))[time(item) * sample_rate] +=
-            volume(item);
-}
-
-struct energy_histogram_sum_functor final {
-    template <typename T, typename Ret>
-    void operator()(const T& item, double sample_rate, Ret& ret) const {
-        energy_histogram_sum(item, sample_rate, ret);
-    }
-};
-
 /// Where Histogram is probably a stochastic::energy_histogram or a
 /// stochastic::directional_energy_histogram.
 template <typename Histogram>
@@ -46,133 +29,231 @@ public:
     /// A max_image_source_order of 0 = direct energy from image-source
     /// An order of 1 = direct and one reflection from image-source
     /// i.e. the order == the number of reflections for each image
-    stochastic_group_processor(const core::compute_context& cc,
-                               const glm::vec3& source,
-                               const glm::vec3& receiver,
-                               const core::environment& environment,
-                               size_t total_rays,
-                               size_t max_image_source_order,
-                               float receiver_radius,
-                               float histogram_sample_rate,
-                               size_t group_items)
+    stochastic_group_processor(
+            const core::compute_context& cc,
+            const glm::vec3& source,
+            const util::aligned::vector<glm::vec3>& receivers,
+            const core::environment& environment,
+            size_t total_rays,
+            size_t max_image_source_order,
+            float receiver_radius,
+            float histogram_sample_rate,
+            float max_impulse_distance,
+            size_t group_items)
             : finder_(cc,
                       group_items,
                       source,
-                      receiver,
+                      receivers,
                       receiver_radius,
-                      stochastic::compute_ray_energy(
-                              total_rays, source, receiver, receiver_radius))
-            , receiver_{receiver}
-            , environment_{environment}
+                      util::map_to_vector(
+                              begin(receivers),
+                              end(receivers),
+                              [&](const auto& receiver) {
+                                  return stochastic::compute_ray_energy(
+                                          total_rays,
+                                          source,
+                                          receiver,
+                                          receiver_radius);
+                              }))
+            , histograms_{util::map_to_vector(
+                      begin(receivers),
+                      end(receivers),
+                      [&](const auto& receiver) {
+                          return stochastic::make_device_histogram<Histogram>(
+                                  cc,
+                                  finder_.get_queue(),
+                                  receiver,
+                                  environment.speed_of_sound,
+                                  histogram_sample_rate);
+                      })}
             , max_image_source_order_{max_image_source_order}
-            , histogram_{histogram_sample_rate} {}
+            , group_items_{group_items} {
+        //  The histograms are sized up front, so their size is known in
+        //  advance (see get_histogram_memory), and they never have to grow.
+        for (auto& histogram : histograms_) {
+            histogram.reserve(max_impulse_distance);
+        }
+    }
 
-    template <typename It>
-    void process(It b,
-                 It e,
+    void process(reflection_batch& reflections,
                  const core::scene_buffers& buffers,
                  size_t step,
                  size_t /*total*/) {
-        const auto output = finder_.process(b, e, buffers);
-
-        struct intermediate_impulse final {
-            core::bands_type volume;
-            double time;
-            glm::vec3 pointing;
-        };
-
-        const auto intermediate = [&] {
-            util::aligned::vector<intermediate_impulse> ret;
-            ret.reserve(output.stochastic.size() + output.specular.size());
-
-            const auto push_vector = [&](const auto& vec) {
-                for (const auto& impulse : vec) {
-                    ret.emplace_back(intermediate_impulse{
-                            impulse.volume,
-                            impulse.distance / environment_.speed_of_sound,
-                            glm::normalize(core::to_vec3{}(impulse.position) -
-                                           receiver_)});
-                }
-            };
-
-            push_vector(output.stochastic);
-            if (max_image_source_order_ <= step) {
-                push_vector(output.specular);
-            }
-
-            return ret;
-        }();
+        //  Impulses are binned on the device, and the histograms are only
+        //  read back once all steps have run.
+        finder_.process(reflections,
+                        buffers,
+                        histograms_,
+                        max_image_source_order_ <= step);
+    }
 
-        incremental_histogram(histogram_.histogram,
-                              begin(intermediate),
-                              end(intermediate),
-                              histogram_.sample_rate,
-                              energy_histogram_sum_functor{});
+    /// One histogram per receiver.
+    util::aligned::vector<Histogram> get_results() const {
+        return util::map_to_vector(
+                begin(histograms_), end(histograms_), [](const auto& i) {
+                    return stochastic::read_histogram(i, Histogram{});
+                });
     }
 
-    Histogram get_results() const { return histogram_; }
+    /// The number of rays traced by this group.
+    size_t get_num_rays() const { return group_items_; }
 
 private:
     stochastic::finder finder_;
-    glm::vec3 receiver_;
-    core::environment environment_;
+    util::aligned::vector<stochastic::device_histogram> histograms_;
     size_t max_image_source_order_;
-    Histogram histogram_;
+    size_t group_items_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/// No straight path inside the scene can be longer than this.
+float compute_max_segment_length(
+        const core::voxelised_scene_data<cl_float3,
+                                         core::surface<core::simulation_bands>>&
+                voxelised);
+
+/// How far an impulse found by raytracer::run may realistically travel.
+///
+/// Every path is made of at most reflections + 1 segments, but almost all of
+/// them are about one mean free path (4V/S) long, rather than the length of
+/// the scene's diagonal.
+/// The bound allows for paths which are twice as long as the mean, plus one
+/// maximum-length segment, and never exceeds the hard limit.
+/// Impulses which travel further than this are dropped, but they have
+/// passed the reflection depth at which the raytracer gives up anyway.
+/// If the scene has no sensible volume, the hard limit is used.
+float compute_max_impulse_distance(
+        const core::voxelised_scene_data<cl_float3,
+                                         core::surface<core::simulation_bands>>&
+                voxelised);
+
+/// The device memory used by the histograms of a single group processor.
+/// There is one group processor for each segment of rays in flight.
+template <typename Histogram>
+size_t get_histogram_memory(
+        const core::voxelised_scene_data<cl_float3,
+                                         core::surface<core::simulation_bands>>&
+                voxelised,
+        size_t num_receivers,
+        double speed_of_sound,
+        double histogram_sample_rate) {
+    //  Matches the reservation made by each group processor.
+    const auto bins = stochastic::compute_histogram_bins(
+            compute_max_impulse_distance(voxelised),
+            speed_of_sound,
+            histogram_sample_rate);
+    using directions = stochastic::histogram_directions<Histogram>;
+    return num_receivers * directions::azimuth * directions::elevation * bins *
+           sizeof(core::bands_type);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// If target_relative_error is greater than zero, the processor will report
+/// that it has converged once the decay curve at every receiver is known to
+/// within that relative error (see stochastic::convergence_monitor).
+/// total_rays is then the most rays that may be traced, and results are
+/// scaled to account for the rays which were actually traced.
 template <typename Histogram>
 class stochastic_processor final {
 public:
     stochastic_processor(const core::compute_context& cc,
                          const glm::vec3& source,
-                         const glm::vec3& receiver,
+                         const util::aligned::vector<glm::vec3>& receivers,
                          const core::environment& environment,
                          size_t total_rays,
                          size_t max_image_source_order,
                          float receiver_radius,
-                         float histogram_sample_rate)
+                         float histogram_sample_rate,
+                         float max_impulse_distance,
+                         double target_relative_error = 0)
             : cc_{cc}
             , source_{source}
-            , receiver_{receiver}
+            , receivers_{receivers}
             , environment_{environment}
             , total_rays_{total_rays}
             , max_image_source_order_{max_image_source_order}
             , receiver_radius_{receiver_radius}
             , histogram_sample_rate_{histogram_sample_rate}
-            , histogram_{histogram_sample_rate} {}
+            , max_impulse_distance_{max_impulse_distance}
+            , target_relative_error_{target_relative_error}
+            , histograms_(receivers.size(), Histogram{histogram_sample_rate})
+            , monitors_(receivers.size()) {}
 
     stochastic_group_processor<Histogram> get_group_processor(
             size_t num_directions) const {
         return {cc_,
                 source_,
-                receiver_,
+                receivers_,
                 environment_,
                 total_rays_,
                 max_image_source_order_,
                 receiver_radius_,
                 histogram_sample_rate_,
+                max_impulse_distance_,
                 num_directions};
     }
 
     void accumulate(const stochastic_group_processor<Histogram>& processor) {
-        sum_histograms(histogram_, processor.get_results());
+        const auto results = processor.get_results();
+        for (auto i = 0u; i != histograms_.size(); ++i) {
+            sum_histograms(histograms_[i], results[i]);
+        }
+
+        rays_traced_ += processor.get_num_rays();
+
+        if (0 < target_relative_error_) {
+            for (auto i = 0u; i != monitors_.size(); ++i) {
+                monitors_[i].add_segment(
+                        stochastic::compute_summed_histogram(
+                                results[i], core::attenuator::null{})
+                                .histogram,
+                        processor.get_num_rays());
+            }
+        }
+    }
+
+    /// True if tracing more rays is unlikely to improve the results
+    /// noticeably.
+    bool converged() const {
+        return 0 < target_relative_error_ &&
+               std::all_of(
+                       begin(monitors_), end(monitors_), [&](const auto& i) {
+                           return i.converged(target_relative_error_);
+                       });
     }
 
-    Histogram get_results() const { return histogram_; }
+    /// One histogram per receiver.
+    util::aligned::vector<Histogram> get_results() const {
+        auto ret = histograms_;
+        if (0 < target_relative_error_ && rays_traced_ &&
+            rays_traced_ < total_rays_) {
+            //  Each ray was given its share of the energy assuming that all
+            //  total_rays would be traced.
+            for (auto& i : ret) {
+                stochastic::scale_histogram(
+                        i, static_cast<float>(total_rays_) / rays_traced_);
+            }
+        }
+        return ret;
+    }
 
 private:
     core::compute_context cc_;
     glm::vec3 source_;
-    glm::vec3 receiver_;
+    util::aligned::vector<glm::vec3> receivers_;
     core::environment environment_;
     size_t total_rays_;
     size_t max_image_source_order_;
     float receiver_radius_;
     float histogram_sample_rate_;
+    float max_impulse_distance_;
+    double target_relative_error_;
 
-    Histogram histogram_;
+    util::aligned::vector<Histogram> histograms_;
+    util::aligned::vector<stochastic::convergence_monitor> monitors_;
+    size_t rays_traced_ = 0;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -182,12 +263,13 @@ public:
     make_stochastic_histogram(size_t total_rays,
                               size_t max_image_source_order,
                               float receiver_radius,
-                              float histogram_sample_rate);
+                              float histogram_sample_rate,
+                              double target_relative_error = 0);
 
     stochastic_processor<stochastic::energy_histogram> get_processor(
             const core::compute_context& cc,
             const glm::vec3& source,
-            const glm::vec3& receiver,
+            const util::aligned::vector<glm::vec3>& receivers,
             const core::environment& environment,
             const core::voxelised_scene_data<
                     cl_float3,
@@ -198,6 +280,7 @@ private:
     size_t max_image_source_order_;
     float receiver_radius_;
     float histogram_sample_rate_;
+    double target_relative_error_;
 };
 
 class make_directional_histogram final {
@@ -205,13 +288,14 @@ public:
     make_directional_histogram(size_t total_rays,
                                size_t max_image_source_order,
                                float receiver_radius,
-                               float histogram_sample_rate);
+                               float histogram_sample_rate,
+                               double target_relative_error = 0);
 
     stochastic_processor<stochastic::directional_energy_histogram<20, 9>>
     get_processor(
             const core::compute_context& cc,
             const glm::vec3& source,
-            const glm::vec3& receiver,
+            const util::aligned::vector<glm::vec3>& receivers,
             const core::environment& environment,
             const core::voxelised_scene_data<
                     cl_float3,
@@ -222,6 +306,7 @@ private:
     size_t max_image_source_order_;
     float receiver_radius_;
     float histogram_sample_rate_;
+    double target_relative_error_;
 };
 
 }  // namespace reflection_processor
@@ -2,6 +2,7 @@
 
 #include "raytracer/cl/structs.h"
 #include "raytracer/iterative_builder.h"
+#include "raytracer/reflection_batch.h"
 
 #include "core/cl/common.h"
 #include "core/environment.h"
@@ -15,13 +16,14 @@ class visual_group_processor final {
 public:
     explicit visual_group_processor(size_t items);
 
-    template <typename It>
-    void process(It b,
-                 It /*e*/,
+    void process(reflection_batch& reflections,
                  const core::scene_buffers& /*buffers*/,
                  size_t /*step*/,
                  size_t /*total*/) {
-        builder_.push(b, b + builder_.get_num_items());
+        //  only the first few reflections are needed on the host
+        const auto items = builder_.get_num_items();
+        const auto b = begin(reflections.read(items));
+        builder_.push(b, b + items);
     }
 
     auto get_results() const { return builder_.get_data(); }
@@ -56,7 +58,7 @@ public:
     visual_processor get_processor(
             const core::compute_context& cc,
             const glm::vec3& source,
-            const glm::vec3& receiver,
+            const util::aligned::vector<glm::vec3>& receivers,
             const core::environment& environment,
             const core::voxelised_scene_data<
                     cl_float3,
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "raytracer/program.h"
+#include "raytracer/reflection_batch.h"
 
 #include "core/cl/geometry.h"
 #include "core/cl/include.h"
@@ -12,6 +13,9 @@
 
 #include "glm/glm.hpp"
 
+#include <random>
+#include <stdexcept>
+
 namespace wayverb {
 namespace raytracer {
 
@@ -24,15 +28,38 @@ auto get_rays_from_directions(It begin, It end, const glm::vec3& source) {
 
 class reflector final {
 public:
+    /// Scattering directions are generated on the device, keyed by the seed,
+    /// the index of each ray, and the bounce number.
+    /// When a large batch is split over several reflectors, first_ray should
+    /// be the index of the first ray of this reflector in the whole batch.
+    /// Then, the same seed will produce identical results no matter how the
+    /// batch was divided.
+    ///
+    /// Every receiver is tested for visibility at each reflection point, so
+    /// several receivers can share a single trace through the scene.
+    ///
+    /// Only rays which are still going are traced at each step.
+    /// If roulette_threshold is above zero, rays whose remaining energy (in
+    /// their loudest band) falls below it are stopped at random, and the
+    /// survivors report a weight to make up for the lost energy.
     template <typename It>
     reflector(const core::compute_context& cc,
-              const glm::vec3& receiver,
+              const util::aligned::vector<glm::vec3>& receivers,
               It b,
-              It e)
+              It e,
+              cl_uint seed = std::random_device{}(),
+              cl_uint first_ray = 0,
+              float roulette_threshold = 0)
             : cc_{cc}
             , queue_{cc.context, cc.device}
             , kernel_{program{cc}.get_kernel()}
-            , receiver_{core::to_cl_float3{}(receiver)}
+            , num_receivers_{receivers.size()}
+            , receivers_buffer_{core::load_to_buffer(
+                      cc.context,
+                      util::map_to_vector(begin(receivers),
+                                          end(receivers),
+                                          core::to_cl_float3{}),
+                      true)}
             , rays_(std::distance(b, e))
             , ray_buffer_{core::load_to_buffer(
                       cc.context,
@@ -44,39 +71,109 @@ public:
             , reflection_buffer_{cc.context,
                                  CL_MEM_READ_WRITE,
                                  rays_ * sizeof(reflection)}
-            , rng_buffer_{cc.context,
-                          CL_MEM_READ_WRITE,
-                          rays_ * 2 * sizeof(cl_float)} {
+            , visibility_buffer_{cc.context,
+                                 CL_MEM_READ_WRITE,
+                                 rays_ * num_receivers_ * sizeof(cl_char)}
+            , active_buffer_{core::load_to_buffer(
+                      cc.context, make_indices(rays_), false)}
+            , next_active_buffer_{cc.context,
+                                  CL_MEM_READ_WRITE,
+                                  rays_ * sizeof(cl_uint)}
+            , num_next_active_buffer_{cc.context,
+                                      CL_MEM_READ_WRITE,
+                                      sizeof(cl_uint)}
+            , num_active_{rays_}
+            , throughput_buffer_{core::load_to_buffer(
+                      cc.context,
+                      util::aligned::vector<core::bands_type>(
+                              rays_, core::make_bands_type(1)),
+                      false)}
+            , roulette_threshold_{roulette_threshold}
+            , seed_{seed}
+            , first_ray_{first_ray} {
+        if (receivers.empty()) {
+            throw std::runtime_error{"Reflector requires at least one receiver."};
+        }
         program{cc_}.get_init_reflections_kernel()(
                 cl::EnqueueArgs{queue_, cl::NDRange{rays_}},
                 reflection_buffer_);
+        core::write_value(queue_, num_next_active_buffer_, 0, cl_uint{0});
     }
 
+    template <typename It>
+    reflector(const core::compute_context& cc,
+              const glm::vec3& receiver,
+              It b,
+              It e,
+              cl_uint seed = std::random_device{}(),
+              cl_uint first_ray = 0,
+              float roulette_threshold = 0)
+            : reflector{cc,
+                        util::aligned::vector<glm::vec3>{receiver},
+                        b,
+                        e,
+                        seed,
+                        first_ray,
+                        roulette_threshold} {}
+
+    /// Trace one bounce, leaving the results in device memory.
+    /// The returned batch refers to this reflector's buffers, so it is only
+    /// valid until the next call.
+    /// The buffers are overwritten once everything in wait_for has finished,
+    /// which should include the consumer events of the previous batch.
+    reflection_batch run_step_on_device(
+            const core::scene_buffers& buffers,
+            const std::vector<cl::Event>& wait_for = {});
+
+    /// Trace one bounce and copy the results back to the host.
     util::aligned::vector<reflection> run_step(
             const core::scene_buffers& buffers);
 
     util::aligned::vector<core::ray> get_rays();
     util::aligned::vector<reflection> get_reflections();
-    util::aligned::vector<cl_float> get_rng();
+
+    /// The number of rays which will be traced by the next step.
+    size_t get_num_active();
 
     /// The constant buffer size required per parallel ray.
-    static constexpr auto get_per_ray_size() {
-        return sizeof(core::ray) + sizeof(reflection) + 2 * sizeof(cl_float);
+    static constexpr auto get_per_ray_size(size_t num_receivers = 1) {
+        return sizeof(core::ray) + sizeof(reflection) +
+               num_receivers * sizeof(cl_char) + 2 * sizeof(cl_uint) +
+               sizeof(core::bands_type);
     }
 
 private:
     using kernel_t = decltype(std::declval<program>().get_kernel());
 
+    static util::aligned::vector<cl_uint> make_indices(size_t num);
+
+    void update_active();
+
     core::compute_context cc_;
     cl::CommandQueue queue_;
     kernel_t kernel_;
-    cl_float3 receiver_;
+    size_t num_receivers_;
+    cl::Buffer receivers_buffer_;
     size_t rays_;
 
     cl::Buffer ray_buffer_;
     cl::Buffer reflection_buffer_;
+    cl::Buffer visibility_buffer_;
+
+    //  Indices of the rays to trace on the current step, and of the rays
+    //  which are still going after it.
+    cl::Buffer active_buffer_;
+    cl::Buffer next_active_buffer_;
+    cl::Buffer num_next_active_buffer_;
+    size_t num_active_;
+    bool active_stale_{false};
+
+    cl::Buffer throughput_buffer_;
+    float roulette_threshold_;
 
-    cl::Buffer rng_buffer_;
+    cl_uint seed_;
+    cl_uint first_ray_;
+    cl_uint bounce_{0};
 };
 
 }  // namespace raytracer
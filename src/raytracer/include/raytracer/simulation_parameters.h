@@ -10,6 +10,8 @@ struct simulation_parameters final {
     /// The number of rays to use.
     /// More is better, but also will take longer.
     /// Use at least a few thousand.
+    /// If target_relative_error is set, this is the most rays that will be
+    /// used.
     size_t rays;
 
     /// The raytracer uses an exact method to find early image sources.
@@ -31,6 +33,20 @@ struct simulation_parameters final {
     /// The frequency of the energy histogram.
     /// Smaller intervals need more rays, longer intervals are inaccurate.
     double histogram_sample_rate = 1000;
+
+    /// Rays whose remaining energy falls below this proportion of their
+    /// starting energy are stopped at random (russian roulette), and the
+    /// energy of the survivors is scaled up so that the results are unbiased.
+    /// Late reflections then only cost as much as the rays which still carry
+    /// significant energy.
+    /// 0 disables roulette, so that every ray is traced to the full depth.
+    double roulette_threshold = 0;
+
+    /// If greater than zero, rays are traced until the energy decay curve in
+    /// every band is known to within this relative error (e.g. 0.01 for 1%),
+    /// or until all rays have been traced, whichever comes first.
+    /// 0 disables the check, so that all rays are always traced.
+    double target_relative_error = 0;
 };
 
 constexpr auto to_tuple(const simulation_parameters& x) {
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "core/cl/scene_structs.h"
+
+#include "utilities/aligned/vector.h"
+
+#include <array>
+
+namespace wayverb {
+namespace raytracer {
+namespace stochastic {
+
+/// Estimates how noisy an energy histogram is while it is being built up.
+///
+/// Each segment of rays gives an independent estimate of the histogram.
+/// The spread of those estimates tells us the standard error of their mean,
+/// which is the histogram we'll actually use.
+/// Individual bins are very noisy even in good results, so the error is
+/// measured on the backward-integrated (Schroeder) decay curve of each band
+/// instead, which is what determines how the reverb tail sounds.
+class convergence_monitor final {
+public:
+    /// Estimates from fewer segments than this are too unreliable to stop on.
+    static constexpr size_t min_segments = 4;
+
+    /// Only the part of each decay curve above this level (relative to the
+    /// total energy in the band) is checked, i.e. down to -60 dB.
+    static constexpr double floor = 1.0e-6;
+
+    /// Histogram holds the energy found by a single segment of rays.
+    void add_segment(const util::aligned::vector<core::bands_type>& histogram,
+                     size_t rays);
+
+    size_t get_num_segments() const;
+
+    /// The largest relative standard error of the mean decay curve, in any
+    /// band, above the floor.
+    /// Infinite until at least two segments have been added.
+    double relative_error() const;
+
+    /// True once enough segments have been added and the relative error is
+    /// no greater than target.
+    bool converged(double target) const;
+
+private:
+    using bands = std::array<double, core::simulation_bands>;
+
+    size_t segments_ = 0;
+    util::aligned::vector<bands> sum_;
+    util::aligned::vector<bands> sum_squared_;
+};
+
+}  // namespace stochastic
+}  // namespace raytracer
+}  // namespace wayverb
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "raytracer/stochastic/postprocessing.h"
+#include "raytracer/stochastic/program.h"
+
+#include "core/cl/common.h"
+
+#include "glm/glm.hpp"
+
+namespace wayverb {
+namespace raytracer {
+namespace stochastic {
+
+/// The number of time steps needed to hold impulses which have travelled up
+/// to max_distance.
+size_t compute_histogram_bins(double max_distance,
+                              double speed_of_sound,
+                              double sample_rate);
+
+/// An energy histogram which lives in device memory.
+/// Impulses are binned on the device as they are found, and the histogram is
+/// only copied to the host when the results are actually needed.
+class device_histogram final {
+public:
+    /// The queue should be the one used to produce the impulses, so that
+    /// binning happens in order.
+    device_histogram(const core::compute_context& cc,
+                     const cl::CommandQueue& queue,
+                     const glm::vec3& receiver,
+                     double speed_of_sound,
+                     double sample_rate,
+                     size_t azimuth_divisions,
+                     size_t elevation_divisions);
+
+    /// Make sure that impulses travelling up to max_distance will fit.
+    /// Impulses beyond the reserved length are dropped.
+    /// Growing the histogram means copying it, so it's best to reserve the
+    /// whole length up front.
+    void reserve(double max_distance);
+
+    /// Bin `items` impulses from a buffer, starting at index `first`.
+    /// Entries with a distance of zero are ignored.
+    void add(const cl::Buffer& impulses, size_t items, size_t first = 0);
+
+    /// Copy the histogram back to the host.
+    /// Each time step holds one entry per direction, in
+    /// [azimuth][elevation] order.
+    util::aligned::vector<core::bands_type> read() const;
+
+    double get_sample_rate() const;
+    size_t get_azimuth_divisions() const;
+    size_t get_elevation_divisions() const;
+
+private:
+    size_t get_directions() const;
+
+    using kernel_t =
+            decltype(std::declval<program>().get_bin_impulses_kernel());
+
+    core::compute_context cc_;
+    mutable cl::CommandQueue queue_;
+    kernel_t kernel_;
+
+    cl_float3 receiver_;
+    double speed_of_sound_;
+    double sample_rate_;
+    size_t azimuth_divisions_;
+    size_t elevation_divisions_;
+
+    size_t bins_{0};
+    cl::Buffer histogram_buffer_;
+    cl::Buffer used_bins_buffer_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename Histogram>
+struct histogram_directions;
+
+template <>
+struct histogram_directions<energy_histogram> final {
+    static constexpr size_t azimuth = 1;
+    static constexpr size_t elevation = 1;
+};
+
+template <size_t Az, size_t El>
+struct histogram_directions<directional_energy_histogram<Az, El>> final {
+    static constexpr size_t azimuth = Az;
+    static constexpr size_t elevation = El;
+};
+
+template <typename Histogram>
+device_histogram make_device_histogram(const core::compute_context& cc,
+                                       const cl::CommandQueue& queue,
+                                       const glm::vec3& receiver,
+                                       double speed_of_sound,
+                                       double sample_rate) {
+    return {cc,
+            queue,
+            receiver,
+            speed_of_sound,
+            sample_rate,
+            histogram_directions<Histogram>::azimuth,
+            histogram_directions<Histogram>::elevation};
+}
+
+energy_histogram read_histogram(const device_histogram& histogram,
+                                const energy_histogram&);
+
+template <size_t Az, size_t El>
+auto read_histogram(const device_histogram& histogram,
+                    const directional_energy_histogram<Az, El>&) {
+    const auto raw = histogram.read();
+    const auto bins = raw.size() / (Az * El);
+
+    directional_energy_histogram<Az, El> ret{histogram.get_sample_rate(), {}};
+    for (auto az = 0ul; az != Az; ++az) {
+        for (auto el = 0ul; el != El; ++el) {
+            auto& segment = ret.histogram.table[az][el];
+            segment.resize(bins);
+            for (auto i = 0ul; i != bins; ++i) {
+                segment[i] = raw[(i * Az + az) * El + el];
+            }
+        }
+    }
+    return ret;
+}
+
+}  // namespace stochastic
+}  // namespace raytracer
+}  // namespace wayverb
@@ -3,6 +3,8 @@
 #include "program.h"
 
 #include "raytracer/cl/structs.h"
+#include "raytracer/reflection_batch.h"
+#include "raytracer/stochastic/device_histogram.h"
 
 #include "core/cl/common.h"
 #include "core/conversions.h"
@@ -10,6 +12,9 @@
 #include "core/spatial_division/scene_buffers.h"
 
 #include "utilities/aligned/vector.h"
+#include "utilities/map_to_vector.h"
+
+#include <stdexcept>
 
 namespace wayverb {
 namespace raytracer {
@@ -33,6 +38,15 @@ float compute_ray_energy(size_t total_rays,
 
 class finder final {
 public:
+    /// All receivers share the same rays, so each needs its own starting
+    /// energy (see compute_ray_energy).
+    finder(const core::compute_context& cc,
+           size_t group_size,
+           const glm::vec3& source,
+           const util::aligned::vector<glm::vec3>& receivers,
+           float receiver_radius,
+           const util::aligned::vector<float>& starting_energies);
+
     finder(const core::compute_context& cc,
            size_t group_size,
            const glm::vec3& source,
@@ -45,50 +59,86 @@ public:
         util::aligned::vector<impulse<core::simulation_bands>> stochastic;
     };
 
+    /// Host-side reflections only carry a single visibility flag, so this
+    /// may only be used by single-receiver finders.
     template <typename It>
     auto process(It b, It e, const core::scene_buffers& scene_buffers) {
+        if (num_receivers_ != 1) {
+            throw std::runtime_error{
+                    "Host reflections can only be processed for a single "
+                    "receiver."};
+        }
+
         //  copy the current batch of reflections to the device
-        cl::copy(queue_, b, e, reflections_buffer_);
-
-        //  get the kernel and run it
-        kernel_(cl::EnqueueArgs(queue_, cl::NDRange(rays_)),
-                reflections_buffer_,
-                receiver_,
-                receiver_radius_,
-                scene_buffers.get_triangles_buffer(),
-                scene_buffers.get_vertices_buffer(),
-                scene_buffers.get_surfaces_buffer(),
-                stochastic_path_buffer_,
-                stochastic_output_buffer_,
-                specular_output_buffer_);
-
-        const auto read_out_impulses = [&](const auto& buffer) {
-            auto raw = core::read_from_buffer<impulse<core::simulation_bands>>(
-                    queue_, buffer);
-            raw.erase(std::remove_if(begin(raw),
-                                     end(raw),
-                                     [](const auto& impulse) {
-                                         return !impulse.distance;
-                                     }),
-                      end(raw));
-            return raw;
-        };
-
-        return results{read_out_impulses(specular_output_buffer_),
-                       read_out_impulses(stochastic_output_buffer_)};
+        const util::aligned::vector<reflection> reflections(b, e);
+        cl::copy(queue_,
+                 begin(reflections),
+                 end(reflections),
+                 reflections_buffer_);
+
+        const auto visibility = util::map_to_vector(
+                begin(reflections), end(reflections), [](const auto& i) {
+                    return i.receiver_visible;
+                });
+        cl::copy(queue_,
+                 begin(visibility),
+                 end(visibility),
+                 visibility_buffer_);
+
+        return process(reflections_buffer_,
+                       visibility_buffer_,
+                       scene_buffers,
+                       {})
+                .front();
     }
 
+    /// Use reflections which are already in device memory, skipping the
+    /// round-trip through the host.
+    /// The reflections buffer must belong to the same context as the finder.
+    /// Returns one set of results per receiver.
+    util::aligned::vector<results> process(
+            const reflection_batch& reflections,
+            const core::scene_buffers& scene_buffers);
+
+    /// Add the impulses straight into histograms in device memory, without
+    /// reading anything back.
+    /// There should be one histogram per receiver, and each must have been
+    /// created with this finder's queue.
+    /// Nothing waits for the device here, so an event is added to the batch,
+    /// which completes once the finder has finished reading the reflections.
+    void process(reflection_batch& reflections,
+                 const core::scene_buffers& scene_buffers,
+                 util::aligned::vector<device_histogram>& histograms,
+                 bool include_specular);
+
+    const cl::CommandQueue& get_queue() const;
+    size_t get_num_receivers() const;
+
 private:
+    util::aligned::vector<results> process(
+            const cl::Buffer& reflections,
+            const cl::Buffer& visibility,
+            const core::scene_buffers& scene_buffers,
+            const std::vector<cl::Event>& wait_for);
+
+    void run_kernel(const cl::Buffer& reflections,
+                    const cl::Buffer& visibility,
+                    const core::scene_buffers& scene_buffers,
+                    const std::vector<cl::Event>& wait_for);
+
     using kernel_t = decltype(std::declval<program>().get_kernel());
 
     core::compute_context cc_;
     cl::CommandQueue queue_;
     kernel_t kernel_;
-    cl_float3 receiver_;
+    size_t num_receivers_;
+    cl::Buffer receivers_buffer_;
+    cl::Buffer energies_buffer_;
     cl_float receiver_radius_;
     size_t rays_;
 
     cl::Buffer reflections_buffer_;
+    cl::Buffer visibility_buffer_;
     cl::Buffer stochastic_path_buffer_;
     cl::Buffer stochastic_output_buffer_;
     cl::Buffer specular_output_buffer_;
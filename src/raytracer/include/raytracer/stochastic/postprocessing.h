@@ -89,6 +89,24 @@ void sum_histograms(directional_energy_histogram<Az, El>& a,
     a.sample_rate = b.sample_rate;
 }
 
+template <typename T>
+void scale_vector(T& a, float factor) {
+    for (auto& i : a) {
+        i *= core::make_bands_type(factor);
+    }
+}
+
+void scale_histogram(energy_histogram& a, float factor);
+
+template <size_t Az, size_t El>
+void scale_histogram(directional_energy_histogram<Az, El>& a, float factor) {
+    for (auto i = 0; i != Az; ++i) {
+        for (auto j = 0; j != El; ++j) {
+            scale_vector(a.histogram.table[i][j], factor);
+        }
+    }
+}
+
 template <size_t Az, size_t El>
 auto max_size(const core::vector_look_up_table<
               util::aligned::vector<core::bands_type>,
@@ -15,7 +15,10 @@ public:
 
     auto get_kernel() const {
         return program_wrapper_.get_kernel<cl::Buffer,  // reflections
-                                           cl_float3,   // receiver
+                                           cl::Buffer,  // receivers
+                                           cl::Buffer,  // receiver energies
+                                           cl_uint,     // num receivers
+                                           cl::Buffer,  // visibility
                                            cl_float,    // receiver radius
                                            cl::Buffer,  // triangles
                                            cl::Buffer,  // vertices
@@ -33,6 +36,19 @@ public:
                                            >("init_stochastic_path_info");
     }
 
+    auto get_bin_impulses_kernel() const {
+        return program_wrapper_.get_kernel<cl::Buffer,  // impulses
+                                           cl_float3,   // receiver
+                                           cl_float,    // speed of sound
+                                           cl_float,    // sample rate
+                                           cl_uint,     // azimuth divisions
+                                           cl_uint,     // elevation divisions
+                                           cl_uint,     // bins
+                                           cl::Buffer,  // histogram
+                                           cl::Buffer   // used bins
+                                           >("bin_impulses");
+    }
+
 private:
     core::program_wrapper program_wrapper_;
 };
@@ -15,7 +15,8 @@ make_canonical_callbacks(const simulation_parameters& params,
                     params.rays,
                     params.maximum_image_source_order + 1,
                     params.receiver_radius,
-                    params.histogram_sample_rate),
+                    params.histogram_sample_rate,
+                    params.target_relative_error),
             raytracer::reflection_processor::make_visual{visual_items});
 }
 
@@ -101,5 +101,11 @@ float mean(bands_type v);
 float mean(bands_type v) {
     return (v.s0 + v.s1 + v.s2 + v.s3 + v.s4 + v.s5 + v.s6 + v.s7) / 8;
 }
+
+float max_band(bands_type v);
+float max_band(bands_type v) {
+    const float4 m = fmax(v.lo, v.hi);
+    return fmax(fmax(m.x, m.y), fmax(m.z, m.w));
+}
 )"};
 }  // namespace cl_sources
@@ -0,0 +1,47 @@
+#include "raytracer/cl/random.h"
+
+namespace cl_sources {
+const char* random{R"(
+//  Philox2x32-10 counter-based generator (Salmon et al. 2011).
+//  Each (key, counter) pair maps to an independent pair of random values, so
+//  every thread can generate its own numbers without any shared state.
+uint2 philox2x32_round(uint2 counter, uint key);
+uint2 philox2x32_round(uint2 counter, uint key) {
+    const ulong product = (ulong)0xD256D193u * counter.x;
+    return (uint2)((uint)(product >> 32) ^ key ^ counter.y, (uint)product);
+}
+
+uint2 philox2x32(uint2 counter, uint key);
+uint2 philox2x32(uint2 counter, uint key) {
+    for (int i = 0; i != 10; ++i) {
+        counter = philox2x32_round(counter, key);
+        key += 0x9E3779B9u;
+    }
+    return counter;
+}
+
+//  Maps the top 24 bits onto [0, 1).
+float uint_to_unit_float(uint x);
+float uint_to_unit_float(uint x) {
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+//  Returns a (z, theta) pair suitable for sphere_point.
+//  z range: -1 to 1
+//  theta range: -pi to pi
+float2 direction_rng(uint seed, uint ray_index, uint bounce);
+float2 direction_rng(uint seed, uint ray_index, uint bounce) {
+    const uint2 r = philox2x32((uint2)(ray_index, bounce), seed);
+    return (float2)(uint_to_unit_float(r.x) * 2 - 1,
+                    (uint_to_unit_float(r.y) * 2 - 1) * M_PI_F);
+}
+
+//  Returns a value in [0, 1) for russian roulette, which is independent of
+//  the direction_rng result for the same ray and bounce.
+float roulette_rng(uint seed, uint ray_index, uint bounce);
+float roulette_rng(uint seed, uint ray_index, uint bounce) {
+    const uint2 r = philox2x32((uint2)(ray_index, bounce), ~seed);
+    return uint_to_unit_float(r.x);
+}
+)"};
+}  // namespace cl_sources
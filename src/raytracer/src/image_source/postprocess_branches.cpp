@@ -1,31 +1,132 @@
 #include "raytracer/image_source/postprocess_branches.h"
 #include "raytracer/image_source/fast_pressure_calculator.h"
 
+#include "utilities/work_stealing.h"
+
+#include <numeric>
+
 namespace wayverb {
 namespace raytracer {
 namespace image_source {
+namespace {
+
+auto make_accumulator(
+        const core::voxelised_scene_data<cl_float3,
+                                         core::surface<core::simulation_bands>>&
+                voxelised,
+        const glm::vec3& receiver,
+        bool flip_phase) {
+    return core::make_callback_accumulator(make_fast_pressure_calculator(
+            begin(voxelised.get_scene_data().get_surfaces()),
+            end(voxelised.get_scene_data().get_surfaces()),
+            receiver,
+            flip_phase));
+}
+
+/// The number of nodes in the subtree under each node, including the node
+/// itself.
+util::aligned::vector<size_t> count_nodes(const tree& tree) {
+    //  Children always come after their parents, so a single backwards pass
+    //  finishes each node before it is added to its parent.
+    util::aligned::vector<size_t> ret(tree.size(), 1);
+    for (auto i = tree.size() - 1; i != tree::root; --i) {
+        ret[tree.get_parent(i)] += ret[i];
+    }
+    return ret;
+}
+
+/// A subtree to check, along with the path which leads to it.
+struct branch_task final {
+    util::aligned::vector<path_element> prefix;
+    tree::node_index node;
+};
+
+}  // namespace
 
 util::aligned::vector<impulse<core::simulation_bands>> postprocess_branches(
-        const multitree<path_element>& tree,
+        const tree& tree,
+        const glm::vec3& source,
+        const glm::vec3& receiver,
+        const core::voxelised_scene_data<cl_float3,
+                                         core::surface<core::simulation_bands>>&
+                voxelised,
+        bool flip_phase) {
+    const auto num_threads =
+            std::max(std::thread::hardware_concurrency(), 1u);
+
+    //  Subtrees bigger than this are split into their branches, so that there
+    //  are plenty of similarly-sized units of work to go around.
+    const auto nodes = count_nodes(tree);
+    const auto split_threshold =
+            std::max(nodes[tree::root] / (num_threads * 16), size_t{1});
+
+    //  Each worker keeps its own output, so there's no contention.
+    std::vector<decltype(make_accumulator(voxelised, receiver, flip_phase))>
+            outputs;
+    outputs.reserve(num_threads);
+    for (auto i = 0u; i != num_threads; ++i) {
+        outputs.emplace_back(make_accumulator(voxelised, receiver, flip_phase));
+    }
+
+    std::vector<branch_task> tasks;
+    tree.for_each_child(tree::root, [&](auto branch) {
+        tasks.emplace_back(branch_task{{}, branch});
+    });
+
+    util::work_stealing_for_each(
+            std::move(tasks),
+            num_threads,
+            [&](auto worker, auto task, const auto& spawn) {
+                auto& output = outputs[worker];
+                const postprocessor callback = [&](auto img, auto b, auto e) {
+                    output(img, b, e);
+                };
+
+                const auto recurse = nodes[task.node] <= split_threshold;
+                find_valid_paths(tree,
+                                 task.node,
+                                 task.prefix,
+                                 recurse,
+                                 source,
+                                 receiver,
+                                 voxelised,
+                                 callback);
+
+                if (!recurse) {
+                    task.prefix.emplace_back(tree.get_item(task.node));
+                    tree.for_each_child(task.node, [&](auto branch) {
+                        spawn(branch_task{task.prefix, branch});
+                    });
+                }
+            });
+
+    util::aligned::vector<impulse<core::simulation_bands>> ret;
+    for (const auto& output : outputs) {
+        ret.insert(ret.end(),
+                   output.get_output().begin(),
+                   output.get_output().end());
+    }
+    return ret;
+}
+
+util::aligned::vector<impulse<core::simulation_bands>> postprocess_candidates(
+        path_validator& validator,
+        const core::scene_buffers& buffers,
+        const candidate_paths& candidates,
         const glm::vec3& source,
         const glm::vec3& receiver,
         const core::voxelised_scene_data<cl_float3,
                                          core::surface<core::simulation_bands>>&
                 voxelised,
         bool flip_phase) {
-    auto callback =
-            core::make_callback_accumulator(make_fast_pressure_calculator(
-                    begin(voxelised.get_scene_data().get_surfaces()),
-                    end(voxelised.get_scene_data().get_surfaces()),
-                    receiver,
-                    flip_phase));
-    find_valid_paths(
-            tree,
+    auto output = make_accumulator(voxelised, receiver, flip_phase);
+    validator.validate(
+            candidates,
+            buffers,
             source,
             receiver,
-            voxelised,
-            [&](auto img, auto begin, auto end) { callback(img, begin, end); });
-    return callback.get_output();
+            [&](auto img, auto b, auto e) { output(img, b, e); });
+    return output.get_output();
 }
 
 }  // namespace image_source
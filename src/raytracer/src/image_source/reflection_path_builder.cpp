@@ -0,0 +1,71 @@
+#include "raytracer/image_source/reflection_path_builder.h"
+
+#include "utilities/work_stealing.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+namespace wayverb {
+namespace raytracer {
+namespace image_source {
+
+constexpr size_t reflection_path_builder::min_rays_per_chunk;
+
+reflection_path_builder::reflection_path_builder(size_t rays)
+        : cursors_(rays, tree::root) {
+    const auto num_chunks = std::max(
+            std::min(rays / min_rays_per_chunk,
+                     size_t{std::thread::hardware_concurrency()}),
+            size_t{1});
+    chunks_.reserve(num_chunks);
+    for (auto i = 0u; i != num_chunks; ++i) {
+        chunks_.emplace_back(chunk{
+                i * rays / num_chunks, (i + 1) * rays / num_chunks, tree{}});
+    }
+}
+
+void reflection_path_builder::push(
+        const util::aligned::vector<reflection>& reflections) {
+    if (reflections.size() != cursors_.size()) {
+        throw std::runtime_error{
+                "Incorrect range size passed to reflection_path_builder."};
+    }
+
+    const auto push_chunk = [&](chunk& c) {
+        for (auto i = c.begin; i != c.end; ++i) {
+            const auto& r = reflections[i];
+            if (r.keep_going) {
+                cursors_[i] = c.paths.insert(
+                        cursors_[i],
+                        path_element{r.triangle,
+                                     static_cast<bool>(r.receiver_visible)});
+            }
+        }
+    };
+
+    if (chunks_.size() == 1) {
+        push_chunk(chunks_.front());
+        return;
+    }
+
+    std::vector<size_t> tasks(chunks_.size());
+    std::iota(begin(tasks), end(tasks), 0);
+    util::work_stealing_for_each(
+            std::move(tasks),
+            chunks_.size(),
+            [&](auto /*worker*/, auto task, const auto& /*spawn*/) {
+                push_chunk(chunks_[task]);
+            });
+}
+
+void reflection_path_builder::merge_into(tree& ret) const {
+    for (const auto& c : chunks_) {
+        ret.merge(c.paths);
+    }
+}
+
+}  // namespace image_source
+}  // namespace raytracer
+}  // namespace wayverb
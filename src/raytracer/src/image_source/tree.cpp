@@ -3,6 +3,7 @@
 #include "utilities/map_to_vector.h"
 #include "utilities/mapping_iterator_adapter.h"
 
+#include <cstdint>
 #include <iostream>
 
 namespace wayverb {
@@ -64,6 +65,18 @@ public:
                 source_, receiver_, voxelised_, callback_, state_, p};
     }
 
+    static state path_element_to_state(
+            const glm::vec3& source,
+            const vsd& voxelised,
+            const util::aligned::vector<state>& state,
+            const path_element& p) {
+        return {p.index,
+                find_image_source(
+                        state.empty() ? source : state.back().image_source,
+                        voxelised,
+                        p.index)};
+    }
+
 private:
     static auto get_triangle(const vsd& voxelised,
                              const cl_uint triangle_index) {
@@ -80,18 +93,6 @@ private:
                                  get_triangle(voxelised, triangle_index));
     }
 
-    static state path_element_to_state(
-            const glm::vec3& source,
-            const vsd& voxelised,
-            const util::aligned::vector<state>& state,
-            const path_element& p) {
-        return {p.index,
-                find_image_source(
-                        state.empty() ? source : state.back().image_source,
-                        voxelised,
-                        p.index)};
-    }
-
     struct valid_path final {
         glm::vec3 image_source;
         util::aligned::vector<reflection_metadata> intersections;
@@ -182,39 +183,160 @@ private:
 
 ////////////////////////////////////////////////////////////////////////////////
 
-multitree<path_element>::branches_type construct_image_source_tree(
-        const util::aligned::vector<util::aligned::vector<path_element>>&
-                paths) {
-    multitree<path_element> root{path_element{}};
-    for (const auto& i : paths) {
-        add_path(root, i.begin(), i.end());
+constexpr tree::node_index tree::root;
+constexpr tree::node_index tree::none;
+
+tree::tree()
+        : nodes_{node{path_element{}, none, none, none}}
+        , slots_(16, none) {}
+
+size_t tree::slot(node_index parent, cl_uint triangle) const {
+    //  Fibonacci hashing spreads consecutive keys over the whole table.
+    const auto key = (uint64_t{parent} << 32) | triangle;
+    return (key * 0x9e3779b97f4a7c15ull) >> 32 & (slots_.size() - 1);
+}
+
+void tree::grow() {
+    slots_.assign(slots_.size() * 2, none);
+    for (auto i = root + 1; i != nodes_.size(); ++i) {
+        auto s = slot(nodes_[i].parent, nodes_[i].item.index);
+        while (slots_[s] != none) {
+            s = (s + 1) & (slots_.size() - 1);
+        }
+        slots_[s] = i;
+    }
+}
+
+tree::node_index tree::find(node_index parent, cl_uint triangle) const {
+    for (auto s = slot(parent, triangle);; s = (s + 1) & (slots_.size() - 1)) {
+        const auto i = slots_[s];
+        if (i == none ||
+            (nodes_[i].parent == parent && nodes_[i].item.index == triangle)) {
+            return i;
+        }
     }
-    return std::move(root.branches);
+}
+
+tree::node_index tree::insert(node_index parent, const path_element& item) {
+    auto s = slot(parent, item.index);
+    for (; slots_[s] != none; s = (s + 1) & (slots_.size() - 1)) {
+        auto& existing = nodes_[slots_[s]];
+        if (existing.parent == parent && existing.item.index == item.index) {
+            existing.item.visible = existing.item.visible || item.visible;
+            return slots_[s];
+        }
+    }
+
+    if (none <= nodes_.size()) {
+        throw std::runtime_error{"Too many nodes in image-source tree."};
+    }
+
+    const auto ret = static_cast<node_index>(nodes_.size());
+    nodes_.emplace_back(node{item, parent, none, nodes_[parent].first_child});
+    nodes_[parent].first_child = ret;
+
+    //  Keep the load factor at or below one half, so probes stay short.
+    if (slots_.size() < nodes_.size() * 2) {
+        grow();
+    } else {
+        slots_[s] = ret;
+    }
+
+    return ret;
 }
 
 void tree::push(const util::aligned::vector<path_element>& path) {
-    add_path(root_, path.cbegin(), path.cend());
+    auto node = root;
+    for (const auto& item : path) {
+        node = insert(node, item);
+    }
+}
+
+void tree::merge(const tree& other) {
+    //  Parents always come before their children, so the parent of each
+    //  node has already been found by the time we get to it.
+    util::aligned::vector<node_index> mapping(other.size());
+    mapping[root] = root;
+    for (auto i = root + 1; i != other.size(); ++i) {
+        mapping[i] = insert(mapping[other.nodes_[i].parent],
+                            other.nodes_[i].item);
+    }
+}
+
+size_t tree::size() const { return nodes_.size(); }
+
+const path_element& tree::get_item(node_index node) const {
+    return nodes_[node].item;
+}
+
+tree::node_index tree::get_parent(node_index node) const {
+    return nodes_[node].parent;
 }
 
-const multitree<path_element>::branches_type& tree::get_branches() const {
-    return root_.branches;
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+/// The trick here is that the callback can be a stateful object...
+template <typename Callback>
+void traverse_tree(const tree& tree,
+                   tree::node_index node,
+                   const Callback& callback) {
+    const auto next = callback(tree.get_item(node));
+    tree.for_each_child(
+            node, [&](auto child) { traverse_tree(tree, child, next); });
 }
 
+}  // namespace
+
 void find_valid_paths(
-        const multitree<path_element>& tree,
+        const tree& tree,
         const glm::vec3& source,
         const glm::vec3& receiver,
         const core::voxelised_scene_data<cl_float3,
                                          core::surface<core::simulation_bands>>&
                 voxelised,
         const postprocessor& callback) {
-    //  set up a state array
+    tree.for_each_child(tree::root, [&](auto branch) {
+        find_valid_paths(tree,
+                         branch,
+                         util::aligned::vector<path_element>{},
+                         true,
+                         source,
+                         receiver,
+                         voxelised,
+                         callback);
+    });
+}
+
+void find_valid_paths(
+        const tree& tree,
+        tree::node_index node,
+        const util::aligned::vector<path_element>& prefix,
+        bool recurse,
+        const glm::vec3& source,
+        const glm::vec3& receiver,
+        const core::voxelised_scene_data<cl_float3,
+                                         core::surface<core::simulation_bands>>&
+                voxelised,
+        const postprocessor& callback) {
+    //  set up a state array, starting from the end of the prefix
     util::aligned::vector<traversal_callback::state> state{};
+    state.reserve(prefix.size() + 1);
+    for (const auto& element : prefix) {
+        state.emplace_back(traversal_callback::path_element_to_state(
+                source, voxelised, state, element));
+    }
+
+    //  check the root of the subtree
+    const traversal_callback root{
+            source, receiver, voxelised, callback, state, tree.get_item(node)};
+
     //  traverse all paths on this branch
-    traverse_multitree(
-            tree,
-            traversal_callback{
-                    source, receiver, voxelised, callback, state, tree.item});
+    if (recurse) {
+        tree.for_each_child(
+                node, [&](auto child) { traverse_tree(tree, child, root); });
+    }
 }
 
 }  // namespace image_source
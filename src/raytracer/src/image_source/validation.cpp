@@ -0,0 +1,312 @@
+#include "raytracer/image_source/validation.h"
+
+#include "core/cl/bvh.h"
+#include "core/cl/bvh_structs.h"
+#include "core/cl/geometry.h"
+#include "core/cl/geometry_structs.h"
+#include "core/cl/voxel.h"
+#include "core/cl/voxel_structs.h"
+#include "core/conversions.h"
+#include "core/geo/geometric.h"
+
+#include <algorithm>
+
+namespace wayverb {
+
+template <>
+struct core::cl_representation<raytracer::image_source::reflection_metadata>
+        final {
+    static constexpr auto value = R"(
+typedef struct {
+    uint surface_index;
+    float cos_angle;
+} reflection_metadata;
+)";
+};
+
+namespace raytracer {
+namespace image_source {
+namespace {
+
+constexpr auto source = R"(
+
+intersection closest_intersection(ray r,
+                                  const global uint* voxel_index,
+                                  aabb global_aabb,
+                                  uint side,
+                                  const global bvh_node* bvh_nodes,
+                                  const global uint* bvh_triangle_indices,
+                                  uint use_bvh,
+                                  const global triangle* triangles,
+                                  const global float3* vertices,
+                                  uint avoid_intersecting_with);
+intersection closest_intersection(ray r,
+                                  const global uint* voxel_index,
+                                  aabb global_aabb,
+                                  uint side,
+                                  const global bvh_node* bvh_nodes,
+                                  const global uint* bvh_triangle_indices,
+                                  uint use_bvh,
+                                  const global triangle* triangles,
+                                  const global float3* vertices,
+                                  uint avoid_intersecting_with) {
+    return use_bvh ? bvh_traversal(r,
+                                   bvh_nodes,
+                                   bvh_triangle_indices,
+                                   triangles,
+                                   vertices,
+                                   avoid_intersecting_with)
+                   : voxel_traversal(r,
+                                     voxel_index,
+                                     global_aabb,
+                                     side,
+                                     triangles,
+                                     vertices,
+                                     avoid_intersecting_with);
+}
+
+//  One thread per candidate path.
+//  Mirrors traversal_callback::find_valid_path in tree.cpp.
+kernel void validate_image_source_paths(
+        const global uint* offsets,  //  paths
+        const global uint* path_triangles,
+        const global float3* image_sources,
+
+        float3 source,
+        float3 receiver,
+
+        const global uint* voxel_index,  //  voxel
+        aabb global_aabb,
+        uint side,
+
+        const global bvh_node* bvh_nodes,  //  bvh
+        const global uint* bvh_triangle_indices,
+        uint use_bvh,
+
+        const global triangle* triangles,  //  scene
+        const global float3* vertices,
+
+        global char* valid,  //  output
+        global reflection_metadata* metadata) {
+    const size_t thread = get_global_id(0);
+    const uint begin = offsets[thread];
+    const uint end = offsets[thread + 1];
+
+    valid[thread] = false;
+
+    //  In weird scenarios the image source might end up getting plastered
+    //  over the receiver.
+    if (all(receiver == image_sources[end - 1])) {
+        return;
+    }
+
+    //  Check that we can cast a ray to the receiver from all of the image
+    //  sources, through the correct triangles.
+    float3 prev_intersection = receiver;
+    uint prev_surface = ~(uint)0;
+
+    for (uint i = end; i != begin; --i) {
+        const uint expected = path_triangles[i - 1];
+        const float3 image_source = image_sources[i - 1];
+        if (all(prev_intersection == image_source)) {
+            return;
+        }
+
+        const ray r = {prev_intersection,
+                       normalize(image_source - prev_intersection)};
+        const intersection inter = closest_intersection(r,
+                                                        voxel_index,
+                                                        global_aabb,
+                                                        side,
+                                                        bvh_nodes,
+                                                        bvh_triangle_indices,
+                                                        use_bvh,
+                                                        triangles,
+                                                        vertices,
+                                                        prev_surface);
+        if (!inter.inter.t || inter.index != expected) {
+            return;
+        }
+
+        const triangle t = triangles[expected];
+        const float3 normal = triangle_normal(t, vertices);
+        const float cos_angle =
+                clamp(fabs(dot(r.direction, normal)), 0.0f, 1.0f);
+        metadata[begin + end - i] = (reflection_metadata){t.surface, cos_angle};
+
+        prev_intersection = r.position + r.direction * inter.inter.t;
+        prev_surface = expected;
+    }
+
+    //  Ensure there is line-of-sight from source to initial image-source
+    //  intersection point.
+    if (all(source == prev_intersection)) {
+        return;
+    }
+
+    const ray r = {source, normalize(prev_intersection - source)};
+    const intersection inter = closest_intersection(r,
+                                                    voxel_index,
+                                                    global_aabb,
+                                                    side,
+                                                    bvh_nodes,
+                                                    bvh_triangle_indices,
+                                                    use_bvh,
+                                                    triangles,
+                                                    vertices,
+                                                    ~(uint)0);
+    if (!inter.inter.t || inter.index != prev_surface) {
+        return;
+    }
+
+    valid[thread] = true;
+}
+
+)";
+
+}  // namespace
+
+candidate_paths collect_candidate_paths(
+        const tree& tree,
+        const glm::vec3& source,
+        const core::voxelised_scene_data<cl_float3,
+                                         core::surface<core::simulation_bands>>&
+                voxelised) {
+    const auto& scene = voxelised.get_scene_data();
+
+    //  Parents come before their children, so each node's image source can
+    //  be found from its parent's in a single forward pass.
+    util::aligned::vector<glm::vec3> image_sources(tree.size(), source);
+    for (auto i = tree::root + 1; i != tree.size(); ++i) {
+        const auto triangle = core::geo::get_triangle_vec3(
+                scene.get_triangles()[tree.get_item(i).index],
+                scene.get_vertices().data());
+        image_sources[i] =
+                core::geo::mirror(image_sources[tree.get_parent(i)], triangle);
+    }
+
+    candidate_paths ret;
+    for (auto i = tree::root + 1; i != tree.size(); ++i) {
+        if (!tree.get_item(i).visible) {
+            continue;
+        }
+
+        //  Walk back up to the root, then put the path in order.
+        const auto path_begin = ret.triangles.size();
+        for (auto node = i; node != tree::root; node = tree.get_parent(node)) {
+            ret.triangles.emplace_back(tree.get_item(node).index);
+            ret.image_sources.emplace_back(
+                    core::to_cl_float3{}(image_sources[node]));
+        }
+        std::reverse(ret.triangles.begin() + path_begin, ret.triangles.end());
+        std::reverse(ret.image_sources.begin() + path_begin,
+                     ret.image_sources.end());
+
+        ret.offsets.emplace_back(ret.triangles.size());
+    }
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr size_t path_validator::max_paths_per_batch;
+
+path_validator::path_validator(const core::compute_context& cc)
+        : cc_{cc}
+        , queue_{cc.context, cc.device}
+        , program_wrapper_{
+                  cc,
+                  std::vector<std::string>{
+                          core::cl_representation_v<core::triangle>,
+                          core::cl_representation_v<core::triangle_verts>,
+                          core::cl_representation_v<core::aabb>,
+                          core::cl_representation_v<core::bvh_node>,
+                          core::cl_representation_v<core::ray>,
+                          core::cl_representation_v<core::triangle_inter>,
+                          core::cl_representation_v<core::intersection>,
+                          core::cl_representation_v<reflection_metadata>,
+                          core::cl_sources::geometry,
+                          core::cl_sources::voxel,
+                          core::cl_sources::bvh,
+                          source}} {}
+
+void path_validator::validate(const candidate_paths& paths,
+                              const core::scene_buffers& buffers,
+                              const glm::vec3& source,
+                              const glm::vec3& receiver,
+                              const postprocessor& callback) {
+    auto kernel = get_kernel();
+
+    for (size_t b = 0, num_paths = size(paths); b < num_paths;
+         b += max_paths_per_batch) {
+        const auto e = std::min(b + max_paths_per_batch, num_paths);
+        const auto first = paths.offsets[b];
+        const auto last = paths.offsets[e];
+
+        //  Offsets are rebased so that the batch starts at zero.
+        util::aligned::vector<cl_uint> offsets(paths.offsets.begin() + b,
+                                               paths.offsets.begin() + e + 1);
+        for (auto& i : offsets) {
+            i -= first;
+        }
+
+        const auto offsets_buffer =
+                core::load_to_buffer(cc_.context, offsets, true);
+        const auto triangles_buffer = core::load_to_buffer(
+                cc_.context,
+                util::aligned::vector<cl_uint>(
+                        paths.triangles.begin() + first,
+                        paths.triangles.begin() + last),
+                true);
+        const auto image_sources_buffer = core::load_to_buffer(
+                cc_.context,
+                util::aligned::vector<cl_float3>(
+                        paths.image_sources.begin() + first,
+                        paths.image_sources.begin() + last),
+                true);
+
+        cl::Buffer valid_buffer{
+                cc_.context, CL_MEM_READ_WRITE, (e - b) * sizeof(cl_char)};
+        cl::Buffer metadata_buffer{
+                cc_.context,
+                CL_MEM_READ_WRITE,
+                (last - first) * sizeof(reflection_metadata)};
+
+        kernel(cl::EnqueueArgs{queue_, cl::NDRange{e - b}},
+               offsets_buffer,
+               triangles_buffer,
+               image_sources_buffer,
+               core::to_cl_float3{}(source),
+               core::to_cl_float3{}(receiver),
+               buffers.get_voxel_index_buffer(),
+               buffers.get_global_aabb(),
+               buffers.get_side(),
+               buffers.get_bvh_nodes_buffer(),
+               buffers.get_bvh_triangle_indices_buffer(),
+               buffers.get_use_bvh(),
+               buffers.get_triangles_buffer(),
+               buffers.get_vertices_buffer(),
+               valid_buffer,
+               metadata_buffer);
+
+        const auto valid =
+                core::read_from_buffer<cl_char>(queue_, valid_buffer);
+        const auto metadata = core::read_from_buffer<reflection_metadata>(
+                queue_, metadata_buffer);
+
+        //  Only the pressure calculation is left for the host.
+        for (auto i = 0u; i != valid.size(); ++i) {
+            if (valid[i]) {
+                const auto image_source =
+                        paths.image_sources[first + offsets[i + 1] - 1];
+                callback(core::to_vec3{}(image_source),
+                         metadata.begin() + offsets[i],
+                         metadata.begin() + offsets[i + 1]);
+            }
+        }
+    }
+}
+
+}  // namespace image_source
+}  // namespace raytracer
+}  // namespace wayverb
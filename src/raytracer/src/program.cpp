@@ -1,8 +1,11 @@
 #include "raytracer/program.h"
 
 #include "raytracer/cl/brdf.h"
+#include "raytracer/cl/random.h"
 #include "raytracer/cl/structs.h"
 
+#include "core/cl/bvh.h"
+#include "core/cl/bvh_structs.h"
 #include "core/cl/geometry.h"
 #include "core/cl/geometry_structs.h"
 #include "core/cl/scene_structs.h"
@@ -53,50 +56,91 @@ kernel void init_reflections(global reflection* reflections) {
     reflections[thread] = (reflection){(float3)(0),
                                        ~(uint)0,
                                        (char)true,
-                                       (char)0};
+                                       (char)0,
+                                       1};
 }
 
 kernel void reflections(global ray* rays,  //  ray
 
-                        float3 receiver,  //  receiver
+                        const global float3* receivers,  //  receivers
+                        uint num_receivers,
 
                         const global uint* voxel_index,  //  voxel
                         aabb global_aabb,
                         uint side,
 
+                        const global bvh_node* bvh_nodes,  //  bvh
+                        const global uint* bvh_triangle_indices,
+                        uint use_bvh,
+
                         const global triangle* triangles,  //  scene
                         const global float3* vertices,
                         const global surface* surfaces,
 
-                        const global float* rng,  //  random numbers
+                        uint seed,  //  random numbers
+                        uint first_ray,
+                        uint bounce,
 
-                        global reflection* reflections) {  //  output
-    //  get thread index
-    const size_t thread = get_global_id(0);
+                        const global uint* active,  //  compaction
+                        global uint* next_active,
+                        volatile global uint* num_next_active,
+
+                        global bands_type* throughput,  //  roulette
+                        float roulette_threshold,
+
+                        global reflection* reflections,  //  output
+                        global char* visibility) {
+    //  Only rays which are still going are launched.
+    //  Rays which stopped were zeroed on the step where they stopped, and
+    //  those outputs stay valid for every later step.
+    const size_t thread = active[get_global_id(0)];
 
     const bool keep_going = reflections[thread].keep_going;
     const uint previous_triangle = reflections[thread].triangle;
 
     //  zero out result reflection
     reflections[thread] = (reflection){};
+    for (uint i = 0; i != num_receivers; ++i) {
+        visibility[thread * num_receivers + i] = false;
+    }
 
     //  if this thread should stop, then stop
     if (!keep_going) {
         return;
     }
 
+    //  Russian roulette: once the ray's remaining energy is small, stop it
+    //  at random, and scale up the energy of the survivors to make up for
+    //  the rays that were stopped.
+    float weight = 1;
+    const float remaining = max_band(throughput[thread]);
+    if (remaining < roulette_threshold) {
+        const float survival = remaining / roulette_threshold;
+        if (survival <= roulette_rng(seed, first_ray + thread, bounce)) {
+            return;
+        }
+        weight = 1 / survival;
+        throughput[thread] *= weight;
+    }
+
     //  find the ray to intersect
     const ray this_ray = rays[thread];
 
     //  find the intersection between scene geometry and this ray
     const intersection closest_intersection =
-            voxel_traversal(this_ray,
-                            voxel_index,
-                            global_aabb,
-                            side,
-                            triangles,
-                            vertices,
-                            previous_triangle);
+            use_bvh ? bvh_traversal(this_ray,
+                                    bvh_nodes,
+                                    bvh_triangle_indices,
+                                    triangles,
+                                    vertices,
+                                    previous_triangle)
+                    : voxel_traversal(this_ray,
+                                      voxel_index,
+                                      global_aabb,
+                                      side,
+                                      triangles,
+                                      vertices,
+                                      previous_triangle);
 
     //  didn't find an intersection, should halt this thread
     if (!closest_intersection.inter.t) {
@@ -118,30 +162,46 @@ kernel void reflections(global ray* rays,  //  ray
     //  make sure the normal faces the right direction
     tnorm *= signbit(dot(tnorm, specular));
 
-    //  see whether the receiver is visible from this point
-    const bool is_intersection =
-            voxel_point_intersection(intersection_pt,
-                                     receiver,
-                                     voxel_index,
-                                     global_aabb,
-                                     side,
-                                     triangles,
-                                     vertices,
-                                     closest_intersection.index);
+    //  see whether each receiver is visible from this point
+    //  The geometry traversal above is shared between all receivers, so
+    //  extra receivers only cost a visibility test each.
+    bool any_visible = false;
+    for (uint i = 0; i != num_receivers; ++i) {
+        const bool is_intersection =
+                use_bvh ? bvh_point_intersection(intersection_pt,
+                                                 receivers[i],
+                                                 bvh_nodes,
+                                                 bvh_triangle_indices,
+                                                 triangles,
+                                                 vertices,
+                                                 closest_intersection.index)
+                        : voxel_point_intersection(intersection_pt,
+                                                   receivers[i],
+                                                   voxel_index,
+                                                   global_aabb,
+                                                   side,
+                                                   triangles,
+                                                   vertices,
+                                                   closest_intersection.index);
+        visibility[thread * num_receivers + i] = is_intersection;
+        any_visible |= is_intersection;
+    }
 
     //  now we can populate the output
     reflections[thread] = (reflection){intersection_pt,
                                        closest_intersection.index,
                                        true,
-                                       is_intersection};
+                                       any_visible,
+                                       weight};
 
     //  we also need to find the next ray to trace
 
     //  find the scattering
     //  get random values to influence direction of reflected ray
-    const float z = rng[2 * thread + 0];
-    const float theta = rng[2 * thread + 1];
-    const float3 random_unit_vector = sphere_point(z, theta);
+    //  keyed on the absolute ray index, so results don't depend on how the
+    //  rays are split into batches
+    const float2 rng = direction_rng(seed, first_ray + thread, bounce);
+    const float3 random_unit_vector = sphere_point(rng.x, rng.y);
     //  scattering coefficient is the average of the diffuse coefficients
     const surface s = surfaces[closest_triangle.surface];
     const float scatter = mean(s.scattering);
@@ -150,6 +210,10 @@ kernel void reflections(global ray* rays,  //  ray
 
     //  find the next ray to trace
     rays[thread] = (ray){intersection_pt, scattering};
+    throughput[thread] *= 1 - s.absorption;
+
+    //  this ray should be traced again on the next step
+    next_active[atomic_inc(num_next_active)] = thread;
 }
 
 )";
@@ -164,6 +228,7 @@ program::program(const core::compute_context& cc)
                           core::cl_representation_v<core::triangle>,
                           core::cl_representation_v<core::triangle_verts>,
                           core::cl_representation_v<core::aabb>,
+                          core::cl_representation_v<core::bvh_node>,
                           core::cl_representation_v<core::ray>,
                           core::cl_representation_v<core::triangle_inter>,
                           core::cl_representation_v<core::intersection>,
@@ -171,7 +236,9 @@ program::program(const core::compute_context& cc)
                           core::cl_representation_v<impulse<8>>,
                           core::cl_sources::geometry,
                           core::cl_sources::voxel,
+                          core::cl_sources::bvh,
                           ::cl_sources::brdf,
+                          ::cl_sources::random,
                           source}} {}
 
 }  // namespace raytracer
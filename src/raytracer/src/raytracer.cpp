@@ -0,0 +1,30 @@
+#include "raytracer/raytracer.h"
+
+#include <algorithm>
+
+namespace wayverb {
+namespace raytracer {
+
+size_t compute_rays_per_segment(const cl::Device& device,
+                                size_t num_receivers) {
+    //  Leave most of the memory for the scene, the histograms, and anything
+    //  else which might be running at the same time.
+    const auto budget = static_cast<size_t>(
+            device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / 8 /
+            segments_in_flight);
+    const auto by_budget = budget / get_per_ray_size(num_receivers);
+
+    //  No single buffer may be larger than the allocation limit either.
+    const auto largest_per_ray =
+            std::max({sizeof(core::ray),
+                      sizeof(reflection),
+                      num_receivers * sizeof(impulse<core::simulation_bands>)});
+    const auto by_allocation = static_cast<size_t>(
+            device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>() / largest_per_ray);
+
+    return std::max(min_rays_per_segment,
+                    std::min({by_budget, by_allocation, max_rays_per_segment}));
+}
+
+}  // namespace raytracer
+}  // namespace wayverb
@@ -0,0 +1,57 @@
+#include "raytracer/reflection_batch.h"
+
+#include <algorithm>
+
+namespace wayverb {
+namespace raytracer {
+
+reflection_batch::reflection_batch(cl::CommandQueue& queue,
+                                   const cl::Buffer& buffer,
+                                   const cl::Buffer& visibility,
+                                   size_t num_receivers,
+                                   const cl::Event& ready,
+                                   size_t size)
+        : queue_{&queue}
+        , buffer_{buffer}
+        , visibility_{visibility}
+        , num_receivers_{num_receivers}
+        , ready_{ready}
+        , size_{size} {}
+
+const cl::Buffer& reflection_batch::get_buffer() const { return buffer_; }
+
+const cl::Buffer& reflection_batch::get_visibility_buffer() const {
+    return visibility_;
+}
+
+size_t reflection_batch::get_num_receivers() const { return num_receivers_; }
+
+const cl::Event& reflection_batch::get_event() const { return ready_; }
+
+void reflection_batch::add_consumer_event(const cl::Event& done) {
+    consumers_.emplace_back(done);
+}
+
+const std::vector<cl::Event>& reflection_batch::get_consumer_events() const {
+    return consumers_;
+}
+
+size_t reflection_batch::size() const { return size_; }
+
+const util::aligned::vector<reflection>& reflection_batch::read(
+        size_t items) {
+    items = std::min(items, size_);
+    if (host_.size() < items) {
+        host_.resize(items);
+        queue_->enqueueReadBuffer(
+                buffer_, CL_TRUE, 0, sizeof(reflection) * items, host_.data());
+    }
+    return host_;
+}
+
+const util::aligned::vector<reflection>& reflection_batch::read() {
+    return read(size_);
+}
+
+}  // namespace raytracer
+}  // namespace wayverb
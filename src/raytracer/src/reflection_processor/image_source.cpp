@@ -4,6 +4,8 @@
 
 #include "core/pressure_intensity.h"
 
+#include "utilities/map_to_vector.h"
+
 namespace wayverb {
 namespace raytracer {
 namespace reflection_processor {
@@ -16,15 +18,17 @@ image_source_group_processor::image_source_group_processor(size_t max_order,
 ////////////////////////////////////////////////////////////////////////////////
 
 image_source_processor::image_source_processor(
+        const core::compute_context& cc,
         const glm::vec3& source,
-        const glm::vec3& receiver,
+        const util::aligned::vector<glm::vec3>& receivers,
         const core::environment& environment,
         const core::voxelised_scene_data<cl_float3,
                                          core::surface<core::simulation_bands>>&
                 voxelised,
         size_t max_order)
-        : source_{source}
-        , receiver_{receiver}
+        : cc_{cc}
+        , source_{source}
+        , receivers_{receivers}
         , environment_{environment}
         , voxelised_{voxelised}
         , max_order_{max_order} {}
@@ -36,35 +40,51 @@ image_source_group_processor image_source_processor::get_group_processor(
 
 void image_source_processor::accumulate(
         const image_source_group_processor& processor) {
-    for (const auto& path : processor.get_results()) {
-        tree_.push(path);
+    processor.get_results().merge_into(tree_);
+    if (!buffers_ && processor.get_buffers()) {
+        buffers_.emplace(*processor.get_buffers());
     }
 }
 
-util::aligned::vector<impulse<8>> image_source_processor::get_results() const {
-    //  Fetch the image source results.
-    auto ret = raytracer::image_source::postprocess_branches(
-            begin(tree_.get_branches()),
-            end(tree_.get_branches()),
-            source_,
-            receiver_,
-            voxelised_,
-            false);
-
-    //  Add the line-of-sight contribution, which isn't directly detected by
-    //  the image-source machinery.
-    using namespace image_source;
-    if (const auto direct = get_direct(source_, receiver_, voxelised_)) {
-        ret.emplace_back(*direct);
-    }
+util::aligned::vector<util::aligned::vector<impulse<8>>>
+image_source_processor::get_results() const {
+    //  The image sources only depend on the source position, so they're
+    //  found once and then checked against each receiver on the device.
+    //  If no rays were traced, there are no buffers to borrow.
+    const auto buffers =
+            buffers_ ? *buffers_ : core::scene_buffers{cc_.context, voxelised_};
+    image_source::path_validator validator{cc_};
+    const auto candidates =
+            image_source::collect_candidate_paths(tree_, source_, voxelised_);
 
-    //  Correct for distance travelled.
-    for (auto& imp : ret) {
-        imp.volume *= core::pressure_for_distance(
-                imp.distance, environment_.acoustic_impedance);
-    }
+    return util::map_to_vector(
+            begin(receivers_), end(receivers_), [&](const auto& receiver) {
+                //  Fetch the image source results.
+                auto ret = raytracer::image_source::postprocess_candidates(
+                        validator,
+                        buffers,
+                        candidates,
+                        source_,
+                        receiver,
+                        voxelised_,
+                        false);
+
+                //  Add the line-of-sight contribution, which isn't directly
+                //  detected by the image-source machinery.
+                using namespace image_source;
+                if (const auto direct =
+                            get_direct(source_, receiver, voxelised_)) {
+                    ret.emplace_back(*direct);
+                }
+
+                //  Correct for distance travelled.
+                for (auto& imp : ret) {
+                    imp.volume *= core::pressure_for_distance(
+                            imp.distance, environment_.acoustic_impedance);
+                }
 
-    return ret;
+                return ret;
+            });
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -73,14 +93,14 @@ make_image_source::make_image_source(size_t max_order)
         : max_order_{max_order} {}
 
 image_source_processor make_image_source::get_processor(
-        const core::compute_context& /*cc*/,
+        const core::compute_context& cc,
         const glm::vec3& source,
-        const glm::vec3& receiver,
+        const util::aligned::vector<glm::vec3>& receivers,
         const core::environment& environment,
         const core::voxelised_scene_data<cl_float3,
                                          core::surface<core::simulation_bands>>&
                 voxelised) const {
-    return {source, receiver, environment, voxelised, max_order_};
+    return {cc, source, receivers, environment, voxelised, max_order_};
 }
 
 }  // namespace reflection_processor
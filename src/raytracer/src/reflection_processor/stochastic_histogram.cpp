@@ -1,36 +1,78 @@
 #include "raytracer/reflection_processor/stochastic_histogram.h"
+#include "raytracer/optimum_reflection_number.h"
+
+#include "core/reverb_time.h"
+
+#include <algorithm>
 
 namespace wayverb {
 namespace raytracer {
 namespace reflection_processor {
 
+float compute_max_segment_length(
+        const core::voxelised_scene_data<cl_float3,
+                                         core::surface<core::simulation_bands>>&
+                voxelised) {
+    return glm::length(dimensions(voxelised.get_voxels().get_aabb()));
+}
+
+float compute_max_impulse_distance(
+        const core::voxelised_scene_data<cl_float3,
+                                         core::surface<core::simulation_bands>>&
+                voxelised) {
+    const auto& scene = voxelised.get_scene_data();
+
+    //  Matches the reflection depth used by raytracer::run.
+    const auto segments = compute_optimum_reflection_number(scene) + 1;
+    const auto max_segment_length = compute_max_segment_length(voxelised);
+    const auto hard_limit = segments * max_segment_length;
+
+    const auto volume = core::estimate_room_volume(scene);
+    const auto surface_area = core::area(scene);
+    if (!(0 < volume && 0 < surface_area)) {
+        return hard_limit;
+    }
+
+    const auto mean_free_path =
+            std::min(static_cast<float>(4 * volume / surface_area),
+                     max_segment_length);
+    return std::min(hard_limit,
+                    2 * segments * mean_free_path + max_segment_length);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 make_stochastic_histogram::make_stochastic_histogram(
         size_t total_rays,
         size_t max_image_source_order,
         float receiver_radius,
-        float histogram_sample_rate)
+        float histogram_sample_rate,
+        double target_relative_error)
         : total_rays_{total_rays}
         , max_image_source_order_{max_image_source_order}
         , receiver_radius_{receiver_radius}
-        , histogram_sample_rate_{histogram_sample_rate} {}
+        , histogram_sample_rate_{histogram_sample_rate}
+        , target_relative_error_{target_relative_error} {}
 
 stochastic_processor<stochastic::energy_histogram>
 make_stochastic_histogram::get_processor(
         const core::compute_context& cc,
         const glm::vec3& source,
-        const glm::vec3& receiver,
+        const util::aligned::vector<glm::vec3>& receivers,
         const core::environment& environment,
         const core::voxelised_scene_data<cl_float3,
                                          core::surface<core::simulation_bands>>&
-        /*voxelised*/) const {
+                voxelised) const {
     return {cc,
             source,
-            receiver,
+            receivers,
             environment,
             total_rays_,
             max_image_source_order_,
             receiver_radius_,
-            histogram_sample_rate_};
+            histogram_sample_rate_,
+            compute_max_impulse_distance(voxelised),
+            target_relative_error_};
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -39,29 +81,33 @@ make_directional_histogram::make_directional_histogram(
         size_t total_rays,
         size_t max_image_source_order,
         float receiver_radius,
-        float histogram_sample_rate)
+        float histogram_sample_rate,
+        double target_relative_error)
         : total_rays_{total_rays}
         , max_image_source_order_{max_image_source_order}
         , receiver_radius_{receiver_radius}
-        , histogram_sample_rate_{histogram_sample_rate} {}
+        , histogram_sample_rate_{histogram_sample_rate}
+        , target_relative_error_{target_relative_error} {}
 
 stochastic_processor<stochastic::directional_energy_histogram<20, 9>>
 make_directional_histogram::get_processor(
         const core::compute_context& cc,
         const glm::vec3& source,
-        const glm::vec3& receiver,
+        const util::aligned::vector<glm::vec3>& receivers,
         const core::environment& environment,
         const core::voxelised_scene_data<cl_float3,
                                          core::surface<core::simulation_bands>>&
-        /*voxelised*/) const {
+                voxelised) const {
     return {cc,
             source,
-            receiver,
+            receivers,
             environment,
             total_rays_,
             max_image_source_order_,
             receiver_radius_,
-            histogram_sample_rate_};
+            histogram_sample_rate_,
+            compute_max_impulse_distance(voxelised),
+            target_relative_error_};
 }
 
 }  // namespace reflection_processor
@@ -36,7 +36,7 @@ make_visual::make_visual(size_t items)
 visual_processor make_visual::get_processor(
         const core::compute_context& /*cc*/,
         const glm::vec3& /*source*/,
-        const glm::vec3& /*receiver*/,
+        const util::aligned::vector<glm::vec3>& /*receivers*/,
         const core::environment& /*environment*/,
         const core::voxelised_scene_data<cl_float3,
                                          core::surface<core::simulation_bands>>&
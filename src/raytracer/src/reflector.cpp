@@ -1,53 +1,96 @@
 #include "raytracer/reflector.h"
 
-#include "core/azimuth_elevation.h"
 #include "core/conversions.h"
 #include "core/spatial_division/scene_buffers.h"
 
-#include <random>
+#include <numeric>
+#include <utility>
 
 namespace wayverb {
 namespace raytracer {
-namespace {
 
-util::aligned::vector<cl_float> get_direction_rng(size_t num) {
-    util::aligned::vector<cl_float> ret;
-    ret.reserve(2 * num);
-    std::default_random_engine engine{std::random_device()()};
+util::aligned::vector<cl_uint> reflector::make_indices(size_t num) {
+    util::aligned::vector<cl_uint> ret(num);
+    std::iota(begin(ret), end(ret), 0);
+    return ret;
+}
 
-    for (auto i = 0ul; i != num; ++i) {
-        const core::direction_rng rng(engine);
-        ret.emplace_back(rng.get_z());
-        ret.emplace_back(rng.get_theta());
+void reflector::update_active() {
+    if (!active_stale_) {
+        return;
     }
+    //  Pick up the rays which survived the previous step.
+    //  This waits for the previous step to finish, but only has to read a
+    //  single value.
+    num_active_ =
+            core::read_value<cl_uint>(queue_, num_next_active_buffer_, 0);
+    std::swap(active_buffer_, next_active_buffer_);
+    core::write_value(queue_, num_next_active_buffer_, 0, cl_uint{0});
+    active_stale_ = false;
+}
 
-    return ret;
+size_t reflector::get_num_active() {
+    update_active();
+    return num_active_;
 }
 
-}  // namespace
+reflection_batch reflector::run_step_on_device(
+        const core::scene_buffers& buffers,
+        const std::vector<cl::Event>& wait_for) {
+    if (!get_num_active()) {
+        //  Every ray has stopped, so the outputs from the previous step
+        //  (all zeroed) are still correct.
+        cl::Event event;
+        queue_.enqueueMarkerWithWaitList(&wait_for, &event);
+        bounce_++;
+        return reflection_batch{queue_,
+                                reflection_buffer_,
+                                visibility_buffer_,
+                                num_receivers_,
+                                event,
+                                rays_};
+    }
+
+    //  get the kernel and run it
+    const auto event =
+            kernel_(cl::EnqueueArgs(
+                            queue_, wait_for, cl::NDRange(num_active_)),
+                    ray_buffer_,
+                    receivers_buffer_,
+                    static_cast<cl_uint>(num_receivers_),
+                    buffers.get_voxel_index_buffer(),
+                    buffers.get_global_aabb(),
+                    buffers.get_side(),
+                    buffers.get_bvh_nodes_buffer(),
+                    buffers.get_bvh_triangle_indices_buffer(),
+                    buffers.get_use_bvh(),
+                    buffers.get_triangles_buffer(),
+                    buffers.get_vertices_buffer(),
+                    buffers.get_surfaces_buffer(),
+                    seed_,
+                    first_ray_,
+                    bounce_++,
+                    active_buffer_,
+                    next_active_buffer_,
+                    num_next_active_buffer_,
+                    throughput_buffer_,
+                    roulette_threshold_,
+                    reflection_buffer_,
+                    visibility_buffer_);
+    active_stale_ = true;
 
-////////////////////////////////////////////////////////////////////////////////
+    return reflection_batch{queue_,
+                            reflection_buffer_,
+                            visibility_buffer_,
+                            num_receivers_,
+                            event,
+                            rays_};
+}
 
 util::aligned::vector<reflection> reflector::run_step(
         const core::scene_buffers& buffers) {
-    //  get some new rng and copy it to device memory
-    const auto rng{get_direction_rng(rays_)};
-    cl::copy(queue_, std::begin(rng), std::end(rng), rng_buffer_);
-
-    //  get the kernel and run it
-    kernel_(cl::EnqueueArgs(queue_, cl::NDRange(rays_)),
-            ray_buffer_,
-            receiver_,
-            buffers.get_voxel_index_buffer(),
-            buffers.get_global_aabb(),
-            buffers.get_side(),
-            buffers.get_triangles_buffer(),
-            buffers.get_vertices_buffer(),
-            buffers.get_surfaces_buffer(),
-            rng_buffer_,
-            reflection_buffer_);
-
-    return core::read_from_buffer<reflection>(queue_, reflection_buffer_);
+    auto batch = run_step_on_device(buffers);
+    return batch.read();
 }
 
 util::aligned::vector<core::ray> reflector::get_rays() {
@@ -58,9 +101,5 @@ util::aligned::vector<reflection> reflector::get_reflections() {
     return core::read_from_buffer<reflection>(queue_, reflection_buffer_);
 }
 
-util::aligned::vector<cl_float> reflector::get_rng() {
-    return core::read_from_buffer<cl_float>(queue_, rng_buffer_);
-}
-
 }  // namespace raytracer
 }  // namespace wayverb
@@ -0,0 +1,81 @@
+#include "raytracer/stochastic/convergence.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace wayverb {
+namespace raytracer {
+namespace stochastic {
+
+constexpr size_t convergence_monitor::min_segments;
+constexpr double convergence_monitor::floor;
+
+void convergence_monitor::add_segment(
+        const util::aligned::vector<core::bands_type>& histogram,
+        size_t rays) {
+    if (!rays) {
+        return;
+    }
+
+    //  Curves from earlier segments are implicitly zero past their ends, so
+    //  growing the running sums with zeros keeps them consistent.
+    if (sum_.size() < histogram.size()) {
+        sum_.resize(histogram.size(), bands{});
+        sum_squared_.resize(histogram.size(), bands{});
+    }
+
+    //  The final segment is usually shorter than the others, so estimates
+    //  are normalised to the energy of a single ray.
+    bands remaining{};
+    for (auto i = histogram.size(); i != 0; --i) {
+        for (auto band = 0u; band != core::simulation_bands; ++band) {
+            remaining[band] += histogram[i - 1].s[band] / rays;
+            sum_[i - 1][band] += remaining[band];
+            sum_squared_[i - 1][band] += remaining[band] * remaining[band];
+        }
+    }
+
+    segments_ += 1;
+}
+
+size_t convergence_monitor::get_num_segments() const { return segments_; }
+
+double convergence_monitor::relative_error() const {
+    if (segments_ < 2) {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    const auto n = static_cast<double>(segments_);
+
+    auto ret = 0.0;
+    auto found_energy = false;
+    for (auto band = 0u; band != core::simulation_bands; ++band) {
+        if (sum_.empty() || sum_.front()[band] <= 0) {
+            //  No energy has reached the receiver in this band yet.
+            continue;
+        }
+
+        found_energy = true;
+        const auto threshold = sum_.front()[band] * floor;
+        for (auto i = 0u; i != sum_.size() && threshold <= sum_[i][band];
+             ++i) {
+            const auto mean = sum_[i][band] / n;
+            const auto variance = std::max(
+                    0.0, (sum_squared_[i][band] - n * mean * mean) / (n - 1));
+            ret = std::max(ret, std::sqrt(variance / n) / mean);
+        }
+    }
+
+    //  Until some energy has been found there's nothing to be confident
+    //  about.
+    return found_energy ? ret : std::numeric_limits<double>::infinity();
+}
+
+bool convergence_monitor::converged(double target) const {
+    return min_segments <= segments_ && relative_error() <= target;
+}
+
+}  // namespace stochastic
+}  // namespace raytracer
+}  // namespace wayverb
@@ -0,0 +1,132 @@
+#include "raytracer/stochastic/device_histogram.h"
+
+#include "core/conversions.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace wayverb {
+namespace raytracer {
+namespace stochastic {
+
+size_t compute_histogram_bins(double max_distance,
+                              double speed_of_sound,
+                              double sample_rate) {
+    return std::floor(max_distance / speed_of_sound * sample_rate) + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+device_histogram::device_histogram(const core::compute_context& cc,
+                                   const cl::CommandQueue& queue,
+                                   const glm::vec3& receiver,
+                                   double speed_of_sound,
+                                   double sample_rate,
+                                   size_t azimuth_divisions,
+                                   size_t elevation_divisions)
+        : cc_{cc}
+        , queue_{queue}
+        , kernel_{program{cc}.get_bin_impulses_kernel()}
+        , receiver_{core::to_cl_float3{}(receiver)}
+        , speed_of_sound_{speed_of_sound}
+        , sample_rate_{sample_rate}
+        , azimuth_divisions_{azimuth_divisions}
+        , elevation_divisions_{elevation_divisions}
+        , used_bins_buffer_{core::load_to_buffer(
+                  cc.context, util::aligned::vector<cl_uint>{0}, false)} {}
+
+void device_histogram::reserve(double max_distance) {
+    const auto required = compute_histogram_bins(
+            max_distance, speed_of_sound_, sample_rate_);
+    if (required <= bins_) {
+        return;
+    }
+
+    //  Grow geometrically to avoid lots of small reallocations.
+    const auto new_bins = std::max(required, bins_ * 2);
+    cl::Buffer new_buffer{core::load_to_buffer(
+            cc_.context,
+            util::aligned::vector<core::bands_type>(new_bins *
+                                                    get_directions()),
+            false)};
+
+    //  Time is the outermost dimension, so old contents are a prefix of the
+    //  new buffer.
+    if (bins_) {
+        queue_.enqueueCopyBuffer(histogram_buffer_,
+                                 new_buffer,
+                                 0,
+                                 0,
+                                 sizeof(core::bands_type) * bins_ *
+                                         get_directions());
+    }
+
+    histogram_buffer_ = new_buffer;
+    bins_ = new_bins;
+}
+
+void device_histogram::add(const cl::Buffer& impulses,
+                           size_t items,
+                           size_t first) {
+    if (!bins_ || !items) {
+        return;
+    }
+
+    //  The global offset selects the range, so the kernel doesn't need to
+    //  know about it.
+    kernel_(cl::EnqueueArgs(queue_,
+                            cl::NDRange(first),
+                            cl::NDRange(items),
+                            cl::NullRange),
+            impulses,
+            receiver_,
+            speed_of_sound_,
+            sample_rate_,
+            azimuth_divisions_,
+            elevation_divisions_,
+            bins_,
+            histogram_buffer_,
+            used_bins_buffer_);
+}
+
+util::aligned::vector<core::bands_type> device_histogram::read() const {
+    const auto used_bins = std::min(
+            static_cast<size_t>(
+                    core::read_value<cl_uint>(queue_, used_bins_buffer_, 0)),
+            bins_);
+
+    util::aligned::vector<core::bands_type> ret(used_bins * get_directions());
+    if (!ret.empty()) {
+        queue_.enqueueReadBuffer(histogram_buffer_,
+                                 CL_TRUE,
+                                 0,
+                                 sizeof(core::bands_type) * ret.size(),
+                                 ret.data());
+    }
+    return ret;
+}
+
+double device_histogram::get_sample_rate() const { return sample_rate_; }
+
+size_t device_histogram::get_azimuth_divisions() const {
+    return azimuth_divisions_;
+}
+
+size_t device_histogram::get_elevation_divisions() const {
+    return elevation_divisions_;
+}
+
+size_t device_histogram::get_directions() const {
+    return azimuth_divisions_ * elevation_divisions_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+energy_histogram read_histogram(const device_histogram& histogram,
+                                const energy_histogram&) {
+    return {histogram.get_sample_rate(), histogram.read()};
+}
+
+}  // namespace stochastic
+}  // namespace raytracer
+}  // namespace wayverb
@@ -1,5 +1,8 @@
 #include "raytracer/stochastic/finder.h"
 
+#include <algorithm>
+#include <iterator>
+
 namespace wayverb {
 namespace raytracer {
 namespace stochastic {
@@ -19,36 +22,157 @@ float compute_ray_energy(size_t total_rays,
 finder::finder(const core::compute_context& cc,
                size_t group_size,
                const glm::vec3& source,
-               const glm::vec3& receiver,
+               const util::aligned::vector<glm::vec3>& receivers,
                float receiver_radius,
-               float starting_energy)
+               const util::aligned::vector<float>& starting_energies)
         : cc_{cc}
         , queue_{cc.context, cc.device}
         , kernel_{program{cc}.get_kernel()}
-        , receiver_{core::to_cl_float3{}(receiver)}
+        , num_receivers_{receivers.size()}
+        , receivers_buffer_{core::load_to_buffer(
+                  cc.context,
+                  util::map_to_vector(begin(receivers),
+                                      end(receivers),
+                                      core::to_cl_float3{}),
+                  true)}
+        , energies_buffer_{core::load_to_buffer(
+                  cc.context, starting_energies, true)}
         , receiver_radius_{receiver_radius}
         , rays_{group_size}
         , reflections_buffer_{cc.context,
                               CL_MEM_READ_WRITE,
                               sizeof(reflection) * group_size}
+        , visibility_buffer_{cc.context,
+                             CL_MEM_READ_WRITE,
+                             sizeof(cl_char) * group_size * num_receivers_}
         , stochastic_path_buffer_{cc.context,
                                   CL_MEM_READ_WRITE,
                                   sizeof(stochastic_path_info) * group_size}
         , stochastic_output_buffer_{cc.context,
                                     CL_MEM_READ_WRITE,
                                     sizeof(impulse<core::simulation_bands>) *
-                                            group_size}
+                                            group_size * num_receivers_}
         , specular_output_buffer_{
                   cc.context,
                   CL_MEM_READ_WRITE,
-                  sizeof(impulse<core::simulation_bands>) * group_size} {
+                  sizeof(impulse<core::simulation_bands>) * group_size *
+                          num_receivers_} {
+    if (receivers.empty() || receivers.size() != starting_energies.size()) {
+        throw std::runtime_error{
+                "Finder requires one starting energy per receiver."};
+    }
+
+    //  Paths start with unit volume, and each receiver's starting energy is
+    //  applied when its outputs are computed.
     program{cc_}.get_init_stochastic_path_info_kernel()(
             cl::EnqueueArgs{queue_, cl::NDRange{rays_}},
             stochastic_path_buffer_,
-            core::make_bands_type(starting_energy),
+            core::make_bands_type(1),
             core::to_cl_float3{}(source));
 }
 
+finder::finder(const core::compute_context& cc,
+               size_t group_size,
+               const glm::vec3& source,
+               const glm::vec3& receiver,
+               float receiver_radius,
+               float starting_energy)
+        : finder{cc,
+                 group_size,
+                 source,
+                 util::aligned::vector<glm::vec3>{receiver},
+                 receiver_radius,
+                 util::aligned::vector<float>{starting_energy}} {}
+
+util::aligned::vector<finder::results> finder::process(
+        const reflection_batch& reflections,
+        const core::scene_buffers& scene_buffers) {
+    return process(reflections.get_buffer(),
+                   reflections.get_visibility_buffer(),
+                   scene_buffers,
+                   {reflections.get_event()});
+}
+
+void finder::process(reflection_batch& reflections,
+                     const core::scene_buffers& scene_buffers,
+                     util::aligned::vector<device_histogram>& histograms,
+                     bool include_specular) {
+    if (histograms.size() != num_receivers_) {
+        throw std::runtime_error{"Finder requires one histogram per receiver."};
+    }
+
+    run_kernel(reflections.get_buffer(),
+               reflections.get_visibility_buffer(),
+               scene_buffers,
+               {reflections.get_event()});
+    for (auto i = 0u; i != num_receivers_; ++i) {
+        histograms[i].add(stochastic_output_buffer_, rays_, i * rays_);
+        if (include_specular) {
+            histograms[i].add(specular_output_buffer_, rays_, i * rays_);
+        }
+    }
+
+    //  The queue is in-order, so the marker completes after everything
+    //  above.
+    cl::Event done;
+    queue_.enqueueMarkerWithWaitList(nullptr, &done);
+    reflections.add_consumer_event(done);
+}
+
+const cl::CommandQueue& finder::get_queue() const { return queue_; }
+
+size_t finder::get_num_receivers() const { return num_receivers_; }
+
+void finder::run_kernel(const cl::Buffer& reflections,
+                        const cl::Buffer& visibility,
+                        const core::scene_buffers& scene_buffers,
+                        const std::vector<cl::Event>& wait_for) {
+    kernel_(cl::EnqueueArgs(queue_, wait_for, cl::NDRange(rays_)),
+            reflections,
+            receivers_buffer_,
+            energies_buffer_,
+            static_cast<cl_uint>(num_receivers_),
+            visibility,
+            receiver_radius_,
+            scene_buffers.get_triangles_buffer(),
+            scene_buffers.get_vertices_buffer(),
+            scene_buffers.get_surfaces_buffer(),
+            stochastic_path_buffer_,
+            stochastic_output_buffer_,
+            specular_output_buffer_);
+}
+
+util::aligned::vector<finder::results> finder::process(
+        const cl::Buffer& reflections,
+        const cl::Buffer& visibility,
+        const core::scene_buffers& scene_buffers,
+        const std::vector<cl::Event>& wait_for) {
+    run_kernel(reflections, visibility, scene_buffers, wait_for);
+
+    const auto specular = core::read_from_buffer<
+            impulse<core::simulation_bands>>(queue_, specular_output_buffer_);
+    const auto stochastic = core::read_from_buffer<
+            impulse<core::simulation_bands>>(queue_, stochastic_output_buffer_);
+
+    //  Outputs are in [receiver][ray] order.
+    const auto read_out_impulses = [&](const auto& raw, size_t receiver) {
+        util::aligned::vector<impulse<core::simulation_bands>> ret;
+        std::copy_if(begin(raw) + receiver * rays_,
+                     begin(raw) + (receiver + 1) * rays_,
+                     std::back_inserter(ret),
+                     [](const auto& impulse) { return impulse.distance; });
+        return ret;
+    };
+
+    util::aligned::vector<results> ret;
+    ret.reserve(num_receivers_);
+    for (auto i = 0u; i != num_receivers_; ++i) {
+        ret.emplace_back(results{read_out_impulses(specular, i),
+                                 read_out_impulses(stochastic, i)});
+    }
+    return ret;
+}
+
 }  // namespace stochastic
 }  // namespace raytracer
 }  // namespace wayverb
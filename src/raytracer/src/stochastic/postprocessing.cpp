@@ -52,6 +52,10 @@ void sum_histograms(energy_histogram& a, const energy_histogram& b) {
     a.sample_rate = b.sample_rate;
 }
 
+void scale_histogram(energy_histogram& a, float factor) {
+    scale_vector(a.histogram, factor);
+}
+
 util::aligned::vector<core::bands_type> weight_sequence(
         const energy_histogram& histogram,
         const dirac_sequence& sequence,
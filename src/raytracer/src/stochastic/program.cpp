@@ -55,8 +55,14 @@ kernel void init_stochastic_path_info(global stochastic_path_info* info,
     info[thread] = (stochastic_path_info){volume, position, 0};
 }
 
+//  Outputs are laid out in [receiver][ray] order.
+//  The path volumes are independent of the receiver, so each receiver's
+//  starting energy is only applied to the outputs.
 kernel void stochastic(const global reflection* reflections,
-                    float3 receiver,
+                    const global float3* receivers,
+                    const global float* energies,
+                    uint num_receivers,
+                    const global char* visibility,
                     float receiver_radius,
 
                     const global triangle* triangles,
@@ -68,10 +74,13 @@ kernel void stochastic(const global reflection* reflections,
                     global impulse* stochastic_output,
                     global impulse* intersected_output) {
     const size_t thread = get_global_id(0);
+    const size_t rays = get_global_size(0);
 
     //  zero out output
-    stochastic_output[thread] = (impulse){};
-    intersected_output[thread] = (impulse){};
+    for (uint i = 0; i != num_receivers; ++i) {
+        stochastic_output[i * rays + thread] = (impulse){};
+        intersected_output[i * rays + thread] = (impulse){};
+    }
 
     //  if this thread doesn't have anything to do, stop now
     if (!reflections[thread].keep_going) {
@@ -87,7 +96,10 @@ kernel void stochastic(const global reflection* reflections,
     const bands_type reflectance =
             absorption_to_energy_reflectance(reflective_surface.absorption);
 
-    const bands_type last_volume = stochastic_path[thread].volume;
+    //  Rays which survived russian roulette carry extra energy, to make up
+    //  for the rays which were stopped.
+    const bands_type last_volume =
+            stochastic_path[thread].volume * reflections[thread].weight;
     const bands_type outgoing = last_volume * reflectance;
 
     const float3 last_position = stochastic_path[thread].position;
@@ -103,52 +115,155 @@ kernel void stochastic(const global reflection* reflections,
             outgoing, this_position, this_distance};
 
     //  compute output
-    
-    //  specular output
-    if (line_segment_sphere_intersection(
-                last_position, this_position, receiver, receiver_radius)) {
-        const float3 to_receiver = receiver - last_position;
-        const float to_receiver_distance = length(to_receiver);
-        const float total_distance = last_distance + to_receiver_distance;
-
-        const bands_type output_volume = last_volume;
-
-        intersected_output[thread] =
-                (impulse){output_volume, last_position, total_distance};
+    const float3 tnorm = triangle_normal(reflective_triangle, vertices);
+    const bands_type scattered_volume =
+            scattered(outgoing, reflective_surface.scattering);
+
+    for (uint i = 0; i != num_receivers; ++i) {
+        const float3 receiver = receivers[i];
+        const float energy = energies[i];
+        const size_t out = i * rays + thread;
+
+        //  specular output
+        if (line_segment_sphere_intersection(
+                    last_position, this_position, receiver, receiver_radius)) {
+            const float3 to_receiver = receiver - last_position;
+            const float to_receiver_distance = length(to_receiver);
+            const float total_distance = last_distance + to_receiver_distance;
+
+            const bands_type output_volume = energy * last_volume;
+
+            intersected_output[out] =
+                    (impulse){output_volume, last_position, total_distance};
+        }
+
+        //  stochastic output
+        if (visibility[thread * num_receivers + i]) {
+            const float3 to_receiver = receiver - this_position;
+            const float to_receiver_distance = length(to_receiver);
+            const float total_distance = this_distance + to_receiver_distance;
+
+            //  This implements diffusion according to Lambert's cosine law.
+            //  i.e. The intensity is proportional to the cosine of the angle
+            //  between the surface normal and the outgoing vector.
+            const float cos_angle = fabs(dot(tnorm, normalize(to_receiver)));
+
+            //  Scattered energy equation:
+            //  schroder2011 5.20
+            //  detected scattered energy =
+            //      incident energy * (1 - a) * s * (1 - cos(y/2)) * 2 *
+            //      cos(theta)
+            //  where
+            //      y = opening angle
+            //      theta = angle between receiver centre and surface normal
+
+            const float sin_y = receiver_radius /
+                                max(receiver_radius, to_receiver_distance);
+            const float angle_correction = 1 - sqrt(1 - sin_y * sin_y);
+
+            const bands_type output_volume = energy * angle_correction * 2 *
+                                             cos_angle * scattered_volume;
+
+            //  set output
+            stochastic_output[out] =
+                    (impulse){output_volume, this_position, total_distance};
+        }
     }
+}
 
-    //  stochastic output
-    if (reflections[thread].receiver_visible) {
-        const float3 to_receiver = receiver - this_position;
-        const float to_receiver_distance = length(to_receiver);
-        const float total_distance = this_distance + to_receiver_distance;
-
-        //  This implements diffusion according to Lambert's cosine law.
-        //  i.e. The intensity is proportional to the cosine of the angle
-        //  between the surface normal and the outgoing vector.
-        const float3 tnorm = triangle_normal(reflective_triangle, vertices);
-        const float cos_angle = fabs(dot(tnorm, normalize(to_receiver)));
-
-        //  Scattered energy equation:
-        //  schroder2011 5.20
-        //  detected scattered energy =
-        //      incident energy * (1 - a) * s * (1 - cos(y/2)) * 2 * cos(theta)
-        //  where
-        //      y = opening angle
-        //      theta = angle between receiver centre and surface normal
-
-        const float sin_y =
-                receiver_radius / max(receiver_radius, to_receiver_distance);
-        const float angle_correction = 1 - sqrt(1 - sin_y * sin_y);
-
-        const bands_type output_volume =
-                angle_correction * 2 * cos_angle *
-                scattered(outgoing, reflective_surface.scattering);
-
-        //  set output
-        stochastic_output[thread] =
-                (impulse){output_volume, this_position, total_distance};
+////////////////////////////////////////////////////////////////////////////////
+
+//  OpenCL 1.2 has no floating-point atomics, so this does a compare-and-swap
+//  on the bit pattern instead.
+void atomic_add_float(volatile global float* address, float value);
+void atomic_add_float(volatile global float* address, float value) {
+    union {
+        uint u;
+        float f;
+    } old_value, new_value;
+    do {
+        old_value.f = *address;
+        new_value.f = old_value.f + value;
+    } while (atomic_cmpxchg((volatile global uint*)address,
+                            old_value.u,
+                            new_value.u) != old_value.u);
+}
+
+//  Replicates core::vector_look_up_table::index.
+uint direction_index(float3 pointing,
+                     uint azimuth_divisions,
+                     uint elevation_divisions);
+uint direction_index(float3 pointing,
+                     uint azimuth_divisions,
+                     uint elevation_divisions) {
+    const float elevation = asin(clamp(pointing.y, -1.0f, 1.0f));
+    const float azimuth = M_PI_2_F - fabs(elevation) < 1.0e-6f
+                                  ? 0
+                                  : atan2(pointing.x, -pointing.z);
+
+    const float azimuth_angle = 360.0f / azimuth_divisions;
+    float az = degrees(-azimuth) + azimuth_angle / 2;
+    while (az < 0) {
+        az += 360;
     }
+    const uint azimuth_index = (uint)(az / azimuth_angle) % azimuth_divisions;
+
+    const float elevation_angle = 180.0f / (elevation_divisions + 1);
+    const float el = degrees(elevation) + 90 + elevation_angle / 2;
+    const uint adjusted =
+            (uint)(el / elevation_angle) % (2 * (elevation_divisions + 1));
+    const uint elevation_index = clamp(adjusted, 1u, elevation_divisions) - 1;
+
+    return azimuth_index * elevation_divisions + elevation_index;
+}
+
+//  Histogram layout is [time bin][azimuth][elevation][band], so that the
+//  buffer can be grown by appending.
+kernel void bin_impulses(const global impulse* impulses,
+                         float3 receiver,
+                         float speed_of_sound,
+                         float sample_rate,
+                         uint azimuth_divisions,
+                         uint elevation_divisions,
+                         uint bins,
+                         volatile global float* histogram,
+                         volatile global uint* used_bins) {
+    const size_t thread = get_global_id(0);
+    const impulse this_impulse = impulses[thread];
+
+    //  Empty outputs are marked with a zero distance.
+    if (!this_impulse.distance) {
+        return;
+    }
+
+    const uint bin =
+            (uint)(this_impulse.distance / speed_of_sound * sample_rate);
+    atomic_max(used_bins, bin + 1);
+
+    //  The host is responsible for making the histogram large enough.
+    if (bins <= bin) {
+        return;
+    }
+
+    const uint directions = azimuth_divisions * elevation_divisions;
+    const uint direction =
+            directions == 1
+                    ? 0
+                    : direction_index(normalize(this_impulse.position -
+                                                receiver),
+                                      azimuth_divisions,
+                                      elevation_divisions);
+
+    volatile global float* out = histogram + (bin * directions + direction) * 8;
+    const bands_type volume = this_impulse.volume;
+    atomic_add_float(out + 0, volume.s0);
+    atomic_add_float(out + 1, volume.s1);
+    atomic_add_float(out + 2, volume.s2);
+    atomic_add_float(out + 3, volume.s3);
+    atomic_add_float(out + 4, volume.s4);
+    atomic_add_float(out + 5, volume.s5);
+    atomic_add_float(out + 6, volume.s6);
+    atomic_add_float(out + 7, volume.s7);
 }
 
 )";
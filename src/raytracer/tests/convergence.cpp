@@ -0,0 +1,81 @@
+#include "raytracer/stochastic/convergence.h"
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <random>
+
+using namespace wayverb::raytracer::stochastic;
+using namespace wayverb::core;
+
+namespace {
+
+auto exponential_decay(size_t bins, float scale) {
+    util::aligned::vector<bands_type> ret;
+    for (auto i = 0u; i != bins; ++i) {
+        ret.emplace_back(make_bands_type(scale * std::exp(-0.1f * i)));
+    }
+    return ret;
+}
+
+TEST(convergence, identical_segments) {
+    convergence_monitor monitor;
+    ASSERT_TRUE(std::isinf(monitor.relative_error()));
+
+    for (auto i = 0u; i != convergence_monitor::min_segments - 1; ++i) {
+        monitor.add_segment(exponential_decay(100, 1), 1000);
+        ASSERT_FALSE(monitor.converged(0.01));
+    }
+
+    monitor.add_segment(exponential_decay(100, 1), 1000);
+    ASSERT_NEAR(monitor.relative_error(), 0, 1.0e-6);
+    ASSERT_TRUE(monitor.converged(0.01));
+}
+
+TEST(convergence, normalised_by_ray_count) {
+    //  Half the rays should find half the energy.
+    convergence_monitor monitor;
+    for (auto i = 0u; i != convergence_monitor::min_segments; ++i) {
+        monitor.add_segment(exponential_decay(100, 1), 1000);
+    }
+    monitor.add_segment(exponential_decay(100, 0.5), 500);
+    ASSERT_NEAR(monitor.relative_error(), 0, 1.0e-6);
+}
+
+TEST(convergence, silent) {
+    convergence_monitor monitor;
+    for (auto i = 0u; i != convergence_monitor::min_segments; ++i) {
+        monitor.add_segment(exponential_decay(100, 0), 1000);
+    }
+    ASSERT_FALSE(monitor.converged(0.01));
+}
+
+TEST(convergence, error_falls_with_segments) {
+    std::default_random_engine engine{std::random_device{}()};
+    std::uniform_real_distribution<float> dist{0.5, 1.5};
+
+    convergence_monitor monitor;
+    const auto add_segments = [&](auto segments) {
+        for (auto i = 0u; i != segments; ++i) {
+            auto histogram = exponential_decay(100, 1);
+            for (auto& bin : histogram) {
+                bin *= make_bands_type(dist(engine));
+            }
+            monitor.add_segment(histogram, 1000);
+        }
+    };
+
+    add_segments(10);
+    const auto few = monitor.relative_error();
+    ASSERT_LT(0, few);
+
+    add_segments(990);
+    const auto many = monitor.relative_error();
+    ASSERT_LT(many, few);
+
+    //  The standard error should fall with the square root of the number of
+    //  segments, so allow plenty of slack for the randomness.
+    ASSERT_LT(many, few / 3);
+}
+
+}  // namespace
@@ -46,7 +46,7 @@ void run_test(const Attenuator& attenuator) {
                 compute_context{},
                 voxelised,
                 source,
-                receiver,
+                util::aligned::vector<glm::vec3>{receiver},
                 environment,
                 true,
                 [](auto i, auto tot) {
@@ -69,7 +69,8 @@ void run_test(const Attenuator& attenuator) {
 
     const auto histogram_energy = [&] {
         const auto histogram =
-                compute_summed_histogram(std::get<0>(*results), attenuator)
+                compute_summed_histogram(std::get<0>(*results).front(),
+                                         attenuator)
                         .histogram;
         const auto histogram_bin = glm::distance(source, receiver) *
                                    params.histogram_sample_rate /
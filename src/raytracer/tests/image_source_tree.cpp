@@ -0,0 +1,171 @@
+#include "raytracer/image_source/reflection_path_builder.h"
+#include "raytracer/image_source/tree.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+
+using namespace wayverb::raytracer;
+using namespace wayverb::core;
+
+namespace {
+
+using image_source::path_element;
+using image_source::tree;
+
+size_t count_children(const tree& t, tree::node_index node) {
+    size_t ret = 0;
+    t.for_each_child(node, [&](auto) { ret += 1; });
+    return ret;
+}
+
+/// Returns the node at the end of path, or none if it isn't in the tree.
+tree::node_index find_path(const tree& t,
+                           const util::aligned::vector<path_element>& path) {
+    auto node = tree::root;
+    for (const auto& item : path) {
+        node = t.find(node, item.index);
+        if (node == tree::none) {
+            break;
+        }
+    }
+    return node;
+}
+
+auto make_random_paths(size_t num) {
+    std::default_random_engine engine{std::random_device{}()};
+    std::uniform_int_distribution<cl_uint> distribution{0, 99};
+
+    const auto make_path = [&] {
+        util::aligned::vector<path_element> ret(distribution(engine) % 10);
+        std::generate(ret.begin(), ret.end(), [&] {
+            return path_element{distribution(engine), true};
+        });
+        return ret;
+    };
+
+    util::aligned::vector<util::aligned::vector<path_element>> ret(num);
+    std::generate(ret.begin(), ret.end(), make_path);
+    return ret;
+}
+
+}  // namespace
+
+TEST(image_source_tree, construct_image_source_tree_small) {
+    const util::aligned::vector<util::aligned::vector<path_element>> paths{
+            util::aligned::vector<path_element>{path_element{0, true},
+                                                path_element{0, true},
+                                                path_element{0, true}},
+            util::aligned::vector<path_element>{path_element{0, true},
+                                                path_element{1, true},
+                                                path_element{0, true}}};
+
+    tree ist{};
+    for (const auto& path : paths) {
+        ist.push(path);
+    }
+
+    //  The root, then 0, then 0 and 1, then a 0 under each.
+    ASSERT_EQ(ist.size(), 6);
+    ASSERT_EQ(count_children(ist, tree::root), 1);
+
+    const auto first = ist.find(tree::root, 0);
+    ASSERT_NE(first, tree::none);
+    ASSERT_EQ(ist.get_parent(first), tree::root);
+    ASSERT_EQ(count_children(ist, first), 2);
+    ASSERT_NE(ist.find(first, 0), tree::none);
+    ASSERT_NE(ist.find(first, 1), tree::none);
+    ASSERT_EQ(ist.find(first, 2), tree::none);
+
+    for (const auto& path : paths) {
+        ASSERT_NE(find_path(ist, path), tree::none);
+    }
+}
+
+TEST(image_source_tree, visibility) {
+    tree t{};
+    t.push({path_element{3, false}, path_element{4, false}});
+    t.push({path_element{3, true}});
+
+    const auto a = t.find(tree::root, 3);
+    ASSERT_TRUE(t.get_item(a).visible);
+    ASSERT_FALSE(t.get_item(t.find(a, 4)).visible);
+}
+
+TEST(image_source_tree, construct_image_source_tree_large) {
+    const auto paths = make_random_paths(100000);
+
+    tree whole{};
+    for (const auto& path : paths) {
+        whole.push(path);
+    }
+
+    //  Build the same paths in several pieces, and then merge them.
+    tree merged{};
+    const auto pieces = 4;
+    for (auto i = 0; i != pieces; ++i) {
+        tree piece{};
+        for (auto j = i * paths.size() / pieces,
+                  end = (i + 1) * paths.size() / pieces;
+             j != end;
+             ++j) {
+            piece.push(paths[j]);
+        }
+        merged.merge(piece);
+    }
+
+    ASSERT_EQ(whole.size(), merged.size());
+    for (const auto& path : paths) {
+        ASSERT_NE(find_path(whole, path), tree::none);
+        ASSERT_NE(find_path(merged, path), tree::none);
+    }
+
+    //  Every node is reachable from the root exactly once.
+    size_t reachable = 0;
+    const std::function<void(tree::node_index)> visit = [&](auto node) {
+        reachable += 1;
+        merged.for_each_child(node, visit);
+    };
+    visit(tree::root);
+    ASSERT_EQ(reachable, merged.size());
+}
+
+TEST(image_source_tree, reflection_path_builder) {
+    //  Enough rays that they're split over several chunks.
+    const auto rays = 3 * image_source::reflection_path_builder::
+                                  min_rays_per_chunk +
+                      5;
+    const auto steps = 4;
+    const auto paths = [&] {
+        auto ret = make_random_paths(rays);
+        for (auto& path : ret) {
+            path.resize(steps, path_element{7, false});
+        }
+        return ret;
+    }();
+
+    image_source::reflection_path_builder builder{rays};
+    for (auto step = 0; step != steps; ++step) {
+        util::aligned::vector<reflection> reflections(rays);
+        for (auto i = 0u; i != rays; ++i) {
+            //  Rays with odd indices stop after the second reflection.
+            reflections[i].keep_going = step < 2 || i % 2 == 0;
+            reflections[i].triangle = paths[i][step].index;
+            reflections[i].receiver_visible = paths[i][step].visible;
+        }
+        builder.push(reflections);
+    }
+
+    tree built{};
+    builder.merge_into(built);
+
+    tree expected{};
+    for (auto i = 0u; i != rays; ++i) {
+        auto path = paths[i];
+        path.resize(i % 2 == 0 ? steps : 2);
+        expected.push(path);
+        ASSERT_NE(find_path(built, path), tree::none);
+    }
+    ASSERT_EQ(built.size(), expected.size());
+}
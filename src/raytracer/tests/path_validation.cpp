@@ -0,0 +1,165 @@
+#include "raytracer/image_source/postprocess_branches.h"
+#include "raytracer/image_source/validation.h"
+
+#include "core/geo/box.h"
+#include "core/spatial_division/voxelised_scene_data.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace wayverb::raytracer;
+using namespace wayverb::core;
+
+namespace {
+
+/// Every sequence of reflections up to max_order, all marked as visible.
+/// Rays can't reflect from the same triangle twice in a row, so those paths
+/// are left out.
+image_source::tree make_exhaustive_tree(size_t triangles, size_t max_order) {
+    image_source::tree ret;
+    util::aligned::vector<image_source::tree::node_index> frontier{
+            image_source::tree::root};
+    for (auto order = 0u; order != max_order; ++order) {
+        util::aligned::vector<image_source::tree::node_index> next;
+        for (const auto parent : frontier) {
+            for (auto i = 0u; i != triangles; ++i) {
+                if (parent != image_source::tree::root &&
+                    ret.get_item(parent).index == i) {
+                    continue;
+                }
+                next.emplace_back(ret.insert(
+                        parent, image_source::path_element{i, true}));
+            }
+        }
+        frontier = std::move(next);
+    }
+    return ret;
+}
+
+/// A box in which every wall has its own surface, and every band of every
+/// surface has a different absorption, so that paths which reflect from
+/// different walls have different volumes.
+auto make_scene_with_distinct_walls(const geo::box& box) {
+    const auto box_data =
+            geo::get_scene_data(box, make_surface<simulation_bands>(0, 0));
+
+    //  The box triangles come in pairs, one pair per wall.
+    auto triangles = box_data.get_triangles();
+    for (auto i = 0u; i != triangles.size(); ++i) {
+        triangles[i].surface = i / 2;
+    }
+
+    util::aligned::vector<surface<simulation_bands>> surfaces;
+    for (auto wall = 0u; wall != triangles.size() / 2; ++wall) {
+        auto s = make_surface<simulation_bands>(0, 0);
+        for (auto band = 0u; band != simulation_bands; ++band) {
+            s.absorption.s[band] = 0.05f + 0.03f * wall + 0.07f * band;
+        }
+        surfaces.emplace_back(s);
+    }
+
+    return make_scene_data(
+            std::move(triangles), box_data.get_vertices(), std::move(surfaces));
+}
+
+bool volumes_match(const impulse<simulation_bands>& a,
+                   const impulse<simulation_bands>& b) {
+    for (auto band = 0u; band != simulation_bands; ++band) {
+        const auto tolerance = std::abs(b.volume.s[band]) * 1.0e-3f + 1.0e-9f;
+        if (tolerance < std::abs(a.volume.s[band] - b.volume.s[band])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(path_validation, candidate_paths) {
+    image_source::tree tree;
+    tree.push({{3, true}, {5, false}, {7, true}});
+    tree.push({{3, true}, {4, true}});
+
+    const geo::box box{glm::vec3{0}, glm::vec3{4, 3, 6}};
+    const auto voxelised = make_voxelised_scene_data(
+            geo::get_scene_data(box, make_surface<simulation_bands>(0, 0)),
+            5,
+            0.1f);
+
+    const auto candidates = image_source::collect_candidate_paths(
+            tree, glm::vec3{1, 2, 1}, voxelised);
+
+    //  The node reflecting from triangle 5 isn't visible.
+    ASSERT_EQ(size(candidates), 3);
+    ASSERT_EQ(candidates.offsets,
+              (util::aligned::vector<cl_uint>{0, 1, 4, 6}));
+    ASSERT_EQ(candidates.triangles,
+              (util::aligned::vector<cl_uint>{3, 3, 5, 7, 3, 4}));
+    ASSERT_EQ(candidates.image_sources.size(), candidates.triangles.size());
+}
+
+TEST(path_validation, matches_host) {
+    const geo::box box{glm::vec3{0}, glm::vec3{4, 3, 6}};
+    const auto voxelised = make_voxelised_scene_data(
+            make_scene_with_distinct_walls(box), 5, 0.1f);
+
+    const compute_context cc{};
+    const scene_buffers buffers{cc.context, voxelised};
+
+    const glm::vec3 source{1.1, 2.2, 1.3};
+    const glm::vec3 receiver{2.4, 1.5, 2.6};
+
+    const auto tree = make_exhaustive_tree(
+            voxelised.get_scene_data().get_triangles().size(), 3);
+    const auto candidates =
+            image_source::collect_candidate_paths(tree, source, voxelised);
+
+    image_source::path_validator validator{cc};
+
+    const auto by_distance = [](const auto& a, const auto& b) {
+        return a.distance < b.distance;
+    };
+
+    auto host = image_source::postprocess_branches(
+            tree, source, receiver, voxelised, false);
+    std::sort(host.begin(), host.end(), by_distance);
+
+    const auto device =
+            image_source::postprocess_candidates(validator,
+                                                 buffers,
+                                                 candidates,
+                                                 source,
+                                                 receiver,
+                                                 voxelised,
+                                                 false);
+
+    //  Paths which graze the edges of triangles may be classified
+    //  differently due to differences in precision, but there should be very
+    //  few of them.
+    ASSERT_FALSE(host.empty());
+    ASSERT_NEAR(host.size(), device.size(), host.size() * 0.01);
+
+    //  Each device impulse must have a host impulse with the same length and
+    //  the same per-band volume.
+    //  Different paths may have the same length, so every host impulse of
+    //  about the right length is considered.
+    constexpr auto distance_tolerance = 1.0e-3f;
+    for (const auto& impulse : device) {
+        auto lower = impulse;
+        lower.distance -= distance_tolerance;
+        auto upper = impulse;
+        upper.distance += distance_tolerance;
+
+        const auto b =
+                std::lower_bound(host.begin(), host.end(), lower, by_distance);
+        const auto e =
+                std::upper_bound(host.begin(), host.end(), upper, by_distance);
+        ASSERT_NE(b, e) << "no host path with distance " << impulse.distance;
+        ASSERT_TRUE(std::any_of(b, e, [&](const auto& i) {
+            return volumes_match(impulse, i);
+        })) << "no host path with matching volumes at distance "
+            << impulse.distance;
+    }
+}
+
+}  // namespace
@@ -1,3 +1,4 @@
+#include "raytracer/raytracer.h"
 #include "raytracer/reflector.h"
 
 #include "core/conversions.h"
@@ -8,6 +9,9 @@
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <atomic>
+
 using namespace wayverb::raytracer;
 using namespace wayverb::core;
 
@@ -152,4 +156,159 @@ TEST_F(reflector_fixture, multi_layer_reflections) {
         }
     }
 }
+
+TEST_F(reflector_fixture, reproducible_scattering) {
+    //  The same seed should give the same results, even when the rays are
+    //  split over several reflectors.
+    constexpr cl_uint seed = 1234;
+    const auto split = rays.size() / 3;
+
+    class reflector whole{cc, receiver, begin(rays), end(rays), seed};
+    class reflector first{cc, receiver, begin(rays), begin(rays) + split, seed};
+    class reflector second{cc,
+                           receiver,
+                           begin(rays) + split,
+                           end(rays),
+                           seed,
+                           static_cast<cl_uint>(split)};
+
+    for (auto i = 0u; i != 10; ++i) {
+        const auto a = whole.run_step(buffers);
+        auto b = first.run_step(buffers);
+        const auto c = second.run_step(buffers);
+        b.insert(end(b), begin(c), end(c));
+
+        ASSERT_EQ(a.size(), b.size());
+        for (auto j = 0u; j != a.size(); ++j) {
+            ASSERT_EQ(a[j].triangle, b[j].triangle);
+            ASSERT_EQ(to_vec3{}(a[j].position), to_vec3{}(b[j].position));
+        }
+    }
+}
+
+TEST_F(reflector_fixture, russian_roulette) {
+    //  Every reflection loses half its energy, so roulette starts on the
+    //  third bounce.
+    const scene_buffers absorbing{
+            cc.context,
+            get_voxelised(geo::get_scene_data(
+                    box, make_surface<simulation_bands>(0.5, 0)))};
+
+    class reflector r{cc, receiver, begin(rays), end(rays), 1234, 0, 0.5f};
+
+    util::aligned::vector<float> weights(rays.size(), 1);
+    util::aligned::vector<bool> stopped(rays.size(), false);
+
+    for (auto i = 0u; i != 6; ++i) {
+        ASSERT_EQ(r.get_num_active(),
+                  static_cast<size_t>(
+                          std::count(begin(stopped), end(stopped), false)));
+
+        const auto reflections = r.run_step(absorbing);
+        for (auto j = 0u; j != reflections.size(); ++j) {
+            if (stopped[j]) {
+                //  Stopped rays stay stopped.
+                ASSERT_FALSE(reflections[j].keep_going);
+            } else if (reflections[j].keep_going) {
+                ASSERT_LE(1, reflections[j].weight);
+                weights[j] *= reflections[j].weight;
+            } else {
+                stopped[j] = true;
+            }
+        }
+
+        //  On average, the weights of the survivors should make up for the
+        //  rays which were stopped.
+        auto total = 0.0;
+        for (auto j = 0u; j != rays.size(); ++j) {
+            if (!stopped[j]) {
+                total += weights[j];
+            }
+        }
+        ASSERT_NEAR(total / rays.size(), 1, 0.2);
+    }
+}
+
+TEST_F(reflector_fixture, segment_size) {
+    for (const auto receivers : {1, 16}) {
+        const auto rays = compute_rays_per_segment(cc.device, receivers);
+        ASSERT_LE(min_rays_per_segment, rays);
+        ASSERT_LE(rays, max_rays_per_segment);
+    }
+}
+
+/// Counts the rays and segments which reach accumulate.
+class counting_group_processor final {
+public:
+    explicit counting_group_processor(size_t rays)
+            : rays_{rays} {}
+
+    void process(reflection_batch& reflections,
+                 const scene_buffers&,
+                 size_t step,
+                 size_t total) {
+        ASSERT_EQ(reflections.size(), rays_);
+        ASSERT_LT(step, total);
+    }
+
+    size_t get_results() const { return rays_; }
+
+private:
+    size_t rays_;
+};
+
+class counting_processor final {
+public:
+    counting_group_processor get_group_processor(size_t rays) const {
+        return counting_group_processor{rays};
+    }
+
+    void accumulate(const counting_group_processor& processor) {
+        rays_ += processor.get_results();
+        segments_ += 1;
+    }
+
+    std::pair<size_t, size_t> get_results() const {
+        return std::make_pair(rays_, segments_);
+    }
+
+private:
+    size_t rays_ = 0;
+    size_t segments_ = 0;
+};
+
+struct make_counting_processor final {
+    template <typename... Ts>
+    counting_processor get_processor(Ts&&...) const {
+        return {};
+    }
+};
+
+TEST_F(reflector_fixture, pipelined_segments) {
+    //  Several segments, with a partial one at the end.
+    const auto per_segment = compute_rays_per_segment(cc.device, 1);
+    const auto num_rays = 2 * per_segment + 123;
+    const auto directions = get_random_directions(num_rays);
+
+    const std::atomic_bool keep_going{true};
+    size_t callbacks = 0;
+    const auto results = run(begin(directions),
+                             end(directions),
+                             cc,
+                             voxelised,
+                             source,
+                             util::aligned::vector<glm::vec3>{receiver},
+                             environment{},
+                             keep_going,
+                             [&](auto group, auto groups) {
+                                 ASSERT_EQ(group, callbacks);
+                                 ASSERT_EQ(groups, 3);
+                                 callbacks += 1;
+                             },
+                             std::make_tuple(make_counting_processor{}));
+
+    ASSERT_TRUE(results);
+    ASSERT_EQ(std::get<0>(*results), std::make_pair(num_rays, size_t{3}));
+    ASSERT_EQ(callbacks, 3);
+}
 }  // namespace
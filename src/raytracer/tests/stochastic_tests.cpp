@@ -1,11 +1,22 @@
+#include "raytracer/histogram.h"
+#include "raytracer/optimum_reflection_number.h"
+#include "raytracer/reflection_processor/stochastic_histogram.h"
+#include "raytracer/reflector.h"
+#include "raytracer/stochastic/device_histogram.h"
 #include "raytracer/stochastic/finder.h"
 
+#include "core/azimuth_elevation.h"
 #include "core/geo/box.h"
 #include "core/scene_data_loader.h"
 #include "core/spatial_division/voxelised_scene_data.h"
 
+#include "utilities/map_to_vector.h"
+
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <random>
+
 #ifndef OBJ_PATH
 #define OBJ_PATH ""
 #endif
@@ -28,9 +39,9 @@ TEST(stochastic, bad_reflections_box) {
     const scene_buffers buffers{cc.context, voxelised};
 
     const util::aligned::vector<reflection> bad_reflections{
-            reflection{cl_float3{{2.66277409, 0.0182733424, 6}}, 10, 1, 1},
-            reflection{cl_float3{{3.34029818, 1.76905692, 6}}, 10, 1, 1},
-            reflection{cl_float3{{4, 2.46449089, 1.54567611}}, 7, 1, 1},
+            reflection{cl_float3{{2.66277409, 0.0182733424, 6}}, 10, 1, 1, 1},
+            reflection{cl_float3{{3.34029818, 1.76905692, 6}}, 10, 1, 1, 1},
+            reflection{cl_float3{{4, 2.46449089, 1.54567611}}, 7, 1, 1, 1},
     };
 
     const auto receiver_radius = 1.0f;
@@ -61,14 +72,25 @@ TEST(stochastic, bad_reflections_vault) {
     const scene_buffers buffers{cc.context, voxelised};
 
     const util::aligned::vector<reflection> bad_reflections{
-            reflection{cl_float3{{2.29054403, 1.00505638, -1.5}}, 2906, 1, 1},
-            reflection{
-                    cl_float3{{5.28400469, 3.0999999, -3.8193748}}, 2671, 1, 1},
-            reflection{
-                    cl_float3{{5.29999971, 2.40043592, -2.991467}}, 2808, 1, 1},
+            reflection{cl_float3{{2.29054403, 1.00505638, -1.5}},
+                       2906,
+                       1,
+                       1,
+                       1},
+            reflection{cl_float3{{5.28400469, 3.0999999, -3.8193748}},
+                       2671,
+                       1,
+                       1,
+                       1},
+            reflection{cl_float3{{5.29999971, 2.40043592, -2.991467}},
+                       2808,
+                       1,
+                       1,
+                       1},
             reflection{cl_float3{{-1.29793882, 2.44466829, 5.30000019}},
                        1705,
                        1,
+                       1,
                        1},
     };
 
@@ -85,3 +107,205 @@ TEST(stochastic, bad_reflections_vault) {
 
     diff.process(begin(bad_reflections), end(bad_reflections), buffers);
 }
+
+TEST(stochastic, multiple_receivers) {
+    const geo::box box{glm::vec3{0, 0, 0}, glm::vec3{4, 3, 6}};
+    constexpr glm::vec3 source{1, 2, 1};
+    const util::aligned::vector<glm::vec3> receivers{{2, 1, 5}, {3, 2, 2}};
+    constexpr auto surface = make_surface<simulation_bands>(0.1, 0.5);
+
+    const compute_context cc{};
+
+    const auto scene = geo::get_scene_data(box, surface);
+    const auto voxelised = make_voxelised_scene_data(scene, 5, 0.1f);
+
+    const scene_buffers buffers{cc.context, voxelised};
+
+    constexpr auto rays = 1 << 10;
+    std::default_random_engine engine{0};
+    util::aligned::vector<geo::ray> directions;
+    for (auto i = 0; i != rays; ++i) {
+        directions.emplace_back(source, random_unit_vector(engine));
+    }
+
+    constexpr auto seed = 0;
+    constexpr auto receiver_radius = 1.0f;
+
+    const auto compute_energy = [&](const auto& receiver) {
+        return stochastic::compute_ray_energy(
+                rays, source, receiver, receiver_radius);
+    };
+
+    //  Trace all receivers together, and the second receiver on its own.
+    //  The second receiver should see exactly the same impulses in each case.
+    reflector shared_reflector{
+            cc, receivers, begin(directions), end(directions), seed};
+    stochastic::finder shared_finder{
+            cc,
+            rays,
+            source,
+            receivers,
+            receiver_radius,
+            util::map_to_vector(
+                    begin(receivers), end(receivers), compute_energy)};
+
+    reflector single_reflector{
+            cc, receivers[1], begin(directions), end(directions), seed};
+    stochastic::finder single_finder{cc,
+                                     rays,
+                                     source,
+                                     receivers[1],
+                                     receiver_radius,
+                                     compute_energy(receivers[1])};
+
+    for (auto step = 0; step != 5; ++step) {
+        const auto shared = shared_finder.process(
+                shared_reflector.run_step_on_device(buffers), buffers);
+        const auto single = single_finder.process(
+                single_reflector.run_step_on_device(buffers), buffers);
+
+        ASSERT_EQ(shared.size(), 2);
+        ASSERT_EQ(single.size(), 1);
+
+        const auto check = [](const auto& a, const auto& b) {
+            ASSERT_EQ(a.size(), b.size());
+            for (auto i = 0u; i != a.size(); ++i) {
+                ASSERT_EQ(a[i].distance, b[i].distance);
+                for (auto band = 0u; band != simulation_bands; ++band) {
+                    ASSERT_FLOAT_EQ(a[i].volume.s[band], b[i].volume.s[band]);
+                }
+            }
+        };
+
+        check(shared[1].specular, single.front().specular);
+        check(shared[1].stochastic, single.front().stochastic);
+    }
+}
+
+TEST(stochastic, device_histogram_matches_host) {
+    const geo::box box{glm::vec3{0, 0, 0}, glm::vec3{4, 3, 6}};
+    constexpr glm::vec3 source{1, 2, 1}, receiver{2, 1, 5};
+    constexpr auto surface = make_surface<simulation_bands>(0.1, 0.5);
+
+    const compute_context cc{};
+
+    const auto scene = geo::get_scene_data(box, surface);
+    const auto voxelised = make_voxelised_scene_data(scene, 5, 0.1f);
+
+    const scene_buffers buffers{cc.context, voxelised};
+
+    constexpr auto rays = 1 << 10;
+    std::default_random_engine engine{0};
+    util::aligned::vector<geo::ray> directions;
+    for (auto i = 0; i != rays; ++i) {
+        directions.emplace_back(source, random_unit_vector(engine));
+    }
+
+    constexpr auto seed = 0;
+    constexpr auto receiver_radius = 1.0f;
+    constexpr auto speed_of_sound = 340.0;
+    constexpr auto sample_rate = 1000.0;
+    constexpr auto steps = 10;
+
+    const auto energy = stochastic::compute_ray_energy(
+            rays, source, receiver, receiver_radius);
+
+    //  The same rays are traced twice, binning on the host in one case and
+    //  on the device in the other.
+    reflector host_reflector{
+            cc, receiver, begin(directions), end(directions), seed};
+    stochastic::finder host_finder{
+            cc, rays, source, receiver, receiver_radius, energy};
+    util::aligned::vector<bands_type> host;
+
+    reflector device_reflector{
+            cc, receiver, begin(directions), end(directions), seed};
+    stochastic::finder device_finder{
+            cc, rays, source, receiver, receiver_radius, energy};
+    util::aligned::vector<stochastic::device_histogram> histograms{
+            stochastic::make_device_histogram<stochastic::energy_histogram>(
+                    cc,
+                    device_finder.get_queue(),
+                    receiver,
+                    speed_of_sound,
+                    sample_rate)};
+    histograms.front().reserve((steps + 1) * glm::length(box.get_max()));
+
+    std::vector<cl::Event> consumers;
+    for (auto step = 0; step != steps; ++step) {
+        const auto results = host_finder.process(
+                host_reflector.run_step_on_device(buffers), buffers);
+        for (const auto& impulses :
+             {results.front().specular, results.front().stochastic}) {
+            incremental_histogram(
+                    host,
+                    make_histogram_iterator(begin(impulses), speed_of_sound),
+                    make_histogram_iterator(end(impulses), speed_of_sound),
+                    sample_rate,
+                    dirac_sum_functor{});
+        }
+
+        auto batch = device_reflector.run_step_on_device(buffers, consumers);
+        device_finder.process(batch, buffers, histograms, true);
+        consumers = batch.get_consumer_events();
+    }
+
+    auto device =
+            read_histogram(histograms.front(), stochastic::energy_histogram{})
+                    .histogram;
+
+    //  Device and host may disagree about which bin an impulse lands in if it
+    //  is very close to a boundary, and atomic float sums aren't ordered, so
+    //  the running totals are compared rather than the individual bins.
+    ASSERT_FALSE(host.empty());
+    ASSERT_NEAR(host.size(), device.size(), 1);
+    const auto bins = std::max(host.size(), device.size());
+    host.resize(bins, make_bands_type(0));
+    device.resize(bins, make_bands_type(0));
+
+    for (auto band = 0u; band != simulation_bands; ++band) {
+        double total = 0;
+        for (const auto& i : host) {
+            total += i.s[band];
+        }
+        ASSERT_LT(0, total);
+
+        double host_sum = 0;
+        double device_sum = 0;
+        for (auto i = 0u; i != host.size(); ++i) {
+            host_sum += host[i].s[band];
+            device_sum += device[i].s[band];
+            ASSERT_NEAR(host_sum, device_sum, total * 1.0e-3);
+        }
+    }
+}
+
+TEST(stochastic, max_impulse_distance) {
+    const geo::box box{glm::vec3{0, 0, 0}, glm::vec3{4, 3, 6}};
+
+    //  Low absorption means lots of reflections, so the hard limit is far
+    //  longer than any realistic path.
+    const auto voxelised = make_voxelised_scene_data(
+            geo::get_scene_data(box, make_surface<simulation_bands>(0.01, 0)),
+            5,
+            0.1f);
+
+    const auto segments = compute_optimum_reflection_number(
+                                  voxelised.get_scene_data()) +
+                          1;
+    const auto max_segment_length =
+            reflection_processor::compute_max_segment_length(voxelised);
+    //  4V/S
+    const auto mean_free_path =
+            4 * (4 * 3 * 6) / (2 * (4 * 3 + 4 * 6 + 3 * 6.0));
+
+    const auto distance =
+            reflection_processor::compute_max_impulse_distance(voxelised);
+
+    //  Paths of the mean length must always fit.
+    ASSERT_LE(segments * mean_free_path, distance);
+    ASSERT_LT(distance, segments * max_segment_length);
+    ASSERT_NEAR(distance,
+                2 * segments * mean_free_path + max_segment_length,
+                distance * 1.0e-3);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <functional>
+#include <iosfwd>
+#include <string>
+
+namespace util {
+
+/// A directory for files which are kept between runs, which only the current
+/// user may read or write.
+/// This is $XDG_CACHE_HOME/wayverb/name, or ~/.cache/wayverb/name if
+/// XDG_CACHE_HOME isn't set, and is created with mode 0700 if necessary.
+/// Returns an empty string if the directory can't be created, or if it
+/// already exists but belongs to someone else or is open to other users.
+std::string user_cache_directory(const std::string& name);
+
+/// Writes a file through a uniquely-named temporary in the same directory,
+/// which is then renamed over path.
+/// Concurrent writers never share a temporary, and readers never see a
+/// half-written file.
+/// If write returns false, the temporary is removed and path is left alone.
+bool write_file_atomically(const std::string& path,
+                           const std::function<bool(std::ostream&)>& write);
+
+}  // namespace util
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace util {
+
+/// FNV-1a. std::hash gives no guarantees about stability between runs, so
+/// it can't be used to name files or to identify data across runs.
+class fnv1a final {
+public:
+    void update(const char* data, size_t size) {
+        for (auto i = 0u; i != size; ++i) {
+            value_ = (value_ ^ static_cast<unsigned char>(data[i])) *
+                     1099511628211ull;
+        }
+    }
+
+    void update(const std::string& str) {
+        //  Include the terminator so that "ab"+"c" and "a"+"bc" differ.
+        update(str.c_str(), str.size() + 1);
+    }
+
+    /// Only use this for types without padding, or the result will depend on
+    /// whatever happens to be in the padding bytes.
+    template <typename T>
+    void update_value(const T& t) {
+        update(reinterpret_cast<const char*>(&t), sizeof(T));
+    }
+
+    uint64_t get() const { return value_; }
+
+private:
+    uint64_t value_{14695981039346656037ull};
+};
+
+}  // namespace util
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "utilities/scoped_thread.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <experimental/optional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util {
+namespace detail {
+
+template <typename Task>
+class work_queue final {
+public:
+    void push_back(Task task) {
+        std::lock_guard<std::mutex> lck{mutex_};
+        tasks_.push_back(std::move(task));
+    }
+
+    std::experimental::optional<Task> pop_back() {
+        std::lock_guard<std::mutex> lck{mutex_};
+        if (tasks_.empty()) {
+            return std::experimental::nullopt;
+        }
+        auto ret = std::move(tasks_.back());
+        tasks_.pop_back();
+        return std::move(ret);
+    }
+
+    std::experimental::optional<Task> pop_front() {
+        std::lock_guard<std::mutex> lck{mutex_};
+        if (tasks_.empty()) {
+            return std::experimental::nullopt;
+        }
+        auto ret = std::move(tasks_.front());
+        tasks_.pop_front();
+        return std::move(ret);
+    }
+
+private:
+    std::mutex mutex_;
+    std::deque<Task> tasks_;
+};
+
+}  // namespace detail
+
+/// Calls callback(worker, task, spawn) for every task, using a fixed number of
+/// threads.
+///
+/// worker is the index of the calling thread, in the range [0, num_threads),
+/// so per-thread state can be kept in a plain vector.
+/// spawn(Task) adds another task, so big tasks can be split up as they go.
+///
+/// Each thread has its own queue, and works depth-first from the back of it.
+/// Idle threads steal from the front of other queues, where the oldest (and
+/// usually biggest) tasks are.
+///
+/// Tasks run in no particular order, and on no particular thread, so results
+/// collected per worker and then concatenated come out in a different order
+/// each run.
+///
+/// Returns once all tasks, including spawned ones, have finished.
+/// If callback throws, the remaining tasks are abandoned and the first
+/// exception is rethrown.
+template <typename Task, typename Callback>
+void work_stealing_for_each(std::vector<Task> tasks,
+                            size_t num_threads,
+                            const Callback& callback) {
+    num_threads = std::max(num_threads, size_t{1});
+
+    std::vector<detail::work_queue<Task>> queues(num_threads);
+    for (auto i = 0u; i != tasks.size(); ++i) {
+        queues[i % num_threads].push_back(std::move(tasks[i]));
+    }
+
+    //  Spawned tasks are counted before their parent finishes, so this only
+    //  reaches zero once everything is done.
+    std::atomic<size_t> outstanding{tasks.size()};
+
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    std::atomic_bool failed{false};
+
+    const auto worker = [&](size_t index) {
+        const auto spawn = [&](Task task) {
+            ++outstanding;
+            queues[index].push_back(std::move(task));
+        };
+
+        while (outstanding && !failed) {
+            auto task = queues[index].pop_back();
+            for (auto i = 1u; !task && i != num_threads; ++i) {
+                task = queues[(index + i) % num_threads].pop_front();
+            }
+
+            if (!task) {
+                //  Someone else is still busy, and might spawn more work.
+                std::this_thread::yield();
+                continue;
+            }
+
+            try {
+                callback(index, std::move(*task), spawn);
+            } catch (...) {
+                std::lock_guard<std::mutex> lck{error_mutex};
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+            --outstanding;
+        }
+    };
+
+    {
+        std::vector<scoped_thread> threads;
+        threads.reserve(num_threads - 1);
+        for (auto i = 1u; i != num_threads; ++i) {
+            threads.emplace_back(std::thread{worker, i});
+        }
+        worker(0);
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+}  // namespace util
@@ -0,0 +1,84 @@
+#include "utilities/cache_file.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+namespace util {
+namespace {
+
+bool make_directory(const std::string& path) {
+    return !mkdir(path.c_str(), 0700) || errno == EEXIST;
+}
+
+/// If the directory already existed, someone else might have created it
+/// first and could then plant files in it, so it's only used if nobody else
+/// can get in.
+bool make_private_directory(const std::string& path) {
+    if (!make_directory(path)) {
+        return false;
+    }
+    struct stat info {};
+    return !lstat(path.c_str(), &info) && S_ISDIR(info.st_mode) &&
+           info.st_uid == getuid() && !(info.st_mode & (S_IRWXG | S_IRWXO));
+}
+
+std::string base_cache_directory() {
+    //  Relative paths are invalid according to the XDG spec.
+    const auto xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && xdg[0] == '/') {
+        return xdg;
+    }
+    if (const auto home = std::getenv("HOME")) {
+        return std::string{home} + "/.cache";
+    }
+    return {};
+}
+
+}  // namespace
+
+std::string user_cache_directory(const std::string& name) {
+    //  The base directory is shared with other applications, so it only has
+    //  to exist.
+    const auto base = base_cache_directory();
+    if (base.empty() || !make_directory(base)) {
+        return {};
+    }
+
+    const auto app = base + "/wayverb";
+    if (!make_private_directory(app)) {
+        return {};
+    }
+
+    const auto ret = app + "/" + name;
+    return make_private_directory(ret) ? ret : std::string{};
+}
+
+bool write_file_atomically(const std::string& path,
+                           const std::function<bool(std::ostream&)>& write) {
+    //  mkstemp creates the file with mode 0600, and never reuses a name
+    //  which is already taken.
+    auto tmp = path + ".XXXXXX";
+    const auto fd = mkstemp(&tmp[0]);
+    if (fd == -1) {
+        return false;
+    }
+    close(fd);
+
+    const auto written = [&] {
+        std::ofstream file{tmp, std::ios::binary | std::ios::trunc};
+        return file && write(file) && file.flush();
+    }();
+
+    if (!written || std::rename(tmp.c_str(), path.c_str())) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+}  // namespace util
@@ -0,0 +1,136 @@
+#include "utilities/work_stealing.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace util;
+
+namespace {
+
+/// A range of integers, which is split in half until it is small.
+struct range_task final {
+    size_t begin;
+    size_t end;
+};
+
+}  // namespace
+
+TEST(work_stealing, runs_every_task_once) {
+    constexpr size_t items = 1 << 14;
+    std::vector<std::atomic<size_t>> counts(items);
+    for (auto& i : counts) {
+        i = 0;
+    }
+
+    std::atomic<size_t> spawned{0};
+    std::atomic<size_t> workers_out_of_range{0};
+    constexpr size_t num_threads = 8;
+
+    work_stealing_for_each(
+            std::vector<range_task>{{0, items / 2}, {items / 2, items}},
+            num_threads,
+            [&](auto worker, auto task, const auto& spawn) {
+                if (num_threads <= worker) {
+                    ++workers_out_of_range;
+                }
+                if (16 < task.end - task.begin) {
+                    const auto mid = task.begin + (task.end - task.begin) / 2;
+                    spawn(range_task{task.begin, mid});
+                    spawn(range_task{mid, task.end});
+                    spawned += 2;
+                    return;
+                }
+                for (auto i = task.begin; i != task.end; ++i) {
+                    ++counts[i];
+                }
+            });
+
+    ASSERT_NE(spawned, 0);
+    ASSERT_EQ(workers_out_of_range, 0);
+    for (auto i = 0u; i != items; ++i) {
+        ASSERT_EQ(counts[i], 1) << "item " << i;
+    }
+}
+
+TEST(work_stealing, more_threads_than_tasks) {
+    std::vector<std::atomic<size_t>> counts(3);
+    for (auto& i : counts) {
+        i = 0;
+    }
+
+    work_stealing_for_each(std::vector<size_t>{0, 1, 2},
+                           16,
+                           [&](auto, auto task, const auto&) {
+                               ++counts[task];
+                           });
+
+    for (const auto& i : counts) {
+        ASSERT_EQ(i, 1);
+    }
+}
+
+TEST(work_stealing, empty) {
+    auto calls = 0;
+    work_stealing_for_each(std::vector<size_t>{},
+                           4,
+                           [&](auto, auto, const auto&) { ++calls; });
+    ASSERT_EQ(calls, 0);
+
+    work_stealing_for_each(std::vector<size_t>{},
+                           0,
+                           [&](auto, auto, const auto&) { ++calls; });
+    ASSERT_EQ(calls, 0);
+}
+
+TEST(work_stealing, rethrows_after_workers_join) {
+    std::vector<size_t> tasks(256);
+    for (auto i = 0u; i != tasks.size(); ++i) {
+        tasks[i] = i;
+    }
+
+    std::atomic<size_t> running{0};
+    std::atomic<size_t> finished{0};
+
+    try {
+        work_stealing_for_each(
+                tasks, 8, [&](auto, auto task, const auto&) {
+                    ++running;
+                    if (task == 10) {
+                        --running;
+                        throw std::runtime_error{"task 10"};
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+                    ++finished;
+                    --running;
+                });
+        FAIL() << "exception was not rethrown";
+    } catch (const std::runtime_error& e) {
+        ASSERT_STREQ(e.what(), "task 10");
+    }
+
+    //  No worker may still be running a task once the call has returned.
+    ASSERT_EQ(running, 0);
+    const size_t finished_on_return = finished;
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    ASSERT_EQ(finished, finished_on_return);
+    ASSERT_LT(finished, tasks.size());
+}
+
+TEST(work_stealing, rethrows_one_of_many) {
+    std::vector<size_t> tasks(64);
+    for (auto i = 0u; i != tasks.size(); ++i) {
+        tasks[i] = i;
+    }
+
+    ASSERT_THROW(work_stealing_for_each(tasks,
+                                        8,
+                                        [](auto, auto, const auto&) {
+                                            throw std::runtime_error{"task"};
+                                        }),
+                 std::runtime_error);
+}
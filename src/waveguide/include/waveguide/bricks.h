@@ -0,0 +1,109 @@
+#pragma once
+
+#include "waveguide/cl/bricks.h"
+#include "waveguide/cl/structs.h"
+#include "waveguide/cl/utils.h"
+#include "waveguide/mesh_descriptor.h"
+
+#include "utilities/aligned/vector.h"
+
+namespace wayverb {
+namespace waveguide {
+
+/// A sparse storage layout for mesh nodes.
+///
+/// The bounding box of the mesh is split into cubic bricks, and only bricks
+/// holding at least one inside or boundary node are stored.
+/// In non-convex rooms most of the bounding box is empty, so this keeps the
+/// memory use and work per step proportional to the volume of the room.
+///
+/// Nodes are stored x-fastest within each brick, and a table with one entry
+/// per brick in the bounding box maps brick positions to storage slots, so
+/// neighbours can still be found in constant time.
+class brick_layout final {
+public:
+    brick_layout() = default;
+    brick_layout(const mesh_descriptor& descriptor,
+                 const util::aligned::vector<condensed_node>& nodes);
+
+    /// The number of bricks along each axis of the bounding box.
+    cl_int3 get_brick_dimensions() const;
+
+    /// One entry per brick in the bounding box, holding the storage slot of
+    /// that brick, or no_brick.
+    const util::aligned::vector<cl_uint>& get_brick_table() const;
+
+    /// The locator of the first node of each stored brick.
+    const util::aligned::vector<cl_int3>& get_brick_origins() const;
+
+    size_t get_num_bricks() const;
+
+    /// The number of node slots in storage, including padding in partially
+    /// filled bricks.
+    size_t get_num_nodes() const;
+
+    /// Returns no_neighbor if the node is not stored.
+    cl_uint to_bricked_index(size_t dense_index) const;
+
+    /// Rearrange per-node data from the dense layout into bricks.
+    /// Padding slots are set to 'fill'.
+    template <typename T>
+    util::aligned::vector<T> to_bricked(const util::aligned::vector<T>& dense,
+                                        const T& fill) const {
+        util::aligned::vector<T> ret(get_num_nodes(), fill);
+        for_each_node([&](auto dense_index, auto bricked_index) {
+            ret[bricked_index] = dense[dense_index];
+        });
+        return ret;
+    }
+
+    /// Rearrange per-node data from bricks into the dense layout.
+    /// Nodes which aren't stored are set to 'fill'.
+    template <typename T>
+    util::aligned::vector<T> to_dense(const util::aligned::vector<T>& bricked,
+                                      const T& fill) const {
+        util::aligned::vector<T> ret(count_nodes(dimensions_), fill);
+        for_each_node([&](auto dense_index, auto bricked_index) {
+            ret[dense_index] = bricked[bricked_index];
+        });
+        return ret;
+    }
+
+private:
+    static size_t count_nodes(const cl_int3& dimensions);
+
+    /// Calls callback(dense_index, bricked_index) for each stored node which
+    /// lies inside the bounding box.
+    template <typename Callback>
+    void for_each_node(const Callback& callback) const {
+        for (auto slot = 0u; slot != brick_origins_.size(); ++slot) {
+            const auto& origin = brick_origins_[slot];
+            for (auto z = 0; z != brick_side; ++z) {
+                for (auto y = 0; y != brick_side; ++y) {
+                    for (auto x = 0; x != brick_side; ++x) {
+                        const auto px = origin.s[0] + x;
+                        const auto py = origin.s[1] + y;
+                        const auto pz = origin.s[2] + z;
+                        if (px < dimensions_.s[0] && py < dimensions_.s[1] &&
+                            pz < dimensions_.s[2]) {
+                            callback(px + dimensions_.s[0] *
+                                                  (py + dimensions_.s[1] * pz),
+                                     slot * brick_nodes +
+                                             x +
+                                             brick_side *
+                                                     (y + brick_side * z));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    cl_int3 dimensions_{};
+    cl_int3 brick_dimensions_{};
+    util::aligned::vector<cl_uint> brick_table_;
+    util::aligned::vector<cl_int3> brick_origins_;
+};
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -4,16 +4,19 @@
 #include "waveguide/calibration.h"
 #include "waveguide/fitted_boundary.h"
 #include "waveguide/postprocessor/directional_receiver.h"
+#include "waveguide/postprocessor/receiver_set.h"
 #include "waveguide/preprocessor/hard_source.h"
 #include "waveguide/simulation_parameters.h"
 #include "waveguide/waveguide.h"
 
-#include "core/callback_accumulator.h"
+#include "core/cl/scene_structs.h"
 #include "core/environment.h"
 #include "core/reverb_time.h"
 
 #include "hrtf/multiband.h"
 
+#include "utilities/map_to_vector.h"
+
 #include <cmath>
 
 /// \file canonical.h
@@ -26,32 +29,56 @@ namespace wayverb {
 namespace waveguide {
 namespace detail {
 
+inline size_t compute_checked_index(const mesh& mesh, const glm::vec3& pt) {
+    const auto ret = compute_index(mesh.get_descriptor(), pt);
+    if (!waveguide::is_inside(mesh.get_structure().get_condensed_nodes()[ret])) {
+        throw std::runtime_error{
+                "Source/receiver node position appears to be outside mesh."};
+    }
+    return ret;
+}
+
+/// The simulation stores nodes in bricks, so node indices have to be
+/// converted before they can be used to find pressures on the device.
+inline cl_uint to_bricked_index(const mesh& mesh, size_t dense_index) {
+    const auto ret = mesh.get_bricks().to_bricked_index(dense_index);
+    if (ret == no_neighbor) {
+        throw std::runtime_error{"Node is not stored in the bricked mesh."};
+    }
+    return ret;
+}
+
+inline auto compute_checked_indices(
+        const mesh& mesh, const util::aligned::vector<glm::vec3>& points) {
+    return util::map_to_vector(begin(points), end(points), [&](auto pt) {
+        return compute_checked_index(mesh, pt);
+    });
+}
+
+/// Indexed by receiver, then band.
+using multiband_output = util::aligned::vector<util::aligned::vector<band>>;
+
+/// Runs a single simulation from one source, recording the output at every
+/// receiver.
 template <typename Callback>
-std::experimental::optional<band> canonical_impl(
+std::experimental::optional<util::aligned::vector<band>> canonical_impl(
         const core::compute_context& cc,
         const mesh& mesh,
         double simulation_time,
         const glm::vec3& source,
-        const glm::vec3& receiver,
+        const util::aligned::vector<glm::vec3>& receivers,
         const core::environment& environment,
         const std::atomic_bool& keep_going,
         Callback&& callback) {
     const auto sample_rate = compute_sample_rate(mesh.get_descriptor(),
                                                  environment.speed_of_sound);
 
-    const auto compute_mesh_index = [&](const auto& pt) {
-        const auto ret = compute_index(mesh.get_descriptor(), pt);
-        if (!waveguide::is_inside(
-                    mesh.get_structure().get_condensed_nodes()[ret])) {
-            throw std::runtime_error{
-                    "Source/receiver node position appears to be outside "
-                    "mesh."};
-        }
-        return ret;
-    };
-
     const auto ideal_steps = std::ceil(sample_rate * simulation_time);
 
+    //  Check for errors occasionally, rather than stalling the queue to check
+    //  after every step.
+    constexpr auto error_check_interval = 1 << 6;
+
     const auto input = [&] {
         auto raw = util::aligned::vector<float>(ideal_steps, 0.0f);
         if (!raw.empty()) {
@@ -62,29 +89,129 @@ std::experimental::optional<band> canonical_impl(
         return raw;
     }();
 
-    auto output_accumulator =
-            core::callback_accumulator<postprocessor::directional_receiver>{
-                    mesh.get_descriptor(),
-                    sample_rate,
-                    get_ambient_density(environment),
-                    compute_mesh_index(receiver)};
+    //  Receiver pressures are gathered on the device and read back in blocks.
+    postprocessor::receiver_set receiver_set{
+            cc,
+            mesh,
+            sample_rate,
+            get_ambient_density(environment),
+            compute_checked_indices(mesh, receivers)};
 
     const auto steps =
-            run(cc,
-                mesh,
-                preprocessor::make_hard_source(
-                        compute_mesh_index(source), begin(input), end(input)),
-                [&](auto& queue, const auto& buffer, auto step) {
-                    output_accumulator(queue, buffer, step);
-                    callback(queue, buffer, step, ideal_steps);
-                },
-                keep_going);
+            run_bricked(cc,
+                        mesh,
+                        preprocessor::make_hard_source(
+                                to_bricked_index(
+                                        mesh,
+                                        compute_checked_index(mesh, source)),
+                                begin(input),
+                                end(input)),
+                        [&](auto& queue, const auto& buffer, auto step) {
+                            receiver_set(queue, buffer, step);
+                            callback(queue, buffer, step, ideal_steps);
+                        },
+                        keep_going,
+                        error_check_interval);
+
+    receiver_set.flush();
+
+    if (steps != ideal_steps) {
+        return std::experimental::nullopt;
+    }
+
+    auto output = receiver_set.take_output();
+    return util::map_to_vector(begin(output), end(output), [&](auto& i) {
+        return band{std::move(i.front()), sample_rate};
+    });
+}
+
+/// Like canonical_impl, but runs `bands` bands at once.
+/// Each lane of boundary_ratios holds a0/b0 of the flat boundary coefficients
+/// for one band.
+template <typename Callback>
+std::experimental::optional<multiband_output> canonical_multiband_impl(
+        const core::compute_context& cc,
+        const mesh& mesh,
+        const util::aligned::vector<core::bands_type>& boundary_ratios,
+        size_t bands,
+        double simulation_time,
+        const glm::vec3& source,
+        const util::aligned::vector<glm::vec3>& receivers,
+        const core::environment& environment,
+        const std::atomic_bool& keep_going,
+        Callback&& callback) {
+    if (core::simulation_bands < bands) {
+        throw std::runtime_error{"Too many waveguide bands requested."};
+    }
+
+    const auto sample_rate = compute_sample_rate(mesh.get_descriptor(),
+                                                 environment.speed_of_sound);
+
+    const auto ideal_steps = std::ceil(sample_rate * simulation_time);
+
+    constexpr auto error_check_interval = 1 << 6;
+
+    const auto input = [&] {
+        auto raw = util::aligned::vector<core::bands_type>(
+                ideal_steps, core::make_bands_type(0));
+        if (!raw.empty()) {
+            raw.front() = core::make_bands_type(rectilinear_calibration_factor(
+                    mesh.get_descriptor().spacing,
+                    environment.acoustic_impedance));
+        }
+        return raw;
+    }();
+
+    //  Nodes hold one pressure per band, so the buffer is probed as if it
+    //  were a flat array of floats.
+    postprocessor::receiver_set receiver_set{
+            cc,
+            mesh,
+            sample_rate,
+            get_ambient_density(environment),
+            compute_checked_indices(mesh, receivers),
+            bands,
+            core::simulation_bands};
+
+    //  Callbacks expect one float per node, so they are shown the lowest
+    //  band.
+    const auto num_nodes = mesh.get_bricks().get_num_nodes();
+    auto extract_band = program{cc}.get_extract_band_kernel();
+    const cl::Buffer callback_buffer{
+            cc.context, CL_MEM_READ_WRITE, sizeof(cl_float) * num_nodes};
+
+    const auto steps = run_multiband(
+            cc,
+            mesh,
+            boundary_ratios,
+            preprocessor::make_hard_source(
+                    to_bricked_index(mesh,
+                                     compute_checked_index(mesh, source)),
+                    begin(input),
+                    end(input)),
+            [&](auto& queue, const auto& buffer, auto step) {
+                receiver_set(queue, buffer, step);
+                extract_band(cl::EnqueueArgs{queue, cl::NDRange{num_nodes}},
+                             buffer,
+                             callback_buffer,
+                             0);
+                callback(queue, callback_buffer, step, ideal_steps);
+            },
+            keep_going,
+            error_check_interval);
+
+    receiver_set.flush();
 
     if (steps != ideal_steps) {
         return std::experimental::nullopt;
     }
 
-    return band{std::move(output_accumulator.get_output()), sample_rate};
+    auto output = receiver_set.take_output();
+    return util::map_to_vector(begin(output), end(output), [&](auto& i) {
+        return util::map_to_vector(begin(i), end(i), [&](auto& j) {
+            return band{std::move(j), sample_rate};
+        });
+    });
 }
 
 }  // namespace detail
@@ -93,31 +220,37 @@ std::experimental::optional<band> canonical_impl(
 
 /// Run a waveguide using:
 ///     specified sample rate
-///     receiver at specified location
+///     receivers at closest available locations
 ///     source at closest available location
 ///     single hard source
-///     single directional receiver
+///     one directional receiver per receiver position
+///
+/// All receivers are recorded from the same simulation, so the result holds
+/// one set of bands per receiver.
 template <typename PressureCallback>
-std::experimental::optional<util::aligned::vector<bandpass_band>> canonical(
-        const core::compute_context& cc,
-        voxels_and_mesh voxelised,
-        const glm::vec3& source,
-        const glm::vec3& receiver,
-        const core::environment& environment,
-        const single_band_parameters& sim_params,
-        double simulation_time,
-        const std::atomic_bool& keep_going,
-        PressureCallback&& pressure_callback) {
+std::experimental::optional<
+        util::aligned::vector<util::aligned::vector<bandpass_band>>>
+canonical(const core::compute_context& cc,
+          const voxels_and_mesh& voxelised,
+          const glm::vec3& source,
+          const util::aligned::vector<glm::vec3>& receivers,
+          const core::environment& environment,
+          const single_band_parameters& sim_params,
+          double simulation_time,
+          const std::atomic_bool& keep_going,
+          PressureCallback&& pressure_callback) {
     if (auto ret = detail::canonical_impl(cc,
                                           voxelised.mesh,
                                           simulation_time,
                                           source,
-                                          receiver,
+                                          receivers,
                                           environment,
                                           keep_going,
                                           pressure_callback)) {
-        return util::aligned::vector<bandpass_band>{bandpass_band{
-                std::move(*ret), util::make_range(0.0, sim_params.cutoff)}};
+        return util::map_to_vector(begin(*ret), end(*ret), [&](auto& i) {
+            return util::aligned::vector<bandpass_band>{bandpass_band{
+                    std::move(i), util::make_range(0.0, sim_params.cutoff)}};
+        });
     }
 
     return std::experimental::nullopt;
@@ -125,55 +258,98 @@ std::experimental::optional<util::aligned::vector<bandpass_band>> canonical(
 
 ////////////////////////////////////////////////////////////////////////////////
 
-inline auto set_flat_coefficients_for_band(voxels_and_mesh& voxels_and_mesh,
-                                           size_t band) {
-    voxels_and_mesh.mesh.set_coefficients(util::map_to_vector(
-            begin(voxels_and_mesh.voxels.get_scene_data().get_surfaces()),
-            end(voxels_and_mesh.voxels.get_scene_data().get_surfaces()),
-            [&](const auto& surface) {
-                return to_flat_coefficients(surface.absorption.s[band]);
-            }));
+/// a0/b0 of the flat boundary coefficients of each surface, with one lane per
+/// band.
+inline auto compute_flat_boundary_ratios(const voxels_and_mesh& voxelised,
+                                         size_t bands) {
+    const auto& surfaces = voxelised.voxels.get_scene_data().get_surfaces();
+    return util::map_to_vector(
+            begin(surfaces), end(surfaces), [&](const auto& surface) {
+                auto ret = core::make_bands_type(0);
+                for (auto band = 0u; band != bands; ++band) {
+                    const auto coeffs =
+                            to_flat_coefficients(surface.absorption.s[band]);
+                    ret.s[band] =
+                            coeffs.b[0] ? coeffs.a[0] / coeffs.b[0] : 0;
+                }
+                return ret;
+            });
 }
 
 /// This is a sort of middle ground - more accurate boundary modelling, but
-/// really unbelievably slow.
+/// slower than the single band version.
+/// All bands are run together in a single pass over the mesh.
 template <typename PressureCallback>
+std::experimental::optional<
+        util::aligned::vector<util::aligned::vector<bandpass_band>>>
+canonical(const core::compute_context& cc,
+          const voxels_and_mesh& voxelised,
+          const glm::vec3& source,
+          const util::aligned::vector<glm::vec3>& receivers,
+          const core::environment& environment,
+          const multiple_band_constant_spacing_parameters& sim_params,
+          double simulation_time,
+          const std::atomic_bool& keep_going,
+          PressureCallback&& pressure_callback) {
+    auto rendered = detail::canonical_multiband_impl(
+            cc,
+            voxelised.mesh,
+            compute_flat_boundary_ratios(voxelised, sim_params.bands),
+            sim_params.bands,
+            simulation_time,
+            source,
+            receivers,
+            environment,
+            keep_going,
+            pressure_callback);
+
+    if (!rendered) {
+        return std::experimental::nullopt;
+    }
+
+    const auto band_params = hrtf_data::hrtf_band_params_hz();
+
+    return util::map_to_vector(
+            begin(*rendered), end(*rendered), [&](auto& rendered_bands) {
+                util::aligned::vector<bandpass_band> ret{};
+                ret.reserve(sim_params.bands);
+                for (auto band = 0u; band != sim_params.bands; ++band) {
+                    ret.emplace_back(bandpass_band{
+                            std::move(rendered_bands[band]),
+                            util::make_range(band_params.edges[band],
+                                             band_params.edges[band + 1])});
+                }
+                return ret;
+            });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// Convenience for simulating a single receiver.
+template <typename SimParams, typename PressureCallback>
 std::experimental::optional<util::aligned::vector<bandpass_band>> canonical(
         const core::compute_context& cc,
-        voxels_and_mesh voxelised,
+        const voxels_and_mesh& voxelised,
         const glm::vec3& source,
         const glm::vec3& receiver,
         const core::environment& environment,
-        const multiple_band_constant_spacing_parameters& sim_params,
+        const SimParams& sim_params,
         double simulation_time,
         const std::atomic_bool& keep_going,
         PressureCallback&& pressure_callback) {
-    const auto band_params = hrtf_data::hrtf_band_params_hz();
-
-    util::aligned::vector<bandpass_band> ret{};
-
-    //  For each band, up to the maximum band specified.
-    for (auto band = 0; band != sim_params.bands; ++band) {
-        set_flat_coefficients_for_band(voxelised, band);
-
-        if (auto rendered_band = detail::canonical_impl(cc,
-                                                        voxelised.mesh,
-                                                        simulation_time,
-                                                        source,
-                                                        receiver,
-                                                        environment,
-                                                        keep_going,
-                                                        pressure_callback)) {
-            ret.emplace_back(bandpass_band{
-                    std::move(*rendered_band),
-                    util::make_range(band_params.edges[band],
-                                     band_params.edges[band + 1])});
-        } else {
-            return std::experimental::nullopt;
-        }
+    if (auto ret = canonical(cc,
+                             voxelised,
+                             source,
+                             util::aligned::vector<glm::vec3>{receiver},
+                             environment,
+                             sim_params,
+                             simulation_time,
+                             keep_going,
+                             std::forward<PressureCallback>(
+                                     pressure_callback))) {
+        return std::move(ret->front());
     }
-
-    return ret;
+    return std::experimental::nullopt;
 }
 
 }  // namespace waveguide
@@ -2,6 +2,9 @@
 
 #include "waveguide/cl/utils.h"
 
+#include <algorithm>
+#include <iterator>
+
 namespace wayverb {
 namespace waveguide {
 
@@ -10,6 +13,18 @@ struct alignas(1 << 2) boundary_index_array final {
     cl_uint array[n];
 };
 
+template <size_t n>
+inline bool operator==(const boundary_index_array<n>& a,
+                       const boundary_index_array<n>& b) {
+    return std::equal(std::begin(a.array), std::end(a.array), b.array);
+}
+
+template <size_t n>
+inline bool operator!=(const boundary_index_array<n>& a,
+                       const boundary_index_array<n>& b) {
+    return !(a == b);
+}
+
 using boundary_index_array_1 = boundary_index_array<1>;
 using boundary_index_array_2 = boundary_index_array<2>;
 using boundary_index_array_3 = boundary_index_array<3>;
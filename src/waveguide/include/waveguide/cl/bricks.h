@@ -0,0 +1,23 @@
+#pragma once
+
+#include "core/cl/include.h"
+
+#include <string>
+
+namespace wayverb {
+namespace waveguide {
+
+/// Sparse meshes are stored in cubic bricks with this many nodes per side.
+constexpr auto brick_side = 8;
+constexpr auto brick_nodes = brick_side * brick_side * brick_side;
+
+/// Marks a brick which has no storage, because it contains no inside or
+/// boundary nodes.
+constexpr auto no_brick = ~cl_uint{0};
+
+namespace cl_sources {
+extern const std::string bricks;
+}  // namespace cl_sources
+
+}  // namespace waveguide
+}  // namespace wayverb
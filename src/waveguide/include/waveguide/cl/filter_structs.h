@@ -11,13 +11,24 @@ constexpr size_t biquad_sections{3};
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/// Boundary filters are run in double precision by default.
+/// Define WAYVERB_SINGLE_PRECISION_FILTERS to run them in float instead, which
+/// is much faster on consumer GPUs, and works on devices without fp64.
+#ifdef WAYVERB_SINGLE_PRECISION_FILTERS
+using filt_real = cl_float;
+#else
 using filt_real = cl_double;
+#endif
+
+/// Filter structs are aligned like their elements, so that the host and
+/// device layouts agree in both precisions.
+constexpr auto filt_alignment = alignof(filt_real);
 
 ////////////////////////////////////////////////////////////////////////////////
 
 /// Just an array of filt_real to use as a delay line.
 template <size_t o>
-struct alignas(1 << 3) memory final {
+struct alignas(filt_alignment) memory final {
     static constexpr size_t order = o;
     filt_real array[order]{};
 };
@@ -37,7 +48,7 @@ inline bool operator!=(const memory<D>& a, const memory<D>& b) {
 
 /// IIR filter coefficient storage.
 template <size_t o>
-struct alignas(1 << 3) coefficients final {
+struct alignas(filt_alignment) coefficients final {
     static constexpr auto order = o;
     filt_real b[order + 1]{};
     filt_real a[order + 1]{};
@@ -68,14 +79,14 @@ using coefficients_canonical =
 ////////////////////////////////////////////////////////////////////////////////
 
 /// Several biquad delay lines in a row.
-struct alignas(1 << 3) biquad_memory_array final {
+struct alignas(filt_alignment) biquad_memory_array final {
     memory_biquad array[biquad_sections]{};
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
 /// Several sets of biquad parameters.
-struct alignas(1 << 3) biquad_coefficients_array final {
+struct alignas(filt_alignment) biquad_coefficients_array final {
     coefficients_biquad array[biquad_sections]{};
 };
 
@@ -83,9 +94,15 @@ struct alignas(1 << 3) biquad_coefficients_array final {
 
 template <>
 struct core::cl_representation<waveguide::filt_real> final {
+#ifdef WAYVERB_SINGLE_PRECISION_FILTERS
+    static constexpr auto value = R"(
+typedef float filt_real;
+)";
+#else
     static constexpr auto value = R"(
 typedef double filt_real;
 )";
+#endif
 };
 
 template <>
@@ -35,7 +35,7 @@ inline bool operator!=(const condensed_node& a, const condensed_node& b) {
 /// Stores filter coefficients for a single high-order filter, and an index
 /// into an array of filter parameters which describe the filter being
 /// modelled.
-struct alignas(1 << 3) boundary_data final {
+struct alignas(filt_alignment) boundary_data final {
     memory_canonical filter_memory{};
     cl_uint coefficient_index{};
 };
@@ -52,7 +52,7 @@ inline bool operator!=(const boundary_data& a, const boundary_data& b) {
 ////////////////////////////////////////////////////////////////////////////////
 
 template <size_t D>
-struct alignas(1 << 3) boundary_data_array final {
+struct alignas(filt_alignment) boundary_data_array final {
     static constexpr auto DIMENSIONS = D;
     boundary_data array[DIMENSIONS]{};
 };
@@ -54,8 +54,9 @@ constexpr auto make_coefficients_canonical(
         const core::filter_coefficients<sizeof...(Ix) - 1, sizeof...(Ix) - 1>&
                 coeffs,
         std::index_sequence<Ix...>) {
-    return coefficients_canonical{{std::get<Ix>(coeffs.b)...},
-                                  {std::get<Ix>(coeffs.a)...}};
+    return coefficients_canonical{
+            {static_cast<filt_real>(std::get<Ix>(coeffs.b))...},
+            {static_cast<filt_real>(std::get<Ix>(coeffs.a))...}};
 }
 
 constexpr auto make_coefficients_canonical(
@@ -71,7 +72,9 @@ constexpr auto make_coefficients_canonical(
 
 inline auto to_flat_coefficients(double absorption) {
     return to_impedance_coefficients(coefficients_canonical{
-            {core::absorption_to_pressure_reflectance(absorption)}, {1}});
+            {static_cast<filt_real>(
+                    core::absorption_to_pressure_reflectance(absorption))},
+            {1}});
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "waveguide/bricks.h"
 #include "waveguide/mesh_descriptor.h"
 #include "waveguide/setup.h"
 
@@ -16,6 +17,10 @@ public:
     const mesh_descriptor& get_descriptor() const;
     const vectors& get_structure() const;
 
+    /// Sparse layout used on the device, which skips empty parts of the
+    /// bounding box.
+    const brick_layout& get_bricks() const;
+
     void set_coefficients(coefficients_canonical coefficients);
     void set_coefficients(
             util::aligned::vector<coefficients_canonical> coefficients);
@@ -23,6 +28,7 @@ public:
 private:
     mesh_descriptor descriptor_;
     vectors vectors_;
+    brick_layout bricks_;
 };
 
 /// Uses the number of 'inside' nodes and the mesh spacing to estimate the
@@ -31,6 +37,15 @@ double estimate_volume(const mesh& mesh);
 
 bool is_inside(const mesh& m, size_t node_index);
 
+/// Boundary filter coefficients for each surface in the scene.
+/// These are the only part of a mesh which depend on the surfaces, so a mesh
+/// can be reused with new materials by replacing its coefficients.
+util::aligned::vector<coefficients_canonical> compute_surface_coefficients(
+        const util::aligned::vector<core::surface<core::simulation_bands>>&
+                surfaces,
+        float mesh_spacing,
+        float speed_of_sound);
+
 ///  use this if you already have a voxelised scene
 mesh compute_mesh(
         const core::compute_context& cc,
@@ -46,6 +61,15 @@ struct voxels_and_mesh final {
     mesh mesh;
 };
 
+/// The voxelised scene used by compute_voxels_and_mesh, with its boundary
+/// adjusted so that the mesh lattice passes through anchor.
+core::voxelised_scene_data<cl_float3, core::surface<core::simulation_bands>>
+compute_voxels(const core::gpu_scene_data& scene,
+               const glm::vec3& anchor,
+               double mesh_spacing,
+               core::acceleration_structure acceleration =
+                       core::acceleration_structure::voxels);
+
 /// this one should be prefered - will set up a voxelised scene with the correct
 /// boundaries, and then will use it to create a mesh
 voxels_and_mesh compute_voxels_and_mesh(
@@ -54,7 +78,9 @@ voxels_and_mesh compute_voxels_and_mesh(
         const glm::vec3& anchor,  //  probably the receiver if you want it to
                                   //  coincide with an actual node
         double sample_rate,
-        double speed_of_sound);
+        double speed_of_sound,
+        core::acceleration_structure acceleration =
+                core::acceleration_structure::voxels);
 
 }  // namespace waveguide
 }  // namespace wayverb
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "waveguide/mesh.h"
+
+#include "glm/glm.hpp"
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace wayverb {
+namespace waveguide {
+
+/// Identifies a scene by its geometry and surfaces.
+uint64_t compute_scene_hash(const core::gpu_scene_data& scene);
+
+/// Identifies a scene by its geometry alone.
+/// Triangles still record which surface they use, but the surface materials
+/// themselves are ignored.
+uint64_t compute_geometry_hash(const core::gpu_scene_data& scene);
+
+/// A mesh only depends on the scene, the grid spacing, and where the grid
+/// lattice sits relative to the origin.
+/// compute_voxels_and_mesh builds the same mesh for any anchor on the same
+/// lattice, so receivers which are snapped onto a shared lattice can share a
+/// single mesh instead of building one each.
+///
+/// Meshes are returned as shared pointers, so entries can be evicted while
+/// they are still in use.
+///
+/// If a directory is set, built meshes are also written there, keyed by the
+/// scene geometry rather than its materials.
+/// A mesh which is found on disk only needs its boundary coefficients
+/// recomputing, which is much quicker than building it from scratch.
+/// The directory is taken from WAYVERB_MESH_CACHE_DIR if it is set, or a
+/// private per-user cache directory otherwise (see
+/// util::user_cache_directory). An empty directory disables the on-disk
+/// cache.
+/// Files which don't describe a consistent mesh are ignored.
+class mesh_cache final {
+public:
+    explicit mesh_cache(size_t max_entries = 4);
+    mesh_cache(size_t max_entries, std::string directory);
+
+    /// Returns a cached mesh if there is one for this lattice, otherwise
+    /// builds one and caches it.
+    /// Meshes are built without holding the cache lock, so requests for
+    /// other meshes are not held up by a slow build. Concurrent requests for
+    /// a mesh which is being built wait for that build rather than starting
+    /// another, and see its exception if it fails.
+    /// The acceleration structure only changes the voxelised scene which is
+    /// returned alongside the mesh, so meshes on disk are shared between
+    /// acceleration structures.
+    std::shared_ptr<const voxels_and_mesh> get(
+            const core::compute_context& cc,
+            const core::gpu_scene_data& scene,
+            const glm::vec3& anchor,
+            double sample_rate,
+            double speed_of_sound,
+            core::acceleration_structure acceleration =
+                    core::acceleration_structure::voxels);
+
+    size_t size() const;
+    void clear();
+
+    /// The number of meshes which were loaded from disk rather than built.
+    size_t get_disk_hits() const;
+
+    void set_directory(std::string directory);
+    std::string get_directory() const;
+
+private:
+    struct cache_key final {
+        uint64_t scene_hash;
+        float spacing;
+        glm::ivec3 lattice_offset;
+        core::acceleration_structure acceleration;
+    };
+
+    friend bool operator==(const cache_key& a, const cache_key& b);
+
+    using value_type = std::shared_ptr<const voxels_and_mesh>;
+
+    struct entry final {
+        cache_key key;
+        value_type value;
+    };
+
+    struct pending_entry final {
+        cache_key key;
+        std::shared_future<value_type> value;
+    };
+
+    size_t max_entries_;
+    std::string directory_;
+    size_t disk_hits_{0};
+
+    mutable std::mutex mutex_;
+    std::deque<entry> entries_;  //  most recently used at the front
+    std::deque<pending_entry> pending_;  //  meshes which are being built
+};
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -12,7 +12,8 @@ class setup_program final {
 public:
     setup_program(const core::compute_context& cc);
 
-    auto get_node_inside_kernel() const {
+    /// Run with one work item per (x, y) column of the mesh.
+    auto get_column_inside_kernel() const {
         return wrapper_.get_kernel<cl::Buffer,       /// nodes
                                    mesh_descriptor,  /// descriptor
                                    cl::Buffer,       /// voxel_index
@@ -20,7 +21,7 @@ public:
                                    cl_uint,          /// side
                                    cl::Buffer,       /// triangles
                                    cl::Buffer        /// vertices
-                                   >("set_node_inside");
+                                   >("set_column_inside");
     }
 
     auto get_node_boundary_kernel() const {
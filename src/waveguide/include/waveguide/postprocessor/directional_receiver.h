@@ -37,8 +37,16 @@ public:
                            const cl::Buffer& buffer,
                            size_t step);
 
+    /// Use pressures which have already been copied to the host, e.g. by a
+    /// probe.
+    return_type operator()(float pressure,
+                           const std::array<float, 6>& surrounding);
+
     size_t get_output_node() const;
 
+    /// The output node followed by its six neighbours.
+    std::array<unsigned, 7> get_probe_nodes() const;
+
 private:
     double mesh_spacing_;
     double sample_rate_;
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "waveguide/program.h"
+
+#include "core/cl/common.h"
+
+#include "utilities/aligned/vector.h"
+
+#include <experimental/optional>
+
+namespace wayverb {
+namespace waveguide {
+namespace postprocessor {
+
+/// Records the pressures at a fixed set of nodes, without blocking.
+///
+/// After each step, a small kernel copies the probed pressures into a ring
+/// buffer in device memory.
+/// Once block_steps steps have been recorded, the block is copied back to the
+/// host asynchronously, while the next block is filled.
+/// This replaces lots of tiny blocking reads with a few large transfers.
+class probe final {
+public:
+    static constexpr size_t default_block_steps = 1 << 10;
+
+    probe(const core::compute_context& cc,
+          util::aligned::vector<cl_uint> nodes,
+          size_t block_steps = default_block_steps);
+
+    /// The device may still be copying into the staging areas, so they can't
+    /// be moved or freed until any pending read has finished.
+    probe(const probe&) = delete;
+    probe& operator=(const probe&) = delete;
+
+    /// Waits for any pending read, so that it can't write into freed memory
+    /// if the run is abandoned part of the way through.
+    ~probe() noexcept;
+
+    /// The device memory used by a probe with this many nodes, which is
+    /// mostly the ring buffer.
+    static size_t get_device_memory(size_t num_nodes,
+                                    size_t block_steps = default_block_steps);
+
+    /// Enqueue a copy of the probed pressures for this step.
+    void operator()(cl::CommandQueue& queue,
+                    const cl::Buffer& buffer,
+                    size_t step);
+
+    /// Block until all recorded steps are available from take_frames.
+    void flush();
+
+    /// Returns all frames which have arrived on the host since the last call.
+    /// Each frame holds one pressure per node, in the order that the nodes
+    /// were passed to the constructor.
+    util::aligned::vector<cl_float> take_frames();
+
+    size_t get_num_nodes() const;
+
+private:
+    void start_read(size_t steps);
+    void finish_read();
+
+    using kernel_t =
+            decltype(std::declval<program>().get_gather_probes_kernel());
+
+    kernel_t kernel_;
+    cl::CommandQueue queue_;
+    size_t num_nodes_;
+    size_t block_steps_;
+
+    cl::Buffer node_buffer_;
+    cl::Buffer ring_buffer_;
+
+    size_t block_{0};
+    size_t step_in_block_{0};
+
+    /// The two halves of the ring each have their own host staging area, so
+    /// one can be read back while the other is being written.
+    util::aligned::vector<cl_float> staging_[2];
+
+    struct pending_read final {
+        size_t half;
+        size_t steps;
+        cl::Event event;
+    };
+    std::experimental::optional<pending_read> pending_;
+
+    util::aligned::vector<cl_float> ready_;
+};
+
+}  // namespace postprocessor
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "waveguide/postprocessor/directional_receiver.h"
+#include "waveguide/postprocessor/probe.h"
+
+namespace wayverb {
+namespace waveguide {
+
+class mesh;
+
+namespace postprocessor {
+
+/// Records the output of several directional receivers from one simulation.
+///
+/// There is one receiver per output node and band, and they are all fed from
+/// a single probe, so adding receivers only adds a few extra pressures to
+/// each block transfer.
+///
+/// Pressures are looked up in the bricked layout.
+/// Each node holds lane_stride floats, of which the first `bands` are used.
+class receiver_set final {
+public:
+    using output = directional_receiver::output;
+
+    receiver_set(const core::compute_context& cc,
+                 const mesh& mesh,
+                 double sample_rate,
+                 double ambient_density,
+                 const util::aligned::vector<size_t>& output_nodes,
+                 size_t bands = 1,
+                 size_t lane_stride = 1);
+
+    /// The device memory used by the probe of a receiver set with this many
+    /// output nodes and bands.
+    static size_t get_device_memory(size_t num_output_nodes, size_t bands);
+
+    /// Enqueue a copy of the probed pressures for this step, and process any
+    /// which have arrived.
+    void operator()(cl::CommandQueue& queue,
+                    const cl::Buffer& buffer,
+                    size_t step);
+
+    /// Block until every recorded step has been processed.
+    void flush();
+
+    /// Indexed by output node, then band, then step.
+    util::aligned::vector<util::aligned::vector<util::aligned::vector<output>>>
+    take_output();
+
+private:
+    void drain();
+
+    size_t bands_;
+
+    /// One per output node and band, with bands adjacent.
+    util::aligned::vector<directional_receiver> receivers_;
+    util::aligned::vector<util::aligned::vector<output>> output_;
+
+    probe probe_;
+};
+
+}  // namespace postprocessor
+}  // namespace waveguide
+}  // namespace wayverb
@@ -26,6 +26,9 @@ public:
                             cl::Buffer,  /// current
                             cl::Buffer,  /// nodes
                             cl_int3,     /// dimensions
+                            cl::Buffer,  /// brick_table, null if dense
+                            cl_int3,     /// brick_dimensions
+                            cl::Buffer,  /// brick_origins, null if dense
                             cl::Buffer,  /// boundary_data_1
                             cl::Buffer,  /// boundary_data_2
                             cl::Buffer,  /// boundary_data_3
@@ -34,10 +37,45 @@ public:
                             >("condensed_waveguide");
     }
 
+    /// Like get_kernel, but for meshes holding one pressure per band.
+    /// Boundaries must be flat, and are described by a0/b0 of each surface's
+    /// coefficients, with one lane per band.
+    auto get_multiband_kernel() const {
+        return program_wrapper_
+                .get_kernel<cl::Buffer,  /// previous
+                            cl::Buffer,  /// current
+                            cl::Buffer,  /// nodes
+                            cl_int3,     /// dimensions
+                            cl::Buffer,  /// brick_table, null if dense
+                            cl_int3,     /// brick_dimensions
+                            cl::Buffer,  /// brick_origins, null if dense
+                            cl::Buffer,  /// boundary_indices_1
+                            cl::Buffer,  /// boundary_indices_2
+                            cl::Buffer,  /// boundary_indices_3
+                            cl::Buffer,  /// boundary_ratios
+                            cl::Buffer   /// error_flag
+                            >("condensed_waveguide_multiband");
+    }
+
     auto get_zero_buffer_kernel() const {
         return program_wrapper_.get_kernel<cl::Buffer>("zero_buffer");
     }
 
+    auto get_gather_probes_kernel() const {
+        return program_wrapper_.get_kernel<cl::Buffer,  /// pressures
+                                           cl::Buffer,  /// probe_nodes
+                                           cl::Buffer,  /// output
+                                           cl_uint      /// offset
+                                           >("gather_probes");
+    }
+
+    auto get_extract_band_kernel() const {
+        return program_wrapper_.get_kernel<cl::Buffer,  /// pressures
+                                           cl::Buffer,  /// output
+                                           cl_uint      /// band
+                                           >("extract_band");
+    }
+
     auto get_filter_test_kernel() const {
         return program_wrapper_
                 .get_kernel<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer>(
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "waveguide/boundary_coefficient_finder.h"
+#include "waveguide/cl/boundary_index_array.h"
+#include "waveguide/cl/structs.h"
+#include "waveguide/mesh_descriptor.h"
+
+#include "cereal/cereal.hpp"
+#include "cereal/types/vector.hpp"
+
+namespace cereal {
+
+template <typename Archive>
+void serialize(Archive& archive, wayverb::waveguide::mesh_descriptor& m) {
+    archive(make_nvp("min_corner", m.min_corner.s),
+            make_nvp("dimensions", m.dimensions.s),
+            make_nvp("spacing", m.spacing));
+}
+
+template <typename Archive>
+void serialize(Archive& archive, wayverb::waveguide::condensed_node& n) {
+    archive(make_nvp("boundary_type", n.boundary_type),
+            make_nvp("boundary_index", n.boundary_index));
+}
+
+template <typename Archive, size_t N>
+void serialize(Archive& archive,
+               wayverb::waveguide::boundary_index_array<N>& b) {
+    archive(make_nvp("array", b.array));
+}
+
+template <typename Archive>
+void serialize(Archive& archive, wayverb::waveguide::boundary_index_data& b) {
+    archive(make_nvp("b1", b.b1), make_nvp("b2", b.b2), make_nvp("b3", b.b3));
+}
+
+}  // namespace cereal
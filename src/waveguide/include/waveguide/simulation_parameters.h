@@ -31,9 +31,10 @@ constexpr bool operator!=(const single_band_parameters& a,
 
 struct multiple_band_constant_spacing_parameters final {
     /// The number of bands which should be simulated with the waveguide.
-    /// Be careful with high numbers.
-    /// The waveguide will be run once, at the required sampling rate, for each
-    /// band, so i.e. 4 bands will take 4 times as long.
+    /// All bands are run together in a single pass over the mesh, so extra
+    /// bands are much cheaper than extra runs, but every node needs storage
+    /// for all bands.
+    /// At most core::simulation_bands bands may be requested.
     size_t bands;
 
     /// The cutoff to use for all bands.
@@ -3,16 +3,159 @@
 #include "waveguide/mesh.h"
 
 #include "core/cl/include.h"
+#include "core/cl/scene_structs.h"
 #include "core/conversions.h"
 #include "core/exceptions.h"
 
 #include <atomic>
 #include <cassert>
+#include <experimental/optional>
 #include <functional>
 #include <iostream>
 
 namespace wayverb {
 namespace waveguide {
+namespace detail {
+
+/// Throws an appropriate exception if any error bits are set.
+/// The error happened somewhere in the steps [first_step, last_step).
+void throw_if_error(cl_int error_flag, size_t first_step, size_t last_step);
+
+/// Owns the device-side error flag for a waveguide run, and reads it back
+/// every `interval` steps without blocking the queue.
+///
+/// The flag is sticky: kernels only ever set bits in it, so it only needs to
+/// be cleared once.
+/// Only one read is in flight at a time, and it is checked just before the
+/// next one is enqueued.
+class error_checker final {
+public:
+    error_checker(const cl::Context& context,
+                  cl::CommandQueue& queue,
+                  size_t interval);
+
+    /// A read may be in flight into error_flag_, so the checker must stay
+    /// where it is until that read has finished.
+    error_checker(const error_checker&) = delete;
+    error_checker& operator=(const error_checker&) = delete;
+
+    /// Waits for any pending read, which would otherwise write into freed
+    /// memory if the run ended with an exception.
+    ~error_checker() noexcept;
+
+    const cl::Buffer& get_buffer() const;
+
+    /// Call once the kernel for a step has been enqueued.
+    void step_enqueued(size_t step);
+
+    /// Call once the run is over.
+    /// Makes sure that any remaining steps get checked too.
+    void finish(size_t steps);
+
+private:
+    void start_check(size_t last_step);
+    void finish_check();
+
+    cl::CommandQueue& queue_;
+    size_t interval_;
+    cl::Buffer buffer_;
+
+    struct pending_check final {
+        cl::Event event;
+        size_t last_step;
+    };
+    std::experimental::optional<pending_check> pending_;
+    cl_int error_flag_{id_success};
+    size_t last_clean_step_{0};
+};
+
+/// Describes how the nodes of a mesh are stored on the device.
+/// The brick buffers are null if nodes are stored densely.
+struct device_layout final {
+    size_t num_nodes;
+    cl::Buffer nodes;
+    cl::Buffer brick_table;
+    cl_int3 brick_dimensions;
+    cl::Buffer brick_origins;
+};
+
+/// One node per grid point in the mesh's bounding box.
+device_layout make_dense_layout(const cl::Context& context, const mesh& mesh);
+
+/// Only the bricks which hold inside or boundary nodes.
+device_layout make_bricked_layout(const cl::Context& context,
+                                  const mesh& mesh);
+
+template <typename step_preprocessor, typename step_postprocessor>
+size_t run_single_band(const core::compute_context& cc,
+                       const mesh& mesh,
+                       const device_layout& layout,
+                       step_preprocessor&& pre,
+                       step_postprocessor&& post,
+                       const std::atomic_bool& keep_going,
+                       size_t error_check_interval) {
+    const program program{cc};
+    cl::CommandQueue queue{cc.context, cc.device};
+    const auto make_zeroed_buffer = [&] {
+        auto ret = cl::Buffer{cc.context,
+                              CL_MEM_READ_WRITE,
+                              sizeof(cl_float) * layout.num_nodes};
+        auto kernel = program.get_zero_buffer_kernel();
+        kernel(cl::EnqueueArgs{queue, cl::NDRange{layout.num_nodes}}, ret);
+        return ret;
+    };
+
+    auto previous = make_zeroed_buffer();
+    auto current = make_zeroed_buffer();
+
+    const auto boundary_coefficients_buffer = core::load_to_buffer(
+            cc.context, mesh.get_structure().get_coefficients(), true);
+
+    auto boundary_buffer_1 = core::load_to_buffer(
+            cc.context, get_boundary_data<1>(mesh.get_structure()), false);
+    auto boundary_buffer_2 = core::load_to_buffer(
+            cc.context, get_boundary_data<2>(mesh.get_structure()), false);
+    auto boundary_buffer_3 = core::load_to_buffer(
+            cc.context, get_boundary_data<3>(mesh.get_structure()), false);
+
+    auto kernel = program.get_kernel();
+
+    error_checker error_checker{cc.context, queue, error_check_interval};
+
+    //  run
+    auto step = 0u;
+
+    //  The preprocessor returns 'true' while it should be run.
+    //  It also updates the mesh with new pressure values.
+    for (; pre(queue, current, step) && keep_going; ++step) {
+        //  run kernel
+        kernel(cl::EnqueueArgs(queue, cl::NDRange(layout.num_nodes)),
+               previous,
+               current,
+               layout.nodes,
+               mesh.get_descriptor().dimensions,
+               layout.brick_table,
+               layout.brick_dimensions,
+               layout.brick_origins,
+               boundary_buffer_1,
+               boundary_buffer_2,
+               boundary_buffer_3,
+               boundary_coefficients_buffer,
+               error_checker.get_buffer());
+
+        error_checker.step_enqueued(step);
+
+        post(queue, current, step);
+
+        std::swap(previous, current);
+    }
+
+    error_checker.finish(step);
+
+    return step;
+}
+
+}  // namespace detail
 
 /// Will set up and run a waveguide using an existing 'template' (the mesh).
 ///
@@ -21,6 +164,12 @@ namespace waveguide {
 /// pre:            will be run before each step, should inject inputs
 /// post:           will be run after each step, should collect outputs
 /// keep_going:     toggle this from another thread to quit early
+/// error_check_interval:
+///                 the error flag is checked every this-many steps, without
+///                 blocking the queue. Larger values allow more kernels to
+///                 be in flight at once, but errors are only reported to
+///                 within a window of this many steps. Set to 1 to find the
+///                 exact step which failed.
 ///
 /// returns:        the number of steps completed successfully
 
@@ -38,90 +187,118 @@ size_t run(const core::compute_context& cc,
            const mesh& mesh,
            step_preprocessor&& pre,
            step_postprocessor&& post,
-           const std::atomic_bool& keep_going) {
+           const std::atomic_bool& keep_going,
+           size_t error_check_interval = 1) {
+    return detail::run_single_band(
+            cc,
+            mesh,
+            detail::make_dense_layout(cc.context, mesh),
+            std::forward<step_preprocessor>(pre),
+            std::forward<step_postprocessor>(post),
+            keep_going,
+            error_check_interval);
+}
+
+/// Like run, but only stores the parts of the mesh which are inside the room,
+/// which is much faster for non-convex rooms.
+///
+/// The buffers passed to pre and post are in the layout described by
+/// mesh.get_bricks(), so node indices must be converted with
+/// brick_layout::to_bricked_index.
+template <typename step_preprocessor, typename step_postprocessor>
+size_t run_bricked(const core::compute_context& cc,
+                   const mesh& mesh,
+                   step_preprocessor&& pre,
+                   step_postprocessor&& post,
+                   const std::atomic_bool& keep_going,
+                   size_t error_check_interval = 1) {
+    return detail::run_single_band(
+            cc,
+            mesh,
+            detail::make_bricked_layout(cc.context, mesh),
+            std::forward<step_preprocessor>(pre),
+            std::forward<step_postprocessor>(post),
+            keep_going,
+            error_check_interval);
+}
 
-    const auto num_nodes = mesh.get_structure().get_condensed_nodes().size();
+/// Like run_bricked, but advances every band at once.
+///
+/// Each node holds a bands_type rather than a single float, so the buffers
+/// passed to pre and post hold one bands_type per node, in the layout
+/// described by mesh.get_bricks().
+/// The mesh's own boundary coefficients are ignored.
+/// Instead, boundary_ratios holds a0/b0 of the flat impedance coefficients
+/// of each surface, with one lane per band, in the same order as the mesh's
+/// coefficient indices.
+template <typename step_preprocessor, typename step_postprocessor>
+size_t run_multiband(
+        const core::compute_context& cc,
+        const mesh& mesh,
+        const util::aligned::vector<core::bands_type>& boundary_ratios,
+        step_preprocessor&& pre,
+        step_postprocessor&& post,
+        const std::atomic_bool& keep_going,
+        size_t error_check_interval = 1) {
+    const auto layout = detail::make_bricked_layout(cc.context, mesh);
+    const auto num_nodes = layout.num_nodes;
 
     const program program{cc};
     cl::CommandQueue queue{cc.context, cc.device};
     const auto make_zeroed_buffer = [&] {
-        auto ret = cl::Buffer{
-                cc.context, CL_MEM_READ_WRITE, sizeof(cl_float) * num_nodes};
+        auto ret = cl::Buffer{cc.context,
+                              CL_MEM_READ_WRITE,
+                              sizeof(core::bands_type) * num_nodes};
         auto kernel = program.get_zero_buffer_kernel();
-        kernel(cl::EnqueueArgs{queue, cl::NDRange{num_nodes}}, ret);
+        kernel(cl::EnqueueArgs{queue,
+                               cl::NDRange{num_nodes * core::simulation_bands}},
+               ret);
         return ret;
     };
 
     auto previous = make_zeroed_buffer();
     auto current = make_zeroed_buffer();
 
-    const auto node_buffer = core::load_to_buffer(
-            cc.context, mesh.get_structure().get_condensed_nodes(), true);
+    const auto boundary_ratios_buffer =
+            core::load_to_buffer(cc.context, boundary_ratios, true);
 
-    const auto boundary_coefficients_buffer = core::load_to_buffer(
-            cc.context, mesh.get_structure().get_coefficients(), true);
+    const auto boundary_buffer_1 = core::load_to_buffer(
+            cc.context, mesh.get_structure().get_boundary_indices<1>(), true);
+    const auto boundary_buffer_2 = core::load_to_buffer(
+            cc.context, mesh.get_structure().get_boundary_indices<2>(), true);
+    const auto boundary_buffer_3 = core::load_to_buffer(
+            cc.context, mesh.get_structure().get_boundary_indices<3>(), true);
 
-    cl::Buffer error_flag_buffer{cc.context, CL_MEM_READ_WRITE, sizeof(cl_int)};
+    auto kernel = program.get_multiband_kernel();
 
-    auto boundary_buffer_1 = core::load_to_buffer(
-            cc.context, get_boundary_data<1>(mesh.get_structure()), false);
-    auto boundary_buffer_2 = core::load_to_buffer(
-            cc.context, get_boundary_data<2>(mesh.get_structure()), false);
-    auto boundary_buffer_3 = core::load_to_buffer(
-            cc.context, get_boundary_data<3>(mesh.get_structure()), false);
+    detail::error_checker error_checker{
+            cc.context, queue, error_check_interval};
 
-    auto kernel = program.get_kernel();
-
-    //  run
     auto step = 0u;
-
-    //  The preprocessor returns 'true' while it should be run.
-    //  It also updates the mesh with new pressure values.
     for (; pre(queue, current, step) && keep_going; ++step) {
-        //  set flag state to successful
-        core::write_value(queue, error_flag_buffer, 0, id_success);
-
-        //  run kernel
-        kernel(cl::EnqueueArgs(queue,
-                               cl::NDRange(mesh.get_structure()
-                                                   .get_condensed_nodes()
-                                                   .size())),
+        kernel(cl::EnqueueArgs(queue, cl::NDRange(num_nodes)),
                previous,
                current,
-               node_buffer,
+               layout.nodes,
                mesh.get_descriptor().dimensions,
+               layout.brick_table,
+               layout.brick_dimensions,
+               layout.brick_origins,
                boundary_buffer_1,
                boundary_buffer_2,
                boundary_buffer_3,
-               boundary_coefficients_buffer,
-               error_flag_buffer);
-
-        //  read out flag value
-        if (const auto error_flag =
-                    core::read_value<error_code>(queue, error_flag_buffer, 0)) {
-            if (error_flag & id_inf_error) {
-                throw core::exceptions::value_is_inf(
-                        "Pressure value is inf, check filter coefficients.");
-            }
-
-            if (error_flag & id_nan_error) {
-                throw core::exceptions::value_is_nan(
-                        "Pressure value is nan, check filter coefficients.");
-            }
-
-            if (error_flag & id_outside_mesh_error) {
-                throw std::runtime_error("Tried to read non-existant node.");
-            }
-
-            if (error_flag & id_suspicious_boundary_error) {
-                throw std::runtime_error("Suspicious boundary read.");
-            }
-        }
+               boundary_ratios_buffer,
+               error_checker.get_buffer());
+
+        error_checker.step_enqueued(step);
 
         post(queue, current, step);
 
         std::swap(previous, current);
     }
+
+    error_checker.finish(step);
+
     return step;
 }
 
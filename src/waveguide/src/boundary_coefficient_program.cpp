@@ -162,6 +162,15 @@ typedef struct {
     float distance_squared;
 } triangle_distance_pair;
 
+//  Ties go to the lower triangle index, so that the result doesn't depend on
+//  the order in which voxels are searched.
+bool is_closer(triangle_distance_pair a, triangle_distance_pair b);
+bool is_closer(triangle_distance_pair a, triangle_distance_pair b) {
+    return a.distance_squared < b.distance_squared ||
+           (a.distance_squared == b.distance_squared &&
+            a.triangle < b.triangle);
+}
+
 triangle_distance_pair closest_triangle_in_voxel(
         float3 pt,
         const global uint* voxel_index,
@@ -183,9 +192,11 @@ triangle_distance_pair closest_triangle_in_voxel(
         float3 voxel_dimensions,
         float distance_squared) {
     const float3 this_voxel_c0 =
-            global_aabb.c0 + (this_voxel_index + (int3)(0)) * voxel_dimensions;
+            global_aabb.c0 +
+            convert_float3(this_voxel_index + (int3)(0)) * voxel_dimensions;
     const float3 this_voxel_c1 =
-            global_aabb.c1 + (this_voxel_index + (int3)(1)) * voxel_dimensions;
+            global_aabb.c0 +
+            convert_float3(this_voxel_index + (int3)(1)) * voxel_dimensions;
 
     const aabb this_voxel_aabb = (aabb){this_voxel_c0, this_voxel_c1};
 
@@ -207,11 +218,13 @@ triangle_distance_pair closest_triangle_in_voxel(
             //  find squared distance to the triangle
             const uint this_index = *it;
             const triangle this_triangle = triangles[this_index];
-            const float d = point_triangle_dist_squared(this_triangle, vertices, pt);
+            const triangle_distance_pair pair = {
+                    this_index,
+                    point_triangle_dist_squared(this_triangle, vertices, pt)};
 
-            if (d < ret.distance_squared && d <= distance_squared) {
-                ret.triangle = *it;
-                ret.distance_squared = d;
+            if (pair.distance_squared <= distance_squared &&
+                is_closer(pair, ret)) {
+                ret = pair;
             }
         }
     }
@@ -256,9 +269,12 @@ uint closest_triangle(float3 pt,
     const int3 starting_index =
             get_starting_index(pt, global_aabb, voxel_dimensions);
 
-    //  keep increasing search distance until we find a triangle
+    //  Keep increasing search distance until we find a triangle.
+    //  Any triangle within dist of the point must overlap one of the voxels
+    //  searched, so the closest triangle found is also the closest overall.
+    //  The search stops once it covers the whole grid.
     const float lim = distance(global_aabb.c0, global_aabb.c1);
-    for (float dist = length(voxel_dimensions); dist < lim; dist *= 1.6) {
+    for (float dist = length(voxel_dimensions);; dist *= 1.6f) {
         const float distance_squared = dist * dist;
 
         //  find the range of the voxel structure to search
@@ -271,9 +287,9 @@ uint closest_triangle(float3 pt,
         triangle_distance_pair ret = {0, INFINITY};
 
         //  for each voxel in the search range
-        for (int x = min_diff.x; x != max_diff.x; ++x) {
-            for (int y = min_diff.y; y != max_diff.y; ++y) {
-                for (int z = min_diff.z; z != max_diff.z; ++z) {
+        for (int x = min_diff.x; x < max_diff.x; ++x) {
+            for (int y = min_diff.y; y < max_diff.y; ++y) {
+                for (int z = min_diff.z; z < max_diff.z; ++z) {
                     const int3 this_voxel_index = (int3)(x, y, z);
 
                     //  find the closest triangle in this voxel
@@ -290,7 +306,7 @@ uint closest_triangle(float3 pt,
 
                     //  if it's closer than the current closest, update the
                     //  current closest with the nearer results
-                    if (pair.distance_squared < ret.distance_squared) {
+                    if (is_closer(pair, ret)) {
                         ret = pair;
                     }
                 }
@@ -301,10 +317,12 @@ uint closest_triangle(float3 pt,
         if (ret.distance_squared < INFINITY) {
             return ret.triangle;
         }
-    }
 
-    //  if we get here there are bad problems
-    return ~(uint)(0);
+        if (lim <= dist) {
+            //  The point is far outside the grid, or the grid is empty.
+            return ~(uint)(0);
+        }
+    }
 }
 
 kernel void boundary_coefficient_finder_1d(
@@ -335,7 +353,12 @@ kernel void boundary_coefficient_finder_1d(
     //  find the closest triangle
     const int3 locator = to_locator(thread, descriptor.dimensions);
     const float3 pt = compute_node_position(descriptor, locator);
-    const uint closest_triangle_index = slow_closest_triangle(pt, triangles, num_triangles, vertices);
+    uint closest_triangle_index = closest_triangle(
+            pt, voxel_index, global_aabb, side, triangles, vertices);
+    if (closest_triangle_index == ~(uint)(0)) {
+        closest_triangle_index =
+                slow_closest_triangle(pt, triangles, num_triangles, vertices);
+    }
     const uint s = triangles[closest_triangle_index].surface;
 
     //  now set the boundary to the triangle's surface
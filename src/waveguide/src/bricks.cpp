@@ -0,0 +1,110 @@
+#include "waveguide/bricks.h"
+
+#include <stdexcept>
+#include <vector>
+
+namespace wayverb {
+namespace waveguide {
+
+namespace {
+int bricks_along(int nodes) { return (nodes + brick_side - 1) / brick_side; }
+}  // namespace
+
+brick_layout::brick_layout(const mesh_descriptor& descriptor,
+                           const util::aligned::vector<condensed_node>& nodes)
+        : dimensions_{descriptor.dimensions}
+        , brick_dimensions_{{bricks_along(dimensions_.s[0]),
+                             bricks_along(dimensions_.s[1]),
+                             bricks_along(dimensions_.s[2])}}
+        , brick_table_(count_nodes(brick_dimensions_), no_brick) {
+    if (nodes.size() != count_nodes(dimensions_)) {
+        throw std::runtime_error{"Node count doesn't match mesh dimensions."};
+    }
+
+    //  Find the bricks which need storage.
+    std::vector<bool> occupied(brick_table_.size(), false);
+    for (auto z = 0; z != dimensions_.s[2]; ++z) {
+        for (auto y = 0; y != dimensions_.s[1]; ++y) {
+            for (auto x = 0; x != dimensions_.s[0]; ++x) {
+                const auto& node =
+                        nodes[x + dimensions_.s[0] * (y + dimensions_.s[1] * z)];
+                if (node.boundary_type != id_none) {
+                    occupied[x / brick_side +
+                             brick_dimensions_.s[0] *
+                                     (y / brick_side +
+                                      brick_dimensions_.s[1] *
+                                              (z / brick_side))] = true;
+                }
+            }
+        }
+    }
+
+    //  Assign slots in scan order, so that neighbouring bricks tend to be
+    //  close together in memory.
+    for (auto z = 0; z != brick_dimensions_.s[2]; ++z) {
+        for (auto y = 0; y != brick_dimensions_.s[1]; ++y) {
+            for (auto x = 0; x != brick_dimensions_.s[0]; ++x) {
+                const auto brick =
+                        x +
+                        brick_dimensions_.s[0] *
+                                (y + brick_dimensions_.s[1] * z);
+                if (occupied[brick]) {
+                    brick_table_[brick] = brick_origins_.size();
+                    brick_origins_.emplace_back(cl_int3{{x * brick_side,
+                                                         y * brick_side,
+                                                         z * brick_side}});
+                }
+            }
+        }
+    }
+}
+
+cl_int3 brick_layout::get_brick_dimensions() const {
+    return brick_dimensions_;
+}
+
+const util::aligned::vector<cl_uint>& brick_layout::get_brick_table() const {
+    return brick_table_;
+}
+
+const util::aligned::vector<cl_int3>& brick_layout::get_brick_origins()
+        const {
+    return brick_origins_;
+}
+
+size_t brick_layout::get_num_bricks() const { return brick_origins_.size(); }
+
+size_t brick_layout::get_num_nodes() const {
+    return get_num_bricks() * brick_nodes;
+}
+
+cl_uint brick_layout::to_bricked_index(size_t dense_index) const {
+    const auto x = static_cast<int>(dense_index % dimensions_.s[0]);
+    const auto y = static_cast<int>((dense_index / dimensions_.s[0]) %
+                                    dimensions_.s[1]);
+    const auto z = static_cast<int>(dense_index /
+                                    (dimensions_.s[0] * dimensions_.s[1]));
+    if (dimensions_.s[2] <= z) {
+        return no_neighbor;
+    }
+
+    const auto slot =
+            brick_table_[x / brick_side +
+                         brick_dimensions_.s[0] *
+                                 (y / brick_side +
+                                  brick_dimensions_.s[1] * (z / brick_side))];
+    if (slot == no_brick) {
+        return no_neighbor;
+    }
+
+    return slot * brick_nodes + x % brick_side +
+           brick_side * (y % brick_side + brick_side * (z % brick_side));
+}
+
+size_t brick_layout::count_nodes(const cl_int3& dimensions) {
+    return static_cast<size_t>(dimensions.s[0]) * dimensions.s[1] *
+           dimensions.s[2];
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
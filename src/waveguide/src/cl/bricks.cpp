@@ -0,0 +1,76 @@
+#include "waveguide/cl/bricks.h"
+
+namespace wayverb {
+namespace waveguide {
+namespace cl_sources {
+
+const std::string bricks =
+        "#define BRICK_SIDE " + std::to_string(brick_side) + "\n" + R"(
+#define BRICK_NODES (BRICK_SIDE * BRICK_SIDE * BRICK_SIDE)
+#define no_brick (~(uint)(0))
+
+//  Describes where each node of the mesh is stored.
+//  If brick_table is null, nodes are stored densely, x-fastest.
+//  Otherwise, brick_table holds the storage slot of each brick in the
+//  bounding box, and nodes are stored x-fastest within their brick.
+typedef struct {
+    int3 dimensions;
+    int3 brick_dimensions;
+    const global uint* brick_table;
+} mesh_lookup;
+
+uint lookup_index(int3 locator, mesh_lookup lookup);
+uint lookup_index(int3 locator, mesh_lookup lookup) {
+    if (locator_outside(locator, lookup.dimensions)) {
+        return no_neighbor;
+    }
+    if (!lookup.brick_table) {
+        return to_index(locator, lookup.dimensions);
+    }
+    const uint slot = lookup.brick_table[to_index(locator / BRICK_SIDE,
+                                                  lookup.brick_dimensions)];
+    if (slot == no_brick) {
+        return no_neighbor;
+    }
+    return slot * BRICK_NODES +
+           to_index(locator % BRICK_SIDE, (int3)(BRICK_SIDE));
+}
+
+int3 port_offset(PortDirection pd);
+int3 port_offset(PortDirection pd) {
+    switch (pd) {
+        case id_port_nx: return (int3)(-1, 0, 0);
+        case id_port_px: return (int3)(1, 0, 0);
+        case id_port_ny: return (int3)(0, -1, 0);
+        case id_port_py: return (int3)(0, 1, 0);
+        case id_port_nz: return (int3)(0, 0, -1);
+        case id_port_pz: return (int3)(0, 0, 1);
+
+        default: return (int3)(0);
+    }
+}
+
+uint lookup_neighbor(int3 locator, mesh_lookup lookup, PortDirection pd);
+uint lookup_neighbor(int3 locator, mesh_lookup lookup, PortDirection pd) {
+    return lookup_index(locator + port_offset(pd), lookup);
+}
+
+//  Find the grid position of the node in storage slot 'index'.
+int3 lookup_locator(size_t index,
+                    mesh_lookup lookup,
+                    const global int3* brick_origins);
+int3 lookup_locator(size_t index,
+                    mesh_lookup lookup,
+                    const global int3* brick_origins) {
+    if (!lookup.brick_table) {
+        return to_locator(index, lookup.dimensions);
+    }
+    return brick_origins[index / BRICK_NODES] +
+           to_locator(index % BRICK_NODES, (int3)(BRICK_SIDE));
+}
+
+)";
+
+}  // namespace cl_sources
+}  // namespace waveguide
+}  // namespace wayverb
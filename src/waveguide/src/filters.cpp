@@ -14,9 +14,12 @@ coefficients_biquad get_peak_coefficients(const filter_descriptor& n) {
     const auto sw0 = sin(w0);
     const auto alpha = sw0 / 2.0 * n.Q;
     const auto a0 = 1 + alpha / A;
-    return coefficients_biquad{
-            {(1 + (alpha * A)) / a0, (-2 * cw0) / a0, (1 - alpha * A) / a0},
-            {1, (-2 * cw0) / a0, (1 - alpha / A) / a0}};
+    //  Coefficients are designed in double, whatever filt_real is.
+    const auto r = [](double x) { return static_cast<filt_real>(x); };
+    return coefficients_biquad{{r((1 + (alpha * A)) / a0),
+                                r((-2 * cw0) / a0),
+                                r((1 - alpha * A) / a0)},
+                               {1, r((-2 * cw0) / a0), r((1 - alpha / A) / a0)}};
 }
 
 biquad_coefficients_array get_peak_biquads_array(
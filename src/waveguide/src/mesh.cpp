@@ -19,10 +19,12 @@ namespace waveguide {
 
 mesh::mesh(mesh_descriptor descriptor, vectors vectors)
         : descriptor_(std::move(descriptor))
-        , vectors_(std::move(vectors)) {}
+        , vectors_(std::move(vectors))
+        , bricks_(descriptor_, vectors_.get_condensed_nodes()) {}
 
 const mesh_descriptor& mesh::get_descriptor() const { return descriptor_; }
 const vectors& mesh::get_structure() const { return vectors_; }
+const brick_layout& mesh::get_bricks() const { return bricks_; }
 
 bool is_inside(const mesh& m, size_t node_index) {
     return is_inside(m.get_structure().get_condensed_nodes()[node_index]);
@@ -50,6 +52,21 @@ double estimate_volume(const mesh& mesh) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+util::aligned::vector<coefficients_canonical> compute_surface_coefficients(
+        const util::aligned::vector<core::surface<core::simulation_bands>>&
+                surfaces,
+        float mesh_spacing,
+        float speed_of_sound) {
+    return util::map_to_vector(
+            begin(surfaces), end(surfaces), [&](const auto& surface) {
+                return to_impedance_coefficients(
+                        compute_reflectance_filter_coefficients(
+                                surface.absorption.s,
+                                1 / config::time_step(speed_of_sound,
+                                                      mesh_spacing)));
+            });
+}
+
 mesh compute_mesh(
         const core::compute_context& cc,
         const core::voxelised_scene_data<cl_float3,
@@ -83,8 +100,11 @@ mesh compute_mesh(
 
         //  find whether each node is inside or outside the model
         {
-            auto kernel = program.get_node_inside_kernel();
-            kernel(enqueue(),
+            //  one work item per column of nodes along z
+            const auto num_columns =
+                    desc.dimensions.s[0] * desc.dimensions.s[1];
+            auto kernel = program.get_column_inside_kernel();
+            kernel(cl::EnqueueArgs(queue, cl::NDRange(num_columns)),
                    node_buffer,
                    desc,
                    buffers.get_voxel_index_buffer(),
@@ -125,35 +145,39 @@ mesh compute_mesh(
 
     auto v = vectors{
             std::move(nodes),
-            util::map_to_vector(
-                    begin(voxelised.get_scene_data().get_surfaces()),
-                    end(voxelised.get_scene_data().get_surfaces()),
-                    [&](const auto& surface) {
-                        return to_impedance_coefficients(
-                                compute_reflectance_filter_coefficients(
-                                        surface.absorption.s,
-                                        1 / config::time_step(speed_of_sound,
-                                                              mesh_spacing)));
-                    }),
+            compute_surface_coefficients(
+                    voxelised.get_scene_data().get_surfaces(),
+                    mesh_spacing,
+                    speed_of_sound),
             std::move(boundary_data)};
 
     return {desc, std::move(v)};
 }
 
+core::voxelised_scene_data<cl_float3, core::surface<core::simulation_bands>>
+compute_voxels(const core::gpu_scene_data& scene,
+               const glm::vec3& anchor,
+               double mesh_spacing,
+               core::acceleration_structure acceleration) {
+    return make_voxelised_scene_data(
+            scene,
+            waveguide::compute_adjusted_boundary(
+                    core::geo::compute_aabb(scene.get_vertices()),
+                    anchor,
+                    mesh_spacing),
+            acceleration);
+}
+
 voxels_and_mesh compute_voxels_and_mesh(const core::compute_context& cc,
                                         const core::gpu_scene_data& scene,
                                         const glm::vec3& anchor,
                                         double sample_rate,
-                                        double speed_of_sound) {
+                                        double speed_of_sound,
+                                        core::acceleration_structure
+                                                acceleration) {
     const auto mesh_spacing =
             config::grid_spacing(speed_of_sound, 1 / sample_rate);
-    auto voxelised = make_voxelised_scene_data(
-            scene,
-            5,
-            waveguide::compute_adjusted_boundary(
-                    core::geo::compute_aabb(scene.get_vertices()),
-                    anchor,
-                    mesh_spacing));
+    auto voxelised = compute_voxels(scene, anchor, mesh_spacing, acceleration);
     auto mesh = compute_mesh(cc, voxelised, mesh_spacing, speed_of_sound);
     return {std::move(voxelised), std::move(mesh)};
 }
@@ -0,0 +1,364 @@
+#include "waveguide/mesh_cache.h"
+#include "waveguide/boundary_coefficient_finder.h"
+#include "waveguide/config.h"
+#include "waveguide/serialize/mesh.h"
+
+#include "utilities/cache_file.h"
+#include "utilities/fnv1a.h"
+
+#include "cereal/archives/binary.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <experimental/optional>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace wayverb {
+namespace waveguide {
+
+namespace {
+
+void update_geometry_hash(util::fnv1a& hash,
+                          const core::gpu_scene_data& scene) {
+    //  cl_float3 has a padding component, which is skipped here.
+    for (const auto& vertex : scene.get_vertices()) {
+        for (auto i = 0; i != 3; ++i) {
+            hash.update_value(vertex.s[i]);
+        }
+    }
+
+    for (const auto& triangle : scene.get_triangles()) {
+        hash.update_value(triangle.surface);
+        hash.update_value(triangle.v0);
+        hash.update_value(triangle.v1);
+        hash.update_value(triangle.v2);
+    }
+}
+
+}  // namespace
+
+uint64_t compute_scene_hash(const core::gpu_scene_data& scene) {
+    util::fnv1a hash;
+    update_geometry_hash(hash, scene);
+
+    for (const auto& surface : scene.get_surfaces()) {
+        hash.update_value(surface.absorption.s);
+        hash.update_value(surface.scattering.s);
+    }
+
+    return hash.get();
+}
+
+uint64_t compute_geometry_hash(const core::gpu_scene_data& scene) {
+    util::fnv1a hash;
+    update_geometry_hash(hash, scene);
+    return hash.get();
+}
+
+namespace {
+
+/// The position of the anchor within a single grid cell, quantised so that
+/// tiny floating-point differences don't produce different keys.
+glm::ivec3 compute_lattice_offset(const glm::vec3& anchor, float spacing) {
+    constexpr auto resolution = 1 << 10;
+    const glm::ivec3 quantised{
+            glm::round(glm::fract(anchor / spacing) * float{resolution})};
+    return quantised % resolution;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// Bump this whenever the layout of the mesh or of the file changes, so that
+/// old files are ignored rather than misread.
+constexpr uint32_t file_format_version = 1;
+
+std::string mesh_path(const std::string& directory,
+                      uint64_t geometry_hash,
+                      float spacing,
+                      const glm::ivec3& lattice_offset) {
+    util::fnv1a hash;
+    hash.update_value(file_format_version);
+    hash.update_value(geometry_hash);
+    hash.update_value(spacing);
+    for (auto i = 0; i != 3; ++i) {
+        hash.update_value(lattice_offset[i]);
+    }
+
+    std::ostringstream ss;
+    ss << directory << "/wayverb_mesh_" << std::hex << std::setfill('0')
+       << std::setw(16) << hash.get() << ".bin";
+    return ss.str();
+}
+
+/// Everything in the mesh which doesn't depend on the surface materials.
+struct mesh_structure final {
+    mesh_descriptor descriptor;
+    util::aligned::vector<condensed_node> nodes;
+    boundary_index_data boundary_index_data;
+};
+
+/// Files might be stale, corrupt, or planted, so everything which is used
+/// as an index is checked before the mesh is used.
+template <size_t n>
+bool boundary_indices_are_valid(
+        const util::aligned::vector<condensed_node>& nodes,
+        const util::aligned::vector<boundary_index_array<n>>& boundaries,
+        size_t num_surfaces) {
+    //  Boundary nodes of each kind are numbered consecutively.
+    const auto num_boundaries =
+            count_boundary_type(begin(nodes), end(nodes), is_boundary<n>);
+    if (num_boundaries != boundaries.size()) {
+        return false;
+    }
+
+    const auto nodes_ok =
+            std::all_of(begin(nodes), end(nodes), [&](const auto& node) {
+                return !is_boundary<n>(node.boundary_type) ||
+                       node.boundary_index < boundaries.size();
+            });
+
+    const auto surfaces_ok = std::all_of(
+            begin(boundaries), end(boundaries), [&](const auto& boundary) {
+                return std::all_of(std::begin(boundary.array),
+                                   std::end(boundary.array),
+                                   [&](auto i) { return i < num_surfaces; });
+            });
+
+    return nodes_ok && surfaces_ok;
+}
+
+bool is_valid(const mesh_structure& structure, size_t num_surfaces) {
+    const auto& dim = structure.descriptor.dimensions;
+    if (dim.s[0] <= 0 || dim.s[1] <= 0 || dim.s[2] <= 0) {
+        return false;
+    }
+    const auto expected_nodes = static_cast<uint64_t>(dim.s[0]) *
+                                static_cast<uint64_t>(dim.s[1]) *
+                                static_cast<uint64_t>(dim.s[2]);
+    if (expected_nodes != structure.nodes.size()) {
+        return false;
+    }
+
+    const auto& boundaries = structure.boundary_index_data;
+    return boundary_indices_are_valid(
+                   structure.nodes, boundaries.b1, num_surfaces) &&
+           boundary_indices_are_valid(
+                   structure.nodes, boundaries.b2, num_surfaces) &&
+           boundary_indices_are_valid(
+                   structure.nodes, boundaries.b3, num_surfaces);
+}
+
+std::experimental::optional<mesh_structure> read_mesh(const std::string& path,
+                                                      size_t num_surfaces) {
+    std::ifstream file{path, std::ios::binary};
+    if (!file) {
+        return std::experimental::nullopt;
+    }
+    try {
+        cereal::BinaryInputArchive archive{file};
+        uint32_t version{};
+        archive(version);
+        if (version != file_format_version) {
+            return std::experimental::nullopt;
+        }
+        mesh_structure ret{};
+        archive(ret.descriptor, ret.nodes, ret.boundary_index_data);
+        if (!is_valid(ret, num_surfaces)) {
+            return std::experimental::nullopt;
+        }
+        return ret;
+    } catch (const std::exception&) {
+        //  The file is truncated or corrupt, so the mesh must be rebuilt.
+        return std::experimental::nullopt;
+    }
+}
+
+void write_mesh(const std::string& path, const mesh& m) {
+    util::write_file_atomically(path, [&](std::ostream& file) {
+        try {
+            cereal::BinaryOutputArchive archive{file};
+            const auto& structure = m.get_structure();
+            archive(file_format_version,
+                    m.get_descriptor(),
+                    structure.get_condensed_nodes(),
+                    boundary_index_data{structure.get_boundary_indices<1>(),
+                                        structure.get_boundary_indices<2>(),
+                                        structure.get_boundary_indices<3>()});
+        } catch (const std::exception&) {
+            return false;
+        }
+        return static_cast<bool>(file);
+    });
+}
+
+std::string default_directory() {
+    if (const auto dir = std::getenv("WAYVERB_MESH_CACHE_DIR")) {
+        return dir;
+    }
+    return util::user_cache_directory("meshes");
+}
+
+}  // namespace
+
+bool operator==(const mesh_cache::cache_key& a,
+                const mesh_cache::cache_key& b) {
+    return a.scene_hash == b.scene_hash && a.spacing == b.spacing &&
+           a.lattice_offset == b.lattice_offset &&
+           a.acceleration == b.acceleration;
+}
+
+mesh_cache::mesh_cache(size_t max_entries)
+        : mesh_cache{max_entries, default_directory()} {}
+
+mesh_cache::mesh_cache(size_t max_entries, std::string directory)
+        : max_entries_{std::max(max_entries, size_t{1})}
+        , directory_{std::move(directory)} {}
+
+std::shared_ptr<const voxels_and_mesh> mesh_cache::get(
+        const core::compute_context& cc,
+        const core::gpu_scene_data& scene,
+        const glm::vec3& anchor,
+        double sample_rate,
+        double speed_of_sound,
+        core::acceleration_structure acceleration) {
+    const auto mesh_spacing =
+            config::grid_spacing(speed_of_sound, 1 / sample_rate);
+    const auto spacing = static_cast<float>(mesh_spacing);
+    const auto lattice_offset = compute_lattice_offset(anchor, spacing);
+    const cache_key k{
+            compute_scene_hash(scene), spacing, lattice_offset, acceleration};
+
+    std::promise<value_type> promise;
+    std::string directory;
+    {
+        std::unique_lock<std::mutex> lck{mutex_};
+
+        const auto it = std::find_if(begin(entries_),
+                                     end(entries_),
+                                     [&](const auto& i) { return i.key == k; });
+        if (it != end(entries_)) {
+            auto ret = it->value;
+            std::rotate(begin(entries_), it, std::next(it));
+            return ret;
+        }
+
+        const auto pending =
+                std::find_if(begin(pending_),
+                             end(pending_),
+                             [&](const auto& i) { return i.key == k; });
+        if (pending != end(pending_)) {
+            //  This mesh is already being built, so wait for that build
+            //  rather than starting another.
+            const auto future = pending->value;
+            lck.unlock();
+            return future.get();
+        }
+
+        pending_.emplace_back(pending_entry{k, promise.get_future().share()});
+        directory = directory_;
+    }
+
+    //  The lock isn't held while building, so requests for other meshes can
+    //  carry on in the meantime.
+    const auto path = directory.empty()
+                              ? std::string{}
+                              : mesh_path(directory,
+                                          compute_geometry_hash(scene),
+                                          spacing,
+                                          lattice_offset);
+
+    auto loaded_from_disk = false;
+    const auto build = [&]() -> value_type {
+        if (!path.empty()) {
+            if (auto structure =
+                        read_mesh(path, scene.get_surfaces().size())) {
+                loaded_from_disk = true;
+                //  Only the boundary coefficients depend on the materials,
+                //  so they are recomputed rather than stored.
+                auto coefficients = compute_surface_coefficients(
+                        scene.get_surfaces(), mesh_spacing, speed_of_sound);
+                vectors v{std::move(structure->nodes),
+                          std::move(coefficients),
+                          std::move(structure->boundary_index_data)};
+                return std::make_shared<voxels_and_mesh>(voxels_and_mesh{
+                        compute_voxels(
+                                scene, anchor, mesh_spacing, acceleration),
+                        mesh{structure->descriptor, std::move(v)}});
+            }
+        }
+
+        auto built = compute_voxels_and_mesh(cc,
+                                             scene,
+                                             anchor,
+                                             sample_rate,
+                                             speed_of_sound,
+                                             acceleration);
+        if (!path.empty()) {
+            write_mesh(path, built.mesh);
+        }
+        return std::make_shared<voxels_and_mesh>(std::move(built));
+    };
+
+    const auto finish_pending = [&] {
+        pending_.erase(std::find_if(begin(pending_),
+                                    end(pending_),
+                                    [&](const auto& i) { return i.key == k; }));
+    };
+
+    value_type ret;
+    try {
+        ret = build();
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lck{mutex_};
+            finish_pending();
+        }
+        //  Waiting requests see the same failure.
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lck{mutex_};
+        finish_pending();
+        if (loaded_from_disk) {
+            disk_hits_ += 1;
+        }
+        entries_.emplace_front(entry{k, ret});
+        if (entries_.size() > max_entries_) {
+            entries_.pop_back();
+        }
+    }
+    promise.set_value(ret);
+    return ret;
+}
+
+size_t mesh_cache::size() const {
+    std::lock_guard<std::mutex> lck{mutex_};
+    return entries_.size();
+}
+
+void mesh_cache::clear() {
+    std::lock_guard<std::mutex> lck{mutex_};
+    entries_.clear();
+}
+
+size_t mesh_cache::get_disk_hits() const {
+    std::lock_guard<std::mutex> lck{mutex_};
+    return disk_hits_;
+}
+
+void mesh_cache::set_directory(std::string directory) {
+    std::lock_guard<std::mutex> lck{mutex_};
+    directory_ = std::move(directory);
+}
+
+std::string mesh_cache::get_directory() const {
+    std::lock_guard<std::mutex> lck{mutex_};
+    return directory_;
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -107,35 +107,136 @@ int test_directions(int3 locator,
     return ret;
 }
 
-kernel void set_node_inside(global condensed_node* nodes,
-                            const mesh_descriptor descriptor,
+//  Casts a ray up a column of nodes, toggling the boundary_type of the first
+//  node above each crossing, so that a running xor up the column gives the
+//  parity of the crossings below each node.
+//  Returns false if any crossing was degenerate (near an edge or vertex), in
+//  which case the column must be cleared and cast again.
+bool toggle_column_crossings(ray r,
+                             global condensed_node* nodes,
+                             const mesh_descriptor descriptor,
+                             int2 column,
+                             const global uint* voxel_index,
+                             aabb global_aabb,
+                             uint side,
+                             const global triangle* triangles,
+                             const global float3* vertices);
+bool toggle_column_crossings(ray r,
+                             global condensed_node* nodes,
+                             const mesh_descriptor descriptor,
+                             int2 column,
+                             const global uint* voxel_index,
+                             aabb global_aabb,
+                             uint side,
+                             const global triangle* triangles,
+                             const global float3* vertices) {
+    VOXEL_TRAVERSAL_ALGORITHM(for (uint i = 0; i != num_triangles; ++i) {
+        const triangle tri = triangles[voxel_begin[i]];
+        const triangle_inter inter = triangle_intersection(tri, vertices, r);
+        if (inter.t) {
+            if (is_degenerate(inter)) {
+                return false;
+            }
+            if (prev_max < inter.t && inter.t <= max_dist_inside_voxel) {
+                const float z = r.position.z + inter.t;
+                const int k = (int)(ceil((z - descriptor.min_corner.z) /
+                                         descriptor.spacing));
+                if (0 <= k && k < descriptor.dimensions.z) {
+                    nodes[to_index((int3)(column, k), descriptor.dimensions)]
+                            .boundary_type ^= 1;
+                }
+            }
+        }
+    })
+    return true;
+}
 
-                            const global uint* voxel_index,  //  voxel
-                            aabb global_aabb,
-                            uint side,
+void clear_column(global condensed_node* nodes, int3 dim, int2 column);
+void clear_column(global condensed_node* nodes, int3 dim, int2 column) {
+    for (int z = 0; z != dim.z; ++z) {
+        nodes[to_index((int3)(column, z), dim)] = (condensed_node){};
+    }
+}
 
-                            const global triangle* triangles,  //  scene
-                            const global float3* vertices) {
-    //  find this thread index
+//  Offsets (as a proportion of the mesh spacing) used to nudge a column ray
+//  away from edges and vertices if it hits one.
+constant float2 column_jitter[] = {(float2)(0, 0),
+                                   (float2)(0.0123f, 0.0311f),
+                                   (float2)(-0.0271f, 0.0147f),
+                                   (float2)(0.0389f, -0.0219f),
+                                   (float2)(-0.0173f, -0.0337f),
+                                   (float2)(0.0251f, 0.0043f),
+                                   (float2)(-0.0067f, -0.0409f),
+                                   (float2)(0.0331f, 0.0281f)};
+constant size_t num_column_jitter = sizeof(column_jitter) / sizeof(float2);
+
+//  Finds whether each node in a column (fixed x and y) is inside the model.
+//  One ray is cast along z per column, rather than one set of rays per node,
+//  so the cost scales with the cross-section of the mesh, not its volume.
+kernel void set_column_inside(global condensed_node* nodes,
+                              const mesh_descriptor descriptor,
+
+                              const global uint* voxel_index,  //  voxel
+                              aabb global_aabb,
+                              uint side,
+
+                              const global triangle* triangles,  //  scene
+                              const global float3* vertices) {
     const size_t thread = get_global_id(0);
+    const int3 dim = descriptor.dimensions;
+    const int2 column = (int2)(thread % dim.x, thread / dim.x);
+
+    const float3 base = compute_node_position(descriptor, (int3)(column, 0));
+
+    bool found = false;
+    for (size_t i = 0; !found && i != num_column_jitter; ++i) {
+        clear_column(nodes, dim, column);
+
+        const float2 offset = column_jitter[i] * descriptor.spacing;
+        //  The bottom of the column should lie on the bottom of the voxel
+        //  grid, but make sure rounding doesn't push it outside.
+        const float3 origin =
+                (float3)(base.xy + offset, max(base.z, global_aabb.c0.z));
+        const ray r = {origin, (float3)(0, 0, 1)};
+        found = toggle_column_crossings(r,
+                                        nodes,
+                                        descriptor,
+                                        column,
+                                        voxel_index,
+                                        global_aabb,
+                                        side,
+                                        triangles,
+                                        vertices);
+    }
 
-    //  zero out the return struct
-    nodes[thread] = (condensed_node){};  //  zero it out to begin with
-
-    //  find the 3d index of the node in the mesh
-    const int3 locator = to_locator(thread, descriptor.dimensions);
-
-    //  find its physical position
-    const float3 position = compute_node_position(descriptor, locator);
-
-    //  is the node's physical position inside the mesh?
-    const bool inside = voxel_inside(
-            position, voxel_index, global_aabb, side, triangles, vertices);
+    if (found) {
+        //  A node is inside if an odd number of crossings lie below it.
+        int parity = 0;
+        for (int z = 0; z != dim.z; ++z) {
+            const size_t index = to_index((int3)(column, z), dim);
+            parity ^= nodes[index].boundary_type;
+            nodes[index] = (condensed_node){};
+            if (parity) {
+                nodes[index].boundary_type = id_inside;
+            }
+        }
+        return;
+    }
 
-    //  if the node is inside
-    if (inside) {
-        //  signal that it inside
-        nodes[thread].boundary_type = id_inside;
+    //  Every column ray was degenerate, so fall back to testing each node
+    //  individually.
+    for (int z = 0; z != dim.z; ++z) {
+        const int3 locator = (int3)(column, z);
+        const size_t index = to_index(locator, dim);
+        nodes[index] = (condensed_node){};
+        if (voxel_inside(compute_node_position(descriptor, locator),
+                         voxel_index,
+                         global_aabb,
+                         side,
+                         triangles,
+                         vertices)) {
+            nodes[index].boundary_type = id_inside;
+        }
     }
 }
 
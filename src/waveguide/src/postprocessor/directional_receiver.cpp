@@ -3,6 +3,8 @@
 
 #include "core/cl/common.h"
 
+#include <algorithm>
+
 namespace wayverb {
 namespace waveguide {
 namespace postprocessor {
@@ -33,17 +35,23 @@ directional_receiver::return_type directional_receiver::operator()(
             core::read_value<cl_float>(queue, buffer, output_node_);
 
     //  copy out surrounding pressures
+    std::array<float, 6> surrounding;
+    for (auto i = 0ul; i != surrounding.size(); ++i) {
+        surrounding[i] =
+                core::read_value<cl_float>(queue, buffer, surrounding_nodes_[i]);
+    }
+
+    return operator()(pressure, surrounding);
+}
 
+directional_receiver::return_type directional_receiver::operator()(
+        float pressure, const std::array<float, 6>& surrounding) {
     //  pressure difference vector is obtained by subtracting the central
     //  junction pressure from the pressure values of neighboring junctions
     //  and dividing these terms by the spatial sampling period
-    constexpr auto num_surrounding = 6;
-    std::array<cl_float, num_surrounding> surrounding;
-    for (auto i = 0ul; i != num_surrounding; ++i) {
-        surrounding[i] = (core::read_value<cl_float>(
-                                  queue, buffer, surrounding_nodes_[i]) -
-                          pressure) /
-                         mesh_spacing_;
+    std::array<float, 6> difference;
+    for (auto i = 0ul; i != difference.size(); ++i) {
+        difference[i] = (surrounding[i] - pressure) / mesh_spacing_;
     }
 
     //  The approximation of the pressure gradient is obtained by
@@ -53,9 +61,9 @@ directional_receiver::return_type directional_receiver::operator()(
     //         0    0 -0.5  0.5    0    0
     //         0    0    0    0 -0.5  0.5
     //  so the product looks like this:
-    const glm::dvec3 m{(surrounding[1] - surrounding[0]) * 0.5,
-                       (surrounding[3] - surrounding[2]) * 0.5,
-                       (surrounding[5] - surrounding[4]) * 0.5};
+    const glm::dvec3 m{(difference[1] - difference[0]) * 0.5,
+                       (difference[3] - difference[2]) * 0.5,
+                       (difference[5] - difference[4]) * 0.5};
 
     //  The result is scaled by the negative inverse of the ambient density
     //  and integrated using a discrete-time integrator:
@@ -70,6 +78,15 @@ directional_receiver::return_type directional_receiver::operator()(
 
 size_t directional_receiver::get_output_node() const { return output_node_; }
 
+std::array<unsigned, 7> directional_receiver::get_probe_nodes() const {
+    std::array<unsigned, 7> ret;
+    ret[0] = output_node_;
+    std::copy(begin(surrounding_nodes_),
+              end(surrounding_nodes_),
+              begin(ret) + 1);
+    return ret;
+}
+
 }  // namespace postprocessor
 }  // namespace waveguide
 }  // namespace wayverb
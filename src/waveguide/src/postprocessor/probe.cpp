@@ -0,0 +1,111 @@
+#include "waveguide/postprocessor/probe.h"
+
+namespace wayverb {
+namespace waveguide {
+namespace postprocessor {
+
+constexpr size_t probe::default_block_steps;
+
+probe::probe(const core::compute_context& cc,
+             util::aligned::vector<cl_uint> nodes,
+             size_t block_steps)
+        : kernel_{program{cc}.get_gather_probes_kernel()}
+        , num_nodes_{nodes.size()}
+        , block_steps_{block_steps}
+        , node_buffer_{core::load_to_buffer(cc.context, std::move(nodes), true)}
+        , ring_buffer_{cc.context,
+                       CL_MEM_READ_WRITE,
+                       sizeof(cl_float) * 2 * block_steps_ * num_nodes_}
+        , staging_{util::aligned::vector<cl_float>(block_steps_ * num_nodes_),
+                   util::aligned::vector<cl_float>(block_steps_ *
+                                                   num_nodes_)} {
+    if (!num_nodes_ || !block_steps_) {
+        throw std::runtime_error{
+                "Probe needs at least one node and a non-zero block size."};
+    }
+}
+
+probe::~probe() noexcept {
+    if (pending_) {
+        try {
+            pending_->event.wait();
+        } catch (...) {
+            //  If the wait failed, the queue is broken anyway.
+        }
+    }
+}
+
+size_t probe::get_device_memory(size_t num_nodes, size_t block_steps) {
+    return sizeof(cl_uint) * num_nodes +
+           sizeof(cl_float) * 2 * block_steps * num_nodes;
+}
+
+void probe::operator()(cl::CommandQueue& queue,
+                       const cl::Buffer& buffer,
+                       size_t /*step*/) {
+    queue_ = queue;
+
+    const auto half = block_ % 2;
+    kernel_(cl::EnqueueArgs{queue_, cl::NDRange{num_nodes_}},
+            buffer,
+            node_buffer_,
+            ring_buffer_,
+            ((half * block_steps_) + step_in_block_) * num_nodes_);
+
+    if (++step_in_block_ == block_steps_) {
+        start_read(block_steps_);
+    }
+}
+
+void probe::flush() {
+    if (step_in_block_) {
+        start_read(step_in_block_);
+    }
+    finish_read();
+}
+
+util::aligned::vector<cl_float> probe::take_frames() {
+    auto ret = std::move(ready_);
+    ready_.clear();
+    return ret;
+}
+
+size_t probe::get_num_nodes() const { return num_nodes_; }
+
+void probe::start_read(size_t steps) {
+    //  The previous block was enqueued a whole block ago, so it has probably
+    //  arrived already.
+    finish_read();
+
+    const auto half = block_ % 2;
+    cl::Event event;
+    queue_.enqueueReadBuffer(ring_buffer_,
+                             CL_FALSE,
+                             sizeof(cl_float) * half * block_steps_ *
+                                     num_nodes_,
+                             sizeof(cl_float) * steps * num_nodes_,
+                             staging_[half].data(),
+                             nullptr,
+                             &event);
+    pending_ = pending_read{half, steps, event};
+
+    //  The queue is in-order, so the next block can't overwrite this half of
+    //  the ring until the read has finished.
+    block_ += 1;
+    step_in_block_ = 0;
+}
+
+void probe::finish_read() {
+    if (pending_) {
+        pending_->event.wait();
+        const auto& staging = staging_[pending_->half];
+        ready_.insert(end(ready_),
+                      begin(staging),
+                      begin(staging) + pending_->steps * num_nodes_);
+        pending_ = std::experimental::nullopt;
+    }
+}
+
+}  // namespace postprocessor
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,121 @@
+#include "waveguide/postprocessor/receiver_set.h"
+#include "waveguide/mesh.h"
+
+namespace wayverb {
+namespace waveguide {
+namespace postprocessor {
+namespace {
+
+constexpr auto nodes_per_receiver =
+        std::tuple_size<decltype(std::declval<directional_receiver>()
+                                         .get_probe_nodes())>::value;
+
+/// Checked before anything else is built, because the probe lanes are
+/// computed modulo the number of bands.
+size_t check_band_layout(size_t bands, size_t lane_stride) {
+    if (!bands || lane_stride < bands) {
+        throw std::runtime_error{"Invalid band layout for receiver set."};
+    }
+    return bands;
+}
+
+auto make_receivers(const mesh& mesh,
+                    double sample_rate,
+                    double ambient_density,
+                    const util::aligned::vector<size_t>& output_nodes,
+                    size_t bands) {
+    util::aligned::vector<directional_receiver> ret;
+    ret.reserve(output_nodes.size() * bands);
+    for (const auto node : output_nodes) {
+        //  Every band sees the same node, but keeps its own velocity state.
+        const directional_receiver receiver{
+                mesh.get_descriptor(), sample_rate, ambient_density, node};
+        ret.insert(ret.end(), bands, receiver);
+    }
+    return ret;
+}
+
+/// For each receiver and band, the lanes of the output node followed by its
+/// neighbours.
+auto compute_probe_lanes(
+        const mesh& mesh,
+        const util::aligned::vector<directional_receiver>& receivers,
+        size_t bands,
+        size_t lane_stride) {
+    util::aligned::vector<cl_uint> ret;
+    ret.reserve(receivers.size() * nodes_per_receiver);
+    for (auto i = 0u; i != receivers.size(); ++i) {
+        const auto band = i % bands;
+        for (const auto node : receivers[i].get_probe_nodes()) {
+            const auto bricked = mesh.get_bricks().to_bricked_index(node);
+            if (bricked == no_neighbor) {
+                throw std::runtime_error{
+                        "Node is not stored in the bricked mesh."};
+            }
+            ret.emplace_back(bricked * lane_stride + band);
+        }
+    }
+    return ret;
+}
+
+}  // namespace
+
+receiver_set::receiver_set(const core::compute_context& cc,
+                           const mesh& mesh,
+                           double sample_rate,
+                           double ambient_density,
+                           const util::aligned::vector<size_t>& output_nodes,
+                           size_t bands,
+                           size_t lane_stride)
+        : bands_{check_band_layout(bands, lane_stride)}
+        , receivers_{make_receivers(
+                  mesh, sample_rate, ambient_density, output_nodes, bands)}
+        , output_(receivers_.size())
+        , probe_{cc,
+                 compute_probe_lanes(mesh, receivers_, bands_, lane_stride)} {}
+
+size_t receiver_set::get_device_memory(size_t num_output_nodes,
+                                       size_t bands) {
+    return probe::get_device_memory(num_output_nodes * bands *
+                                    nodes_per_receiver);
+}
+
+void receiver_set::operator()(cl::CommandQueue& queue,
+                              const cl::Buffer& buffer,
+                              size_t step) {
+    probe_(queue, buffer, step);
+    drain();
+}
+
+void receiver_set::flush() {
+    probe_.flush();
+    drain();
+}
+
+void receiver_set::drain() {
+    const auto frames = probe_.take_frames();
+    for (auto it = begin(frames); it != end(frames);) {
+        for (auto i = 0u; i != receivers_.size();
+             ++i, it += nodes_per_receiver) {
+            std::array<float, 6> surrounding;
+            std::copy(it + 1, it + nodes_per_receiver, begin(surrounding));
+            output_[i].emplace_back(receivers_[i](*it, surrounding));
+        }
+    }
+}
+
+util::aligned::vector<util::aligned::vector<util::aligned::vector<
+        receiver_set::output>>>
+receiver_set::take_output() {
+    util::aligned::vector<util::aligned::vector<util::aligned::vector<output>>>
+            ret(output_.size() / bands_);
+    for (auto i = 0u; i != output_.size(); ++i) {
+        ret[i / bands_].emplace_back(std::move(output_[i]));
+        output_[i].clear();
+    }
+    return ret;
+}
+
+}  // namespace postprocessor
+}  // namespace waveguide
+}  // namespace wayverb
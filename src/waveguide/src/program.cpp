@@ -1,10 +1,14 @@
 #include "waveguide/program.h"
 
+#include "waveguide/cl/boundary_index_array.h"
+#include "waveguide/cl/bricks.h"
 #include "waveguide/cl/filters.h"
 #include "waveguide/cl/structs.h"
 #include "waveguide/cl/utils.h"
 #include "waveguide/mesh_descriptor.h"
 
+#include "core/cl/scene_structs.h"
+
 namespace wayverb {
 namespace waveguide {
 
@@ -181,20 +185,21 @@ void ghost_point_pressure_update(
             CAT(InnerNodeDirections, dimensions) pd,                         \
             const global float* current,                                     \
             int3 locator,                                                    \
-            int3 dim,                                                        \
+            mesh_lookup dim,                                                 \
             volatile global int* error_flag);                                \
     float CAT(get_summed_surrounding_, dimensions)(                          \
             const global condensed_node* nodes,                              \
             CAT(InnerNodeDirections, dimensions) pd,                         \
             const global float* current,                                     \
             int3 locator,                                                    \
-            int3 dim,                                                        \
+            mesh_lookup dim,                                                 \
             volatile global int* error_flag) {                               \
         float ret = 0;                                                       \
         CAT(SurroundingPorts, dimensions)                                    \
         on_boundary = CAT(on_boundary_, dimensions)(pd);                     \
         for (int i = 0; i != CAT(NUM_SURROUNDING_PORTS_, dimensions); ++i) { \
-            uint index = neighbor_index(locator, dim, on_boundary.array[i]); \
+            uint index =                                                     \
+                    lookup_neighbor(locator, dim, on_boundary.array[i]);     \
             if (index == no_neighbor) {                                      \
                 atomic_or(error_flag, id_outside_mesh_error);                \
                 return 0;                                                    \
@@ -215,13 +220,13 @@ float get_summed_surrounding_3(const global condensed_node* nodes,
                                InnerNodeDirections3 i,
                                const global float* current,
                                int3 locator,
-                               int3 dimensions,
+                               mesh_lookup dimensions,
                                volatile global int* error_flag);
 float get_summed_surrounding_3(const global condensed_node* nodes,
                                InnerNodeDirections3 i,
                                const global float* current,
                                int3 locator,
-                               int3 dimensions,
+                               mesh_lookup dimensions,
                                volatile global int* error_flag) {
     return 0;
 }
@@ -231,16 +236,16 @@ float get_summed_surrounding_3(const global condensed_node* nodes,
 float get_inner_pressure(const global condensed_node* nodes,
                          const global float* current,
                          int3 locator,
-                         int3 dim,
+                         mesh_lookup dim,
                          PortDirection bt,
                          volatile global int* error_flag);
 float get_inner_pressure(const global condensed_node* nodes,
                          const global float* current,
                          int3 locator,
-                         int3 dim,
+                         mesh_lookup dim,
                          PortDirection bt,
                          volatile global int* error_flag) {
-    uint neighbor = neighbor_index(locator, dim, bt);
+    uint neighbor = lookup_neighbor(locator, dim, bt);
     if (neighbor == no_neighbor) {
         atomic_or(error_flag, id_outside_mesh_error);
         return 0;
@@ -253,14 +258,14 @@ float get_inner_pressure(const global condensed_node* nodes,
             const global condensed_node* nodes,                                \
             const global float* current,                                       \
             int3 locator,                                                      \
-            int3 dim,                                                          \
+            mesh_lookup dim,                                                   \
             CAT(InnerNodeDirections, dimensions) ind,                          \
             volatile global int* error_flag);                                  \
     float CAT(get_current_surrounding_weighting_, dimensions)(                 \
             const global condensed_node* nodes,                                \
             const global float* current,                                       \
             int3 locator,                                                      \
-            int3 dim,                                                          \
+            mesh_lookup dim,                                                   \
             CAT(InnerNodeDirections, dimensions) ind,                          \
             volatile global int* error_flag) {                                 \
         float sum = 0;                                                         \
@@ -293,7 +298,7 @@ GET_CURRENT_SURROUNDING_WEIGHTING_TEMPLATE(3);
         float sum = 0;                                                    \
         for (int i = 0; i != dimensions; ++i) {                           \
             boundary_data bd = bda->array[i];                             \
-            const filt_real filt_state = bd.filter_memory.array[0];            \
+            const filt_real filt_state = bd.filter_memory.array[0];       \
             sum += filt_state /                                           \
                    boundary_coefficients[bd.coefficient_index].b[0];      \
         }                                                                 \
@@ -335,7 +340,7 @@ GET_COEFF_WEIGHTING_TEMPLATE(3);
             condensed_node node,                                               \
             const global condensed_node* nodes,                                \
             int3 locator,                                                      \
-            int3 dim,                                                          \
+            mesh_lookup dim,                                                   \
             global CAT(boundary_data_array_, dimensions) * bdat,               \
             const global coefficients_canonical* boundary_coefficients,        \
             volatile global int* error_flag);                                  \
@@ -345,7 +350,7 @@ GET_COEFF_WEIGHTING_TEMPLATE(3);
             condensed_node node,                                               \
             const global condensed_node* nodes,                                \
             int3 locator,                                                      \
-            int3 dim,                                                          \
+            mesh_lookup dim,                                                   \
             global CAT(boundary_data_array_, dimensions) * bdat,               \
             const global coefficients_canonical* boundary_coefficients,        \
             volatile global int* error_flag) {                                 \
@@ -392,15 +397,15 @@ BOUNDARY_TEMPLATE(3);
 
 float normal_waveguide_update(float prev_pressure,
                               const global float* current,
-                              int3 dimensions,
+                              mesh_lookup dimensions,
                               int3 locator);
 float normal_waveguide_update(float prev_pressure,
                               const global float* current,
-                              int3 dimensions,
+                              mesh_lookup dimensions,
                               int3 locator) {
     float ret = 0;
     for (int i = 0; i != PORTS; ++i) {
-        uint port_index = neighbor_index(locator, dimensions, i);
+        uint port_index = lookup_neighbor(locator, dimensions, i);
         if (port_index != no_neighbor) {
             ret += current[port_index];
         }
@@ -416,7 +421,7 @@ float next_waveguide_pressure(
         const global condensed_node* nodes,
         float prev_pressure,
         const global float* current,
-        int3 dimensions,
+        mesh_lookup dimensions,
         int3 locator,
         global boundary_data_array_1* boundary_data_1,
         global boundary_data_array_2* boundary_data_2,
@@ -428,7 +433,7 @@ float next_waveguide_pressure(
         const global condensed_node* nodes,
         float prev_pressure,
         const global float* current,
-        int3 dimensions,
+        mesh_lookup dimensions,
         int3 locator,
         global boundary_data_array_1* boundary_data_1,
         global boundary_data_array_2* boundary_data_2,
@@ -491,11 +496,22 @@ kernel void zero_buffer(global float* buffer) {
     buffer[thread] = 0.0f;
 }
 
+kernel void gather_probes(const global float* pressures,
+                          const global uint* probe_nodes,
+                          global float* output,
+                          uint offset) {
+    const size_t thread = get_global_id(0);
+    output[offset + thread] = pressures[probe_nodes[thread]];
+}
+
 kernel void condensed_waveguide(
         global float* previous,
         const global float* current,
         const global condensed_node* nodes,
         int3 dimensions,
+        const global uint* brick_table,
+        int3 brick_dimensions,
+        const global int3* brick_origins,
         global boundary_data_array_1* boundary_data_1,
         global boundary_data_array_2* boundary_data_2,
         global boundary_data_array_3* boundary_data_3,
@@ -504,14 +520,15 @@ kernel void condensed_waveguide(
     const size_t index = get_global_id(0);
 
     const condensed_node node = nodes[index];
-    const int3 locator = to_locator(index, dimensions);
+    const mesh_lookup lookup = {dimensions, brick_dimensions, brick_table};
+    const int3 locator = lookup_locator(index, lookup, brick_origins);
 
     const float prev_pressure = previous[index];
     const float next_pressure = next_waveguide_pressure(node,
                                                         nodes,
                                                         prev_pressure,
                                                         current,
-                                                        dimensions,
+                                                        lookup,
                                                         locator,
                                                         boundary_data_1,
                                                         boundary_data_2,
@@ -529,6 +546,267 @@ kernel void condensed_waveguide(
     previous[index] = next_pressure;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//  Multi-band update.
+//
+//  Each node holds one pressure per band, so that all bands are advanced in a
+//  single pass over the mesh.
+//  Only flat boundaries are supported here.
+//  Their impedance filters have no memory, so the boundary update only needs
+//  the ratio a0/b0 of each surface's coefficients, one lane per band.
+
+bands_type get_inner_pressure_multiband(const global bands_type* current,
+                                        int3 locator,
+                                        mesh_lookup dim,
+                                        PortDirection bt,
+                                        volatile global int* error_flag);
+bands_type get_inner_pressure_multiband(const global bands_type* current,
+                                        int3 locator,
+                                        mesh_lookup dim,
+                                        PortDirection bt,
+                                        volatile global int* error_flag) {
+    uint neighbor = lookup_neighbor(locator, dim, bt);
+    if (neighbor == no_neighbor) {
+        atomic_or(error_flag, id_outside_mesh_error);
+        return (bands_type)(0);
+    }
+    return current[neighbor];
+}
+
+#define TEMPLATE_SUM_SURROUNDING_PORTS_MULTIBAND(dimensions)                 \
+    bands_type CAT(get_summed_surrounding_multiband_, dimensions)(           \
+            const global condensed_node* nodes,                              \
+            CAT(InnerNodeDirections, dimensions) pd,                         \
+            const global bands_type* current,                                \
+            int3 locator,                                                    \
+            mesh_lookup dim,                                                 \
+            volatile global int* error_flag);                                \
+    bands_type CAT(get_summed_surrounding_multiband_, dimensions)(           \
+            const global condensed_node* nodes,                              \
+            CAT(InnerNodeDirections, dimensions) pd,                         \
+            const global bands_type* current,                                \
+            int3 locator,                                                    \
+            mesh_lookup dim,                                                 \
+            volatile global int* error_flag) {                               \
+        bands_type ret = (bands_type)(0);                                    \
+        CAT(SurroundingPorts, dimensions)                                    \
+        on_boundary = CAT(on_boundary_, dimensions)(pd);                     \
+        for (int i = 0; i != CAT(NUM_SURROUNDING_PORTS_, dimensions); ++i) { \
+            uint index =                                                     \
+                    lookup_neighbor(locator, dim, on_boundary.array[i]);     \
+            if (index == no_neighbor) {                                      \
+                atomic_or(error_flag, id_outside_mesh_error);                \
+                return (bands_type)(0);                                      \
+            }                                                                \
+            int boundary_type = nodes[index].boundary_type;                  \
+            if (boundary_type == id_none || boundary_type == id_inside) {    \
+                atomic_or(error_flag, id_suspicious_boundary_error);         \
+            }                                                                \
+            ret += current[index];                                           \
+        }                                                                    \
+        return ret;                                                          \
+    }
+
+TEMPLATE_SUM_SURROUNDING_PORTS_MULTIBAND(1);
+TEMPLATE_SUM_SURROUNDING_PORTS_MULTIBAND(2);
+
+bands_type get_summed_surrounding_multiband_3(
+        const global condensed_node* nodes,
+        InnerNodeDirections3 i,
+        const global bands_type* current,
+        int3 locator,
+        mesh_lookup dimensions,
+        volatile global int* error_flag);
+bands_type get_summed_surrounding_multiband_3(
+        const global condensed_node* nodes,
+        InnerNodeDirections3 i,
+        const global bands_type* current,
+        int3 locator,
+        mesh_lookup dimensions,
+        volatile global int* error_flag) {
+    return (bands_type)(0);
+}
+
+#define BOUNDARY_MULTIBAND_TEMPLATE(dimensions)                                \
+    bands_type CAT(boundary_multiband_, dimensions)(                           \
+            const global bands_type* current,                                  \
+            bands_type prev_pressure,                                          \
+            condensed_node node,                                               \
+            const global condensed_node* nodes,                                \
+            int3 locator,                                                      \
+            mesh_lookup dim,                                                   \
+            const global CAT(boundary_index_array_, dimensions) * bia,         \
+            const global bands_type* boundary_ratios,                          \
+            volatile global int* error_flag);                                  \
+    bands_type CAT(boundary_multiband_, dimensions)(                           \
+            const global bands_type* current,                                  \
+            bands_type prev_pressure,                                          \
+            condensed_node node,                                               \
+            const global condensed_node* nodes,                                \
+            int3 locator,                                                      \
+            mesh_lookup dim,                                                   \
+            const global CAT(boundary_index_array_, dimensions) * bia,         \
+            const global bands_type* boundary_ratios,                          \
+            volatile global int* error_flag) {                                 \
+        CAT(InnerNodeDirections, dimensions)                                   \
+        ind = CAT(get_inner_node_directions_, dimensions)(node.boundary_type); \
+        const global CAT(boundary_index_array_, dimensions)* indices =         \
+                bia + node.boundary_index;                                     \
+        bands_type inner = (bands_type)(0);                                    \
+        bands_type coeff_weighting = (bands_type)(0);                          \
+        for (int i = 0; i != dimensions; ++i) {                                \
+            inner += get_inner_pressure_multiband(                             \
+                    current, locator, dim, ind.array[i], error_flag);          \
+            coeff_weighting += boundary_ratios[indices->array[i]];             \
+        }                                                                      \
+        coeff_weighting *= courant;                                            \
+        const bands_type current_surrounding_weighting =                       \
+                courant_sq *                                                   \
+                (2.0f * inner +                                                \
+                 CAT(get_summed_surrounding_multiband_, dimensions)(           \
+                         nodes, ind, current, locator, dim, error_flag));      \
+        const bands_type prev_weighting =                                      \
+                (coeff_weighting - 1.0f) * prev_pressure;                      \
+        return (current_surrounding_weighting + prev_weighting) /              \
+               (1.0f + coeff_weighting);                                       \
+    }
+
+BOUNDARY_MULTIBAND_TEMPLATE(1);
+BOUNDARY_MULTIBAND_TEMPLATE(2);
+BOUNDARY_MULTIBAND_TEMPLATE(3);
+
+bands_type normal_waveguide_update_multiband(bands_type prev_pressure,
+                                             const global bands_type* current,
+                                             mesh_lookup dimensions,
+                                             int3 locator);
+bands_type normal_waveguide_update_multiband(bands_type prev_pressure,
+                                             const global bands_type* current,
+                                             mesh_lookup dimensions,
+                                             int3 locator) {
+    bands_type ret = (bands_type)(0);
+    for (int i = 0; i != PORTS; ++i) {
+        uint port_index = lookup_neighbor(locator, dimensions, i);
+        if (port_index != no_neighbor) {
+            ret += current[port_index];
+        }
+    }
+
+    return ret / (PORTS / 2.0f) - prev_pressure;
+}
+
+bands_type next_waveguide_pressure_multiband(
+        const condensed_node node,
+        const global condensed_node* nodes,
+        bands_type prev_pressure,
+        const global bands_type* current,
+        mesh_lookup dimensions,
+        int3 locator,
+        const global boundary_index_array_1* boundary_indices_1,
+        const global boundary_index_array_2* boundary_indices_2,
+        const global boundary_index_array_3* boundary_indices_3,
+        const global bands_type* boundary_ratios,
+        volatile global int* error_flag);
+bands_type next_waveguide_pressure_multiband(
+        const condensed_node node,
+        const global condensed_node* nodes,
+        bands_type prev_pressure,
+        const global bands_type* current,
+        mesh_lookup dimensions,
+        int3 locator,
+        const global boundary_index_array_1* boundary_indices_1,
+        const global boundary_index_array_2* boundary_indices_2,
+        const global boundary_index_array_3* boundary_indices_3,
+        const global bands_type* boundary_ratios,
+        volatile global int* error_flag) {
+    switch (popcount(node.boundary_type)) {
+        case 1:
+            if (node.boundary_type & id_inside ||
+                node.boundary_type & id_reentrant) {
+                return normal_waveguide_update_multiband(
+                        prev_pressure, current, dimensions, locator);
+            }
+            return boundary_multiband_1(current,
+                                        prev_pressure,
+                                        node,
+                                        nodes,
+                                        locator,
+                                        dimensions,
+                                        boundary_indices_1,
+                                        boundary_ratios,
+                                        error_flag);
+        case 2:
+            return boundary_multiband_2(current,
+                                        prev_pressure,
+                                        node,
+                                        nodes,
+                                        locator,
+                                        dimensions,
+                                        boundary_indices_2,
+                                        boundary_ratios,
+                                        error_flag);
+        case 3:
+            return boundary_multiband_3(current,
+                                        prev_pressure,
+                                        node,
+                                        nodes,
+                                        locator,
+                                        dimensions,
+                                        boundary_indices_3,
+                                        boundary_ratios,
+                                        error_flag);
+        default: return (bands_type)(0);
+    }
+}
+
+kernel void condensed_waveguide_multiband(
+        global bands_type* previous,
+        const global bands_type* current,
+        const global condensed_node* nodes,
+        int3 dimensions,
+        const global uint* brick_table,
+        int3 brick_dimensions,
+        const global int3* brick_origins,
+        const global boundary_index_array_1* boundary_indices_1,
+        const global boundary_index_array_2* boundary_indices_2,
+        const global boundary_index_array_3* boundary_indices_3,
+        const global bands_type* boundary_ratios,
+        volatile global int* error_flag) {
+    const size_t index = get_global_id(0);
+
+    const condensed_node node = nodes[index];
+    const mesh_lookup lookup = {dimensions, brick_dimensions, brick_table};
+    const int3 locator = lookup_locator(index, lookup, brick_origins);
+
+    const bands_type next_pressure =
+            next_waveguide_pressure_multiband(node,
+                                              nodes,
+                                              previous[index],
+                                              current,
+                                              lookup,
+                                              locator,
+                                              boundary_indices_1,
+                                              boundary_indices_2,
+                                              boundary_indices_3,
+                                              boundary_ratios,
+                                              error_flag);
+
+    if (any(isinf(next_pressure))) {
+        atomic_or(error_flag, id_inf_error);
+    }
+    if (any(isnan(next_pressure))) {
+        atomic_or(error_flag, id_nan_error);
+    }
+
+    previous[index] = next_pressure;
+}
+
+kernel void extract_band(const global bands_type* pressures,
+                         global float* output,
+                         uint band) {
+    const size_t thread = get_global_id(0);
+    output[thread] = ((const global float*)(pressures + thread))[band];
+}
+
 )";
 
 program::program(const core::compute_context& cc)
@@ -551,8 +829,13 @@ program::program(const core::compute_context& cc)
                           core::cl_representation_v<boundary_data_array_2>,
                           core::cl_representation_v<boundary_data_array_3>,
                           core::cl_representation_v<boundary_type>,
+                          core::cl_representation_v<boundary_index_array_1>,
+                          core::cl_representation_v<boundary_index_array_2>,
+                          core::cl_representation_v<boundary_index_array_3>,
+                          core::cl_representation_v<core::bands_type>,
                           cl_sources::filters,
                           cl_sources::utils,
+                          cl_sources::bricks,
                           source}} {}
 
 }  // namespace waveguide
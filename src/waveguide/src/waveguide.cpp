@@ -0,0 +1,142 @@
+#include "waveguide/waveguide.h"
+
+#include "core/cl/common.h"
+
+#include "utilities/string_builder.h"
+
+namespace wayverb {
+namespace waveguide {
+namespace detail {
+
+void throw_if_error(cl_int error_flag, size_t first_step, size_t last_step) {
+    if (!error_flag) {
+        return;
+    }
+
+    const auto window =
+            first_step + 1 == last_step
+                    ? util::build_string(" (at step ", first_step, ")")
+                    : util::build_string(" (between steps ",
+                                         first_step,
+                                         " and ",
+                                         last_step - 1,
+                                         ")");
+
+    if (error_flag & id_inf_error) {
+        throw core::exceptions::value_is_inf(util::build_string(
+                "Pressure value is inf, check filter coefficients.", window));
+    }
+
+    if (error_flag & id_nan_error) {
+        throw core::exceptions::value_is_nan(util::build_string(
+                "Pressure value is nan, check filter coefficients.", window));
+    }
+
+    if (error_flag & id_outside_mesh_error) {
+        throw std::runtime_error(util::build_string(
+                "Tried to read non-existant node.", window));
+    }
+
+    if (error_flag & id_suspicious_boundary_error) {
+        throw std::runtime_error(
+                util::build_string("Suspicious boundary read.", window));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+device_layout make_dense_layout(const cl::Context& context, const mesh& mesh) {
+    const auto& nodes = mesh.get_structure().get_condensed_nodes();
+    return {nodes.size(),
+            core::load_to_buffer(context, nodes, true),
+            cl::Buffer{},
+            cl_int3{},
+            cl::Buffer{}};
+}
+
+device_layout make_bricked_layout(const cl::Context& context,
+                                  const mesh& mesh) {
+    const auto& bricks = mesh.get_bricks();
+    if (!bricks.get_num_bricks()) {
+        throw std::runtime_error{"Mesh has no inside or boundary nodes."};
+    }
+    return {bricks.get_num_nodes(),
+            core::load_to_buffer(
+                    context,
+                    bricks.to_bricked(
+                            mesh.get_structure().get_condensed_nodes(),
+                            condensed_node{}),
+                    true),
+            core::load_to_buffer(context, bricks.get_brick_table(), true),
+            bricks.get_brick_dimensions(),
+            core::load_to_buffer(context, bricks.get_brick_origins(), true)};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+error_checker::error_checker(const cl::Context& context,
+                             cl::CommandQueue& queue,
+                             size_t interval)
+        : queue_{queue}
+        , interval_{interval}
+        , buffer_{context, CL_MEM_READ_WRITE, sizeof(cl_int)} {
+    if (!interval_) {
+        throw std::runtime_error{"Error check interval must be non-zero."};
+    }
+    core::write_value(queue_, buffer_, 0, id_success);
+}
+
+error_checker::~error_checker() noexcept {
+    if (pending_) {
+        try {
+            pending_->event.wait();
+        } catch (...) {
+            //  If the wait failed, the queue is broken anyway.
+        }
+    }
+}
+
+const cl::Buffer& error_checker::get_buffer() const { return buffer_; }
+
+void error_checker::step_enqueued(size_t step) {
+    if ((step + 1) % interval_ == 0) {
+        start_check(step + 1);
+        if (interval_ == 1) {
+            //  Check synchronously, so that post never sees bad values.
+            finish_check();
+        }
+    }
+}
+
+void error_checker::finish(size_t steps) {
+    if ((pending_ ? pending_->last_step : last_clean_step_) != steps) {
+        start_check(steps);
+    }
+    finish_check();
+}
+
+void error_checker::start_check(size_t last_step) {
+    finish_check();
+    cl::Event event;
+    queue_.enqueueReadBuffer(buffer_,
+                             CL_FALSE,
+                             0,
+                             sizeof(cl_int),
+                             &error_flag_,
+                             nullptr,
+                             &event);
+    pending_ = pending_check{event, last_step};
+}
+
+void error_checker::finish_check() {
+    if (pending_) {
+        pending_->event.wait();
+        throw_if_error(error_flag_, last_clean_step_, pending_->last_step);
+        last_clean_step_ = pending_->last_step;
+        pending_ = std::experimental::nullopt;
+    }
+}
+
+}  // namespace detail
+}  // namespace waveguide
+}  // namespace wayverb
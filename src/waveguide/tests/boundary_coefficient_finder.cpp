@@ -0,0 +1,70 @@
+#include "waveguide/boundary_coefficient_finder.h"
+#include "waveguide/mesh.h"
+
+#include "core/cl/common.h"
+#include "core/conversions.h"
+#include "core/geo/geometric.h"
+#include "core/scene_data_loader.h"
+
+#include "utilities/map_to_vector.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+
+#ifndef OBJ_PATH
+#define OBJ_PATH ""
+#endif
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+TEST(boundary_coefficient_finder, matches_brute_force) {
+    const compute_context cc{};
+    const auto scene = scene_with_extracted_surfaces(
+            *scene_data_loader{OBJ_PATH}.get_scene_data(),
+            util::aligned::unordered_map<std::string,
+                                         surface<simulation_bands>>{});
+
+    const auto anchor = centre(geo::compute_aabb(scene.get_vertices()));
+    const auto model = compute_voxels_and_mesh(cc, scene, anchor, 5000, 340);
+
+    const auto& triangles = scene.get_triangles();
+    const auto vertices = util::map_to_vector(
+            begin(scene.get_vertices()), end(scene.get_vertices()), to_vec3{});
+
+    const auto& descriptor = model.mesh.get_descriptor();
+    const auto& nodes = model.mesh.get_structure().get_condensed_nodes();
+    const auto& b1 = model.mesh.get_structure().get_boundary_indices<1>();
+
+    size_t checked = 0;
+    for (auto i = 0u; i != nodes.size(); ++i) {
+        if (!is_boundary<1>(nodes[i].boundary_type)) {
+            continue;
+        }
+
+        const auto position = compute_position(descriptor, i);
+        const auto distances = util::map_to_vector(
+                begin(triangles), end(triangles), [&](const auto& tri) {
+                    return geo::point_triangle_distance_squared(
+                            tri, vertices.data(), vertices.size(), position);
+                });
+        const auto closest =
+                *std::min_element(begin(distances), end(distances));
+
+        //  The device and host might round differently, so accept any
+        //  surface which is (almost) as close as the closest.
+        const auto surface = b1[nodes[i].boundary_index].array[0];
+        bool found = false;
+        for (auto j = 0u; j != triangles.size(); ++j) {
+            if (triangles[j].surface == surface &&
+                distances[j] <= closest * 1.0001f + 1.0e-6f) {
+                found = true;
+                break;
+            }
+        }
+        ASSERT_TRUE(found);
+        checked += 1;
+    }
+    ASSERT_NE(checked, 0u);
+}
@@ -0,0 +1,133 @@
+#include "waveguide/bricks.h"
+#include "waveguide/mesh.h"
+#include "waveguide/preprocessor/hard_source.h"
+#include "waveguide/waveguide.h"
+
+#include "core/cl/common.h"
+#include "core/geo/box.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+namespace {
+
+/// An L-shaped room in a 20 * 20 * 4 box.
+/// Only the nodes with x < 6 or y < 6 are inside.
+auto make_l_shape() {
+    const mesh_descriptor descriptor{
+            cl_float3{{0, 0, 0}}, cl_int3{{20, 20, 4}}, 1};
+    util::aligned::vector<condensed_node> nodes(20 * 20 * 4);
+    for (auto z = 0; z != 4; ++z) {
+        for (auto y = 0; y != 20; ++y) {
+            for (auto x = 0; x != 20; ++x) {
+                if (x < 6 || y < 6) {
+                    nodes[x + 20 * (y + 20 * z)].boundary_type = id_inside;
+                }
+            }
+        }
+    }
+    return std::make_pair(descriptor, nodes);
+}
+
+}  // namespace
+
+TEST(bricks, skips_empty_bricks) {
+    const auto room = make_l_shape();
+    const brick_layout layout{room.first, room.second};
+
+    //  The box is 3 * 3 * 1 bricks, and the L covers 5 of them.
+    ASSERT_EQ(layout.get_brick_table().size(), 9);
+    ASSERT_EQ(layout.get_num_bricks(), 5);
+    ASSERT_EQ(layout.get_num_nodes(), 5 * brick_nodes);
+}
+
+TEST(bricks, round_trip) {
+    const auto room = make_l_shape();
+    const brick_layout layout{room.first, room.second};
+
+    util::aligned::vector<int> dense(room.second.size());
+    for (auto i = 0u; i != dense.size(); ++i) {
+        dense[i] = i;
+    }
+
+    const auto bricked = layout.to_bricked(dense, -1);
+    const auto restored = layout.to_dense(bricked, -1);
+
+    for (auto i = 0u; i != dense.size(); ++i) {
+        const auto bricked_index = layout.to_bricked_index(i);
+        if (room.second[i].boundary_type != id_none) {
+            ASSERT_NE(bricked_index, no_neighbor);
+        }
+        if (bricked_index != no_neighbor) {
+            ASSERT_EQ(bricked[bricked_index], i);
+            ASSERT_EQ(restored[i], i);
+        } else {
+            ASSERT_EQ(restored[i], -1);
+        }
+    }
+}
+
+TEST(bricks, kernel_matches_dense_layout) {
+    const compute_context cc{};
+
+    //  Not a whole number of bricks in any direction, so some bricks are
+    //  only partly inside.
+    const geo::box box{glm::vec3{0, 0, 0}, glm::vec3{3, 2.3, 1.7}};
+    constexpr glm::vec3 source{1, 1, 1};
+    const auto scene_data =
+            geo::get_scene_data(box, make_surface<simulation_bands>(0.1, 0));
+
+    const auto voxels_and_mesh =
+            compute_voxels_and_mesh(cc, scene_data, source, 4000, 340);
+    const auto& mesh = voxels_and_mesh.mesh;
+    const auto& bricks = mesh.get_bricks();
+
+    const auto source_index = compute_index(mesh.get_descriptor(), source);
+    constexpr auto steps = 100;
+    util::aligned::vector<float> input(steps, 0);
+    input[0] = 1;
+    input[1] = -0.5;
+
+    //  Returns the pressure field after the final step, in the dense layout.
+    const auto run_layout = [&](auto run, size_t source_node) {
+        util::aligned::vector<float> ret;
+        auto pre = preprocessor::make_hard_source(
+                source_node, begin(input), end(input));
+        const auto count = run(
+                cc,
+                mesh,
+                [&](auto& queue, auto& buffer, auto step) {
+                    return pre(queue, buffer, step);
+                },
+                [&](auto& queue, const auto& buffer, auto step) {
+                    if (step == steps - 1) {
+                        ret = read_from_buffer<cl_float>(queue, buffer);
+                    }
+                },
+                true,
+                1);
+        EXPECT_EQ(count, steps);
+        return ret;
+    };
+
+    const auto dense = run_layout(
+            [](auto&&... ts) { return run(ts...); }, source_index);
+    const auto bricked = bricks.to_dense(
+            run_layout([](auto&&... ts) { return run_bricked(ts...); },
+                       bricks.to_bricked_index(source_index)),
+            0.0f);
+
+    ASSERT_EQ(dense.size(), bricked.size());
+
+    const auto& nodes = mesh.get_structure().get_condensed_nodes();
+    auto nonzero = 0u;
+    for (auto i = 0u; i != dense.size(); ++i) {
+        if (nodes[i].boundary_type != id_none) {
+            ASSERT_EQ(dense[i], bricked[i]) << "node " << i;
+            nonzero += dense[i] != 0;
+        }
+    }
+    ASSERT_NE(nonzero, 0);
+}
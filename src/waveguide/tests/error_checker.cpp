@@ -0,0 +1,107 @@
+#include "waveguide/waveguide.h"
+
+#include "core/cl/common.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+namespace {
+
+/// Runs `steps` fake steps, setting error bits on the device just before
+/// step `bad_step` is enqueued, as the kernel would.
+/// Returns the message of the exception, or an empty string.
+std::string run_checker(size_t interval,
+                        size_t steps,
+                        size_t bad_step,
+                        cl_int error) {
+    const compute_context cc{};
+    cl::CommandQueue queue{cc.context, cc.device};
+    detail::error_checker checker{cc.context, queue, interval};
+
+    try {
+        for (auto step = 0u; step != steps; ++step) {
+            if (step == bad_step) {
+                auto buffer = checker.get_buffer();
+                write_value(queue, buffer, 0, error);
+            }
+            checker.step_enqueued(step);
+        }
+        checker.finish(steps);
+    } catch (const exceptions::value_is_nan& e) {
+        return e.what();
+    }
+    return "";
+}
+
+bool contains(const std::string& str, const std::string& substr) {
+    return str.find(substr) != std::string::npos;
+}
+
+}  // namespace
+
+TEST(error_checker, clean_run) {
+    ASSERT_EQ(run_checker(4, 10, 10, id_nan_error), "");
+    ASSERT_EQ(run_checker(1, 10, 10, id_nan_error), "");
+    ASSERT_EQ(run_checker(64, 10, 10, id_nan_error), "");
+}
+
+TEST(error_checker, reports_window) {
+    //  The flag is read back every 4 steps, so the error is only known to
+    //  have happened somewhere in that window.
+    const auto message = run_checker(4, 16, 5, id_nan_error);
+    ASSERT_TRUE(contains(message, "between steps 4 and 7")) << message;
+}
+
+TEST(error_checker, reports_exact_step) {
+    const auto message = run_checker(1, 16, 5, id_nan_error);
+    ASSERT_TRUE(contains(message, "at step 5")) << message;
+}
+
+TEST(error_checker, checks_final_partial_window) {
+    //  The run ends part of the way through a window, which must still be
+    //  checked.
+    const auto message = run_checker(64, 10, 7, id_nan_error);
+    ASSERT_TRUE(contains(message, "between steps 0 and 9")) << message;
+}
+
+TEST(error_checker, reports_at_next_check) {
+    //  The read which sees the error has only been enqueued, so the error is
+    //  reported when the next check starts.
+    const compute_context cc{};
+    cl::CommandQueue queue{cc.context, cc.device};
+    detail::error_checker checker{cc.context, queue, 2};
+
+    auto buffer = checker.get_buffer();
+    write_value(queue, buffer, 0, cl_int{id_inf_error});
+
+    checker.step_enqueued(0);
+    checker.step_enqueued(1);
+    ASSERT_THROW(checker.step_enqueued(3), exceptions::value_is_inf);
+}
+
+TEST(error_checker, destroyed_with_read_in_flight) {
+    const compute_context cc{};
+    cl::CommandQueue queue{cc.context, cc.device};
+
+    for (auto run = 0; run != 8; ++run) {
+        detail::error_checker checker{cc.context, queue, 4};
+        for (auto step = 0u; step != 8; ++step) {
+            checker.step_enqueued(step);
+        }
+        //  The checker goes out of scope without finish being called, as it
+        //  would if the run threw.
+    }
+
+    queue.finish();
+}
+
+TEST(error_checker, rejects_zero_interval) {
+    const compute_context cc{};
+    cl::CommandQueue queue{cc.context, cc.device};
+    ASSERT_THROW((detail::error_checker{cc.context, queue, 0}),
+                 std::runtime_error);
+}
@@ -0,0 +1,249 @@
+#include "waveguide/config.h"
+#include "waveguide/mesh_cache.h"
+#include "waveguide/serialize/mesh.h"
+
+#include "core/cl/common.h"
+#include "core/geo/box.h"
+
+#include "cereal/archives/binary.hpp"
+
+#include "gtest/gtest.h"
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+namespace {
+
+constexpr auto sample_rate = 10000.0;
+constexpr auto speed_of_sound = 340.0;
+
+auto make_box(float absorption) {
+    const geo::box box{glm::vec3{0, 0, 0}, glm::vec3{4, 3, 6}};
+    return geo::get_scene_data(
+            box, make_surface<simulation_bands>(absorption, 0));
+}
+
+/// A fresh directory for the on-disk cache, which is removed afterwards.
+class scratch_directory final {
+public:
+    scratch_directory()
+            : path_{std::string{SCRATCH_PATH} + "/mesh_cache_XXXXXX"} {
+        if (!mkdtemp(&path_[0])) {
+            throw std::runtime_error{"Unable to create scratch directory."};
+        }
+    }
+
+    scratch_directory(const scratch_directory&) = delete;
+    scratch_directory& operator=(const scratch_directory&) = delete;
+
+    ~scratch_directory() noexcept {
+        for (const auto& file : files()) {
+            std::remove(file.c_str());
+        }
+        rmdir(path_.c_str());
+    }
+
+    const std::string& get_path() const { return path_; }
+
+    std::vector<std::string> files() const {
+        std::vector<std::string> ret;
+        if (const auto dir = opendir(path_.c_str())) {
+            while (const auto entry = readdir(dir)) {
+                const std::string name{entry->d_name};
+                if (name != "." && name != "..") {
+                    ret.emplace_back(path_ + "/" + name);
+                }
+            }
+            closedir(dir);
+        }
+        return ret;
+    }
+
+private:
+    std::string path_;
+};
+
+}  // namespace
+
+TEST(mesh_cache, scene_hash) {
+    ASSERT_EQ(compute_scene_hash(make_box(0.1)),
+              compute_scene_hash(make_box(0.1)));
+    ASSERT_NE(compute_scene_hash(make_box(0.1)),
+              compute_scene_hash(make_box(0.2)));
+}
+
+TEST(mesh_cache, geometry_hash) {
+    ASSERT_EQ(compute_geometry_hash(make_box(0.1)),
+              compute_geometry_hash(make_box(0.2)));
+}
+
+TEST(mesh_cache, shares_lattice) {
+    const compute_context cc{};
+    const auto scene = make_box(0.1);
+    const auto spacing = config::grid_spacing(speed_of_sound, 1 / sample_rate);
+
+    mesh_cache cache{4, ""};
+
+    const glm::vec3 anchor{2, 1.5, 1};
+    const auto a = cache.get(cc, scene, anchor, sample_rate, speed_of_sound);
+
+    //  A whole number of grid cells away, so on the same lattice.
+    const auto b = cache.get(cc,
+                             scene,
+                             anchor + glm::vec3{2, 1, 3} * float(spacing),
+                             sample_rate,
+                             speed_of_sound);
+    ASSERT_EQ(a, b);
+    ASSERT_EQ(cache.size(), 1);
+
+    //  Half a cell away, so needs a new lattice.
+    const auto c = cache.get(cc,
+                             scene,
+                             anchor + glm::vec3{0.5, 0, 0} * float(spacing),
+                             sample_rate,
+                             speed_of_sound);
+    ASSERT_NE(a, c);
+    ASSERT_EQ(cache.size(), 2);
+
+    //  Different scene.
+    const auto d = cache.get(
+            cc, make_box(0.2), anchor, sample_rate, speed_of_sound);
+    ASSERT_NE(a, d);
+    ASSERT_EQ(cache.size(), 3);
+}
+
+TEST(mesh_cache, concurrent_requests) {
+    const compute_context cc{};
+    const glm::vec3 anchor{2, 1.5, 1};
+
+    mesh_cache cache{4, ""};
+
+    //  Half of the threads ask for one mesh and half for another. Each mesh
+    //  should only be built once, and shared by everyone who asked for it.
+    constexpr auto num_threads = 8;
+    std::vector<std::shared_ptr<const voxels_and_mesh>> results(num_threads);
+    std::vector<std::thread> threads;
+    for (auto i = 0; i != num_threads; ++i) {
+        threads.emplace_back([&, i] {
+            results[i] = cache.get(cc,
+                                   make_box(i % 2 ? 0.1 : 0.2),
+                                   anchor,
+                                   sample_rate,
+                                   speed_of_sound);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(cache.size(), 2);
+    for (auto i = 2; i != num_threads; ++i) {
+        ASSERT_EQ(results[i], results[i % 2]);
+    }
+    ASSERT_NE(results[0], results[1]);
+}
+
+TEST(mesh_cache, disk) {
+    const compute_context cc{};
+    const glm::vec3 anchor{2, 1.5, 1};
+    const scratch_directory scratch;
+
+    const auto fresh = compute_voxels_and_mesh(
+            cc, make_box(0.2), anchor, sample_rate, speed_of_sound);
+
+    //  Write the mesh for one material, then load it for another.
+    mesh_cache cache{4, scratch.get_path()};
+    cache.get(cc, make_box(0.1), anchor, sample_rate, speed_of_sound);
+    ASSERT_EQ(cache.get_disk_hits(), 0);
+    ASSERT_EQ(scratch.files().size(), 1);
+
+    //  Only the file can provide the mesh now.
+    cache.clear();
+    const auto loaded =
+            cache.get(cc, make_box(0.2), anchor, sample_rate, speed_of_sound);
+    ASSERT_EQ(cache.get_disk_hits(), 1);
+
+    const auto& a = fresh.mesh;
+    const auto& b = loaded->mesh;
+    ASSERT_EQ(a.get_descriptor(), b.get_descriptor());
+    ASSERT_EQ(a.get_structure().get_condensed_nodes(),
+              b.get_structure().get_condensed_nodes());
+    ASSERT_EQ(a.get_structure().get_boundary_indices<1>(),
+              b.get_structure().get_boundary_indices<1>());
+    ASSERT_EQ(a.get_structure().get_boundary_indices<2>(),
+              b.get_structure().get_boundary_indices<2>());
+    ASSERT_EQ(a.get_structure().get_boundary_indices<3>(),
+              b.get_structure().get_boundary_indices<3>());
+    ASSERT_EQ(a.get_structure().get_coefficients(),
+              b.get_structure().get_coefficients());
+}
+
+TEST(mesh_cache, rejects_inconsistent_files) {
+    const compute_context cc{};
+    const glm::vec3 anchor{2, 1.5, 1};
+    const scratch_directory scratch;
+
+    mesh_cache cache{4, scratch.get_path()};
+    const auto built =
+            cache.get(cc, make_box(0.1), anchor, sample_rate, speed_of_sound);
+    const auto files = scratch.files();
+    ASSERT_EQ(files.size(), 1);
+
+    //  Rewrites the cached file, which is otherwise well-formed, with a
+    //  change which would lead to out-of-bounds accesses.
+    const auto tamper = [&](const auto& modify) {
+        uint32_t version{};
+        mesh_descriptor descriptor{};
+        util::aligned::vector<condensed_node> nodes;
+        boundary_index_data boundaries;
+        {
+            std::ifstream file{files.front(), std::ios::binary};
+            cereal::BinaryInputArchive archive{file};
+            archive(version, descriptor, nodes, boundaries);
+        }
+        modify(descriptor, nodes, boundaries);
+        {
+            std::ofstream file{files.front(),
+                               std::ios::binary | std::ios::trunc};
+            cereal::BinaryOutputArchive archive{file};
+            archive(version, descriptor, nodes, boundaries);
+        }
+    };
+
+    const auto check_rebuilt = [&] {
+        cache.clear();
+        const auto rebuilt = cache.get(
+                cc, make_box(0.1), anchor, sample_rate, speed_of_sound);
+        ASSERT_EQ(cache.get_disk_hits(), 0);
+        ASSERT_EQ(built->mesh.get_structure().get_condensed_nodes(),
+                  rebuilt->mesh.get_structure().get_condensed_nodes());
+    };
+
+    tamper([](auto& descriptor, auto&, auto&) {
+        descriptor.dimensions.s[0] += 1;
+    });
+    check_rebuilt();
+
+    tamper([](auto&, auto& nodes, auto&) {
+        const auto it = std::find_if(
+                begin(nodes), end(nodes), [](const auto& node) {
+                    return is_boundary<1>(node.boundary_type);
+                });
+        it->boundary_index = ~cl_uint{0};
+    });
+    check_rebuilt();
+
+    tamper([](auto&, auto&, auto& boundaries) {
+        boundaries.b1.pop_back();
+    });
+    check_rebuilt();
+}
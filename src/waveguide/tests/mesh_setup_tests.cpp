@@ -1,10 +1,15 @@
 #include "waveguide/mesh.h"
 
+#include "core/cl/common.h"
+#include "core/geo/box.h"
 #include "core/scene_data_loader.h"
 #include "core/spatial_division/voxelised_scene_data.h"
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <cmath>
+
 #ifndef OBJ_PATH_BEDROOM
 #define OBJ_PATH_BEDROOM ""
 #endif
@@ -27,4 +32,23 @@ TEST(mesh_setup, setup) {
     const auto m = compute_mesh(compute_context{}, boundary, 0.1, 340);
 }
 
+TEST(mesh_setup, box_inside) {
+    const geo::box box{glm::vec3{0, 0, 0}, glm::vec3{4, 3, 6}};
+    const auto boundary = get_voxelised(geo::get_scene_data(
+            box, make_surface<simulation_bands>(0.1, 0)));
+    const auto m = compute_mesh(compute_context{}, boundary, 0.1, 340);
+
+    const auto& nodes = m.get_structure().get_condensed_nodes();
+    for (auto i = 0u; i != nodes.size(); ++i) {
+        const auto position = compute_position(m.get_descriptor(), i);
+        const auto d = glm::min(position - box.get_min(),
+                                box.get_max() - position);
+        const auto distance_to_wall = std::min({d.x, d.y, d.z});
+        //  Nodes right on a wall could go either way.
+        if (0.001f < std::abs(distance_to_wall)) {
+            ASSERT_EQ(is_inside(m, i), 0 < distance_to_wall);
+        }
+    }
+}
+
 }  // namespace
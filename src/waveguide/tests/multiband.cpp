@@ -0,0 +1,101 @@
+#include "waveguide/canonical.h"
+#include "waveguide/fitted_boundary.h"
+#include "waveguide/mesh.h"
+
+#include "core/cl/common.h"
+#include "core/environment.h"
+#include "core/geo/box.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+TEST(multiband, matches_single_band_runs) {
+    const compute_context cc{};
+
+    const geo::box box{glm::vec3{0, 0, 0}, glm::vec3{3, 2.5, 2}};
+    constexpr glm::vec3 source{1, 1, 1};
+    const util::aligned::vector<glm::vec3> receivers{{2, 1.5, 1},
+                                                     {1.5, 0.5, 1.5}};
+
+    //  Each band has a different absorption, so that mixing up lanes would
+    //  be noticed.
+    constexpr auto bands = 4;
+    auto surface = make_surface<simulation_bands>(0, 0);
+    for (auto band = 0u; band != simulation_bands; ++band) {
+        surface.absorption.s[band] = 0.05f + 0.2f * band;
+    }
+    const auto scene_data = geo::get_scene_data(box, surface);
+
+    const environment environment{};
+    constexpr auto sample_rate = 4000.0;
+    const auto voxels_and_mesh = compute_voxels_and_mesh(
+            cc, scene_data, source, sample_rate, environment.speed_of_sound);
+
+    constexpr auto simulation_time = 0.05;
+    const auto callback = [](auto&, const auto&, auto, auto) {};
+
+    const auto multiband = detail::canonical_multiband_impl(
+            cc,
+            voxels_and_mesh.mesh,
+            compute_flat_boundary_ratios(voxels_and_mesh, bands),
+            bands,
+            simulation_time,
+            source,
+            receivers,
+            environment,
+            true,
+            callback);
+    ASSERT_TRUE(multiband);
+    ASSERT_EQ(multiband->size(), receivers.size());
+
+    for (auto band = 0u; band != bands; ++band) {
+        //  Same mesh, with this band's flat coefficients on every surface.
+        auto mesh = voxels_and_mesh.mesh;
+        const auto& surfaces =
+                voxels_and_mesh.voxels.get_scene_data().get_surfaces();
+        mesh.set_coefficients(util::map_to_vector(
+                begin(surfaces), end(surfaces), [&](const auto& i) {
+                    return to_flat_coefficients(i.absorption.s[band]);
+                }));
+
+        const auto single = detail::canonical_impl(cc,
+                                                   mesh,
+                                                   simulation_time,
+                                                   source,
+                                                   receivers,
+                                                   environment,
+                                                   true,
+                                                   callback);
+        ASSERT_TRUE(single);
+        ASSERT_EQ(single->size(), receivers.size());
+
+        for (auto receiver = 0u; receiver != receivers.size(); ++receiver) {
+            const auto& a = (*multiband)[receiver][band].directional;
+            const auto& b = (*single)[receiver].directional;
+            ASSERT_EQ(a.size(), b.size());
+            ASSERT_FALSE(a.empty());
+
+            //  The kernels do the same arithmetic, but may be compiled
+            //  differently, so allow for rounding.
+            const auto max_pressure = std::accumulate(
+                    begin(b), end(b), 0.0f, [](auto acc, const auto& i) {
+                        return std::max(acc, std::abs(i.pressure));
+                    });
+            ASSERT_NE(max_pressure, 0);
+
+            for (auto step = 0u; step != a.size(); ++step) {
+                ASSERT_NEAR(a[step].pressure,
+                            b[step].pressure,
+                            max_pressure * 1e-4)
+                        << "band " << band << ", receiver " << receiver
+                        << ", step " << step;
+            }
+        }
+    }
+}
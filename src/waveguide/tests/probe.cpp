@@ -0,0 +1,104 @@
+#include "waveguide/postprocessor/probe.h"
+
+#include "core/cl/common.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+namespace {
+
+constexpr size_t buffer_size = 32;
+
+/// The value of a node at a step, so that frames can be checked.
+constexpr float value_at(size_t node, size_t step) {
+    return step * buffer_size + node;
+}
+
+void fill_buffer(cl::CommandQueue& queue, cl::Buffer& buffer, size_t step) {
+    util::aligned::vector<cl_float> values(buffer_size);
+    for (auto i = 0u; i != buffer_size; ++i) {
+        values[i] = value_at(i, step);
+    }
+    cl::copy(queue, values.begin(), values.end(), buffer);
+}
+
+}  // namespace
+
+TEST(probe, gathers_frames_in_order) {
+    const compute_context cc{};
+    cl::CommandQueue queue{cc.context, cc.device};
+    cl::Buffer buffer{
+            cc.context, CL_MEM_READ_WRITE, sizeof(cl_float) * buffer_size};
+
+    const util::aligned::vector<cl_uint> nodes{3, 0, 31, 7, 7};
+
+    //  Not a whole number of blocks, so the last block is partial.
+    constexpr size_t block_steps = 4;
+    constexpr size_t steps = 3 * block_steps + 2;
+
+    postprocessor::probe probe{cc, nodes, block_steps};
+    ASSERT_EQ(probe.get_num_nodes(), nodes.size());
+
+    util::aligned::vector<cl_float> frames;
+    for (auto step = 0u; step != steps; ++step) {
+        fill_buffer(queue, buffer, step);
+        probe(queue, buffer, step);
+
+        //  Frames should arrive while the run is still going.
+        const auto arrived = probe.take_frames();
+        frames.insert(frames.end(), arrived.begin(), arrived.end());
+        ASSERT_EQ(frames.size() % nodes.size(), 0);
+        ASSERT_LE(frames.size(), (step + 1) * nodes.size());
+    }
+    ASSERT_NE(frames.size(), 0);
+
+    probe.flush();
+    const auto rest = probe.take_frames();
+    frames.insert(frames.end(), rest.begin(), rest.end());
+    ASSERT_TRUE(probe.take_frames().empty());
+
+    ASSERT_EQ(frames.size(), steps * nodes.size());
+    for (auto step = 0u; step != steps; ++step) {
+        for (auto i = 0u; i != nodes.size(); ++i) {
+            ASSERT_EQ(frames[step * nodes.size() + i],
+                      value_at(nodes[i], step))
+                    << "step " << step << ", node " << i;
+        }
+    }
+}
+
+TEST(probe, abandoned_with_read_in_flight) {
+    const compute_context cc{};
+    cl::CommandQueue queue{cc.context, cc.device};
+    cl::Buffer buffer{
+            cc.context, CL_MEM_READ_WRITE, sizeof(cl_float) * buffer_size};
+
+    //  Large blocks make it likely that the read is still going when the
+    //  probe is destroyed.
+    constexpr size_t block_steps = 1 << 10;
+    util::aligned::vector<cl_uint> nodes(buffer_size);
+    for (auto i = 0u; i != nodes.size(); ++i) {
+        nodes[i] = i;
+    }
+
+    for (auto run = 0; run != 8; ++run) {
+        postprocessor::probe probe{cc, nodes, block_steps};
+        for (auto step = 0u; step != block_steps; ++step) {
+            probe(queue, buffer, step);
+        }
+        //  The probe goes out of scope without being flushed, as it would
+        //  if the run threw.
+    }
+
+    queue.finish();
+}
+
+TEST(probe, rejects_empty) {
+    const compute_context cc{};
+    ASSERT_THROW(
+            (postprocessor::probe{cc, util::aligned::vector<cl_uint>{}, 4}),
+            std::runtime_error);
+    ASSERT_THROW((postprocessor::probe{cc, {0, 1}, 0}), std::runtime_error);
+}